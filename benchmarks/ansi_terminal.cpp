@@ -0,0 +1,297 @@
+#include <condition_variable>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "helpers/benchmarks.h"
+#include "helpers/filesystem.h"
+
+#include "ui-terminal/ansi_terminal.h"
+#include "ui-terminal/terminal_snapshot.h"
+
+namespace ui {
+
+    namespace {
+
+        /** Pseudoterminal that never receives anything so that the benchmark can feed the terminal input directly.
+         */
+        class IdlePTY : public tpp::PTYMaster {
+        public:
+
+            void send(char const * buffer, size_t numBytes) override {
+                MARK_AS_UNUSED(buffer);
+                MARK_AS_UNUSED(numBytes);
+            }
+
+            size_t receive(char * buffer, size_t bufferSize) override {
+                MARK_AS_UNUSED(buffer);
+                MARK_AS_UNUSED(bufferSize);
+                std::unique_lock<std::mutex> g{m_};
+                while (! terminated_)
+                    cv_.wait(g);
+                return 0;
+            }
+
+            void terminate() override {
+                std::lock_guard<std::mutex> g{m_};
+                terminated_ = true;
+                cv_.notify_all();
+            }
+
+            void resize(int cols, int rows) override {
+                MARK_AS_UNUSED(cols);
+                MARK_AS_UNUSED(rows);
+            }
+
+        private:
+            std::mutex m_;
+            std::condition_variable cv_;
+        };
+
+        class ReplayTerminal : public AnsiTerminal {
+        public:
+            ReplayTerminal(Size size, bool detectHyperlinks = false):
+                AnsiTerminal{new IdlePTY{}, Palette::XTerm256()} {
+                setMaxHistoryRows(1000);
+                setDetectHyperlinks(detectHyperlinks);
+                resize(size);
+            }
+
+            /** Processes the input in reads of given size, just like the PTY reader would.
+
+                If painted, the published snapshot is acquired after every read as if the UI thread painted the terminal as fast as it could.
+             */
+            void replay(std::string const & input, size_t readSize, bool painted = false) {
+                char * i = const_cast<char *>(input.c_str());
+                char const * end = i + input.size();
+                while (i < end) {
+                    char const * readEnd = std::min(end, static_cast<char const *>(i + readSize));
+                    i += received(i, readEnd);
+                    if (painted)
+                        acquireSnapshot();
+                }
+            }
+
+            /** Reads given number of history rows starting at given row, as painting them would, and returns the number of their cells.
+             */
+            size_t readHistory(int row, int rows) {
+                std::lock_guard<PriorityLock> g{bufferLock_};
+                size_t result = 0;
+                for (int i = row, e = std::min(row + rows, historyRows()); i < e; ++i)
+                    result += static_cast<size_t>(historyRow(i).cols);
+                return result;
+            }
+        };
+
+        /** Output of a full screen editor: every frame redraws the changed lines with erase in line, inserts and deletes characters on the cursor line, scrolls a region with line inserts and deletes and from time to time clears the whole screen.
+         */
+        std::string TuiInput(Size size, size_t frames) {
+            std::stringstream s;
+            for (size_t frame = 0; frame < frames; ++frame) {
+                if (frame % 50 == 0)
+                    s << "\033[H\033[2J";
+                // redraw a third of the lines, erasing their tails
+                for (int row = static_cast<int>(frame % 3); row < size.height() - 1; row += 3) {
+                    s << "\033[" << (row + 1) << ";1H\033[3" << (row % 8) << "m";
+                    for (int col = 0, e = (row * 7 + static_cast<int>(frame)) % (size.width() / 2); col < e; ++col)
+                        s << static_cast<char>('a' + (col + row) % 26);
+                    s << "\033[0m\033[K";
+                }
+                // edit the cursor line
+                int row = static_cast<int>(frame % (size.height() - 1)) + 1;
+                s << "\033[" << row << ";10H\033[4@abcd\033[" << row << ";20H\033[3P\033[5X";
+                // scroll the region below the cursor line
+                s << "\033[" << row << ";" << size.height() - 1 << "r\033[" << row << ";1H\033[2L\033[1M\033[r";
+                // status line
+                s << "\033[" << size.height() << ";1H\033[7m -- INSERT -- " << frame << "\033[0m\033[K";
+            }
+            return s.str();
+        }
+
+        /** Log output with an url on every other line, scrolling into the history, interleaved with the same lines redrawn in place with erases, character inserts and deletes, such as a progress display would do.
+         */
+        std::string LogInput(size_t lines) {
+            std::stringstream s;
+            for (size_t i = 0; i < lines; ++i) {
+                s << "2026-10-19 12:00:" << (i % 60) << " INFO request " << i;
+                if (i % 2 == 0)
+                    s << " fetched https://example.com/packages/" << i << "/index.html";
+                s << " in " << (i % 97) << " ms\r\n";
+                if (i % 10 == 0)
+                    s << "\033[A\033[30G\033[3P\033[2@\033[60G\033[K\r\n";
+            }
+            return s.str();
+        }
+
+
+        /** Colorized diff as shown by syntax highlighting pagers: file and hunk headers, added and removed lines with true color backgrounds and every token of the code colored separately with 256 palette or true colors, resetting the attributes often.
+         */
+        std::string DiffInput(size_t lines) {
+            static char const * tokens[] = { "int", "x", "=", "compute", "(", "value", ",", "42", ")", ";", "return", "\"text\"", "//", "comment" };
+            static char const * colors[] = { "\033[38;2;249;38;114m", "\033[38;2;248;248;242m", "\033[38;5;141m", "\033[38;2;166;226;46m", "\033[38;5;186m", "\033[1;38;5;81m", "\033[38;2;117;113;94m", "\033[39m" };
+            std::stringstream s;
+            for (size_t i = 0; i < lines; ++i) {
+                if (i % 200 == 0)
+                    s << "\033[1;33mdiff --git a/src/file" << i << ".cpp b/src/file" << i << ".cpp\033[m\r\n";
+                if (i % 20 == 0) {
+                    s << "\033[36m@@ -" << i << ",20 +" << i << ",21 @@\033[m\r\n";
+                    continue;
+                }
+                switch (i % 4) {
+                    case 0:
+                        s << "\033[48;2;63;0;1m\033[31m-";
+                        break;
+                    case 1:
+                        s << "\033[48;2;0;40;0m\033[32m+";
+                        break;
+                    default:
+                        s << " ";
+                        break;
+                }
+                for (size_t t = 0, e = 6 + i % 8; t < e; ++t)
+                    s << colors[(i + t) % 8] << tokens[(i * 3 + t) % 14] << "\033[22m ";
+                s << "\033[0m\r\n";
+            }
+            return s.str();
+        }
+
+        /** Chat log in given script, every line starts with an ASCII timestamp and nick, followed by the message of words picked from the given ones, separated by spaces.
+         */
+        std::string ChatInput(size_t lines, std::vector<std::string> const & words) {
+            std::stringstream s;
+            for (size_t i = 0; i < lines; ++i) {
+                s << "[12:" << (i / 60) % 60 << ":" << i % 60 << "] <user" << i % 17 << "> ";
+                for (size_t w = 0, e = 4 + i % 11; w < e; ++w)
+                    s << words[(i * 7 + w * 3) % words.size()] << " ";
+                s << "\r\n";
+            }
+            return s.str();
+        }
+
+        /** Chinese and Japanese words, most of the text is three byte UTF8.
+         */
+        std::vector<std::string> const CJKWords{ "\u4f60\u597d", "\u7ec8\u7aef\u6a21\u62df\u5668", "\u4eca\u5929", "\u5929\u6c14\u5f88\u597d", "\u6211\u4eec", "\u3053\u3093\u306b\u3061\u306f", "\u65e5\u672c\u8a9e", "\u6587\u5b57\u5316\u3051", "\u30c6\u30b9\u30c8", "ok" };
+
+        /** Short words interleaved with emoji, which are four byte UTF8. 
+         */
+        std::vector<std::string> const EmojiWords{ "\U0001f600", "lol", "\U0001f44d\U0001f44d", "\U0001f680", "ship it", "\U0001f389\U0001f38a", "\U0001f525", "yes", "\U0001f914", "\U0001f602\U0001f602\U0001f602" };
+    }
+
+    /** Compares the throughput of log output with urls with hyperlink detection disabled and enabled. 
+     */
+    BENCHMARK(AnsiTerminal, Hyperlinks) {
+        Size size{250, 80};
+        std::string input{LogInput(100000)};
+        for (bool detect : { false, true }) {
+            ReplayTerminal terminal{size, detect};
+            measure(detect ? "hyperlinks detected" : "hyperlinks not detected", 1, input.size(), [&]() {
+                terminal.replay(input, 4096);
+            });
+        }
+    }
+
+    /** Compares the cost of log output with urls in a visible terminal and a hidden one, such as an inactive tab. The painting itself is not included, only the work done by the input processing.
+     */
+    BENCHMARK(AnsiTerminal, Hidden) {
+        Size size{250, 80};
+        std::string input{LogInput(100000)};
+        for (bool hidden : { false, true }) {
+            ReplayTerminal terminal{size, true};
+            terminal.setVisible(! hidden);
+            measure(hidden ? "hidden" : "visible", 1, input.size(), [&]() {
+                terminal.replay(input, 4096, /* painted */ true);
+            });
+            report(hidden ? "hidden cpu" : "visible cpu", terminal.metrics().inputCpu.sum() / 1000.0, "ms");
+        }
+    }
+
+    /** Replays the output of a full screen terminal application, which mostly erases, inserts and deletes characters and lines.
+     */
+    BENCHMARK(AnsiTerminal, TuiReplay) {
+        Size size{250, 80};
+        std::string input{TuiInput(size, 2000)};
+        ReplayTerminal terminal{size};
+        measure("tui replay", 1, input.size(), [&]() {
+            terminal.replay(input, 4096);
+        });
+    }
+
+    /** Replays colorized diff output, where most of the input are SGR sequences changing the colors of short tokens.
+     */
+    BENCHMARK(AnsiTerminal, DiffReplay) {
+        Size size{250, 80};
+        std::string input{DiffInput(200000)};
+        ReplayTerminal terminal{size};
+        measure("diff replay", 1, input.size(), [&]() {
+            terminal.replay(input, 4096);
+        });
+    }
+
+    /** Replays chat logs in CJK scripts and full of emoji, where most of the input is multibyte UTF8 that must be decoded.
+     */
+    BENCHMARK(AnsiTerminal, Utf8Replay) {
+        Size size{250, 80};
+        for (auto const & corpus : { std::make_pair("cjk", &CJKWords), std::make_pair("emoji", &EmojiWords) }) {
+            std::string input{ChatInput(200000, *corpus.second)};
+            ReplayTerminal terminal{size};
+            measure(corpus.first, 1, input.size(), [&]() {
+                terminal.replay(input, 4096);
+            });
+        }
+    }
+
+    /** Saves a terminal with a million history rows of log output to a snapshot and restores it, reporting the size of the snapshot on disk, the time of the first save, which writes the whole history, of a save after another thousand lines, which only appends them to the history file, and of the restore.
+     */
+    BENCHMARK(AnsiTerminal, Snapshot) {
+        Size size{120, 40};
+        std::string filename = (std::filesystem::path{TempDir()} / UniqueNameIn(TempDir(), "tpp-snapshot-")).string();
+        ReplayTerminal terminal{size};
+        terminal.setMaxHistoryRows(1000000);
+        terminal.replay(LogInput(1000000), 4096);
+        report("history rows", terminal.historyRows(), "");
+        TerminalSnapshot snapshot{filename};
+        measure("save", 1, [&]() {
+            snapshot.save(terminal);
+        });
+        report("snapshot size", snapshot.bytes() / (1024.0 * 1024.0), "MB");
+        terminal.replay(LogInput(1000), 4096);
+        measure("incremental save", 1, [&]() {
+            snapshot.save(terminal);
+        });
+        ReplayTerminal restored{size};
+        restored.setMaxHistoryRows(1000000);
+        measure("restore", 1, [&]() {
+            TerminalSnapshot{filename}.restore(restored);
+        });
+        ASSERT(restored.historyRows() == terminal.historyRows());
+        std::filesystem::remove(filename);
+        std::filesystem::remove(filename + ".history");
+    }
+
+    /** Replays a million lines of log output into a terminal that keeps its whole history in memory and into one that keeps only the last ten thousand rows in memory and spills the rest to the disk, reporting the memory used by the history, the size of the spill file and the time to read screenfuls of history rows at random positions, as when scrolling through the history.
+     */
+    BENCHMARK(AnsiTerminal, HistorySpill) {
+        Size size{120, 40};
+        std::string input{LogInput(1000000)};
+        for (int memoryRows : { 0, 10000 }) {
+            char const * name = memoryRows == 0 ? "in memory" : "spilled";
+            ReplayTerminal terminal{size};
+            terminal.setMaxHistoryRows(1000000);
+            terminal.setHistorySpill((std::filesystem::path{TempDir()} / UniqueNameIn(TempDir(), "tpp-history-")).string(), memoryRows);
+            measure(STR(name << ", replay"), 1, input.size(), [&]() {
+                terminal.replay(input, 4096);
+            });
+            report(STR(name << ", history memory"), terminal.metrics().historyBytes.value() / (1024.0 * 1024.0), "MB");
+            report(STR(name << ", spill file"), terminal.metrics().historySpillBytes.value() / (1024.0 * 1024.0), "MB");
+            size_t cells = 0;
+            measure(STR(name << ", scroll 1000 screens"), 1, [&]() {
+                for (int i = 0; i < 1000; ++i)
+                    cells += terminal.readHistory((i * 7919) % terminal.historyRows(), size.height());
+            });
+            report(STR(name << ", page loads"), terminal.metrics().historyPageLoads.value(), "");
+            ASSERT(cells > 0);
+        }
+    }
+
+} // namespace ui
@@ -0,0 +1,47 @@
+#include "helpers/benchmarks.h"
+
+#include "ui/canvas.h"
+
+namespace ui {
+
+    namespace {
+
+        /** Terminal sized buffer filled with text, similar to what a busy terminal paints.
+         */
+        void FillText(Canvas::Buffer & buffer) {
+            for (int row = 0; row < buffer.height(); ++row)
+                for (int col = 0; col < buffer.width(); ++col)
+                    buffer.at(col, row).setCodepoint('a' + (row + col) % 26).setFg(Color::Green);
+        }
+
+    }
+
+    /** Compares the copy of the entire grid, as the terminal used to do on every paint, with the tagged row copy when all rows and when only a single row changes between the paints.
+     */
+    BENCHMARK(Canvas, DrawFallbackBuffer) {
+        Size size{250, 80};
+        size_t iterations = 1000;
+        size_t bytes = sizeof(Canvas::Cell) * size.width() * size.height();
+        Canvas::Buffer source{size};
+        Canvas::Buffer target{size};
+        FillText(source);
+        Canvas canvas{target};
+        measure("cell by cell copy", iterations, bytes, [&]() {
+            for (int row = 0; row < size.height(); ++row)
+                for (int col = 0; col < size.width(); ++col)
+                    canvas.at(Point{col, row}).stripSpecialObjectAndAssign(source.at(col, row));
+        });
+        measure("all rows changed", iterations, bytes, [&]() {
+            for (int row = 0; row < size.height(); ++row)
+                source.at(0, row).setCodepoint('x');
+            canvas.drawFallbackBuffer(source, Point{0, 0});
+        });
+        int row = 0;
+        measure("single row changed", iterations, bytes, [&]() {
+            source.at(0, row).setCodepoint('x');
+            row = (row + 1) % size.height();
+            canvas.drawFallbackBuffer(source, Point{0, 0});
+        });
+    }
+
+} // namespace ui
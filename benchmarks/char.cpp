@@ -0,0 +1,115 @@
+#include <string>
+#include <vector>
+
+#include "helpers/benchmarks.h"
+#include "helpers/char.h"
+
+namespace {
+
+    /** Decodes the input one codepoint at a time, as the terminal used to, without any validation.
+     */
+    size_t DecodeScalar(char const * x, char const * end, char32_t * out) {
+        char32_t * o = out;
+        while (x != end) {
+            unsigned char const * ux = pointer_cast<unsigned char const *>(x);
+            if (*ux < 0x80) {
+                *o++ = *ux;
+                ++x;
+            } else if (*ux < 0xe0) {
+                *o++ = ((ux[0] & 0x1f) << 6) + (ux[1] & 0x3f);
+                x += 2;
+            } else if (*ux < 0xf0) {
+                *o++ = ((ux[0] & 0x0f) << 12) + ((ux[1] & 0x3f) << 6) + (ux[2] & 0x3f);
+                x += 3;
+            } else {
+                *o++ = ((ux[0] & 0x07) << 18) + ((ux[1] & 0x3f) << 12) + ((ux[2] & 0x3f) << 6) + (ux[3] & 0x3f);
+                x += 4;
+            }
+        }
+        return o - out;
+    }
+
+    /** The column width as determined before the width table, a chain of comparisons that knows only the wide characters of a few CJK blocks.
+     */
+    int ColumnWidthRanges(char32_t cp) {
+        if (cp >= 0x1100) {
+            if (cp <= 0x115f || // Hangul
+                cp == 0x2329 ||
+                cp == 0x2321 ||
+                (cp >= 0x2e80 && cp <= 0xa4cf && cp != 0x303f) || // CJK
+                (cp >= 0xac00 && cp <= 0xd7a3) || // Hangul Syllables
+                (cp >= 0xf900 && cp <= 0xfaff) || // CJK
+                (cp >= 0xfe10 && cp <= 0xfe19) || // Vertical forms
+                (cp >= 0xfe30 && cp <= 0xfe6f) || // CJK
+                (cp >= 0xff00 && cp <= 0xff60) || // Fullwidth forms
+                (cp >= 0xffe0 && cp <= 0xffe6) ||
+                (cp >= 0x20000 && cp <= 0x2fffd) ||
+                (cp >= 0x30000 && cp <= 0x3fffd))
+                return 2;
+        }
+        return 1;
+    }
+
+    /** Text of the given words separated by spaces, without any control characters.
+     */
+    std::string Text(size_t size, std::vector<std::string> const & words) {
+        std::string result;
+        for (size_t i = 0; result.size() < size; ++i) {
+            result += words[(i * 7) % words.size()];
+            result += ' ';
+        }
+        return result;
+    }
+
+}
+
+/** Compares the throughput of the unvalidated per codepoint UTF8 decoding with the validating block decoder for plain ASCII, CJK and emoji heavy texts.
+ */
+BENCHMARK(Char, DecodeUTF8) {
+    std::vector<std::pair<char const *, std::string>> corpora{
+        { "ascii", Text(16 * 1024 * 1024, { "terminal", "emulator", "the", "of", "output", "is", "fast" }) },
+        { "cjk", Text(16 * 1024 * 1024, { "你好", "终端模拟器", "こんにちは", "日本語", "ok" }) },
+        { "emoji", Text(16 * 1024 * 1024, { "\U0001f600", "lol", "\U0001f44d\U0001f44d", "\U0001f680", "ship it", "\U0001f525" }) },
+    };
+    std::vector<char32_t> out(16 * 1024 * 1024);
+    for (auto const & corpus : corpora) {
+        std::string const & text = corpus.second;
+        size_t scalar = 0;
+        measure(STR(corpus.first << ", scalar"), 10, text.size(), [&]() {
+            scalar = DecodeScalar(text.c_str(), text.c_str() + text.size(), out.data());
+        });
+        size_t decoded = 0;
+        measure(STR(corpus.first << ", DecodeUTF8"), 10, text.size(), [&]() {
+            char const * x = text.c_str();
+            decoded = Char::DecodeUTF8(x, text.c_str() + text.size(), out.data(), out.size());
+        });
+        ASSERT(scalar == decoded);
+    }
+}
+
+/** Compares the chain of range comparisons the column width used to be determined by with the two level width table for the codepoints of ASCII, CJK and emoji heavy texts. The throughput is that of the UTF32 codepoints.
+ */
+BENCHMARK(Char, ColumnWidth) {
+    std::vector<std::pair<char const *, std::string>> corpora{
+        { "ascii", Text(4 * 1024 * 1024, { "terminal", "emulator", "the", "of", "output", "is", "fast" }) },
+        { "cjk", Text(4 * 1024 * 1024, { "你好", "终端模拟器", "こんにちは", "日本語", "ok" }) },
+        { "emoji", Text(4 * 1024 * 1024, { "\U0001f600", "lol", "\U0001f44d\U0001f44d", "\U0001f680", "ship it", "\U0001f525" }) },
+    };
+    for (auto const & corpus : corpora) {
+        std::vector<char32_t> codepoints(corpus.second.size());
+        char const * x = corpus.second.c_str();
+        codepoints.resize(Char::DecodeUTF8(x, x + corpus.second.size(), codepoints.data(), codepoints.size()));
+        size_t ranges = 0;
+        measure(STR(corpus.first << ", ranges"), 10, codepoints.size() * sizeof(char32_t), [&]() {
+            for (char32_t cp : codepoints)
+                ranges += ColumnWidthRanges(cp);
+        });
+        size_t table = 0;
+        measure(STR(corpus.first << ", table"), 10, codepoints.size() * sizeof(char32_t), [&]() {
+            for (char32_t cp : codepoints)
+                table += Char::ColumnWidth(cp);
+        });
+        report(STR(corpus.first << ", columns by ranges"), ranges / 10.0, "");
+        report(STR(corpus.first << ", columns by table"), table / 10.0, "");
+    }
+}
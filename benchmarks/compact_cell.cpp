@@ -0,0 +1,72 @@
+#include <vector>
+
+#include "helpers/benchmarks.h"
+
+#include "ui/canvas.h"
+#include "ui-terminal/compact_cell.h"
+
+namespace ui {
+
+    namespace {
+
+        /** Cell of a syntax highlighted text with a handful of different attributes.
+         */
+        Canvas::Cell HistoryCell(int row, int col) {
+            static Color colors[] = { Color::White, Color::Green, Color::Cyan, Color::Yellow, Color::Magenta, Color::Gray };
+            Canvas::Cell result;
+            int word = (row * 7 + col / 6) % 6;
+            result.setCodepoint('a' + (row + col) % 26).setFg(colors[word]).setDecor(colors[word]);
+            result.font().setBold(word == 3).setItalic(word == 5);
+            return result;
+        }
+
+    }
+
+    /** Compares the memory used by the history stored as full canvas cells and as compact cells and the throughput of painting the history rows from either layout.
+     */
+    BENCHMARK(CompactCell, History) {
+        int cols = 250;
+        int rows = 10000;
+        size_t cells = static_cast<size_t>(cols) * rows;
+        std::vector<Canvas::Cell *> full;
+        std::vector<std::pair<int, CompactCell *>> compact;
+        CompactCell::Attributes attributes;
+        for (int row = 0; row < rows; ++row) {
+            Canvas::Cell * r = new Canvas::Cell[cols];
+            CompactCell * c = new CompactCell[cols];
+            for (int col = 0; col < cols; ++col) {
+                r[col] = HistoryCell(row, col);
+                c[col] = attributes.compact(r[col]);
+            }
+            full.push_back(r);
+            compact.push_back(std::make_pair(cols, c));
+        }
+        report("full cell bytes per cell", static_cast<double>(sizeof(Canvas::Cell)), "B");
+        report("compact cell bytes per cell", static_cast<double>(sizeof(CompactCell) * cells + attributes.bytes()) / cells, "B");
+        report("compact cell attributes", static_cast<double>(attributes.size()), "");
+        // paint the whole history into a terminal sized buffer, 80 rows at a time
+        Canvas::Buffer target{Size{cols, 80}};
+        measure("full cell paint", 1, sizeof(Canvas::Cell) * cells, [&]() {
+            for (int row = 0; row < rows; ++row) {
+                Canvas::Cell * r = full[row];
+                for (int col = 0; col < cols; ++col)
+                    target.at(col, row % 80).stripSpecialObjectAndAssign(r[col]);
+            }
+        });
+        measure("compact cell paint", 1, sizeof(Canvas::Cell) * cells, [&]() {
+            for (int row = 0; row < rows; ++row) {
+                CompactCell * r = compact[row].second;
+                for (int col = 0; col < cols; ++col)
+                    target.at(col, row % 80).stripSpecialObjectAndAssign(attributes.cell(r[col]));
+            }
+        });
+        measure("compact cell attributes compaction", 1, [&]() {
+            attributes.compact(compact.begin(), compact.end());
+        });
+        for (auto r : full)
+            delete [] r;
+        for (auto & r : compact)
+            delete [] r.second;
+    }
+
+} // namespace ui
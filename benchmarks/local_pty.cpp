@@ -0,0 +1,56 @@
+#if (defined ARCH_LINUX)
+
+#include <pty.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#include <cstring>
+#include <memory>
+
+#include "helpers/benchmarks.h"
+
+#include "tpp-lib/local_pty.h"
+
+namespace tpp {
+
+    namespace {
+
+        /** Starts a process in a new pseudoterminal with forkpty, the way the local pseudoterminal did before it switched to posix_spawn, kept for comparison.
+         */
+        void ForkPTY(Command const & command) {
+            int master = -1;
+            pid_t pid = forkpty(&master, nullptr, nullptr, nullptr);
+            if (pid == 0) {
+                char ** argv = command.toArgv();
+                execvp(command.command().c_str(), argv);
+                _exit(EXIT_FAILURE);
+            }
+            // just like the local pseudoterminal's destructor
+            kill(pid, SIGKILL);
+            waitpid(pid, nullptr, 0);
+            close(master);
+        }
+
+    }
+
+    /** Time to open a session running a trivial command as the resident memory of the terminal process grows, such as when a window accumulates history.
+     */
+    BENCHMARK(LocalPTY, Spawn) {
+        Command command{"true", {}};
+        for (size_t mb : { 0, 256, 1024 }) {
+            size_t size = mb * 1024 * 1024;
+            std::unique_ptr<char[]> resident{new char[size + 1]};
+            memset(resident.get(), 1, size + 1);
+            measure(STR("forkpty, " << mb << " MB resident"), 20, [&]() {
+                ForkPTY(command);
+            });
+            measure(STR("posix_spawn, " << mb << " MB resident"), 20, [&]() {
+                LocalPTYMaster pty{command};
+            });
+        }
+    }
+
+} // namespace tpp
+
+#endif
@@ -0,0 +1,125 @@
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#include "helpers/benchmarks.h"
+#include "helpers/locks.h"
+
+namespace {
+
+    /** The priority lock as it was before it was replaced, kept for comparison.
+     */
+    class LegacyPriorityLock {
+    public:
+
+        LegacyPriorityLock & lock() {
+            std::unique_lock<std::mutex> g(m_);
+            while (priorityRequests_ > 0)
+                cv_.wait(g);
+            g.release();
+            return *this;
+        }
+
+        LegacyPriorityLock & priorityLock() {
+            ++priorityRequests_;
+            m_.lock();
+            --priorityRequests_;
+            return *this;
+        }
+
+        void unlock() {
+            cv_.notify_all();
+            m_.unlock();
+        }
+
+    private:
+        std::atomic<unsigned> priorityRequests_{0};
+        std::mutex m_;
+        std::condition_variable cv_;
+    };
+
+    void Busy(std::chrono::microseconds duration) {
+        auto end = std::chrono::steady_clock::now() + duration;
+        while (std::chrono::steady_clock::now() < end) {
+        }
+    }
+
+    class FloodResult {
+    public:
+        double maxWait;
+        double p99Wait;
+        double averageWait;
+        double readerLocks;
+    };
+
+    /** The input thread floods the lock, processing small batches of input back to back, while the UI thread paints at regular intervals and measures how long it waits for the lock.
+     */
+    template<typename LOCK>
+    FloodResult Flood() {
+        LOCK lock;
+        std::atomic<bool> done{false};
+        size_t readerLocks = 0;
+        std::thread reader{[&]() {
+            while (! done) {
+                lock.lock();
+                Busy(std::chrono::microseconds{10});
+                lock.unlock();
+                ++readerLocks;
+            }
+        }};
+        std::vector<double> waits;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < 500; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds{1});
+            auto t = std::chrono::steady_clock::now();
+            lock.priorityLock();
+            waits.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t).count());
+            Busy(std::chrono::microseconds{200});
+            lock.unlock();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        done = true;
+        reader.join();
+        std::sort(waits.begin(), waits.end());
+        double sum = 0;
+        for (double w : waits)
+            sum += w;
+        return FloodResult{waits.back(), waits[waits.size() * 99 / 100], sum / waits.size(), readerLocks / seconds};
+    }
+
+}
+
+/** Compares the worst case and average time the UI thread waits for the priority lock while the input thread floods it, and the input thread's throughput.
+ */
+BENCHMARK(PriorityLock, Flood) {
+    FloodResult legacy = Flood<LegacyPriorityLock>();
+    report("legacy max UI wait", legacy.maxWait, "us");
+    report("legacy p99 UI wait", legacy.p99Wait, "us");
+    report("legacy average UI wait", legacy.averageWait, "us");
+    report("legacy input locks", legacy.readerLocks, "/s");
+    FloodResult current = Flood<PriorityLock>();
+    report("max UI wait", current.maxWait, "us");
+    report("p99 UI wait", current.p99Wait, "us");
+    report("average UI wait", current.averageWait, "us");
+    report("input locks", current.readerLocks, "/s");
+}
+
+/** Measures the uncontended lock and unlock, which is the common case for the input thread.
+ */
+BENCHMARK(PriorityLock, Uncontended) {
+    size_t n = 10000000;
+    LegacyPriorityLock legacy;
+    measure("legacy lock & unlock", 1, [&]() {
+        for (size_t i = 0; i < n; ++i) {
+            legacy.lock();
+            legacy.unlock();
+        }
+    });
+    PriorityLock current;
+    measure("lock & unlock", 1, [&]() {
+        for (size_t i = 0; i < n; ++i) {
+            current.lock();
+            current.unlock();
+        }
+    });
+}
@@ -0,0 +1,8 @@
+#include <cstdlib>
+#include <iostream>
+
+#include "helpers/benchmarks.h"
+
+int main(int argc, char * argv[]) {
+    return Benchmark::RunAll(argc, argv);
+}
@@ -0,0 +1,179 @@
+#include <string>
+#include <vector>
+#include <sstream>
+
+#include "helpers/benchmarks.h"
+
+#include "tpp-lib/sequence.h"
+#include "tpp-lib/input_buffer.h"
+
+namespace tpp {
+
+    namespace {
+
+        /** Terminal input as seen by ropen during a transfer: a large block hashes response followed by a flood of acknowledgements and transfer status responses, interleaved with occasional keystrokes.
+         */
+        std::string TransferInput() {
+            std::stringstream s;
+            Sequence::BlockHashes hashes{1, 65536, 4096 * 65536};
+            for (size_t i = 0; i < 4096; ++i)
+                hashes.addHash(i * 0x9e3779b97f4a7c15ull);
+            s << "\033P+" << hashes << "\007";
+            for (size_t i = 0; i < 50000; ++i) {
+                if (i % 2 == 0)
+                    s << "\033P+" << Sequence::Ack{Sequence::OpenFileTransfer{"localhost", STR("/tmp/file" << i), 1024 * i}, i} << "\007";
+                else
+                    s << "\033P+" << Sequence::TransferStatus{i, 1024 * i, 1024 * i} << "\007";
+                if (i % 64 == 0)
+                    s << "q";
+            }
+            return s.str();
+        }
+
+        /** Sizes of the reads the input is split into.
+         */
+        std::vector<size_t> ReadSizes(size_t total, size_t maxRead) {
+            std::vector<size_t> result;
+            uint64_t x = 88172645463325252ull;
+            while (total > 0) {
+                x ^= x << 13;
+                x ^= x >> 7;
+                x ^= x << 17;
+                size_t size = std::min(total, 1 + x % maxRead);
+                result.push_back(size);
+                total -= size;
+            }
+            return result;
+        }
+
+        /** The compacting input buffer the terminal client used before the input buffer, kept for comparison.
+         */
+        class CompactingBuffer {
+        public:
+            CompactingBuffer():
+                buffer_{new char[1024]},
+                bufferSize_{1024} {
+            }
+
+            ~CompactingBuffer() {
+                delete [] buffer_;
+            }
+
+            size_t copied() const {
+                return copied_;
+            }
+
+            size_t sequences() const {
+                return sequences_;
+            }
+
+            char * writeStart() {
+                if (bufferUnprocessed_ == bufferSize_) {
+                    char * buffer = new char[bufferSize_ * 2];
+                    memcpy(buffer, buffer_, bufferUnprocessed_);
+                    copied_ += bufferUnprocessed_;
+                    delete [] buffer_;
+                    buffer_ = buffer;
+                    bufferSize_ *= 2;
+                }
+                return buffer_ + bufferUnprocessed_;
+            }
+
+            size_t writeSize() const {
+                return bufferSize_ - bufferUnprocessed_;
+            }
+
+            void process(size_t size) {
+                char * i = buffer_;
+                char const * end = buffer_ + bufferUnprocessed_ + size;
+                size_t unprocessed = 0;
+                while (i < end) {
+                    char const * tppStart = Sequence::FindSequenceStart(i, end);
+                    if (tppStart != i)
+                        unprocessed = 0;
+                    char const * tppEnd = Sequence::FindSequenceEnd(tppStart, end);
+                    if (tppEnd < end) {
+                        char const * payloadStart = tppStart + 3;
+                        Sequence::ParseKind(payloadStart, end);
+                        ++sequences_;
+                        ++tppEnd;
+                        if (tppEnd == end) {
+                            move(buffer_, tppStart - unprocessed, unprocessed);
+                            break;
+                        } else {
+                            i = const_cast<char*>(tppEnd - unprocessed);
+                            move(i, tppStart - unprocessed, unprocessed);
+                            continue;
+                        }
+                    } else {
+                        move(buffer_, tppStart - unprocessed, unprocessed);
+                        move(buffer_ + unprocessed, tppStart, end - tppStart);
+                        unprocessed += end - tppStart;
+                        break;
+                    }
+                }
+                bufferUnprocessed_ = unprocessed;
+            }
+
+        private:
+
+            void move(char * dest, char const * src, size_t size) {
+                memmove(dest, src, size);
+                copied_ += size;
+            }
+
+            char * buffer_;
+            size_t bufferSize_;
+            size_t bufferUnprocessed_ = 0;
+            size_t copied_ = 0;
+            size_t sequences_ = 0;
+        };
+
+        template<typename BUFFER, typename PROCESS>
+        void Feed(std::string const & input, std::vector<size_t> const & reads, BUFFER & buffer, PROCESS process) {
+            char const * i = input.c_str();
+            for (size_t size : reads) {
+                // the reads are limited by the free space in the buffer, just like with a real PTY
+                while (size > 0) {
+                    char * start = buffer.writeStart();
+                    size_t chunk = std::min(size, buffer.writeSize());
+                    memcpy(start, i, chunk);
+                    process(buffer, chunk);
+                    i += chunk;
+                    size -= chunk;
+                }
+            }
+        }
+
+    }
+
+    BENCHMARK(TerminalClient, TransferInput) {
+        std::string input{TransferInput()};
+        for (size_t maxRead : { 64, 4096 }) {
+            std::vector<size_t> reads{ReadSizes(input.size(), maxRead)};
+            std::string suffix = STR(" (reads up to " << maxRead << " bytes)");
+            size_t copied = 0;
+            measure("compacting buffer" + suffix, 1, input.size(), [&]() {
+                CompactingBuffer buffer;
+                Feed(input, reads, buffer, [](CompactingBuffer & b, size_t size) {
+                    b.process(size);
+                });
+                copied = buffer.copied();
+            });
+            report("compacting buffer bytes moved" + suffix, static_cast<double>(copied), "B");
+            measure("input buffer" + suffix, 1, input.size(), [&]() {
+                InputBuffer buffer;
+                size_t sequences = 0;
+                Feed(input, reads, buffer, [&sequences](InputBuffer & b, size_t size) {
+                    b.process(size,
+                        [](char const * start, char const * end) { return static_cast<size_t>(end - start); },
+                        [&sequences](Sequence::Kind, char const *, char const *) { ++sequences; }
+                    );
+                });
+                copied = buffer.copied();
+            });
+            report("input buffer bytes moved" + suffix, static_cast<double>(copied), "B");
+        }
+    }
+
+} // namespace tpp
@@ -0,0 +1,53 @@
+#include <filesystem>
+#include <sstream>
+
+#include "helpers/benchmarks.h"
+#include "helpers/trace.h"
+
+namespace {
+
+    Trace::Event BENCHMARK_EVENT{"benchmark", {"codepoint", "column"}};
+    Log BENCHMARK_LOG{"BENCHMARK_TRACE"};
+
+    /** Log writer which formats the messages like the file writers, but discards them so that only the logging overhead is measured.
+     */
+    class NullWriter : public Log::OStreamWriter {
+    public:
+        NullWriter():
+            Log::OStreamWriter{s_} {
+        }
+
+        void endMessage(Log::Message const & message) override {
+            Log::OStreamWriter::endMessage(message);
+            s_.str("");
+        }
+    private:
+        std::stringstream s_;
+    };
+
+}
+
+/** Compares the cost of recording a per codepoint event via the text log and via the binary trace, i.e. the price of leaving the sequence tracing enabled.
+ */
+BENCHMARK(Trace, Record) {
+    size_t n = 100000;
+    std::string filename = (std::filesystem::temp_directory_path() / "tpp-benchmark.trace").string();
+    NullWriter writer;
+    BENCHMARK_LOG.enable(writer);
+    measure("text log", 1, [&]() {
+        for (size_t i = 0; i < n; ++i)
+            LOG(BENCHMARK_LOG) << "codepoint " << static_cast<char>('a' + i % 26) << " at column " << i % 80;
+    });
+    BENCHMARK_LOG.disable();
+    Trace::Start(filename);
+    measure("binary trace", 1, [&]() {
+        for (size_t i = 0; i < n; ++i)
+            TRACE(BENCHMARK_EVENT, 'a' + i % 26, i % 80);
+    });
+    Trace::Stop();
+    measure("disabled trace", 1, [&]() {
+        for (size_t i = 0; i < n; ++i)
+            TRACE(BENCHMARK_EVENT, 'a' + i % 26, i % 80);
+    });
+    std::filesystem::remove(filename);
+}
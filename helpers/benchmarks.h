@@ -0,0 +1,117 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+
+#include "helpers.h"
+
+/** \page helpersBenchmarks Benchmarks
+    \brief Microbenchmarks infrastructure.
+
+    Benchmarks are defined similarly to tests, with the BENCHMARK macro. The body of the benchmark uses measure() to time the code of interest and report() to output any other metrics it is interested in, such as the number of bytes copied. Benchmarks are run by their full name (`suite.name`) in alphabetical order and the results are printed to the standard output one metric per line.
+ */
+
+/** Defines new benchmark.
+ */
+#define BENCHMARK(SUITE_NAME, BENCHMARK_NAME) \
+    class Benchmark_ ## SUITE_NAME ## _ ## BENCHMARK_NAME : public HELPERS_NAMESPACE_DECL::Benchmark { \
+    private: \
+        explicit Benchmark_ ## SUITE_NAME ## _ ## BENCHMARK_NAME (char const * name): \
+            HELPERS_NAMESPACE_DECL::Benchmark(name) { \
+        } \
+        void run_() override; \
+        static Benchmark_ ## SUITE_NAME ## _ ## BENCHMARK_NAME singleton_; \
+    }; \
+    Benchmark_ ## SUITE_NAME ## _ ## BENCHMARK_NAME Benchmark_ ## SUITE_NAME ## _ ## BENCHMARK_NAME ::singleton_{# SUITE_NAME "." # BENCHMARK_NAME }; \
+    inline void Benchmark_ ## SUITE_NAME ## _ ## BENCHMARK_NAME ::run_()
+
+HELPERS_NAMESPACE_BEGIN
+
+    /** A single benchmark.
+     */
+    class Benchmark {
+    public:
+
+        std::string const & name() const {
+            return name_;
+        }
+
+        /** Runs the benchmarks.
+
+            If any arguments are given, only benchmarks whose name starts with any of the arguments are executed.
+         */
+        static int RunAll(int argc, char * argv[]) {
+            for (auto & i : Benchmarks_()) {
+                bool run = argc <= 1;
+                for (int j = 1; j < argc; ++j)
+                    if (i.first.find(argv[j]) == 0)
+                        run = true;
+                if (run)
+                    i.second->run();
+            }
+            return EXIT_SUCCESS;
+        }
+
+    protected:
+
+        explicit Benchmark(std::string const & name):
+            name_{name} {
+            Benchmarks_().insert(std::make_pair(name, this));
+        }
+
+        virtual ~Benchmark() = default;
+
+        /** Executes the given function the specified number of times and reports the time it took.
+
+            If the number of bytes processed by each iteration is specified, the throughput is reported as well.
+         */
+        template<typename T>
+        void measure(std::string const & what, size_t iterations, size_t bytes, T f) {
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < iterations; ++i)
+                f();
+            auto end = std::chrono::steady_clock::now();
+            double ms = std::chrono::duration<double, std::milli>(end - start).count();
+            report(what + " time", ms, "ms");
+            if (bytes != 0 && ms > 0)
+                report(what + " throughput", (static_cast<double>(bytes) * iterations / (1024 * 1024)) / (ms / 1000), "MB/s");
+        }
+
+        template<typename T>
+        void measure(std::string const & what, size_t iterations, T f) {
+            measure(what, iterations, 0, f);
+        }
+
+        /** Reports given metric.
+         */
+        void report(std::string const & metric, double value, char const * unit) {
+            std::cout << name_ << ": " << metric << " " << std::fixed << std::setprecision(2) << value << " " << unit << std::endl;
+        }
+
+    private:
+
+        void run() {
+            try {
+                run_();
+            } catch (Exception const & e) {
+                std::cout << name_ << ": FAILED " << e << std::endl;
+            } catch (std::exception const & e) {
+                std::cout << name_ << ": FAILED " << e.what() << std::endl;
+            }
+        }
+
+        virtual void run_() = 0;
+
+        static std::map<std::string, Benchmark *> & Benchmarks_() {
+            static std::map<std::string, Benchmark *> benchmarks;
+            return benchmarks;
+        }
+
+        std::string name_;
+
+    }; // Benchmark
+
+HELPERS_NAMESPACE_END
@@ -4,6 +4,10 @@
 
 #include "helpers.h"
 
+#if (defined __SSE2__ || defined _M_X64)
+#include <emmintrin.h>
+#endif
+
 #ifdef ARCH_WINDOWS
 static_assert(sizeof(wchar_t) == sizeof(char16_t), "wchar_t and char16_t must have the same size or the conversions would break");
 #endif
@@ -221,6 +225,14 @@ HELPERS_NAMESPACE_BEGIN
 		static constexpr char CR = 13;
 		static constexpr char ESC = 27;
 
+		/** The replacement character, which stands for invalid UTF8 sequences.
+		 */
+		static constexpr char32_t REPLACEMENT = 0xfffd;
+
+		/** Zero width joiner, which joins the characters around it into a single grapheme, such as the emoji sequences.
+		 */
+		static constexpr char32_t ZWJ = 0x200d;
+
 		Char(char c = ' ') :
 			bytes_{ static_cast<unsigned char>(c), 0, 0, 0 } {
 			ASSERT(c >= 0) << "ASCII out of range";
@@ -307,6 +319,123 @@ HELPERS_NAMESPACE_BEGIN
 			}
 		}
 
+		/** Decodes UTF8 encoded text into UTF32 codepoints, stopping at the first C0 control character.
+
+		    Decoding also stops when the output is full, or when the input ends, possibly in the middle of a valid sequence, which is then left undecoded so that it can be decoded together with the rest of its bytes later. Invalid sequences are replaced with the REPLACEMENT character, one per maximal invalid subpart as recommended by the Unicode standard. Advances the input past the decoded text and returns the number of codepoints written.
+
+		    Runs of printable ASCII characters, which make most of the text even in other scripts, are validated and widened 16 bytes at a time where SSE2 is available.
+		 */
+		static size_t DecodeUTF8(char const * & x, char const * end, char32_t * out, size_t outSize) {
+			unsigned char const * i = pointer_cast<unsigned char const *>(x);
+			unsigned char const * e = pointer_cast<unsigned char const *>(end);
+			char32_t * o = out;
+			char32_t * oe = out + outSize;
+			while (i != e && o != oe) {
+				// well formed text is decoded without bounds checks for the sequences as long as there are at least 4 bytes of input left, any invalid sequence is left to the careful decoding below
+				while (e - i >= 4 && o != oe) {
+					unsigned char c = *i;
+					if (c < 0x80) {
+						if (c < 0x20)
+							goto done;
+#if (defined __SSE2__ || defined _M_X64)
+						// only try the whole block if the next few characters are ASCII too, short ASCII runs between other scripts do not benefit from it
+						if (((i[1] | i[2] | i[3]) & 0x80) == 0 && e - i >= 16 && oe - o >= 16) {
+							__m128i bytes = _mm_loadu_si128(pointer_cast<__m128i const *>(i));
+							// non-ASCII bytes are negative when compared as signed and fail the comparison just like the control characters
+							if (_mm_movemask_epi8(_mm_cmpgt_epi8(bytes, _mm_set1_epi8(0x1f))) == 0xffff) {
+								__m128i zero = _mm_setzero_si128();
+								__m128i lo = _mm_unpacklo_epi8(bytes, zero);
+								__m128i hi = _mm_unpackhi_epi8(bytes, zero);
+								_mm_storeu_si128(pointer_cast<__m128i *>(o), _mm_unpacklo_epi16(lo, zero));
+								_mm_storeu_si128(pointer_cast<__m128i *>(o + 4), _mm_unpackhi_epi16(lo, zero));
+								_mm_storeu_si128(pointer_cast<__m128i *>(o + 8), _mm_unpacklo_epi16(hi, zero));
+								_mm_storeu_si128(pointer_cast<__m128i *>(o + 12), _mm_unpackhi_epi16(hi, zero));
+								i += 16;
+								o += 16;
+								continue;
+							}
+						}
+#endif
+						*o++ = c;
+						++i;
+					} else if (c < 0xe0) {
+						if (c < 0xc2 || (i[1] & 0xc0) != 0x80)
+							break;
+						*o++ = ((c & 0x1f) << 6) + (i[1] & 0x3f);
+						i += 2;
+					} else if (c < 0xf0) {
+						if (((i[1] & 0xc0) != 0x80) | ((i[2] & 0xc0) != 0x80))
+							break;
+						char32_t cp = ((c & 0x0f) << 12) + ((i[1] & 0x3f) << 6) + (i[2] & 0x3f);
+						// overlong encodings and surrogates
+						if (cp < 0x800 || (cp & 0xf800) == 0xd800)
+							break;
+						*o++ = cp;
+						i += 3;
+					} else {
+						if (c > 0xf4 || ((i[1] & 0xc0) != 0x80) | ((i[2] & 0xc0) != 0x80) | ((i[3] & 0xc0) != 0x80))
+							break;
+						char32_t cp = ((c & 0x07) << 18) + ((i[1] & 0x3f) << 12) + ((i[2] & 0x3f) << 6) + (i[3] & 0x3f);
+						// overlong encodings and codepoints above 0x10ffff
+						if (cp < 0x10000 || cp > 0x10ffff)
+							break;
+						*o++ = cp;
+						i += 4;
+					}
+				}
+				if (i == e || o == oe)
+					break;
+				unsigned char c = *i;
+				if (c < 0x80) {
+					if (c < 0x20)
+						break;
+					*o++ = c;
+					++i;
+					continue;
+				}
+				// the lead byte determines the length and the valid range of the first continuation byte, which excludes overlong encodings, surrogates and codepoints above 0x10ffff
+				size_t length;
+				unsigned char min = 0x80;
+				unsigned char max = 0xbf;
+				if (c < 0xc2 || c > 0xf4) {
+					*o++ = REPLACEMENT;
+					++i;
+					continue;
+				} else if (c < 0xe0) {
+					length = 2;
+				} else if (c < 0xf0) {
+					length = 3;
+					if (c == 0xe0)
+						min = 0xa0;
+					else if (c == 0xed)
+						max = 0x9f;
+				} else {
+					length = 4;
+					if (c == 0xf0)
+						min = 0x90;
+					else if (c == 0xf4)
+						max = 0x8f;
+				}
+				char32_t cp = c & (0x7f >> length);
+				size_t n = 1;
+				for (; n < length && i + n != e; ++n) {
+					if (i[n] < min || i[n] > max)
+						break;
+					cp = (cp << 6) + (i[n] & 0x3f);
+					min = 0x80;
+					max = 0xbf;
+				}
+				// a valid, but incomplete sequence at the end of the input is left for later
+				if (n != length && i + n == e)
+					break;
+				*o++ = (n == length) ? cp : REPLACEMENT;
+				i += n;
+			}
+		done:
+			x = pointer_cast<char const *>(i);
+			return o - out;
+		}
+
 		/** Returns the number of bytes required to encode the stored codepoint.
 		 */
 		size_t size() const {
@@ -339,25 +468,19 @@ HELPERS_NAMESPACE_BEGIN
 
 		/** Returns number of columns in monospace font (such as a terminal) the given character should occupy. 
 
-		    On linux, the funtion wcwidth should do, however this does not exist on Windows and to make sure that applications behave the same on all platforms, own decission is implemented. 
+		    On linux, the funtion wcwidth should do, however this does not exist on Windows and to make sure that applications behave the same on all platforms, own decission is implemented. Wide and fullwidth characters, including emoji, occupy two columns. Combining marks, format characters such as the zero width joiner and the Hangul medial vowels and final consonants occupy no columns since they belong to the preceding character. 
+
+			The widths are looked up in a two level table generated from the Unicode character database by the char-width tool (see tools/charWidth.cpp).
 		 */
         static int ColumnWidth(char32_t cp) {
-			if (cp >= 0x1100) {
-				if (cp <= 0x115f || // Hangul
-				    cp == 0x2329 ||
-					cp == 0x2321 ||
-					(cp >= 0x2e80 && cp <= 0xa4cf && cp != 0x303f) || // CJK
-					(cp >= 0xac00 && cp <= 0xd7a3) || // Hangul Syllables
-					(cp >= 0xf900 && cp <= 0xfaff) || // CJK
-					(cp >= 0xfe10 && cp <= 0xfe19) || // Vertical forms
-					(cp >= 0xfe30 && cp <= 0xfe6f) || // CJK
-					(cp >= 0xff00 && cp <= 0xff60) || // Fullwidth forms
-					(cp >= 0xffe0 && cp <= 0xffe6) ||
-					(cp >= 0x20000 && cp <= 0x2fffd) ||
-					(cp >= 0x30000 && cp <= 0x3fffd))
-					return 2;
-			}
-			return 1;
+			// nothing below the combining diacritical marks has width other than 1 (the soft hyphen is displayed)
+			if (cp < 0x300)
+				return 1;
+			if (cp > 0x10ffff)
+				return 1;
+			unsigned block = ColumnWidthIndex_[cp >> ColumnWidthBlockBits_];
+			unsigned offset = cp & ((1 << ColumnWidthBlockBits_) - 1);
+			return (ColumnWidthBlocks_[(block << (ColumnWidthBlockBits_ - 2)) + (offset >> 2)] >> ((offset & 3) * 2)) & 3;
 		}
 
         static int ColumnWidth(Char const & c) {
@@ -470,6 +593,8 @@ HELPERS_NAMESPACE_BEGIN
 
 	private:
 
+#include "char_width.inc.h"
+
 	    Char(unsigned char first, unsigned char second = 0, unsigned char third = 0, unsigned char fourth = 0) {
 			bytes_[0] = first;
 			bytes_[1] = second;
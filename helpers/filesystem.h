@@ -7,6 +7,9 @@
 #else
 #include <limits.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <pwd.h>
@@ -309,6 +312,137 @@ HELPERS_NAMESPACE_BEGIN
             }
         }
     }
+    /** Read only memory mapped file.
+
+        Maps the beginning of an existing file into memory so that large files can be read without copying them into buffers first. The mapping is released when the object is destroyed. 
+     */
+    class MappedFile {
+    public:
+
+        /** Maps the first given number of bytes of the file, or the whole file if the file is shorter. 
+         */
+        explicit MappedFile(std::string const & filename, size_t size = static_cast<size_t>(-1)) {
+#if (defined ARCH_WINDOWS)
+            file_ = CreateFileW(UTF8toUTF16(filename).c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            OSCHECK(file_ != INVALID_HANDLE_VALUE) << "Unable to open file " << filename;
+            LARGE_INTEGER fileSize;
+            OSCHECK(GetFileSizeEx(file_, & fileSize)) << "Unable to determine size of " << filename;
+            size_ = std::min(size, static_cast<size_t>(fileSize.QuadPart));
+            if (size_ > 0) {
+                mapping_ = CreateFileMapping(file_, nullptr, PAGE_READONLY, static_cast<DWORD>(static_cast<uint64_t>(size_) >> 32), static_cast<DWORD>(size_), nullptr);
+                OSCHECK(mapping_ != nullptr) << "Unable to map file " << filename;
+                data_ = static_cast<char const *>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, size_));
+                OSCHECK(data_ != nullptr) << "Unable to map file " << filename;
+            }
+#else
+            int fd = ::open(filename.c_str(), O_RDONLY);
+            OSCHECK(fd >= 0) << "Unable to open file " << filename;
+            struct stat st;
+            if (fstat(fd, & st) != 0) {
+                ::close(fd);
+                OSCHECK(false) << "Unable to determine size of " << filename;
+            }
+            size_ = std::min(size, static_cast<size_t>(st.st_size));
+            if (size_ > 0) {
+                void * data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+                ::close(fd);
+                OSCHECK(data != MAP_FAILED) << "Unable to map file " << filename;
+                data_ = static_cast<char const *>(data);
+            } else {
+                ::close(fd);
+            }
+#endif
+        }
+
+        MappedFile(MappedFile const &) = delete;
+        MappedFile & operator = (MappedFile const &) = delete;
+
+        ~MappedFile() {
+#if (defined ARCH_WINDOWS)
+            if (data_ != nullptr)
+                UnmapViewOfFile(data_);
+            if (mapping_ != nullptr)
+                CloseHandle(mapping_);
+            CloseHandle(file_);
+#else
+            if (data_ != nullptr)
+                munmap(const_cast<char *>(data_), size_);
+#endif
+        }
+
+        char const * data() const {
+            return data_;
+        }
+
+        size_t size() const {
+            return size_;
+        }
+
+    private:
+#if (defined ARCH_WINDOWS)
+        HANDLE file_;
+        HANDLE mapping_ = nullptr;
+#endif
+        char const * data_ = nullptr;
+        size_t size_ = 0;
+    }; // MappedFile
+
+    /** Exclusive lock of a file, which is created if it does not exist. 
+
+        The lock is held until the object is destroyed, or the process terminates, so that a killed process never leaves the file locked. The lock is exclusive within the process as well. 
+     */
+    class FileLock {
+    public:
+
+        explicit FileLock(std::string const & filename) {
+#if (defined ARCH_WINDOWS)
+            // a file opened without sharing cannot be opened again until it is closed
+            file_ = CreateFileW(UTF8toUTF16(filename).c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+            OSCHECK(file_ != INVALID_HANDLE_VALUE || GetLastError() == ERROR_SHARING_VIOLATION) << "Unable to open lock file " << filename;
+#else
+            fd_ = ::open(filename.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+            OSCHECK(fd_ >= 0) << "Unable to open lock file " << filename;
+            if (flock(fd_, LOCK_EX | LOCK_NB) != 0) {
+                int error = errno;
+                ::close(fd_);
+                fd_ = -1;
+                errno = error;
+                OSCHECK(error == EWOULDBLOCK) << "Unable to lock file " << filename;
+            }
+#endif
+        }
+
+        FileLock(FileLock const &) = delete;
+        FileLock & operator = (FileLock const &) = delete;
+
+        ~FileLock() {
+#if (defined ARCH_WINDOWS)
+            if (file_ != INVALID_HANDLE_VALUE)
+                CloseHandle(file_);
+#else
+            if (fd_ != -1)
+                ::close(fd_);
+#endif
+        }
+
+        /** Returns true if the lock has been acquired, false if the file is already locked by another lock. 
+         */
+        bool locked() const {
+#if (defined ARCH_WINDOWS)
+            return file_ != INVALID_HANDLE_VALUE;
+#else
+            return fd_ != -1;
+#endif
+        }
+
+    private:
+#if (defined ARCH_WINDOWS)
+        HANDLE file_;
+#else
+        int fd_;
+#endif
+    }; // FileLock
+
 #ifdef HAHA
     /** Temporary folder with optional cleanup.
 
@@ -1,9 +1,10 @@
 #pragma once
 
 #include <cstring>
+#include <cstdint>
 
 #include "helpers.h"
-#include "strings.h"
+#include "char.h"
 
 HELPERS_NAMESPACE_BEGIN
 
@@ -120,6 +121,19 @@ HELPERS_NAMESPACE_BEGIN
 	 */
 	typedef Hash<20> HashSHA1;
 
+	/** Calculates the 64bit FNV-1a hash of given buffer. 
+	 
+	    The hash is not cryptographic, but it is very fast and good enough to detect changed blocks of data. A hash of previous buffer can be passed as the basis to hash discontinuous data. 
+	 */
+	inline uint64_t FNV1a64(char const * buffer, size_t size, uint64_t basis = 0xcbf29ce484222325ull) {
+		uint64_t result = basis;
+		for (unsigned char const * i = reinterpret_cast<unsigned char const *>(buffer), * e = i + size; i != e; ++i) {
+			result ^= *i;
+			result *= 0x100000001b3ull;
+		}
+		return result;
+	}
+
 HELPERS_NAMESPACE_END
 
 namespace std {
@@ -2,6 +2,7 @@
 
 #include <stack>
 #include <string>
+#include <vector>
 #include <functional>
 #include <variant>
 
@@ -787,5 +788,25 @@ HELPERS_NAMESPACE_BEGIN
             THROW(JSONError()) << "Expected double, but " << json << " found";
         return json.toDouble();
     }
+
+    template<>
+    inline std::vector<std::string> JSONConfig::FromJSON<std::vector<std::string>>(JSON const & json) {
+        if (json.kind() != JSON::Kind::Array)
+            THROW(JSONError()) << "Expected array, but " << json << " found";
+        std::vector<std::string> result;
+        for (auto i : json) {
+            if (i.kind() != JSON::Kind::String) 
+                THROW(JSONError()) << "Element items must be strings, but " << i.kind() << " found";
+            result.push_back(i.toString());
+        }
+        return result;
+    }
+
+    template<>
+    inline void JSONConfig::Property<std::vector<std::string>>::cmdArgUpdate(char const * value, size_t index) {
+        JSON x = (index == 0) ? JSON::Array() : toJSON(false);
+        x.add(JSON{value});
+        update(x, [](JSONError &&e) { throw std::move(e);});
+    }
     
 HELPERS_NAMESPACE_END
\ No newline at end of file
@@ -5,50 +5,68 @@
 #include <atomic>
 #include <condition_variable>
 
+#if (defined _M_X64 || defined _M_IX86)
+#include <intrin.h>
+#endif
+
 HELPERS_NAMESPACE_BEGIN
 
-    /** A simple lock that allows locking in normal and priority modes, guaranteeing that a priority lock request will be serviced before any waiting normal locks. 
+    /** A lock that allows locking in normal and priority modes, guaranteeing that a priority lock request will be serviced before any waiting normal locks. 
+
+        The lock is built for a single thread that takes the lock very frequently in normal mode (such as the terminal input processing) and a thread that takes the lock less often, but must not wait for long (such as the UI thread painting the terminal). The whole state is kept in a single atomic word so that uncontended locking and unlocking are a single atomic operation each, without touching the mutex or the condition variable. A thread that cannot get the lock spins for a short while first, since the lock is typically held only briefly, and only then goes to sleep. A pending priority request prevents any new normal locks so that when the current holder unlocks, the lock is handed to the priority thread even if the holder tries to lock again right away. The unlock only wakes the sleeping threads if there are any. 
      */
     class PriorityLock {
     public:
 
-        PriorityLock():
-            priorityRequests_(0) {
-        }
+        PriorityLock() = default;
+
+        PriorityLock(PriorityLock const &) = delete;
+        PriorityLock & operator = (PriorityLock const &) = delete;
 
         /** Grabs the lock in non-priority mode.
          */
         PriorityLock & lock() {
-            std::unique_lock<std::mutex> g(m_);
-            while (priorityRequests_ > 0)
-                cv_.wait(g);
-            g.release();
-#ifndef NDEBUG
-            locked_ = std::this_thread::get_id();
-#endif
+            unsigned s = 0;
+            if (! state_.compare_exchange_strong(s, LOCKED, std::memory_order_acquire, std::memory_order_relaxed))
+                acquire(false);
+            acquired();
             return *this;
         }
 
         /** Grabs the lock in priority mode.
          */
         PriorityLock & priorityLock() {
-            ++priorityRequests_;
-            m_.lock();
-            --priorityRequests_;
-#ifndef NDEBUG
-            locked_ = std::this_thread::get_id();
-#endif
+            unsigned s = 0;
+            if (! state_.compare_exchange_strong(s, LOCKED, std::memory_order_acquire, std::memory_order_relaxed)) {
+                state_.fetch_add(PRIORITY, std::memory_order_relaxed);
+                acquire(true);
+            }
+            acquired();
             return *this;
         }
 
+        /** Grabs the lock only if it is free, returning true if the lock was acquired.
+         */
+        bool tryLock() {
+            unsigned s = 0;
+            if (! state_.compare_exchange_strong(s, LOCKED, std::memory_order_acquire, std::memory_order_relaxed))
+                return false;
+            acquired();
+            return true;
+        }
+
         /** Releases the lock. 
          */
         void unlock() {
-            cv_.notify_all();
 #ifndef NDEBUG
             locked_ = std::thread::id{};
 #endif
-            m_.unlock();
+            if (state_.fetch_sub(LOCKED, std::memory_order_release) & SLEEPING) {
+                // the sleeping threads set the flag while holding the mutex so they are already waiting for the notification
+                std::lock_guard<std::mutex> g{m_};
+                state_.fetch_and(~ SLEEPING, std::memory_order_relaxed);
+                cv_.notify_all();
+            }
         }
 
 #ifndef NDEBUG
@@ -58,7 +76,76 @@ HELPERS_NAMESPACE_BEGIN
 #endif
 
     private:
-        std::atomic<unsigned> priorityRequests_;
+
+        /** The lock is held. */
+        static constexpr unsigned LOCKED = 1;
+        /** There are threads sleeping on the condition variable. */
+        static constexpr unsigned SLEEPING = 2;
+        /** The number of pending priority requests is kept in the remaining bits. */
+        static constexpr unsigned PRIORITY = 4;
+
+        /** Number of attempts to get the lock before the thread goes to sleep. 
+
+            On a single core machine, the holder of the lock cannot make progress while another thread spins, so the threads go to sleep immediately. 
+         */
+        static unsigned Spin() {
+            static unsigned spin = std::thread::hardware_concurrency() > 1 ? 128 : 0;
+            return spin;
+        }
+
+        /** Returns true if the lock can be taken in given mode in given state, i.e. if it is not locked and, for a normal lock, there are no pending priority requests. 
+         */
+        static bool Available(unsigned state, bool priority) {
+            return priority ? ((state & LOCKED) == 0) : ((state & ~ SLEEPING) == 0);
+        }
+
+        /** Tries to take the lock in given state, returning true if successful, or updating the state if not. A priority request is removed from the state when the lock is taken. 
+         */
+        bool tryAcquire(unsigned & state, bool priority) {
+            return state_.compare_exchange_weak(state, (state | LOCKED) - (priority ? PRIORITY : 0), std::memory_order_acquire, std::memory_order_relaxed);
+        }
+
+        /** Slow path of the locking when the lock is not immediately available. 
+         */
+        void acquire(bool priority) {
+            unsigned s = state_.load(std::memory_order_relaxed);
+            for (unsigned i = 0, e = Spin(); i < e; ++i) {
+                if (Available(s, priority)) {
+                    if (tryAcquire(s, priority))
+                        return;
+                } else {
+                    Pause();
+                    s = state_.load(std::memory_order_relaxed);
+                }
+            }
+            std::unique_lock<std::mutex> g{m_};
+            s = state_.load(std::memory_order_relaxed);
+            while (true) {
+                if (Available(s, priority)) {
+                    if (tryAcquire(s, priority))
+                        return;
+                } else if ((s & SLEEPING) || state_.compare_exchange_weak(s, s | SLEEPING, std::memory_order_relaxed)) {
+                    cv_.wait(g);
+                    s = state_.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        void acquired() {
+#ifndef NDEBUG
+            locked_ = std::this_thread::get_id();
+#endif
+        }
+
+        static void Pause() {
+#if (defined __x86_64__ || defined __i386__)
+            __builtin_ia32_pause();
+#elif (defined _M_X64 || defined _M_IX86)
+            _mm_pause();
+#endif
+        }
+
+        std::atomic<unsigned> state_{0};
         std::mutex m_;
         std::condition_variable cv_;
 #ifndef NDEBUG
@@ -0,0 +1,514 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <unordered_map>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+
+#if (defined ARCH_UNIX)
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#include <time.h>
+#endif
+
+#include "helpers.h"
+
+/** \page helpersMetrics Metrics
+
+    \brief Counters, gauges and histograms exported in the Prometheus text format.
+
+    Metrics are members of metric groups, typically one group per instrumented object (such as a terminal), which exists for as long as the object does. Groups carry labels that identify the object and all existing groups are exported together by Metrics::WritePrometheus(), or served over a local Unix socket by the Metrics::Server.
+
+    Updating a metric is a relaxed atomic operation. Counters and gauges are expected to be updated by a single thread only (the owner of the group), which allows them to avoid the locked read-modify-write instructions, while any thread may read them.
+ */
+
+HELPERS_NAMESPACE_BEGIN
+
+    class Metrics {
+    public:
+
+        class Metric;
+        class Counter;
+        class Gauge;
+        class Histogram;
+        class Group;
+#if (defined ARCH_UNIX)
+        class Server;
+#endif
+
+        /** Returns the current time in microseconds for the histogram measurements.
+         */
+        static uint64_t Now() {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+        }
+
+        /** Returns the CPU time consumed by the calling thread in microseconds.
+         */
+        static uint64_t ThreadCpuTime() {
+#if (defined ARCH_WINDOWS)
+            FILETIME creation, exit, kernel, user;
+            GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+            // the times are in 100ns units
+            return ((uint64_t{kernel.dwHighDateTime} << 32 | kernel.dwLowDateTime) + (uint64_t{user.dwHighDateTime} << 32 | user.dwLowDateTime)) / 10;
+#else
+            timespec t;
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+            return static_cast<uint64_t>(t.tv_sec) * 1000000 + static_cast<uint64_t>(t.tv_nsec) / 1000;
+#endif
+        }
+
+        /** Writes all metrics of all existing groups in the Prometheus text format.
+
+            Metrics with the same name from different groups are written together under a single help and type comment.
+         */
+        static void WritePrometheus(std::ostream & s);
+
+        static std::string Prometheus() {
+            std::stringstream s;
+            WritePrometheus(s);
+            return s.str();
+        }
+
+    private:
+
+        /** Guards the groups and their metrics.
+         */
+        static std::mutex & Guard() {
+            static std::mutex m;
+            return m;
+        }
+
+        static std::vector<Group *> & Groups() {
+            static std::vector<Group *> groups;
+            return groups;
+        }
+
+        static std::string JoinLabels(std::string const & a, std::string const & b) {
+            if (a.empty())
+                return b;
+            if (b.empty())
+                return a;
+            return a + "," + b;
+        }
+
+        static void WriteSample(std::ostream & s, std::string const & name, std::string const & labels) {
+            s << name;
+            if (! labels.empty())
+                s << "{" << labels << "}";
+            s << " ";
+        }
+
+    }; // Metrics
+
+    /** Base class for all metrics.
+     */
+    class Metrics::Metric {
+    public:
+
+        enum class Kind {
+            Counter,
+            Gauge,
+            Histogram,
+        };
+
+        virtual ~Metric();
+
+        Metric(Metric const &) = delete;
+        Metric & operator = (Metric const &) = delete;
+
+        std::string const & name() const {
+            return name_;
+        }
+
+        std::string const & help() const {
+            return help_;
+        }
+
+        Kind kind() const {
+            return kind_;
+        }
+
+    protected:
+
+        /** Creates the metric in given group. The labels, if any, distinguish the metric from others of the same name in the group.
+         */
+        Metric(Group & group, Kind kind, char const * name, char const * help, char const * labels);
+
+        /** Writes the samples of the metric, with given labels.
+         */
+        virtual void write(std::ostream & s, std::string const & labels) const = 0;
+
+    private:
+
+        friend class Metrics;
+
+        Group & group_;
+        Kind kind_;
+        std::string name_;
+        std::string help_;
+        std::string labels_;
+
+    }; // Metrics::Metric
+
+    /** Monotonically increasing counter.
+     */
+    class Metrics::Counter : public Metrics::Metric {
+    public:
+
+        Counter(Group & group, char const * name, char const * help, char const * labels = ""):
+            Metric{group, Kind::Counter, name, help, labels} {
+        }
+
+        /** Increments the counter. Must only be called by a single thread.
+         */
+        void add(uint64_t by = 1) {
+            value_.store(value_.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+        }
+
+        uint64_t value() const {
+            return value_.load(std::memory_order_relaxed);
+        }
+
+    protected:
+
+        void write(std::ostream & s, std::string const & labels) const override {
+            WriteSample(s, name(), labels);
+            s << value() << "\n";
+        }
+
+    private:
+        std::atomic<uint64_t> value_{0};
+
+    }; // Metrics::Counter
+
+    /** A value that can go up and down.
+     */
+    class Metrics::Gauge : public Metrics::Metric {
+    public:
+
+        Gauge(Group & group, char const * name, char const * help, char const * labels = ""):
+            Metric{group, Kind::Gauge, name, help, labels} {
+        }
+
+        void set(int64_t value) {
+            value_.store(value, std::memory_order_relaxed);
+        }
+
+        int64_t value() const {
+            return value_.load(std::memory_order_relaxed);
+        }
+
+    protected:
+
+        void write(std::ostream & s, std::string const & labels) const override {
+            WriteSample(s, name(), labels);
+            s << value() << "\n";
+        }
+
+    private:
+        std::atomic<int64_t> value_{0};
+
+    }; // Metrics::Gauge
+
+    /** Histogram of the values with exponential buckets.
+
+        The upper bounds of the buckets are powers of two, i.e. 1, 2, 4 up to 2^(BUCKETS - 1), with the values above falling only into the implicit +Inf bucket. When exported, the values are multiplied by the scale of the histogram, so that the values can be recorded in integral units such as microseconds, but reported in seconds, as is customary for Prometheus.
+
+        Unlike counters, histograms can be updated from multiple threads.
+     */
+    class Metrics::Histogram : public Metrics::Metric {
+    public:
+
+        static constexpr size_t BUCKETS = 24;
+
+        Histogram(Group & group, char const * name, char const * help, double scale = 1.0, char const * labels = ""):
+            Metric{group, Kind::Histogram, name, help, labels},
+            scale_{scale} {
+        }
+
+        /** Records the value.
+         */
+        void record(uint64_t value) {
+            size_t bucket = 0;
+            while (bucket < BUCKETS && (uint64_t{1} << bucket) < value)
+                ++bucket;
+            if (bucket < BUCKETS)
+                buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+            count_.fetch_add(1, std::memory_order_relaxed);
+            sum_.fetch_add(value, std::memory_order_relaxed);
+        }
+
+        /** Records the time elapsed since given start, as returned by Metrics::Now().
+         */
+        void recordSince(uint64_t start) {
+            record(Now() - start);
+        }
+
+        uint64_t count() const {
+            return count_.load(std::memory_order_relaxed);
+        }
+
+        uint64_t sum() const {
+            return sum_.load(std::memory_order_relaxed);
+        }
+
+        /** Returns the number of values that fell into the bucket with given upper bound index.
+         */
+        uint64_t bucket(size_t index) const {
+            ASSERT(index < BUCKETS);
+            return buckets_[index].load(std::memory_order_relaxed);
+        }
+
+    protected:
+
+        void write(std::ostream & s, std::string const & labels) const override {
+            uint64_t total = 0;
+            for (size_t i = 0; i < BUCKETS; ++i) {
+                total += bucket(i);
+                WriteSample(s, name() + "_bucket", JoinLabels(labels, STR("le=\"" << static_cast<double>(uint64_t{1} << i) * scale_ << "\"")));
+                s << total << "\n";
+            }
+            WriteSample(s, name() + "_bucket", JoinLabels(labels, "le=\"+Inf\""));
+            s << count() << "\n";
+            WriteSample(s, name() + "_sum", labels);
+            s << static_cast<double>(sum()) * scale_ << "\n";
+            WriteSample(s, name() + "_count", labels);
+            s << count() << "\n";
+        }
+
+    private:
+
+        double scale_;
+        std::atomic<uint64_t> buckets_[BUCKETS] = {};
+        std::atomic<uint64_t> count_{0};
+        std::atomic<uint64_t> sum_{0};
+
+    }; // Metrics::Histogram
+
+    /** A group of metrics with common labels.
+
+        Groups are expected to be subclassed with the metrics as their members. The group is exported for as long as it exists.
+     */
+    class Metrics::Group {
+    public:
+
+        Group() {
+            std::lock_guard<std::mutex> g{Guard()};
+            Groups().push_back(this);
+        }
+
+        virtual ~Group() {
+            std::lock_guard<std::mutex> g{Guard()};
+            auto & groups = Groups();
+            groups.erase(std::find(groups.begin(), groups.end(), this));
+        }
+
+        Group(Group const &) = delete;
+        Group & operator = (Group const &) = delete;
+
+        /** Sets the label that will be attached to all metrics of the group.
+         */
+        void setLabel(std::string const & name, std::string const & value) {
+            std::lock_guard<std::mutex> g{Guard()};
+            for (auto & i : labels_) {
+                if (i.first == name) {
+                    i.second = value;
+                    return;
+                }
+            }
+            labels_.push_back(std::make_pair(name, value));
+        }
+
+    private:
+
+        friend class Metrics;
+        friend class Metric;
+
+        std::string labels() const {
+            std::stringstream s;
+            for (auto const & i : labels_) {
+                if (s.tellp() > 0)
+                    s << ",";
+                s << i.first << "=\"";
+                for (char c : i.second) {
+                    switch (c) {
+                        case '\\':
+                            s << "\\\\";
+                            break;
+                        case '"':
+                            s << "\\\"";
+                            break;
+                        case '\n':
+                            s << "\\n";
+                            break;
+                        default:
+                            s << c;
+                    }
+                }
+                s << "\"";
+            }
+            return s.str();
+        }
+
+        std::vector<std::pair<std::string, std::string>> labels_;
+        std::vector<Metric *> metrics_;
+
+    }; // Metrics::Group
+
+#if (defined ARCH_UNIX)
+
+    /** Serves the metrics over a local Unix socket.
+
+        Each connection receives the metrics in the Prometheus text format and is closed. If the client sends a HTTP GET request first, the metrics are sent as a HTTP response so that the socket can be scraped directly (e.g. `curl --unix-socket`), otherwise they are written as plain text (e.g. `socat - UNIX-CONNECT:path`).
+     */
+    class Metrics::Server {
+    public:
+
+        /** Creates the socket at given path, replacing any existing socket, and starts serving it. The socket is only accessible by its owner. Throws OSError if the socket cannot be created.
+         */
+        explicit Server(std::string const & path):
+            path_{path} {
+            sockaddr_un addr;
+            memset(& addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            if (path.size() >= sizeof(addr.sun_path))
+                THROW(IOError()) << "Metrics socket path too long: " << path;
+            strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+            socket_ = socket(AF_UNIX, SOCK_STREAM, 0);
+            OSCHECK(socket_ >= 0) << "Unable to create metrics socket";
+            unlink(path.c_str());
+            // the metrics reveal what the user runs, so only the user may connect, which the socket's permissions enforce before it starts listening
+            if (bind(socket_, pointer_cast<sockaddr*>(& addr), sizeof(addr)) != 0 || chmod(path.c_str(), S_IRUSR | S_IWUSR) != 0 || listen(socket_, 4) != 0) {
+                close(socket_);
+                OSCHECK(false) << "Unable to listen on metrics socket " << path;
+            }
+            thread_ = std::thread{[this](){
+                serve();
+            }};
+        }
+
+        ~Server() {
+            stop_ = true;
+            // wakes up the accept call
+            shutdown(socket_, SHUT_RDWR);
+            thread_.join();
+            close(socket_);
+            unlink(path_.c_str());
+        }
+
+        std::string const & path() const {
+            return path_;
+        }
+
+    private:
+
+        /** How long to wait for the request before the metrics are sent as plain text (in ms).
+         */
+        static constexpr int REQUEST_TIMEOUT = 100;
+
+        void serve() {
+            while (! stop_) {
+                int client = accept(socket_, nullptr, nullptr);
+                if (client < 0) {
+                    if (errno == EINTR || errno == ECONNABORTED)
+                        continue;
+                    break;
+                }
+                respond(client);
+                close(client);
+            }
+        }
+
+        void respond(int client) {
+            bool http = false;
+            pollfd p{client, POLLIN, 0};
+            if (poll(& p, 1, REQUEST_TIMEOUT) > 0) {
+                char request[1024];
+                ssize_t n = recv(client, request, sizeof(request), 0);
+                http = n >= 4 && strncmp(request, "GET ", 4) == 0;
+            }
+            std::string body{Prometheus()};
+            if (http)
+                body = STR("HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " << body.size() << "\r\n\r\n" << body);
+            char const * i = body.c_str();
+            char const * end = i + body.size();
+            while (i < end) {
+                ssize_t n = send(client, i, end - i, MSG_NOSIGNAL);
+                if (n <= 0)
+                    break;
+                i += n;
+            }
+        }
+
+        std::string path_;
+        int socket_;
+        std::atomic<bool> stop_{false};
+        std::thread thread_;
+
+    }; // Metrics::Server
+
+#endif
+
+    inline Metrics::Metric::Metric(Group & group, Kind kind, char const * name, char const * help, char const * labels):
+        group_{group},
+        kind_{kind},
+        name_{name},
+        help_{help},
+        labels_{labels} {
+        std::lock_guard<std::mutex> g{Guard()};
+        group_.metrics_.push_back(this);
+    }
+
+    /** Metrics are destroyed before their group is, so they must remove themselves for the group to be safe to export until it is destroyed as well.
+     */
+    inline Metrics::Metric::~Metric() {
+        std::lock_guard<std::mutex> g{Guard()};
+        auto & metrics = group_.metrics_;
+        metrics.erase(std::find(metrics.begin(), metrics.end(), this));
+    }
+
+    inline void Metrics::WritePrometheus(std::ostream & s) {
+        std::lock_guard<std::mutex> g{Guard()};
+        std::vector<std::string> names;
+        std::unordered_map<std::string, std::vector<std::pair<Metric const *, std::string>>> samples;
+        for (Group const * group : Groups()) {
+            std::string labels{group->labels()};
+            for (Metric const * m : group->metrics_) {
+                auto & i = samples[m->name()];
+                if (i.empty())
+                    names.push_back(m->name());
+                i.push_back(std::make_pair(m, JoinLabels(labels, m->labels_)));
+            }
+        }
+        for (std::string const & name : names) {
+            auto const & metrics = samples[name];
+            Metric const * first = metrics.front().first;
+            s << "# HELP " << name << " " << first->help() << "\n";
+            s << "# TYPE " << name << " ";
+            switch (first->kind()) {
+                case Metric::Kind::Counter:
+                    s << "counter\n";
+                    break;
+                case Metric::Kind::Gauge:
+                    s << "gauge\n";
+                    break;
+                case Metric::Kind::Histogram:
+                    s << "histogram\n";
+                    break;
+            }
+            for (auto const & i : metrics)
+                i.first->write(s, i.second);
+        }
+    }
+
+HELPERS_NAMESPACE_END
@@ -5,6 +5,9 @@
 #include <sys/wait.h>
 #include <sys/ioctl.h>
 #include <errno.h>
+
+// not declared by unistd.h on all platforms
+extern char ** environ;
 #endif
 
 #include <vector>
@@ -237,6 +240,25 @@ HELPERS_NAMESPACE_BEGIN
 #endif
 		}
 
+#if (defined ARCH_UNIX)
+		/** Returns the environment of the current process with the changes applied, as a list of `name=value` strings. 
+
+		    Unlike apply(), leaves the environment of the current process intact, which makes it suitable for spawning processes with the changed environment without forking first.
+		 */
+		std::vector<std::string> toEnvp() const {
+			std::vector<std::string> result;
+			for (char ** i = environ; *i != nullptr; ++i) {
+				char const * eq = strchr(*i, '=');
+				if (eq == nullptr || map_.find(std::string(*i, eq - *i)) == map_.end())
+					result.push_back(*i);
+			}
+			for (auto const & i : map_)
+				if (! i.second.empty())
+					result.push_back(i.first + "=" + i.second);
+			return result;
+		}
+#endif
+
 		/** Creates an empty environment. 
 		 */
 		Environment() = default;
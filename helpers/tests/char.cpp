@@ -0,0 +1,93 @@
+#include "helpers/tests.h"
+
+#include "helpers/char.h"
+
+namespace {
+
+    /** Decodes the input and returns the hexadecimal codepoints separated by spaces and the number of bytes decoded.
+     */
+    std::pair<std::string, size_t> Decode(std::string const & input, size_t outSize = 1024) {
+        std::vector<char32_t> out(outSize);
+        char const * x = input.c_str();
+        size_t n = Char::DecodeUTF8(x, input.c_str() + input.size(), out.data(), outSize);
+        std::stringstream s;
+        for (size_t i = 0; i < n; ++i)
+            s << (i == 0 ? "" : " ") << std::hex << static_cast<unsigned>(out[i]);
+        return std::make_pair(s.str(), x - input.c_str());
+    }
+
+}
+
+TEST(helpers_char, decodeUTF8) {
+    EXPECT_EQ(Decode("ab").first, "61 62");
+    EXPECT_EQ(Decode("\xc3\xa9\xe4\xbd\xa0\xf0\x9f\x98\x80").first, "e9 4f60 1f600");
+    EXPECT_EQ(Decode("\xf4\x8f\xbf\xbf").first, "10ffff");
+}
+
+TEST(helpers_char, decodeUTF8Blocks) {
+    // longer than the vectorized ASCII block, interrupted by a multibyte character
+    std::string input{"0123456789abcdefghijklmnopqrstuv\xc3\xa9wxyz0123456789ABCDEFGHIJ"};
+    auto result = Decode(input);
+    EXPECT_EQ(result.second, input.size());
+    EXPECT_EQ(result.first, "30 31 32 33 34 35 36 37 38 39 61 62 63 64 65 66 67 68 69 6a 6b 6c 6d 6e 6f 70 71 72 73 74 75 76 e9 77 78 79 7a 30 31 32 33 34 35 36 37 38 39 41 42 43 44 45 46 47 48 49 4a");
+    // output full
+    result = Decode(input, 20);
+    EXPECT_EQ(result.second, 20u);
+}
+
+TEST(helpers_char, decodeUTF8StopsAtControl) {
+    std::string input{"0123456789abcdefghij\x1b[m"};
+    auto result = Decode(input);
+    EXPECT_EQ(result.second, 20u);
+    result = Decode("\r\n");
+    EXPECT_EQ(result.first, "");
+    EXPECT_EQ(result.second, 0u);
+}
+
+TEST(helpers_char, decodeUTF8Incomplete) {
+    auto result = Decode("a\xe4\xbd");
+    EXPECT_EQ(result.first, "61");
+    EXPECT_EQ(result.second, 1u);
+    result = Decode("\xf0\x9f\x98");
+    EXPECT_EQ(result.first, "");
+    EXPECT_EQ(result.second, 0u);
+}
+
+TEST(helpers_char, decodeUTF8Invalid) {
+    // stray continuation bytes and invalid lead bytes are replaced one by one
+    EXPECT_EQ(Decode("\x80\xbf" "a\xc0\xff").first, "fffd fffd 61 fffd fffd");
+    // truncated sequence is replaced as a whole
+    EXPECT_EQ(Decode("\xe4\xbd" "a").first, "fffd 61");
+    EXPECT_EQ(Decode("\xf0\x9f\x98" "a").first, "fffd 61");
+    // overlong encodings, surrogates and codepoints above 0x10ffff are invalid from their second byte, both at the end of the input and followed by more text
+    EXPECT_EQ(Decode("\xe0\x80\x80").first, "fffd fffd fffd");
+    EXPECT_EQ(Decode("\xed\xa0\x80").first, "fffd fffd fffd");
+    EXPECT_EQ(Decode("\xf4\x90\x80\x80").first, "fffd fffd fffd fffd");
+    EXPECT_EQ(Decode("\xc1\xbf" "abcd").first, "fffd fffd 61 62 63 64");
+    EXPECT_EQ(Decode("\xe0\x80\x80" "abcd").first, "fffd fffd fffd 61 62 63 64");
+    EXPECT_EQ(Decode("\xed\xa0\x80" "abcd").first, "fffd fffd fffd 61 62 63 64");
+    EXPECT_EQ(Decode("\xf4\x90\x80\x80" "abcd").first, "fffd fffd fffd fffd 61 62 63 64");
+    EXPECT_EQ(Decode("\xf8\x90\x80\x80" "abcd").first, "fffd fffd fffd fffd 61 62 63 64");
+    EXPECT_EQ(Decode("\xe4\xbd" "abcd").first, "fffd 61 62 63 64");
+    // invalid sequence followed by a control character
+    auto result = Decode("\xc3\n");
+    EXPECT_EQ(result.first, "fffd");
+    EXPECT_EQ(result.second, 1u);
+}
+
+TEST(helpers_char, columnWidth) {
+    EXPECT_EQ(Char::ColumnWidth('a'), 1);
+    EXPECT_EQ(Char::ColumnWidth(0xad), 1); // soft hyphen
+    EXPECT_EQ(Char::ColumnWidth(0x3b1), 1); // greek alpha
+    EXPECT_EQ(Char::ColumnWidth(0x4f60), 2); // CJK ideograph
+    EXPECT_EQ(Char::ColumnWidth(0xac00), 2); // Hangul syllable
+    EXPECT_EQ(Char::ColumnWidth(0xff21), 2); // fullwidth A
+    EXPECT_EQ(Char::ColumnWidth(0x1f600), 2); // emoji
+    EXPECT_EQ(Char::ColumnWidth(0x2fffd), 2); // unassigned in the CJK extension plane
+    EXPECT_EQ(Char::ColumnWidth(0x301), 0); // combining acute accent
+    EXPECT_EQ(Char::ColumnWidth(0x200d), 0); // zero width joiner
+    EXPECT_EQ(Char::ColumnWidth(0xfe0f), 0); // variation selector
+    EXPECT_EQ(Char::ColumnWidth(0x1160), 0); // Hangul medial vowel
+    EXPECT_EQ(Char::ColumnWidth(0x10ffff), 1);
+    EXPECT_EQ(Char::ColumnWidth(0x110000), 1);
+}
@@ -0,0 +1,20 @@
+#include "../helpers.h"
+#include "../filesystem.h"
+#include "../tests.h"
+
+TEST(helpers_filesystem, fileLockExclusive) {
+    std::string filename = (std::filesystem::path{TempDir()} / UniqueNameIn(TempDir(), "tpp-lock-")).string();
+    {
+        FileLock lock{filename};
+        EXPECT(lock.locked());
+        // the lock is exclusive within the process as well
+        FileLock other{filename};
+        EXPECT(! other.locked());
+    }
+    {
+        // and is released when destroyed
+        FileLock lock{filename};
+        EXPECT(lock.locked());
+    }
+    std::filesystem::remove(filename);
+}
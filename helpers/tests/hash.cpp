@@ -0,0 +1,13 @@
+#include "helpers/tests.h"
+
+#include "helpers/hash.h"
+
+TEST(helpers_hash, fnv1a64) {
+    EXPECT_EQ(FNV1a64("", 0), 0xcbf29ce484222325ull);
+    EXPECT_EQ(FNV1a64("a", 1), 0xaf63dc4c8601ec8cull);
+    EXPECT_EQ(FNV1a64("foobar", 6), 0x85944171f73967e8ull);
+}
+
+TEST(helpers_hash, fnv1a64Discontinuous) {
+    EXPECT_EQ(FNV1a64("bar", 3, FNV1a64("foo", 3)), FNV1a64("foobar", 6));
+}
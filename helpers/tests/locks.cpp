@@ -0,0 +1,65 @@
+#include <thread>
+#include <vector>
+
+#include "../helpers.h"
+#include "../locks.h"
+#include "../tests.h"
+
+TEST(helpers_locks, priorityLockExclusion) {
+    PriorityLock lock;
+    size_t counter = 0;
+    auto increment = [&](bool priority) {
+        for (size_t i = 0; i < 100000; ++i) {
+            if (priority)
+                lock.priorityLock();
+            else
+                lock.lock();
+            ++counter;
+            lock.unlock();
+        }
+    };
+    std::thread t1{increment, false};
+    std::thread t2{increment, false};
+    std::thread t3{increment, true};
+    t1.join();
+    t2.join();
+    t3.join();
+    EXPECT_EQ(counter, 300000u);
+}
+
+TEST(helpers_locks, priorityLockFirst) {
+    PriorityLock lock;
+    std::vector<int> order;
+    lock.lock();
+    std::thread normal{[&]() {
+        lock.lock();
+        order.push_back(1);
+        lock.unlock();
+    }};
+    std::this_thread::sleep_for(std::chrono::milliseconds{20});
+    std::thread priority{[&]() {
+        lock.priorityLock();
+        order.push_back(2);
+        lock.unlock();
+    }};
+    std::this_thread::sleep_for(std::chrono::milliseconds{20});
+    lock.unlock();
+    normal.join();
+    priority.join();
+    EXPECT_EQ(order.size(), 2u);
+    EXPECT_EQ(order[0], 2);
+}
+
+TEST(helpers_locks, priorityLockTryLock) {
+    PriorityLock lock;
+    EXPECT(lock.tryLock());
+    bool acquired = true;
+    std::thread t{[&]() {
+        acquired = lock.tryLock();
+    }};
+    t.join();
+    EXPECT(! acquired);
+    lock.unlock();
+    EXPECT(lock.tryLock());
+    lock.unlock();
+}
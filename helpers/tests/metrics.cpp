@@ -0,0 +1,94 @@
+#include <filesystem>
+
+#include "../metrics.h"
+#include "../tests.h"
+
+namespace {
+
+    class TestMetrics : public Metrics::Group {
+    public:
+        Metrics::Counter requests{*this, "test_requests_total", "Requests", "kind=\"a\""};
+        Metrics::Counter otherRequests{*this, "test_requests_total", "Requests", "kind=\"b\""};
+        Metrics::Gauge size{*this, "test_size", "Size"};
+        Metrics::Histogram latency{*this, "test_latency", "Latency"};
+    };
+
+    bool Contains(std::string const & what, std::string const & line) {
+        return what.find(line + "\n") != std::string::npos;
+    }
+
+}
+
+TEST(helpers_metrics, histogramBuckets) {
+    TestMetrics m;
+    m.latency.record(0);
+    m.latency.record(1);
+    m.latency.record(3);
+    m.latency.record(4);
+    m.latency.record(uint64_t{1} << 40);
+    EXPECT_EQ(m.latency.count(), 5u);
+    EXPECT_EQ(m.latency.bucket(0), 2u);
+    EXPECT_EQ(m.latency.bucket(1), 0u);
+    EXPECT_EQ(m.latency.bucket(2), 2u);
+    EXPECT_EQ(m.latency.sum(), 8 + (uint64_t{1} << 40));
+}
+
+TEST(helpers_metrics, prometheus) {
+    TestMetrics m1;
+    TestMetrics m2;
+    m1.setLabel("group", "1");
+    m2.setLabel("group", "quote\"d");
+    m1.requests.add(3);
+    m2.otherRequests.add();
+    m1.size.set(-5);
+    m1.latency.record(3);
+    std::string s{Metrics::Prometheus()};
+    EXPECT(Contains(s, "# TYPE test_requests_total counter"));
+    EXPECT(Contains(s, "test_requests_total{group=\"1\",kind=\"a\"} 3"));
+    EXPECT(Contains(s, "test_requests_total{group=\"quote\\\"d\",kind=\"b\"} 1"));
+    EXPECT(Contains(s, "test_size{group=\"1\"} -5"));
+    EXPECT(Contains(s, "# TYPE test_latency histogram"));
+    EXPECT(Contains(s, "test_latency_bucket{group=\"1\",le=\"2\"} 0"));
+    EXPECT(Contains(s, "test_latency_bucket{group=\"1\",le=\"4\"} 1"));
+    EXPECT(Contains(s, "test_latency_bucket{group=\"1\",le=\"+Inf\"} 1"));
+    EXPECT(Contains(s, "test_latency_count{group=\"1\"} 1"));
+    // help and type are written only once per metric name
+    EXPECT_EQ(s.find("# HELP test_requests_total"), s.rfind("# HELP test_requests_total"));
+}
+
+TEST(helpers_metrics, groupLifetime) {
+    {
+        TestMetrics m;
+        EXPECT(Metrics::Prometheus().find("test_size") != std::string::npos);
+    }
+    EXPECT(Metrics::Prometheus().find("test_size") == std::string::npos);
+}
+
+#if (defined ARCH_UNIX)
+TEST(helpers_metrics, server) {
+    TestMetrics m;
+    m.requests.add(7);
+    std::string path = (std::filesystem::temp_directory_path() / "tpp-test-metrics.sock").string();
+    Metrics::Server server{path};
+    // only the user may connect to the socket
+    struct stat st;
+    EXPECT_EQ(stat(path.c_str(), & st), 0);
+    EXPECT_EQ(st.st_mode & 0777, static_cast<mode_t>(0600));
+    int s = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr;
+    memset(& addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    EXPECT_EQ(connect(s, pointer_cast<sockaddr*>(& addr), sizeof(addr)), 0);
+    std::string request{"GET /metrics HTTP/1.0\r\n\r\n"};
+    send(s, request.c_str(), request.size(), 0);
+    std::string response;
+    char buffer[1024];
+    ssize_t n;
+    while ((n = recv(s, buffer, sizeof(buffer), 0)) > 0)
+        response.append(buffer, n);
+    close(s);
+    EXPECT(response.find("HTTP/1.0 200 OK\r\n") == 0);
+    EXPECT(Contains(response, "test_requests_total{kind=\"a\"} 7"));
+}
+#endif
@@ -0,0 +1,71 @@
+#include <filesystem>
+
+#include "../trace.h"
+#include "../tests.h"
+
+namespace {
+
+    Trace::Event TEST_EVENT{"test", {"a", "b"}};
+    Log TEST_LOG{"TRACE_TEST"};
+
+    std::string TraceFile() {
+        return (std::filesystem::temp_directory_path() / "tpp-test.trace").string();
+    }
+
+}
+
+TEST(helpers_trace, disabled) {
+    EXPECT(! Trace::Enabled());
+    int evaluated = 0;
+    TRACE(TEST_EVENT, ++evaluated, 2);
+    EXPECT_EQ(evaluated, 0);
+}
+
+TEST(helpers_trace, records) {
+    Trace::Start(TraceFile());
+    EXPECT(Trace::Enabled());
+    TRACE(TEST_EVENT, 1, -2);
+    std::thread t{[](){
+        for (int i = 0; i < 100; ++i)
+            TRACE(TEST_EVENT, i, 3);
+    }};
+    t.join();
+    TRACE(TEST_EVENT, 4, 5);
+    Trace::Stop();
+    EXPECT(! Trace::Enabled());
+    // records after the trace was stopped are ignored
+    TRACE(TEST_EVENT, 6, 7);
+    std::ifstream f{TraceFile(), std::ios::binary};
+    Trace::Reader trace{f};
+    auto const & records = trace.records();
+    EXPECT_EQ(records.size(), 102u);
+    EXPECT_EQ(records.front().event->name, "test");
+    EXPECT_EQ(records.front().event->args.size(), 2u);
+    EXPECT_EQ(records.front().args[0], 1);
+    EXPECT_EQ(records.front().args[1], -2);
+    EXPECT_EQ(records[50].args[0], 49);
+    EXPECT(records[50].thread != records.front().thread);
+    EXPECT_EQ(records.back().args[0], 4);
+    EXPECT(trace.nanoseconds(records.front().timestamp) <= trace.nanoseconds(records.back().timestamp));
+    EXPECT(trace.dropped().empty());
+}
+
+TEST(helpers_trace, logWriter) {
+    Log::Enable(Trace::LogWriter(), { TEST_LOG });
+    Trace::Start(TraceFile());
+    LOG(TEST_LOG) << "foo " << 42;
+    Trace::Stop();
+    LOG(TEST_LOG) << "bar";
+    TEST_LOG.disable();
+    std::ifstream f{TraceFile(), std::ios::binary};
+    Trace::Reader trace{f};
+    EXPECT_EQ(trace.records().size(), 1u);
+    EXPECT(trace.records()[0].event->text);
+    EXPECT_EQ(trace.records()[0].event->name, "TRACE_TEST");
+    EXPECT_EQ(trace.records()[0].text, "foo 42");
+}
+
+TEST(helpers_trace, invalidFile) {
+    std::stringstream s{"NOTATRACE"};
+    EXPECT_THROWS(IOError, Trace::Reader{s});
+}
@@ -0,0 +1,630 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <algorithm>
+#include <unordered_map>
+#include <cstring>
+
+#if (defined __x86_64__ || defined __i386__)
+#include <x86intrin.h>
+#elif (defined _M_X64 || defined _M_IX86)
+#include <intrin.h>
+#endif
+
+#include "helpers.h"
+
+/** \page helpersTrace Binary Trace
+
+    \brief Low overhead binary tracing of events.
+
+    Trace events are static objects identified by their name and the names of their integer arguments. When the trace is started, the TRACE macro records the event id, a timestamp (the CPU's time stamp counter where available) and the arguments as a binary record into a lock-free ring buffer of the current thread. A background thread periodically flushes the buffers into the trace file so that the thread recording the events never waits for IO, or for other threads. If a buffer is full, the record is dropped and the number of dropped records is written to the trace instead.
+
+    When the trace is not started, TRACE costs a single relaxed atomic load. Log messages can be recorded in the trace as well by enabling the Trace::LogWriter() for the logs, which avoids the locking and timestamp formatting of the stream writers, but the messages are still formatted.
+
+    The trace file is decoded by the Trace::Reader, or by the `trace-decode` tool.
+ */
+
+#define TRACE(...) if (HELPERS_NAMESPACE_DECL::Trace::Enabled()) HELPERS_NAMESPACE_DECL::Trace::Record(__VA_ARGS__)
+
+HELPERS_NAMESPACE_BEGIN
+
+    class Trace {
+    public:
+
+        class Event;
+        class Writer;
+        class Reader;
+
+        /** Maximum number of arguments of a single event.
+         */
+        static constexpr size_t MAX_ARGS = 6;
+
+        /** Maximum length of a text record, longer log messages are truncated.
+         */
+        static constexpr size_t MAX_TEXT = 4096;
+
+        /** Size of the ring buffer of each thread, must be a power of two.
+         */
+        static constexpr size_t BUFFER_SIZE = 1024 * 1024;
+
+        /** Interval in which the ring buffers are flushed to the file (in ms).
+         */
+        static constexpr size_t FLUSH_INTERVAL = 50;
+
+        /** Determines whether the trace is being recorded.
+         */
+        static bool Enabled() {
+            return Enabled_.load(std::memory_order_relaxed);
+        }
+
+        /** Records the event with given arguments.
+
+            Use the TRACE macro instead, which only evaluates the arguments when the trace is enabled.
+         */
+        template<typename... ARGS>
+        static void Record(Event const & event, ARGS... args);
+
+        /** Starts recording the trace into given file.
+
+            Throws IOError if the file cannot be created.
+         */
+        static void Start(std::string const & filename);
+
+        /** Stops the trace, flushing all records recorded so far.
+         */
+        static void Stop() {
+            GetState().stop();
+        }
+
+        /** Returns the log writer that records the log messages in the trace.
+         */
+        static Writer & LogWriter();
+
+        /** Returns the current timestamp.
+
+            Uses the time stamp counter of the CPU where available as it is much cheaper than the system clocks. The trace contains clock records with pairs of timestamps and system times so that the timestamps can be converted to time.
+         */
+        static uint64_t Timestamp() {
+#if (defined __x86_64__ || defined __i386__ || defined _M_X64 || defined _M_IX86)
+            return __rdtsc();
+#else
+            return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+        }
+
+    private:
+
+        /** Kinds of blocks in the trace file.
+         */
+        enum class Block : uint8_t {
+            Definition = 1,
+            Clock = 2,
+            Records = 3,
+            Dropped = 4,
+        };
+
+        /** Header of a single record. The header is followed by the arguments, or the text of the record.
+         */
+        struct RecordHeader {
+            uint64_t timestamp;
+            uint32_t event;
+            /** Size of the record including the header. */
+            uint32_t size;
+        };
+
+        /** Single producer single consumer ring buffer of records of a thread.
+         */
+        class Buffer {
+        public:
+            explicit Buffer(uint32_t thread):
+                thread{thread},
+                data_{new char[BUFFER_SIZE]} {
+            }
+
+            ~Buffer() {
+                delete [] data_;
+            }
+
+            /** Appends the record, or drops it if there is not enough space. Called by the owning thread only.
+             */
+            void append(RecordHeader const & header, void const * payload) {
+                size_t head = head_.load(std::memory_order_relaxed);
+                if (header.size > BUFFER_SIZE - (head - tail_.load(std::memory_order_acquire))) {
+                    dropped.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+                copyIn(head, & header, sizeof(RecordHeader));
+                copyIn(head + sizeof(RecordHeader), payload, header.size - sizeof(RecordHeader));
+                head_.store(head + header.size, std::memory_order_release);
+            }
+
+            /** Moves all records from the buffer to given vector. Called by the flusher only.
+             */
+            void read(std::vector<char> & into) {
+                size_t head = head_.load(std::memory_order_acquire);
+                size_t tail = tail_.load(std::memory_order_relaxed);
+                into.resize(head - tail);
+                size_t offset = tail & (BUFFER_SIZE - 1);
+                size_t first = std::min(head - tail, BUFFER_SIZE - offset);
+                memcpy(into.data(), data_ + offset, first);
+                memcpy(into.data() + first, data_, head - tail - first);
+                tail_.store(head, std::memory_order_release);
+            }
+
+            /** Discards all records in the buffer. Called by the flusher only.
+             */
+            void discard() {
+                tail_.store(head_.load(std::memory_order_acquire), std::memory_order_release);
+                dropped = 0;
+            }
+
+            bool empty() const {
+                return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_relaxed);
+            }
+
+            uint32_t const thread;
+            std::atomic<uint64_t> dropped{0};
+            /** Set when the owning thread terminates so that the buffer can be deleted once flushed. */
+            std::atomic<bool> finished{false};
+
+        private:
+
+            void copyIn(size_t at, void const * from, size_t size) {
+                size_t offset = at & (BUFFER_SIZE - 1);
+                size_t first = std::min(size, BUFFER_SIZE - offset);
+                memcpy(data_ + offset, from, first);
+                memcpy(data_, static_cast<char const *>(from) + first, size - first);
+            }
+
+            char * data_;
+            std::atomic<size_t> head_{0};
+            std::atomic<size_t> tail_{0};
+        }; // Trace::Buffer
+
+        /** Registers the buffer of the current thread when the thread first records an event and marks it as finished when the thread terminates.
+         */
+        class ThreadBuffer {
+        public:
+            ThreadBuffer();
+
+            ~ThreadBuffer() {
+                buffer->finished = true;
+            }
+
+            Buffer * buffer;
+        }; // Trace::ThreadBuffer
+
+        /** The trace file, the registered buffers and the flusher thread.
+         */
+        class State {
+        public:
+            ~State() {
+                stop();
+                for (Buffer * b : buffers)
+                    delete b;
+            }
+
+            void start(std::string const & filename);
+
+            void stop();
+
+            void flush();
+
+            void writeBlock(Block kind, std::string const & body) {
+                uint32_t size = static_cast<uint32_t>(body.size());
+                file.put(static_cast<char>(kind));
+                file.write(pointer_cast<char const *>(& size), sizeof(size));
+                file.write(body.c_str(), body.size());
+            }
+
+            std::mutex m;
+            std::condition_variable flushRequest;
+            std::ofstream file;
+            std::thread flusher;
+            bool running = false;
+            std::vector<Buffer *> buffers;
+            uint32_t nextThread = 0;
+            /** Number of events whose definitions were already written to the file. */
+            size_t definitions = 0;
+        }; // Trace::State
+
+        static void Append(Event const & event, void const * payload, size_t size);
+
+        static State & GetState() {
+            static State state;
+            return state;
+        }
+
+        static std::mutex & EventsGuard() {
+            static std::mutex m;
+            return m;
+        }
+
+        static std::vector<Event const *> & Events() {
+            static std::vector<Event const *> events;
+            return events;
+        }
+
+        static inline std::atomic<bool> Enabled_{false};
+
+    }; // Trace
+
+    /** Trace event.
+
+        Events are expected to be static objects that exist for the entire duration of the trace. An event has either integer arguments, or text.
+     */
+    class Trace::Event {
+    public:
+
+        /** Creates new event with given name and names of its arguments.
+         */
+        Event(std::string const & name, std::initializer_list<char const *> args = {}):
+            name_{name},
+            args_{args.begin(), args.end()} {
+            ASSERT(args_.size() <= MAX_ARGS);
+            std::lock_guard<std::mutex> g{EventsGuard()};
+            id_ = static_cast<uint32_t>(Events().size());
+            Events().push_back(this);
+        }
+
+        Event(Event const &) = delete;
+        Event & operator = (Event const &) = delete;
+
+        uint32_t id() const {
+            return id_;
+        }
+
+        std::string const & name() const {
+            return name_;
+        }
+
+        std::vector<std::string> const & args() const {
+            return args_;
+        }
+
+        /** Text events record log messages instead of integer arguments.
+         */
+        bool text() const {
+            return text_;
+        }
+
+    private:
+
+        friend class Trace;
+
+        static Event * CreateText(std::string const & name) {
+            Event * result = new Event{name};
+            result->text_ = true;
+            return result;
+        }
+
+        uint32_t id_;
+        std::string name_;
+        std::vector<std::string> args_;
+        bool text_ = false;
+
+    }; // Trace::Event
+
+    /** Log writer that records the messages as text events in the trace.
+
+        Each log gets its own event named after the log. The message is formatted into a thread local stream, so unlike the stream writers, no lock is held while the message is being written.
+     */
+    class Trace::Writer : public Log::Writer {
+    public:
+
+        std::ostream & beginMessage(Log::Message const & message) override {
+            MARK_AS_UNUSED(message);
+            std::stringstream & s = Stream();
+            s.str("");
+            return s;
+        }
+
+        void endMessage(Log::Message const & message) override {
+            if (! Enabled())
+                return;
+            std::string text{Stream().str()};
+            Append(eventFor(message.log()), text.c_str(), std::min(text.size(), MAX_TEXT));
+        }
+
+    private:
+
+        static std::stringstream & Stream() {
+            thread_local std::stringstream s;
+            return s;
+        }
+
+        Event const & eventFor(Log & log) {
+            thread_local std::unordered_map<Log *, Event const *> cache;
+            auto i = cache.find(& log);
+            if (i != cache.end())
+                return *(i->second);
+            std::lock_guard<std::mutex> g{m_};
+            auto j = events_.find(& log);
+            if (j == events_.end())
+                j = events_.insert(std::make_pair(& log, Event::CreateText(log.name().empty() ? "LOG" : log.name()))).first;
+            cache.insert(*j);
+            return *(j->second);
+        }
+
+        std::mutex m_;
+        /** Events of the logs, never deleted as the threads keep them in their caches. */
+        std::unordered_map<Log *, Event const *> events_;
+
+    }; // Trace::Writer
+
+    /** Decodes the trace file.
+
+        The records of all threads are returned ordered by their timestamps.
+     */
+    class Trace::Reader {
+    public:
+
+        class EventInfo {
+        public:
+            std::string name;
+            std::vector<std::string> args;
+            bool text;
+        };
+
+        class Record {
+        public:
+            uint32_t thread;
+            uint64_t timestamp;
+            EventInfo const * event;
+            std::vector<int64_t> args;
+            std::string text;
+        };
+
+        /** Reads the entire trace from given stream. Throws IOError if the trace is not valid.
+         */
+        explicit Reader(std::istream & s) {
+            char magic[8];
+            s.read(magic, sizeof(magic));
+            if (! s.good() || strncmp(magic, MAGIC, sizeof(magic)) != 0)
+                THROW(IOError()) << "Not a trace file";
+            while (true) {
+                int kind = s.get();
+                if (kind == EOF)
+                    break;
+                uint32_t size;
+                s.read(pointer_cast<char *>(& size), sizeof(size));
+                std::string body(size, '\0');
+                s.read(& body[0], size);
+                if (! s.good())
+                    THROW(IOError()) << "Truncated trace file";
+                readBlock(static_cast<Block>(kind), body.c_str(), body.c_str() + size);
+            }
+            std::stable_sort(records_.begin(), records_.end(), [](Record const & a, Record const & b) {
+                return a.timestamp < b.timestamp;
+            });
+        }
+
+        std::vector<Record> const & records() const {
+            return records_;
+        }
+
+        /** Number of dropped records per thread.
+         */
+        std::unordered_map<uint32_t, uint64_t> const & dropped() const {
+            return dropped_;
+        }
+
+        /** Converts the timestamp to nanoseconds since the start of the trace.
+         */
+        double nanoseconds(uint64_t timestamp) const {
+            if (clock_.empty())
+                return 0;
+            auto const & first = clock_.front();
+            auto const & last = clock_.back();
+            double ratio = (last.first > first.first) ? static_cast<double>(last.second - first.second) / static_cast<double>(last.first - first.first) : 1.0;
+            return (static_cast<double>(timestamp) - static_cast<double>(first.first)) * ratio;
+        }
+
+    private:
+
+        void readBlock(Block kind, char const * i, char const * end) {
+            switch (kind) {
+                case Block::Definition: {
+                    uint32_t id = Read<uint32_t>(i, end);
+                    EventInfo & event = events_[id];
+                    event.text = Read<uint8_t>(i, end) != 0;
+                    event.name = ReadString(i, end);
+                    event.args.clear();
+                    while (i < end)
+                        event.args.push_back(ReadString(i, end));
+                    break;
+                }
+                case Block::Clock: {
+                    uint64_t timestamp = Read<uint64_t>(i, end);
+                    uint64_t ns = Read<uint64_t>(i, end);
+                    clock_.push_back(std::make_pair(timestamp, ns));
+                    break;
+                }
+                case Block::Records: {
+                    uint32_t thread = Read<uint32_t>(i, end);
+                    while (i < end) {
+                        RecordHeader header = Read<RecordHeader>(i, end);
+                        if (header.size < sizeof(RecordHeader) || i + header.size - sizeof(RecordHeader) > end)
+                            THROW(IOError()) << "Invalid trace record";
+                        auto e = events_.find(header.event);
+                        if (e == events_.end())
+                            THROW(IOError()) << "Undefined trace event " << header.event;
+                        Record r{thread, header.timestamp, & e->second, {}, {}};
+                        char const * payloadEnd = i + header.size - sizeof(RecordHeader);
+                        if (e->second.text) {
+                            r.text = std::string{i, payloadEnd};
+                            i = payloadEnd;
+                        } else {
+                            while (i < payloadEnd)
+                                r.args.push_back(Read<int64_t>(i, payloadEnd));
+                        }
+                        records_.push_back(std::move(r));
+                    }
+                    break;
+                }
+                case Block::Dropped: {
+                    uint32_t thread = Read<uint32_t>(i, end);
+                    dropped_[thread] += Read<uint64_t>(i, end);
+                    break;
+                }
+                default:
+                    THROW(IOError()) << "Invalid trace block " << static_cast<int>(kind);
+            }
+        }
+
+        template<typename T>
+        static T Read(char const * & i, char const * end) {
+            if (i + sizeof(T) > end)
+                THROW(IOError()) << "Truncated trace block";
+            T result;
+            memcpy(& result, i, sizeof(T));
+            i += sizeof(T);
+            return result;
+        }
+
+        static std::string ReadString(char const * & i, char const * end) {
+            char const * start = i;
+            while (i < end && *i != 0)
+                ++i;
+            if (i == end)
+                THROW(IOError()) << "Unterminated string in trace";
+            return std::string{start, i++};
+        }
+
+        std::unordered_map<uint32_t, EventInfo> events_;
+        std::vector<std::pair<uint64_t, uint64_t>> clock_;
+        std::vector<Record> records_;
+        std::unordered_map<uint32_t, uint64_t> dropped_;
+
+        static constexpr char const * MAGIC = "TPPTRACE";
+
+    }; // Trace::Reader
+
+    template<typename... ARGS>
+    inline void Trace::Record(Event const & event, ARGS... args) {
+        static_assert(sizeof...(ARGS) <= MAX_ARGS, "Too many trace event arguments");
+        ASSERT(! event.text() && event.args().size() == sizeof...(ARGS));
+        int64_t payload[] = { 0, static_cast<int64_t>(args)... };
+        Append(event, payload + 1, sizeof...(ARGS) * sizeof(int64_t));
+    }
+
+    inline void Trace::Start(std::string const & filename) {
+        GetState().start(filename);
+    }
+
+    inline Trace::Writer & Trace::LogWriter() {
+        static Writer writer;
+        return writer;
+    }
+
+    inline void Trace::Append(Event const & event, void const * payload, size_t size) {
+        thread_local ThreadBuffer buffer;
+        RecordHeader header{Timestamp(), event.id(), static_cast<uint32_t>(sizeof(RecordHeader) + size)};
+        buffer.buffer->append(header, payload);
+    }
+
+    inline Trace::ThreadBuffer::ThreadBuffer() {
+        State & state = GetState();
+        std::lock_guard<std::mutex> g{state.m};
+        buffer = new Buffer{state.nextThread++};
+        state.buffers.push_back(buffer);
+    }
+
+    inline void Trace::State::start(std::string const & filename) {
+        std::unique_lock<std::mutex> g{m};
+        if (running)
+            THROW(IOError()) << "Trace already started";
+        file.open(filename, std::ios::binary | std::ios::trunc);
+        if (! file.good())
+            THROW(IOError()) << "Unable to create trace file " << filename;
+        file.write("TPPTRACE", 8);
+        // records of previous traces which were not flushed are not part of this trace
+        for (Buffer * b : buffers)
+            b->discard();
+        definitions = 0;
+        running = true;
+        flush();
+        Enabled_ = true;
+        flusher = std::thread{[this]() {
+            std::unique_lock<std::mutex> g{m};
+            while (running) {
+                flushRequest.wait_for(g, std::chrono::milliseconds{FLUSH_INTERVAL});
+                if (running)
+                    flush();
+            }
+        }};
+    }
+
+    inline void Trace::State::stop() {
+        {
+            std::lock_guard<std::mutex> g{m};
+            if (! running)
+                return;
+            Enabled_ = false;
+            running = false;
+        }
+        flushRequest.notify_all();
+        flusher.join();
+        std::lock_guard<std::mutex> g{m};
+        flush();
+        file.close();
+    }
+
+    /** Expects the state lock to be held.
+     */
+    inline void Trace::State::flush() {
+        {
+            std::lock_guard<std::mutex> g{EventsGuard()};
+            for (size_t e = Events().size(); definitions < e; ++definitions) {
+                Event const * event = Events()[definitions];
+                std::string body;
+                uint32_t id = event->id();
+                body.append(pointer_cast<char const *>(& id), sizeof(id));
+                body.push_back(event->text() ? 1 : 0);
+                body.append(event->name().c_str(), event->name().size() + 1);
+                for (std::string const & arg : event->args())
+                    body.append(arg.c_str(), arg.size() + 1);
+                writeBlock(Block::Definition, body);
+            }
+        }
+        uint64_t clock[] = {
+            Timestamp(),
+            static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count())
+        };
+        writeBlock(Block::Clock, std::string{pointer_cast<char const *>(clock), sizeof(clock)});
+        std::vector<char> records;
+        for (auto i = buffers.begin(); i != buffers.end(); ) {
+            Buffer * b = *i;
+            // read the finished flag first so that no records can be added after the buffer is found empty
+            bool finished = b->finished;
+            b->read(records);
+            if (! records.empty()) {
+                std::string body{pointer_cast<char const *>(& b->thread), sizeof(uint32_t)};
+                body.append(records.data(), records.size());
+                writeBlock(Block::Records, body);
+            }
+            uint64_t dropped = b->dropped.exchange(0);
+            if (dropped != 0) {
+                std::string body{pointer_cast<char const *>(& b->thread), sizeof(uint32_t)};
+                body.append(pointer_cast<char const *>(& dropped), sizeof(dropped));
+                writeBlock(Block::Dropped, body);
+            }
+            if (finished) {
+                delete b;
+                i = buffers.erase(i);
+            } else {
+                ++i;
+            }
+        }
+        file.flush();
+    }
+
+HELPERS_NAMESPACE_END
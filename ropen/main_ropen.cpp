@@ -2,12 +2,15 @@
 #include <iostream>
 #include <fstream>
 #include <memory>
+#include <future>
 #include <filesystem>
 
 #include "helpers/helpers.h"
 #include "helpers/version.h"
 #include "helpers/filesystem.h"
 #include "helpers/json_config.h"
+#include "helpers/time.h"
+#include "helpers/hash.h"
 
 #include "tpp-lib/local_pty.h"
 #include "tpp-lib/terminal_client.h"
@@ -43,10 +46,16 @@ namespace tpp {
             unsigned
         );
         CONFIG_PROPERTY(
-            filename, 
-            "Local file to be opened on the remote machine",
-            JSON{""},
-            std::string
+            blockSize,
+            "Size of the blocks compared with the terminal's local copy of the file to skip unchanged data",
+            JSON{65536},
+            unsigned
+        );
+        CONFIG_PROPERTY(
+            files, 
+            "Local files, or directories whose files are to be opened on the remote machine",
+            JSON::Array(),
+            std::vector<std::string>
         );
         CONFIG_PROPERTY(
             verbose,
@@ -64,7 +73,7 @@ namespace tpp {
             Config & config = Instance();
             config.fillMissingValues();
             config.parseCommandLine(argc, argv);
-            if (! config.filename.updated())
+            if (! config.files.updated())
                 THROW(ArgumentError()) << "Input file must be specified";
             return config;
         }
@@ -74,34 +83,84 @@ namespace tpp {
         Config() {
             addArgument(timeout, {"--timeout", "-t"});
             addArgument(packetSize, {"--packet-size"});
+            addArgument(blockSize, {"--block-size"});
             addArgument(verbose, {"--verbose", "-v"}, "true");
             addArgument(adaptiveSpeed, {"--adaptive"});
-            addArgument(filename, {"--file", "-f"});
-            setDefaultArgument(filename);
+            addArgument(files, {"--file", "-f"});
+            setDefaultArgument(files);
         }
 
     }; // tpp::Config
 
+    /** Transfers local files to the terminal. 
+     
+        All files are opened at once and their data is interleaved over the single terminal connection in a round robin fashion, one packet per file at a time. Each file keeps its own packet limit. When the limit is reached, the transfer status of the file is requested asynchronously while the other files continue sending so that the status round trips of different files overlap. 
+     */
     class RemoteOpen {
     public:
 
         static constexpr size_t MIN_PACKET_LIMIT = 8;
 
-        static void Transfer(TerminalClient::Sync & t, std::string const & filename) {
+        /** Maximum number of blocks a file is split into for the hashes comparison. Larger files use larger blocks. 
+         */
+        static constexpr size_t MAX_BLOCKS = 4096;
+
+        static void Transfer(TerminalClient::Sync & t, std::vector<std::string> const & filenames) {
             RemoteOpen r{t, Config::Instance()};
-            r.openLocalFile(filename);
+            for (std::string const & filename : filenames)
+                r.addLocalFile(filename);
+            if (r.files_.empty())
+                THROW(IOError()) << "No files to transfer";
+            r.openTransfers();
+            r.compareBlocks();
             r.transfer();
             r.view();
+            r.report();
+        }
+
+        ~RemoteOpen() {
+            for (File * f : files_)
+                delete f;
         }
 
     private:
 
+        /** A single file being transferred. 
+         */
+        class File {
+        public:
+            std::string filename;
+            std::ifstream f;
+            size_t size = 0;
+            size_t sent = 0;
+            size_t streamId = 0;
+            size_t packetLimit;
+            /** Packets sent since the last transfer status check. */
+            size_t packets = 0;
+            /** Pending transfer status request, if any. */
+            std::future<Sequence::TransferStatus> status;
+            size_t blockSize = 0;
+            /** For each block, true if the terminal's local copy has identical block. */
+            std::vector<bool> same;
+
+            File(std::string const & filename, size_t packetLimit):
+                filename{filename},
+                packetLimit{packetLimit} {
+            }
+
+            bool done() const {
+                return sent == size && ! status.valid();
+            }
+        }; 
+
         RemoteOpen(TerminalClient::Sync & t, Config const & config):
             t_{t},
             adaptiveSpeed_{config.adaptiveSpeed()},
             packetSize_{config.packetSize()},
-            packetLimit_{config.packetLimit()},
-            initialPacketLimit_{packetLimit_} {
+            blockSize_{config.blockSize()},
+            initialPacketLimit_{config.packetLimit()},
+            total_{0},
+            sent_{0} {
             // register sigint handler so that we clear the terminal client properly
             struct sigaction sa;
             sigemptyset(&sa.sa_mask);
@@ -114,100 +173,249 @@ namespace tpp {
                 THROW(Exception()) << "Incompatible t++ version " << capabilities.version() << " (required version 1)";
         }
 
-        void openLocalFile(std::string const & filename) {
+        /** Adds the given file, or all regular files in the given directory to the transfer. 
+         */
+        void addLocalFile(std::string const & filename) {
+            std::string canonical;
             try {
-                std::string remoteHost = GetHostname();
-                LOG(Log::Verbose) << "Remote host: " << remoteHost;
-                std::string remoteFile = std::filesystem::canonical(filename);
-                LOG(Log::Verbose) << "Remote file canonical path: " << remoteFile;
-                f_.open(remoteFile);
-                if (!f_.good())
-                    throw false;
-                f_.seekg(0, std::ios_base::end);
-                size_ = f_.tellg();
-                LOG(Log::Verbose) << "    size: " << size_;
-                streamId_ = t_.openFileTransfer(remoteHost, remoteFile, size_);
-                LOG(Log::Verbose) << "Assigned stream id: " << streamId_;
+                canonical = std::filesystem::canonical(filename).string();
             } catch (...) {
                 THROW(IOError()) << "Unable to open file " << filename;
             }
+            if (std::filesystem::is_directory(canonical)) {
+                std::vector<std::string> contents;
+                for (auto const & entry : std::filesystem::directory_iterator(canonical))
+                    if (entry.is_regular_file())
+                        contents.push_back(entry.path().string());
+                std::sort(contents.begin(), contents.end());
+                for (std::string const & f : contents)
+                    addLocalFile(f);
+                return;
+            }
+            for (File * f : files_)
+                if (f->filename == canonical)
+                    return;
+            File * f = new File{canonical, initialPacketLimit_};
+            f->f.open(canonical, std::ios::binary);
+            if (! f->f.good()) {
+                delete f;
+                THROW(IOError()) << "Unable to open file " << filename;
+            }
+            f->f.seekg(0, std::ios_base::end);
+            f->size = f->f.tellg();
+            f->f.seekg(0, std::ios_base::beg);
+            LOG(Log::Verbose) << "Remote file canonical path: " << canonical << ", size: " << f->size;
+            total_ += f->size;
+            files_.push_back(f);
+        }
+
+        /** Opens the transfers for all files. 
+         
+            The requests are all in flight at the same time so that only a single round trip is paid for the handshake regardless of the number of files. 
+         */
+        void openTransfers() {
+            std::string remoteHost = GetHostname();
+            LOG(Log::Verbose) << "Remote host: " << remoteHost;
+            std::vector<std::future<Sequence::Ack>> acks;
+            for (File * f : files_)
+                acks.push_back(t_.requestOpenFileTransfer(remoteHost, f->filename, f->size, t_.timeout(), t_.attempts()));
+            for (size_t i = 0, e = files_.size(); i < e; ++i) {
+                files_[i]->streamId = acks[i].get().id();
+                LOG(Log::Verbose) << "Assigned stream id: " << files_[i]->streamId << " (" << files_[i]->filename << ")";
+            }
+        }
+
+        /** Obtains the block hashes of the terminal's local copies and determines which blocks do not have to be transferred. 
+         
+            Hashes of all files are requested at once. If the terminal does not support the block hashes, all files are transferred in their entirety, as are files so large that their blocks would exceed the maximum block size.
+         */
+        void compareBlocks() {
+            std::vector<std::future<Sequence::BlockHashes>> hashes;
+            for (File * f : files_) {
+                f->blockSize = std::max({blockSize_, packetSize_, (f->size + MAX_BLOCKS - 1) / MAX_BLOCKS});
+                if (f->blockSize <= Sequence::GetBlockHashes::MAX_BLOCK_SIZE)
+                    hashes.push_back(t_.requestBlockHashes(f->streamId, f->blockSize, t_.timeout(), 1));
+                else
+                    hashes.push_back(std::future<Sequence::BlockHashes>{});
+            }
+            std::unique_ptr<char[]> buffer;
+            for (size_t i = 0, e = files_.size(); i < e; ++i) {
+                File * f = files_[i];
+                if (! hashes[i].valid()) {
+                    LOG(Log::Verbose) << "Stream " << f->streamId << ": file too large for block hashes, transferring whole file";
+                    continue;
+                }
+                try {
+                    Sequence::BlockHashes remote{hashes[i].get()};
+                    if (remote.size() == 0)
+                        continue;
+                    buffer.reset(new char[f->blockSize]);
+                    size_t numSame = 0;
+                    for (size_t block = 0; block < remote.hashes().size(); ++block) {
+                        size_t offset = block * f->blockSize;
+                        if (offset >= f->size)
+                            break;
+                        size_t size = std::min(f->blockSize, f->size - offset);
+                        size_t remoteSize = std::min(f->blockSize, remote.size() - offset);
+                        f->f.read(buffer.get(), size);
+                        bool same = (size == remoteSize) && (FNV1a64(buffer.get(), size) == remote.hashes()[block]);
+                        f->same.push_back(same);
+                        if (same)
+                            ++numSame;
+                    }
+                    f->f.clear();
+                    f->f.seekg(0, std::ios_base::beg);
+                    LOG(Log::Verbose) << "Stream " << f->streamId << ": " << numSame << " of " << f->same.size() << " cached blocks unchanged";
+                } catch (TimeoutError const &) {
+                    LOG(Log::Verbose) << "Block hashes not supported by the terminal, transferring whole files";
+                } catch (NackError const & e) {
+                    LOG(Log::Verbose) << "Block hashes not available for stream " << f->streamId << ": " << e.what();
+                }
+            }
         }
 
         void transfer() {
-            std::unique_ptr<char> buffer{new char[packetSize_]};
-            LOG(Log::Verbose) << "Transferring, packet limit: " << packetLimit_;
-            f_.seekg(0, std::ios_base::beg);
-            sent_ = 0;
-            size_t packets = 0;
-            while (sent_ != size_) {
+            std::unique_ptr<char[]> buffer{new char[packetSize_]};
+            LOG(Log::Verbose) << "Transferring " << files_.size() << " file(s), packet limit: " << initialPacketLimit_;
+            stopwatch_.start();
+            while (true) {
                 if (Interrupted_)
                     THROW(Exception()) << "Interrupted";
-                f_.read(buffer.get(), packetSize_);
-                size_t pSize = f_.gcount();
-                // TODO this is a memory copy, can be done more effectively by having a non-ownership version of the Data message. 
-                Sequence::Data d{streamId_, sent_, buffer.get(), buffer.get() + pSize};
-                t_.send(d);
-                sent_ += pSize;
-                if (++packets == packetLimit_ || sent_ == size_) {
-                    packets = 0;
-                    checkTransferStatus();
+                bool finished = true;
+                bool progress = false;
+                for (File * f : files_) {
+                    if (f->done())
+                        continue;
+                    finished = false;
+                    // if the file waits for its transfer status, check whether it has arrived, otherwise skip the file for now
+                    if (f->status.valid()) {
+                        if (f->status.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                            continue;
+                        checkTransferStatus(f);
+                        progress = true;
+                        if (f->done())
+                            continue;
+                    }
+                    // packets never cross block boundaries so that unchanged blocks can be skipped as a whole
+                    size_t block = f->sent / f->blockSize;
+                    size_t blockEnd = std::min((block + 1) * f->blockSize, f->size);
+                    size_t pSize = 0;
+                    if (f->sent == block * f->blockSize && block < f->same.size() && f->same[block]) {
+                        pSize = blockEnd - f->sent;
+                        t_.send(Sequence::SkipData{f->streamId, f->sent, pSize});
+                        f->f.seekg(blockEnd);
+                    } else {
+                        f->f.read(buffer.get(), std::min(packetSize_, blockEnd - f->sent));
+                        pSize = f->f.gcount();
+                        // TODO this is a memory copy, can be done more effectively by having a non-ownership version of the Data message. 
+                        Sequence::Data d{f->streamId, f->sent, buffer.get(), buffer.get() + pSize};
+                        t_.send(d);
+                    }
+                    f->sent += pSize;
+                    sent_ += pSize;
+                    progress = true;
+                    if (++f->packets == f->packetLimit || f->sent == f->size) {
+                        f->packets = 0;
+                        f->status = t_.requestTransferStatus(f->streamId, t_.timeout(), t_.attempts());
+                    }
+                }
+                if (finished)
+                    break;
+                // all remaining files are waiting for their status, block until the first one arrives
+                if (! progress) {
+                    for (File * f : files_)
+                        if (f->status.valid()) {
+                            f->status.wait();
+                            break;
+                        }
+                } else {
                     progressBar();
                 }
             }
+            stopwatch_.stop();
         }
 
-        void checkTransferStatus() {
-            Sequence::TransferStatus ts{t_.getTransferStatus(streamId_)};
-            if (ts.received() == sent_) {
-                if (adaptiveSpeed_ && packetLimit_ < initialPacketLimit_) {
-                    packetLimit_ <<= 2;
-                    LOG(Log::Verbose) << "Packet limit increased to " << packetLimit_; 
+        /** Processes the transfer status received for given file. 
+         
+            If the terminal received everything that was sent, the packet limit for the file may grow, otherwise it is decreased and the file is rewound to the last offset the terminal has received. 
+         */
+        void checkTransferStatus(File * f) {
+            Sequence::TransferStatus ts{f->status.get()};
+            if (ts.received() == f->sent) {
+                if (adaptiveSpeed_ && f->packetLimit < initialPacketLimit_) {
+                    f->packetLimit <<= 2;
+                    LOG(Log::Verbose) << "Packet limit for stream " << f->streamId << " increased to " << f->packetLimit; 
                 }
             } else {
-                LOG(Log::Verbose) << "Mismatch: sent " << sent_ << ", received " << ts.received();
-                sent_ = ts.received();
-                f_.clear();
-                f_.seekg(sent_);
-                if (adaptiveSpeed_ && (packetLimit_ > MIN_PACKET_LIMIT)) {
-                    packetLimit_ >>= 1;
-                    LOG(Log::Verbose) << "Packet limit decreased to " << packetLimit_; 
+                LOG(Log::Verbose) << "Mismatch on stream " << f->streamId << ": sent " << f->sent << ", received " << ts.received();
+                sent_ -= f->sent - ts.received();
+                f->sent = ts.received();
+                f->f.clear();
+                f->f.seekg(f->sent);
+                if (adaptiveSpeed_ && (f->packetLimit > MIN_PACKET_LIMIT)) {
+                    f->packetLimit >>= 1;
+                    LOG(Log::Verbose) << "Packet limit for stream " << f->streamId << " decreased to " << f->packetLimit; 
                 }
             }
         }
 
         void view() {
-            LOG(Log::Verbose) << "Opening remote file...";
-            t_.viewRemoteFile(streamId_);
+            LOG(Log::Verbose) << "Opening remote file(s)...";
+            std::vector<std::future<Sequence::Ack>> acks;
+            for (File * f : files_)
+                acks.push_back(t_.requestViewRemoteFile(f->streamId, t_.timeout(), t_.attempts()));
+            for (auto & ack : acks)
+                ack.get();
+        }
+
+        /** Reports the aggregate throughput of the transfer. 
+         */
+        void report() {
+            size_t ms = std::max(stopwatch_.value(), static_cast<size_t>(1));
+            size_t skipped = 0;
+            for (File * f : files_)
+                for (size_t block = 0, e = f->same.size(); block < e; ++block)
+                    if (f->same[block])
+                        skipped += std::min((block + 1) * f->blockSize, f->size) - block * f->blockSize;
+            LOG() << files_.size() << " file(s), " << total_ << " bytes (" << (total_ - skipped) << " transferred) in " << ms << " ms (" << (total_ * 1000 / ms / 1024) << " KiB/s)";
         }
 
         void progressBar() {
             int barWidth = t_.size().first;
             // TODO sometimes terminal size returns 0,0, why? 
             barWidth = (barWidth == 0) ? 37 : (barWidth - 3);
-            int progress = (barWidth * sent_) / size_;
+            int progress = total_ == 0 ? barWidth : static_cast<int>((barWidth * sent_) / total_);
             std::cout << "[" << progressBarColor();
             for (int i = 0; i < barWidth; ++i)
                 std::cout << ((i <= progress) ? "#" : " ");
             std::cout << "\033[0m]\033[0K\r" << std::flush;
         }
 
+        /** The color reflects the worst packet limit of all files being transferred. 
+         */
         char const * progressBarColor() {
-            if (packetLimit_ == initialPacketLimit_)
+            size_t packetLimit = initialPacketLimit_;
+            for (File * f : files_)
+                if (! f->done())
+                    packetLimit = std::min(packetLimit, f->packetLimit);
+            if (packetLimit == initialPacketLimit_)
                 return "\033[32m";
-            if (packetLimit_ == MIN_PACKET_LIMIT)
+            if (packetLimit == MIN_PACKET_LIMIT)
                 return "\033[91m";
             return "\033[22m";
         }
 
         TerminalClient::Sync & t_;
-        std::ifstream f_;
-        size_t size_;
-        size_t sent_;
-        size_t streamId_;
+        std::vector<File *> files_;
         bool adaptiveSpeed_;
         size_t packetSize_;
-        size_t packetLimit_;
+        size_t blockSize_;
         size_t initialPacketLimit_;
+        /** Total size of all files. */
+        size_t total_;
+        /** Bytes sent (or skipped) across all files. */
+        size_t sent_;
+        Stopwatch stopwatch_;
 
         static volatile bool Interrupted_;
 
@@ -245,7 +453,7 @@ int main(int argc, char * argv[]) {
     		Log::Enable(Log::StdOutWriter(), { Log::Verbose()});
         // create the terminal client and transfer the file
         TerminalClient::Sync t{new LocalPTYSlave{}};
-        RemoteOpen::Transfer(t, Config::Instance().filename());
+        RemoteOpen::Transfer(t, Config::Instance().files());
         // clear the progressbar
         std::cout << "\033[0K";
         return EXIT_SUCCESS;
@@ -0,0 +1,17 @@
+/* AUTOGENERATED FILE, DO NOT EDIT! 
+   This file was produced by the following command:
+  /tmp/xbuild/stamp-generator /root/repo/stamp.h
+ */
+#pragma once
+#include<string_view>
+namespace stamp {
+    std::string_view constexpr version               = "0.8.4";
+    std::string_view constexpr arch                  = "Linux";
+    std::string_view constexpr arch_size             = "64";
+    std::string_view constexpr arch_compiler         = "GNU";
+    std::string_view constexpr arch_compiler_version = "12.2.0";
+    std::string_view constexpr build                 = "debug";
+    std::string_view constexpr build_time            = "2026-10-19T19:17:50Z";
+    std::string_view constexpr commit                = "038416c1fa17aa25a869e46b3738f6e2601d0d95";
+    bool             constexpr dirty                 = true;
+} // namespace stamp
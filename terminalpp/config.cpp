@@ -4,6 +4,11 @@
 
 #include "application.h"
 #include "config.h"
+#include "startup_profile.h"
+
+#if (defined ARCH_UNIX && defined RENDERER_NATIVE)
+#include <fontconfig/fontconfig.h>
+#endif
 
 namespace tpp { 
 
@@ -153,18 +158,41 @@ namespace tpp {
 		return JSON{JoinPath(JoinPath(TempDir(), "terminalpp"),"remoteFiles")};
 	}
 
+	JSON Config::DefaultSnapshotsDir() {
+		return JSON{JoinPath(GetSettingsFolder(), "snapshots")};
+	}
+
 	JSON Config::DefaultFontFamily() {
 #if (defined ARCH_WINDOWS)
 		return JSON{"Consolas"};
 #elif (defined ARCH_MACOS)
         return JSON{"Courier New"};
 #else
+        // the default is calculated for both single and double width fonts, but only needs to be discovered once
+        static std::string discovered;
+        if (! discovered.empty())
+            return JSON{discovered};
+        StartupProfile::Scope profile{"font discovery"};
+        // try the family discovered by previous runs first, which saves checking the candidates that are not installed
+        std::string cacheFile{JoinPath(GetSettingsFolder(), "default-font")};
+        {
+            std::ifstream f{cacheFile};
+            std::string cached;
+            if (f.good() && std::getline(f, cached) && ! cached.empty() && IsFontFamilyInstalled(cached)) {
+                discovered = cached;
+                return JSON{discovered};
+            }
+        }
 		char const * fonts[] = { "Monospace", "DejaVu Sans Mono", "Nimbus Mono", "Liberation Mono", nullptr };
 		char const ** f = fonts;
 		while (*f != nullptr) {
-			std::string found{Exec(Command("fc-list", { *f }))};
-			if (! found.empty())
-			    return JSON{*f};
+			if (IsFontFamilyInstalled(*f)) {
+                discovered = *f;
+                CreatePath(GetSettingsFolder());
+                std::ofstream cache{cacheFile};
+                cache << discovered << std::endl;
+			    return JSON{discovered};
+            }
 			++f;
 		}
 		Application::Instance()->alert("Cannot guess valid font - please specify manually for best results");
@@ -172,6 +200,29 @@ namespace tpp {
 #endif
 	}
 
+#if (defined ARCH_UNIX && ! defined ARCH_MACOS)
+
+    /** With the native renderer, fontconfig is queried directly as it has to be initialized for the X11 fonts anyways, which is much faster than spawning `fc-list` for each font family. 
+     */
+    bool Config::IsFontFamilyInstalled(std::string const & family) {
+#if (defined RENDERER_NATIVE)
+        FcPattern * pattern = FcPatternCreate();
+        FcPatternAddString(pattern, FC_FAMILY, pointer_cast<FcChar8 const *>(family.c_str()));
+        FcObjectSet * objects = FcObjectSetBuild(FC_FAMILY, nullptr);
+        FcFontSet * fonts = FcFontList(nullptr, pattern, objects);
+        bool result = fonts != nullptr && fonts->nfont > 0;
+        if (fonts != nullptr)
+            FcFontSetDestroy(fonts);
+        FcObjectSetDestroy(objects);
+        FcPatternDestroy(pattern);
+        return result;
+#else
+        return ! Exec(Command("fc-list", { family })).empty();
+#endif
+    }
+
+#endif
+
 	JSON Config::DefaultDoubleWidthFontFamily() {
 		return DefaultFontFamily();
 	}
@@ -263,6 +263,18 @@ namespace tpp {
                 JSON::Array(),
                 std::vector<std::reference_wrapper<Log>>
             );
+            CONFIG_PROPERTY(
+                metricsSocket,
+                "Path of the local Unix socket that serves the performance counters of the terminal sessions and the renderer in the Prometheus text format, disabled if empty (not available on Windows)",
+                JSON{""},
+                std::string
+            );
+            CONFIG_PROPERTY(
+                trace,
+                "If true, the processed terminal input is recorded into a binary trace next to the telemetry log, which can be decoded by the trace-decode tool",
+                JSON{false},
+                bool
+            );
         );
         CONFIG_OBJECT(
             renderer,
@@ -411,6 +423,12 @@ namespace tpp {
                     JSON{10000},
                     int
                 );
+                CONFIG_PROPERTY(
+                    historyInMemory,
+                    "Determines the maximum number of the most recent history lines kept in memory. Older lines are spilled to a temporary file and read back when displayed. If set to 0, the whole history is kept in memory.",
+                    JSON{0},
+                    int
+                );
             );
         );
         CONFIG_OBJECT(
@@ -469,6 +487,22 @@ namespace tpp {
                 std::string
             );
         );
+        CONFIG_OBJECT(
+            snapshots,
+            "Settings for saving the sessions to the disk so that they can be restored after the terminal has been killed.",
+            CONFIG_PROPERTY(
+                interval,
+                "Interval in seconds in which the state and history of the running sessions are saved, and saved once more when the window is closed. A new session restores the snapshot of a session of the same name that has not terminated. If 0, the sessions are not saved.",
+                JSON{0},
+                unsigned
+            );
+            CONFIG_PROPERTY(
+                dir,
+                "Directory in which the snapshots of the sessions are stored.",
+                DefaultSnapshotsDir,
+                std::string
+            );
+        );
         CONFIG_OBJECT(
             sessionDefaults,
             "Default values for session properties. These will be used when a session does not override the values",
@@ -786,10 +820,18 @@ namespace tpp {
 
 		static JSON DefaultRemoteFilesDir();		
 
+		static JSON DefaultSnapshotsDir();
+
 		static JSON DefaultFontFamily();
 
 		static JSON DefaultDoubleWidthFontFamily();
 
+    #if (defined ARCH_UNIX && ! defined ARCH_MACOS)
+        /** Determines whether a font family of given name is installed. 
+         */
+        static bool IsFontFamilyInstalled(std::string const & family);
+    #endif
+
         //static JSON DefaultSessions();
 
         //@}
@@ -0,0 +1,159 @@
+#include <fstream>
+#include <sstream>
+
+#include "helpers/filesystem.h"
+#include "helpers/json.h"
+
+#include "font.h"
+
+namespace tpp {
+
+    std::mutex FallbackCache::M_;
+    bool FallbackCache::Loaded_ = false;
+    bool FallbackCache::Dirty_ = false;
+    std::unordered_map<std::string, FallbackCache::Entry> FallbackCache::Entries_;
+
+    FallbackCache::Entry FallbackCache::Get(std::string const & font) {
+        std::lock_guard<std::mutex> g{M_};
+        Load();
+        auto i = Entries_.find(font);
+        return i == Entries_.end() ? Entry{} : i->second;
+    }
+
+    void FallbackCache::AddFallback(std::string const & font, char32_t codepoint, Ranges const & coverage) {
+        std::lock_guard<std::mutex> g{M_};
+        Load();
+        std::vector<Fallback> & fallbacks = Entries_[font].fallbacks;
+        for (Fallback & f : fallbacks) {
+            if (f.codepoint == codepoint) {
+                f.coverage = coverage;
+                Dirty_ = true;
+                return;
+            }
+        }
+        fallbacks.push_back(Fallback{codepoint, coverage});
+        Dirty_ = true;
+    }
+
+    void FallbackCache::AddMissing(std::string const & font, char32_t codepoint) {
+        std::lock_guard<std::mutex> g{M_};
+        Load();
+        Entry & entry = Entries_[font];
+        // the fallback cached for the codepoint, if any, no longer exists
+        for (auto i = entry.fallbacks.begin(), e = entry.fallbacks.end(); i != e; ++i) {
+            if (i->codepoint == codepoint) {
+                entry.fallbacks.erase(i);
+                break;
+            }
+        }
+        auto i = entry.missing.begin();
+        while (i != entry.missing.end() && i->second < codepoint)
+            ++i;
+        if (i != entry.missing.end() && i->first <= codepoint)
+            return;
+        entry.missing.insert(i, std::make_pair(codepoint, codepoint));
+        Dirty_ = true;
+    }
+
+    void FallbackCache::Flush() {
+        std::lock_guard<std::mutex> g{M_};
+        if (! Dirty_)
+            return;
+        Dirty_ = false;
+        Save();
+    }
+
+    void FallbackCache::Load() {
+        if (Loaded_)
+            return;
+        Loaded_ = true;
+        std::ifstream f{JoinPath(Config::GetSettingsFolder(), "fallback-fonts.json")};
+        if (! f.good())
+            return;
+        try {
+            JSON json = JSON::Parse(f);
+            for (auto i = json.begin(), e = json.end(); i != e; ++i) {
+                Entry & entry = Entries_[i.name()];
+                JSON const & fallbacks = (*i)["fallbacks"];
+                for (auto const & fallback : fallbacks)
+                    entry.fallbacks.push_back(Fallback{
+                        static_cast<char32_t>(fallback["codepoint"].toInt()),
+                        DecodeRanges(fallback["coverage"].toString())
+                    });
+                entry.missing = DecodeRanges((*i)["missing"].toString());
+            }
+        } catch (std::exception const & e) {
+            LOG() << "Invalid fallback fonts cache, ignoring: " << e.what();
+            Entries_.clear();
+        }
+    }
+
+    /** The cache is written to a temporary file first and then renamed so that an interrupted write never leaves a truncated cache behind.
+     */
+    void FallbackCache::Save() {
+        JSON json = JSON::Object();
+        for (auto const & i : Entries_) {
+            JSON fallbacks = JSON::Array();
+            for (Fallback const & f : i.second.fallbacks) {
+                JSON fallback = JSON::Object();
+                fallback.add("codepoint", JSON{static_cast<int>(f.codepoint)});
+                fallback.add("coverage", JSON{EncodeRanges(f.coverage)});
+                fallbacks.add(std::move(fallback));
+            }
+            JSON entry = JSON::Object();
+            entry.add("fallbacks", std::move(fallbacks));
+            entry.add("missing", JSON{EncodeRanges(i.second.missing)});
+            json.add(i.first, std::move(entry));
+        }
+        CreatePath(Config::GetSettingsFolder());
+        std::string filename = JoinPath(Config::GetSettingsFolder(), "fallback-fonts.json");
+        std::string tmp = filename + ".tmp";
+        {
+            std::ofstream f{tmp};
+            f << json;
+            f.close();
+            if (! f.good())
+                THROW(IOError()) << "Unable to write to the fallback fonts cache " << tmp;
+        }
+        Rename(tmp, filename);
+    }
+
+    /** The ranges are encoded as comma separated hexadecimal codepoints, or dash separated pairs of them, which is much more compact than JSON arrays for fonts with thousands of ranges.
+     */
+    std::string FallbackCache::EncodeRanges(Ranges const & ranges) {
+        std::stringstream result;
+        result << std::hex;
+        for (auto const & range : ranges) {
+            if (result.tellp() > 0)
+                result << ',';
+            result << static_cast<uint32_t>(range.first);
+            if (range.second != range.first)
+                result << '-' << static_cast<uint32_t>(range.second);
+        }
+        return result.str();
+    }
+
+    FallbackCache::Ranges FallbackCache::DecodeRanges(std::string const & str) {
+        Ranges result;
+        char const * i = str.c_str();
+        while (*i != 0) {
+            char * end;
+            uint32_t first = static_cast<uint32_t>(strtoul(i, & end, 16));
+            uint32_t last = first;
+            if (end == i)
+                THROW(IOError()) << "Invalid codepoint range " << str;
+            if (*end == '-') {
+                i = end + 1;
+                last = static_cast<uint32_t>(strtoul(i, & end, 16));
+                if (end == i || last < first)
+                    THROW(IOError()) << "Invalid codepoint range " << str;
+            }
+            result.push_back(std::make_pair(static_cast<char32_t>(first), static_cast<char32_t>(last)));
+            i = end;
+            if (*i == ',')
+                ++i;
+        }
+        return result;
+    }
+
+} // namespace tpp
@@ -1,6 +1,13 @@
 #pragma once
 
+#include <map>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <unordered_set>
 #include <unordered_map>
+#include <condition_variable>
 
 #include "helpers/helpers.h"
 #include "helpers/char.h"
@@ -9,6 +16,8 @@
 #include "ui/geometry.h"
 
 #include "config.h"
+#include "renderer_metrics.h"
+#include "startup_profile.h"
 
 namespace tpp {
 
@@ -88,6 +97,60 @@ namespace tpp {
 
     }; // tpp::FontMetrics
 
+    /** Persistent cache of the fallback fonts coverage. 
+
+        For each base font remembers the codepoint ranges covered by its fallback fonts and the codepoints no font covers at all so that the next runs do not have to search for the fallbacks. The fallback fonts are identified by the codepoint they were originally resolved for, which is enough to resolve them again. The cache is stored in the settings folder and can be safely deleted, which is also the way to forget the missing codepoints once new fonts are installed. 
+
+        Changes are only kept in memory until flushed so that resolving a burst of codepoints writes the file once. 
+
+        All methods are thread safe. 
+     */
+    class FallbackCache {
+    public:
+
+        /** Inclusive codepoint ranges, ordered. */
+        using Ranges = std::vector<std::pair<char32_t, char32_t>>;
+
+        class Fallback {
+        public:
+            char32_t codepoint;
+            Ranges coverage;
+        }; // tpp::FallbackCache::Fallback
+
+        class Entry {
+        public:
+            /** The fallback fonts in the order they were resolved. */
+            std::vector<Fallback> fallbacks;
+            Ranges missing;
+        }; // tpp::FallbackCache::Entry
+
+        /** Returns the cached fallbacks of the given base font. 
+         */
+        static Entry Get(std::string const & font);
+
+        static void AddFallback(std::string const & font, char32_t codepoint, Ranges const & coverage);
+
+        static void AddMissing(std::string const & font, char32_t codepoint);
+
+        /** Writes the cache to the disk if it has changed since the last flush. 
+         */
+        static void Flush();
+
+    private:
+
+        static void Load();
+        static void Save();
+
+        static std::string EncodeRanges(Ranges const & ranges);
+        static Ranges DecodeRanges(std::string const & str);
+
+        static std::mutex M_;
+        static bool Loaded_;
+        static bool Dirty_;
+        static std::unordered_map<std::string, Entry> Entries_;
+
+    }; // tpp::FallbackCache
+
     /** Base template for fonts used in the terminal window renderers. 
      
         Handles the mechanism for caching the already configured fonts in different sizes and their fallback alternatives for various characters
@@ -106,9 +169,13 @@ namespace tpp {
             size_t id = CreateIdFrom(font, fontHeight);
             auto i = Fonts_.find(id);
             if (i == Fonts_.end()) {
+                RendererMetrics::Instance().fontMisses.add();
+                StartupProfile::Scope profile{"font load"};
                 T * f = new T(font, fontHeight, 0);
                 f->adjustCellSize();
                 i = Fonts_.insert(std::make_pair(id, f)).first;
+            } else {
+                RendererMetrics::Instance().fontHits.add();
             }
             return i->second;
         }
@@ -122,29 +189,68 @@ namespace tpp {
             size_t id = CreateIdFrom(font, fontSize.height());
             auto i = Fonts_.find(id);
             if (i == Fonts_.end()) {
+                RendererMetrics::Instance().fontMisses.add();
+                StartupProfile::Scope profile{"font load"};
                 T * f = new T(font, fontSize.height(), fontSize.width());
                 f->adjustCellSize();
                 i = Fonts_.insert(std::make_pair(id, f)).first;
+            } else {
+                RendererMetrics::Instance().fontHits.add();
             }
             return i->second;
         }
 
         /** Returns a font that provides fallback for given character codepoint.
 
-            Always returns a font, but if a suitable callback cannot be found, the returned font will not render the character properly.  
+            The fallback fonts are looked up in a coverage index that maps codepoint ranges to the fallback fonts already resolved, so that a lookup is logarithmic in the number of ranges instead of asking each fallback font whether it supports the codepoint. Codepoints not in the index are resolved asynchronously by a background thread because searching the system fonts may take a long time. Until the fallback is ready, the font itself is returned as a placeholder, i.e. the character is drawn as missing, and all windows are repainted once the fallback is resolved. The fonts found by the resolver are opened here, on the UI thread, when they are merged into the index. 
+
+            Always returns a font, but if a suitable fallback cannot be found, or is not resolved yet, the returned font will not render the character properly.  
          */
         T * fallbackFor(char32_t codepoint) {
-			std::vector<T*> & fallbackCache = FallbackFonts_[CreateIdFrom(font_, fontSize_.height())];
-            for (auto i : fallbackCache) {
-				if (i != this && i->supportsCodepoint(codepoint))
-                    return i;
-			}
-			// if the character we search the fallback for is double width increase the cell width now
-			//cellWidth *= Char::ColumnWidth(codepoint);
-            T * f = new T(*static_cast<T const *>(this), codepoint);
-            f->adjustCellSize();
-            fallbackCache.push_back(f);
-            return f;
+            FallbackIndex & index = fallbackIndex();
+            {
+                std::vector<Resolution> resolved;
+                {
+                    std::lock_guard<std::mutex> g{Resolver_.m};
+                    std::swap(resolved, index.resolved);
+                }
+                for (Resolution & r : resolved)
+                    index.merge(r);
+            }
+            auto i = index.find(codepoint);
+            if (i != index.ranges.end()) {
+                switch (i->second.state) {
+                    case FallbackState::Resolved:
+                        RendererMetrics::Instance().fallbackHits.add();
+                        return i->second.font;
+                    case FallbackState::Unresolved:
+                        request(index, i->second.codepoint);
+                        break;
+                    case FallbackState::Missing:
+                        break;
+                }
+                RendererMetrics::Instance().fallbackMisses.add();
+                return static_cast<T*>(this);
+            }
+            RendererMetrics::Instance().fallbackMisses.add();
+            // the fallbacks that only report coverage of the codepoint they were resolved for may still support the codepoint
+            for (T * f : index.fonts) {
+                if (f->supportsCodepoint(codepoint)) {
+                    Assign(index.ranges, codepoint, codepoint, Fallback{codepoint, FallbackState::Resolved, f, codepoint});
+                    return f;
+                }
+            }
+            request(index, codepoint);
+            return static_cast<T*>(this);
+        }
+
+        /** Sets the function to be called when a fallback font has been resolved. 
+         
+            The handler is called from the resolver thread. 
+         */
+        static void SetFallbackResolvedHandler(std::function<void()> handler) {
+            std::lock_guard<std::mutex> g{Resolver_.m};
+            Resolver_.onResolved = handler;
         }
 
     protected:
@@ -191,18 +297,300 @@ namespace tpp {
             return ui::Size{w, h};
         }
 
+        /** Finds the fallback font for the given codepoint. 
+
+            Called by the resolver thread, fills in the coverage of the fallback and returns the function that opens it, which is called on the UI thread, or an empty function if no font supports the codepoint. By default the font is created right away, which is only safe if the renderer's font API can be used from any thread. Implementations should otherwise only search for the font here. 
+         */
+        static std::function<T*()> MatchFallback(T const & base, char32_t codepoint, FallbackCache::Ranges & coverage) {
+            T * f = new T(base, codepoint);
+            if (! f->supportsCodepoint(codepoint)) {
+                delete f;
+                return nullptr;
+            }
+            coverage = f->coverage(codepoint);
+            return [f]() {
+                return f;
+            };
+        }
+
+        /** Returns the codepoint ranges supported by the font, which has been created as a fallback for the given codepoint. 
+
+            Implementations that can enumerate the characters supported by the font should override the method, by default only the codepoint itself is reported.
+         */
+        FallbackCache::Ranges coverage(char32_t codepoint) const {
+            return FallbackCache::Ranges{{codepoint, codepoint}};
+        }
+
     private:
-        
+
+        enum class FallbackState {
+            /** The fallback font is known. */
+            Resolved,
+            /** The fallback font is known from the cache, but must be resolved for the codepoint first. */
+            Unresolved,
+            /** There is no font that supports the codepoint. */
+            Missing,
+        }; 
+
+        /** A range of codepoints in the coverage index. 
+         */
+        class Fallback {
+        public:
+            /** Last codepoint of the range, the first is the index key. */
+            char32_t last;
+            FallbackState state;
+            T * font;
+            /** The codepoint the fallback font has been, or should be resolved for. */
+            char32_t codepoint;
+        };
+
+        /** Fallback font resolved by the resolver thread. 
+         */
+        class Resolution {
+        public:
+            char32_t codepoint;
+            /** Opens the fallback font, empty if no font supports the codepoint. */
+            std::function<T*()> open;
+            FallbackCache::Ranges coverage;
+        };
+
+        class FallbackIndex {
+        public:
+            /** Non-overlapping codepoint ranges indexed by their first codepoint. */
+            std::map<char32_t, Fallback> ranges;
+            /** The fallback fonts, owned by the index. */
+            std::vector<T *> fonts;
+            /** Codepoints that have been sent to the resolver. */
+            std::unordered_set<char32_t> requested;
+            /** Fallbacks resolved, but not yet merged into the index, guarded by the resolver's lock. */
+            std::vector<Resolution> resolved;
+
+            typename std::map<char32_t, Fallback>::iterator find(char32_t codepoint) {
+                auto i = ranges.upper_bound(codepoint);
+                if (i == ranges.begin())
+                    return ranges.end();
+                --i;
+                return i->second.last >= codepoint ? i : ranges.end();
+            }
+
+            /** Opens the resolved fallback and merges it into the index. 
+
+                The first font that covers a codepoint wins so that the fallbacks found by the resolver for the codepoints they were requested for are not overriden by larger fonts resolved later. Fonts that do not add any coverage are deleted. 
+             */
+            void merge(Resolution & r) {
+                requested.erase(r.codepoint);
+                T * font = nullptr;
+                if (r.open) {
+                    try {
+                        font = r.open();
+                        font->adjustCellSize();
+                    } catch (std::exception const & e) {
+                        LOG() << "Unable to open fallback font for U+" << std::hex << static_cast<uint32_t>(r.codepoint) << ": " << e.what();
+                    }
+                }
+                if (font != nullptr) {
+                    size_t assigned = 0;
+                    for (auto const & range : r.coverage)
+                        assigned += Assign(ranges, range.first, range.second, Fallback{range.second, FallbackState::Resolved, font, r.codepoint});
+                    if (assigned == 0)
+                        delete font;
+                    else
+                        fonts.push_back(font);
+                }
+                // the cached ranges of the fallback that are no longer covered are forgotten, so that they will be resolved on their own
+                for (auto i = ranges.begin(); i != ranges.end(); ) {
+                    if (i->second.state == FallbackState::Unresolved && i->second.codepoint == r.codepoint)
+                        i = ranges.erase(i);
+                    else
+                        ++i;
+                }
+                if (font == nullptr)
+                    Assign(ranges, r.codepoint, r.codepoint, Fallback{r.codepoint, FallbackState::Missing, nullptr, r.codepoint});
+            }
+        }; // Font::FallbackIndex
+
+        class ResolverRequest {
+        public:
+            T * base;
+            FallbackIndex * index;
+            char32_t codepoint;
+        };
+
+        /** The background thread that resolves the fallback fonts. 
+         */
+        class FallbackResolver {
+        public:
+            std::mutex m;
+            std::condition_variable ready;
+            std::deque<ResolverRequest> requests;
+            std::function<void()> onResolved;
+            std::thread thread;
+            bool stop = false;
+
+            /** Stops the resolver thread and waits for it to finish so that it does not run during the destruction of the static objects it uses. 
+             */
+            ~FallbackResolver() {
+                {
+                    std::lock_guard<std::mutex> g{m};
+                    stop = true;
+                    ready.notify_one();
+                }
+                if (thread.joinable())
+                    thread.join();
+            }
+        };
+
+        /** Returns the fallback index of the font, loading the cached coverage when the index is created. 
+         */
+        FallbackIndex & fallbackIndex() {
+            size_t id = CreateIdFrom(font_, fontSize_.height());
+            auto i = FallbackIndices_.find(id);
+            if (i != FallbackIndices_.end())
+                return i->second;
+            FallbackIndex & index = FallbackIndices_[id];
+            FallbackCache::Entry cached = FallbackCache::Get(fallbackCacheKey());
+            for (auto const & fallback : cached.fallbacks)
+                for (auto const & range : fallback.coverage)
+                    Assign(index.ranges, range.first, range.second, Fallback{range.second, FallbackState::Unresolved, nullptr, fallback.codepoint});
+            for (auto const & range : cached.missing)
+                Assign(index.ranges, range.first, range.second, Fallback{range.second, FallbackState::Missing, nullptr, range.first});
+            return index;
+        }
+
+        /** Identifies the base font in the fallback cache, regardless of its size. 
+         */
+        std::string fallbackCacheKey() const {
+            return STR(Config::Instance().familyForFont(font_) << (font_.bold() ? ":bold" : "") << (font_.italic() ? ":italic" : ""));
+        }
+
+        /** Asks the resolver thread to find fallback for the given codepoint unless already asked. 
+         */
+        void request(FallbackIndex & index, char32_t codepoint) {
+            if (! index.requested.insert(codepoint).second)
+                return;
+            std::lock_guard<std::mutex> g{Resolver_.m};
+            if (Resolver_.stop)
+                return;
+            Resolver_.requests.push_back(ResolverRequest{static_cast<T*>(this), & index, codepoint});
+            if (! Resolver_.thread.joinable())
+                Resolver_.thread = std::thread{Resolve};
+            Resolver_.ready.notify_one();
+        }
+
+        /** The resolver thread. 
+
+            Searching for the fallback font only reads the base font, which is never deleted, and the results are handed to the index under the resolver's lock, so that the fonts can be resolved while the UI thread renders. The thread ends when the resolver is stopped, without touching the index or the cache afterwards. 
+         */
+        static void Resolve() {
+            while (true) {
+                ResolverRequest req;
+                {
+                    std::unique_lock<std::mutex> g{Resolver_.m};
+                    // the cache is saved once all pending requests have been resolved
+                    if (Resolver_.requests.empty()) {
+                        g.unlock();
+                        try {
+                            FallbackCache::Flush();
+                        } catch (std::exception const & e) {
+                            LOG() << "Unable to save fallback fonts cache: " << e.what();
+                        }
+                        g.lock();
+                    }
+                    while (Resolver_.requests.empty() && ! Resolver_.stop)
+                        Resolver_.ready.wait(g);
+                    if (Resolver_.stop)
+                        return;
+                    req = Resolver_.requests.front();
+                    Resolver_.requests.pop_front();
+                }
+                Resolution r{req.codepoint, nullptr, FallbackCache::Ranges{}};
+                try {
+                    r.open = T::MatchFallback(*req.base, req.codepoint, r.coverage);
+                } catch (std::exception const & e) {
+                    LOG() << "Unable to resolve fallback font for U+" << std::hex << static_cast<uint32_t>(req.codepoint) << ": " << e.what();
+                }
+                {
+                    std::lock_guard<std::mutex> g{Resolver_.m};
+                    if (Resolver_.stop)
+                        return;
+                }
+                try {
+                    if (r.open)
+                        FallbackCache::AddFallback(req.base->fallbackCacheKey(), r.codepoint, r.coverage);
+                    else
+                        FallbackCache::AddMissing(req.base->fallbackCacheKey(), r.codepoint);
+                } catch (std::exception const & e) {
+                    LOG() << "Unable to update fallback fonts cache: " << e.what();
+                }
+                std::function<void()> onResolved;
+                {
+                    std::lock_guard<std::mutex> g{Resolver_.m};
+                    if (Resolver_.stop)
+                        return;
+                    req.index->resolved.push_back(std::move(r));
+                    onResolved = Resolver_.onResolved;
+                }
+                if (onResolved)
+                    onResolved();
+            }
+        }
+
+        /** Assigns the fallback to all codepoints in the given range that are not covered already. 
+
+            A resolved fallback replaces unresolved and missing ranges, otherwise any existing range is kept. Returns the number of codepoints assigned. 
+         */
+        static size_t Assign(std::map<char32_t, Fallback> & ranges, char32_t first, char32_t last, Fallback fallback) {
+            size_t assigned = 0;
+            char32_t cp = first;
+            auto i = ranges.upper_bound(first);
+            if (i != ranges.begin() && std::prev(i)->second.last >= first)
+                --i;
+            while (cp <= last) {
+                // fill the gap before the next range 
+                if (i == ranges.end() || i->first > cp) {
+                    char32_t gapLast = (i == ranges.end() || i->first > last) ? last : i->first - 1;
+                    fallback.last = gapLast;
+                    ranges.emplace_hint(i, cp, fallback);
+                    assigned += gapLast - cp + 1;
+                    cp = gapLast + 1;
+                    continue;
+                }
+                if (i->second.state == FallbackState::Resolved || fallback.state != FallbackState::Resolved) {
+                    cp = i->second.last + 1;
+                    ++i;
+                    continue;
+                }
+                // cut the overlapping part out of the existing range, it becomes a gap 
+                Fallback old = i->second;
+                char32_t oldFirst = i->first;
+                i = ranges.erase(i);
+                if (oldFirst < cp) {
+                    Fallback before = old;
+                    before.last = cp - 1;
+                    ranges.emplace(oldFirst, before);
+                }
+                if (old.last > last)
+                    ranges.emplace(last + 1, old);
+                i = ranges.lower_bound(cp);
+            }
+            return assigned;
+        }
+
         static std::unordered_map<size_t, T *> Fonts_;
 
-		static std::unordered_map<size_t, std::vector<T*>> FallbackFonts_;
+        static std::unordered_map<size_t, FallbackIndex> FallbackIndices_;
+
+        static FallbackResolver Resolver_;
 
     }; 
 
     template<typename T>
     std::unordered_map<size_t, T *> Font<T>::Fonts_;
 
-	template<typename T>
-	std::unordered_map<size_t, std::vector<T*>> Font<T>::FallbackFonts_;
+    template<typename T>
+    std::unordered_map<size_t, typename Font<T>::FallbackIndex> Font<T>::FallbackIndices_;
+
+    template<typename T>
+    typename Font<T>::FallbackResolver Font<T>::Resolver_;
 
 } // namespace tpp
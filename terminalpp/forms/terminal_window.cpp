@@ -5,25 +5,60 @@ namespace tpp {
 
     using namespace ui;
 
+    namespace {
+
+        /** Returns the session name with characters that might not be valid in filenames replaced. 
+         */
+        std::string SnapshotName(std::string const & sessionName) {
+            std::string result{sessionName};
+            for (char & c : result)
+                if (! std::isalnum(static_cast<unsigned char>(c)) && c != '-' && c != '_')
+                    c = '_';
+            return result;
+        }
+
+        void RemoveSnapshotFiles(std::string const & filename) {
+            std::error_code ec;
+            std::filesystem::remove(filename, ec);
+            std::filesystem::remove(filename + ".history", ec);
+            // left by a save interrupted when the terminal was killed
+            std::filesystem::remove(filename + ".tmp", ec);
+        }
+
+    }
+
     void TerminalWindow::newSession(Config::sessions_entry const & session) {
-        Config const & config = Config::Instance();
-        std::unique_ptr<SessionInfo> si{new SessionInfo{session}};
         // create the pty
         PTYMaster * pty = nullptr;
-        // sets the working directory of the command to the specified working directory of the session,
-        Command cmd = session.command();
-        cmd.setWorkingDirectory(session.workingDirectory());
+        {
+            StartupProfile::Scope profile{"pty spawn"};
+            // sets the working directory of the command to the specified working directory of the session,
+            Command cmd = session.command();
+            cmd.setWorkingDirectory(session.workingDirectory());
 #if (ARCH_WINDOWS)
-        if (session.pty() != "bypass") 
-            pty = new LocalPTYMaster(cmd);
-        else
-            pty = new BypassPTYMaster(cmd);
+            if (session.pty() != "bypass") 
+                pty = new LocalPTYMaster(cmd);
+            else
+                pty = new BypassPTYMaster(cmd);
 #else
-        pty = new LocalPTYMaster{cmd};
+            pty = new LocalPTYMaster{cmd};
 #endif
-        // and the terminal
+        }
+        newSession(session, pty, session.name());
+    }
+
+    void TerminalWindow::newSession(Config::sessions_entry const & session, PTYMaster * pty, std::string const & name) {
+        Config const & config = Config::Instance();
+        std::unique_ptr<SessionInfo> si{new SessionInfo{session, name}};
+        // create the terminal
         si->terminal = new AnsiTerminal{pty, session.palette()};
+        si->terminal->metrics().setLabel("session", name);
         si->terminal->setMaxHistoryRows(config.renderer.window.historyLimit());
+        if (config.renderer.window.historyInMemory() > 0)
+            si->terminal->setHistorySpill((std::filesystem::path{TempDir()} / UniqueNameIn(TempDir(), "tpp-history-")).string(), config.renderer.window.historyInMemory());
+        // multiplexed sessions are not saved, the session of their connection is
+        if (config.snapshots.interval() > 0 && dynamic_cast<RemoteSessions::Session *>(pty) == nullptr)
+            attachSnapshot(si.get());
         si->terminal->setBoldIsBright(config.sequences.boldIsBright());
         si->terminal->setDisplayBold(config.sequences.displayBold());
         si->terminal->setCursor(session.cursor());
@@ -41,6 +76,7 @@ namespace tpp {
         // add terminal events (so that they are called only *after* the session is registered)
         t->onPTYTerminated.setHandler(&TerminalWindow::sessionPTYTerminated, this);
         t->onTitleChange.setHandler(&TerminalWindow::sessionTitleChanged, this);
+        t->onSendProgress.setHandler(&TerminalWindow::sessionSendProgress, this);
         t->onClipboardSetRequest.setHandler(&TerminalWindow::terminalSetClipboard, this);
         t->onPaste.setHandler(&TerminalWindow::terminalPaste, this);
         t->onNotification.setHandler(&TerminalWindow::sessionNotification, this);
@@ -50,5 +86,70 @@ namespace tpp {
         t->onHyperlinkCopy.setHandler(&TerminalWindow::hyperlinkCopy, this);
     }
 
+    void TerminalWindow::attachSnapshot(SessionInfo * session) {
+        try {
+            std::string dir = Config::Instance().snapshots.dir();
+            CreatePath(dir);
+            std::string name = SnapshotName(session->name);
+            for (size_t i = 0; session->snapshot == nullptr; ++i) {
+                std::string filename = JoinPath(dir, STR(name << "-" << i));
+                std::unique_ptr<FileLock> lock{new FileLock{filename + ".lock"}};
+                if (! lock->locked())
+                    continue;
+                session->snapshotLock = std::move(lock);
+                session->snapshot.reset(new TerminalSnapshot{filename});
+            }
+            try {
+                session->snapshot->restore(*session->terminal);
+            } catch (std::exception const & e) {
+                std::string filename = session->snapshot->filename();
+                LOG() << "Unable to restore session snapshot " << filename << ": " << e.what();
+                session->snapshot.reset();
+                RemoveSnapshotFiles(filename);
+                session->snapshot.reset(new TerminalSnapshot{filename});
+            }
+        } catch (std::exception const & e) {
+            LOG() << "Unable to attach session snapshot: " << e.what();
+            session->snapshot.reset();
+            session->snapshotLock.reset();
+            return;
+        }
+        std::lock_guard<std::mutex> g{mSnapshots_};
+        snapshots_.push_back(session);
+    }
+
+    void TerminalWindow::discardSnapshot(SessionInfo * session) {
+        if (session->snapshot == nullptr)
+            return;
+        {
+            std::lock_guard<std::mutex> g{mSnapshots_};
+            snapshots_.erase(std::find(snapshots_.begin(), snapshots_.end(), session));
+        }
+        // the snapshot's files must be closed before they can be removed on Windows, and removed before the lock is released
+        std::string filename = session->snapshot->filename();
+        session->snapshot.reset();
+        RemoveSnapshotFiles(filename);
+        session->snapshotLock.reset();
+    }
+
+    void TerminalWindow::saveSnapshots() {
+        std::chrono::seconds interval{Config::Instance().snapshots.interval()};
+        std::unique_lock<std::mutex> g{mSnapshots_};
+        while (true) {
+            bool stopped = snapshotsStopped_.wait_for(g, interval, [this](){
+                return stopSnapshots_;
+            });
+            for (SessionInfo * si : snapshots_) {
+                try {
+                    si->snapshot->save(*si->terminal);
+                } catch (std::exception const & e) {
+                    LOG() << "Unable to save session snapshot " << si->snapshot->filename() << ": " << e.what();
+                }
+            }
+            if (stopped)
+                return;
+        }
+    }
+
 } // namespace tpp
 
@@ -1,14 +1,19 @@
 #pragma once
 
+#include <condition_variable>
+#include <mutex>
+
 #include "ui/widgets/window.h"
 #include "ui/widgets/pager.h"
 #include "ui/widgets/panel.h"
 #include "ui/widgets/label.h"
 #include "ui/widgets/dialog.h"
 #include "ui-terminal/ansi_terminal.h"
+#include "ui-terminal/terminal_snapshot.h"
 #include "tpp-lib/local_pty.h"
 #include "tpp-lib/bypass_pty.h"
 #include "tpp-lib/remote_files.h"
+#include "tpp-lib/remote_sessions.h"
 
 #include "../config.h"
 #include "../window.h"
@@ -113,6 +118,11 @@ namespace tpp {
 
             pager_->onPageChange.setHandler(&TerminalWindow::activeSessionChanged, this);
 
+            if (config.snapshots.interval() > 0)
+                snapshotSaver_ = std::thread{[this](){
+                    saveSnapshots();
+                }};
+
             window_->setRoot(this);
             versionChecker_ = std::thread{[this](){
                 std::string channel = Config::Instance().version.checkChannel();
@@ -134,6 +144,14 @@ namespace tpp {
 
         ~TerminalWindow() override {
             versionChecker_.join();
+            if (snapshotSaver_.joinable()) {
+                {
+                    std::lock_guard<std::mutex> g{mSnapshots_};
+                    stopSnapshots_ = true;
+                }
+                snapshotsStopped_.notify_one();
+                snapshotSaver_.join();
+            }
             delete remoteFiles_;
         }
 
@@ -145,16 +163,23 @@ namespace tpp {
         public:
             std::string name;
             std::string title;
+            /** Configuration of the session, for multiplexed sessions the configuration of their connection. */
+            Config::sessions_entry const * config;
             AnsiTerminal * terminal = nullptr;
             bool terminateOnKeyPress = false;
             /** If true, the current session has an active notification. 
              */
             bool notification = false;
             PasteDialog * pendingPaste = nullptr;
-
-            explicit SessionInfo(Config::sessions_entry const & session):
-                name{session.name()},
-                title{session.name()} {
+            /** Keeps sessions in this and other windows from using the same snapshot. */
+            std::unique_ptr<FileLock> snapshotLock;
+            /** Snapshot to which the session is saved, nullptr if the session is not saved. */
+            std::unique_ptr<TerminalSnapshot> snapshot;
+
+            SessionInfo(Config::sessions_entry const & session, std::string const & name):
+                name{name},
+                title{name},
+                config{& session} {
             }
 
             ~SessionInfo() {
@@ -162,6 +187,28 @@ namespace tpp {
             }
         }; 
 
+        /** Creates new session with given pseudoterminal. 
+         */
+        void newSession(Config::sessions_entry const & session, PTYMaster * pty, std::string const & name);
+
+        /** Restores the session from the first snapshot of a session of the same name that is not used by any other session and starts saving the session to it. 
+         
+            The snapshots left by sessions that have not terminated are therefore restored in the order of their numbers. If the snapshot cannot be restored, it is discarded and the session starts afresh. 
+         */
+        void attachSnapshot(SessionInfo * session);
+
+        /** Stops saving the session and deletes its snapshot. 
+         
+            Called when the session terminates, as only killed sessions are restored. 
+         */
+        void discardSnapshot(SessionInfo * session);
+
+        /** Saves the attached snapshots in the configured interval, and once more when the window is destroyed. 
+         
+            Runs in its own thread so that the UI is not blocked by the disk. A session closed while being saved waits for the save to finish. 
+         */
+        void saveSnapshots();
+
         /** The window has been requested to close. 
          
             TODO check that there are no active sessions and perhaps ask if there are whether really to exit. 
@@ -214,6 +261,9 @@ namespace tpp {
                 session->pendingPaste->dismiss(session->pendingPaste->btnCancel());
             sessions_.erase(session->terminal);
             pager_->removePage(session->terminal);
+            // multiplexed sessions hosted in the session can no longer communicate
+            remoteSessions_.detach(session->terminal->pty());
+            discardSnapshot(session);
             delete session;
             // if this was the last session, close the window
             if (sessions_.empty())
@@ -231,6 +281,18 @@ namespace tpp {
                 window_->setTitle(*e);
         }
 
+        /** Shows the amount of input, such as a large paste, still waiting to be read by the session in the window title. 
+         */
+        void sessionSendProgress(SendProgressEvent::Payload & e) {
+            SessionInfo * si = sessionInfo(e.sender());
+            if (activeSession_ != si)
+                return;
+            if (*e == 0)
+                window_->setTitle(si->title);
+            else
+                window_->setTitle(STR(si->title << " (sending, " << (*e + 1023) / 1024 << " KiB left)"));
+        }
+
         void hyperlinkOpen(ui::StringEvent::Payload & e) {
             Application::Instance()->openUrl(*e);
         }
@@ -265,21 +327,26 @@ namespace tpp {
             // set own background to the session's terminal background so that it propagates to the window's background
             if (activeSession_ != nullptr) {
                 setBackground(activeSession_->terminal->palette().defaultBackground());
+                // let the server of a multiplexed session know that it is visible so that its output is not throttled
+                if (auto remote = dynamic_cast<RemoteSessions::Session *>(activeSession_->terminal->pty()))
+                    remote->focus();
             }
         }
 
         void sessionPTYTerminated(ExitCodeEvent::Payload & e) {
             SessionInfo * si = sessionInfo(e.sender());
+            remoteSessions_.detach(si->terminal->pty());
+            discardSnapshot(si);
             window_->setIcon(tpp::Window::Icon::Notification);
             si->title = STR("Terminated, exit code " << *e);
             if (activeSession_ == si)
                 window_->setTitle(si->title);
             Config const & config = Config::Instance();
             if (! config.renderer.window.waitAfterPtyTerminated()) {
-                closeSession(activeSession_);
+                closeSession(si);
             } else {
                 window_->setKeyboardFocus(this);
-                activeSession_->terminateOnKeyPress = true;
+                si->terminateOnKeyPress = true;
             }
         }
 
@@ -342,9 +409,13 @@ namespace tpp {
             SessionInfo * si = sessionInfo(event.sender());
             try {
                 switch (event->kind) {
-                    case tpp::Sequence::Kind::GetCapabilities:
-                        si->terminal->pty()->send(tpp::Sequence::Capabilities{1});
+                    case tpp::Sequence::Kind::GetCapabilities: {
+                        Sequence::GetCapabilities req{event->payloadStart, event->payloadEnd};
+                        Sequence::Capabilities capabilities{1};
+                        capabilities.setRequestId(req.requestId());
+                        si->terminal->pty()->send(capabilities);
                         break;
+                    }
                     case tpp::Sequence::Kind::OpenFileTransfer: {
                         Sequence::OpenFileTransfer req(event->payloadStart, event->payloadEnd);
                         si->terminal->pty()->send(remoteFiles_->openFileTransfer(req));
@@ -357,6 +428,23 @@ namespace tpp {
                         window_->yieldToUIThread();
                         break;
                     }
+                    case tpp::Sequence::Kind::SkipData: {
+                        Sequence::SkipData skip{event->payloadStart, event->payloadEnd};
+                        remoteFiles_->skip(skip);
+                        break;
+                    }
+                    case tpp::Sequence::Kind::GetBlockHashes: {
+                        Sequence::GetBlockHashes req{event->payloadStart, event->payloadEnd};
+                        // the hashes are calculated by a worker, but sent from the UI thread if the session still exists
+                        AnsiTerminal * terminal = si->terminal;
+                        remoteFiles_->getBlockHashes(req, [this, terminal](Sequence::BlockHashes::Response const & response) {
+                            schedule([this, terminal, response]() {
+                                if (sessions_.find(terminal) != sessions_.end())
+                                    terminal->pty()->send(response);
+                            });
+                        });
+                        break;
+                    }
                     case tpp::Sequence::Kind::GetTransferStatus: {
                         Sequence::GetTransferStatus req{event->payloadStart, event->payloadEnd};
                         si->terminal->pty()->send(remoteFiles_->getTransferStatus(req));
@@ -376,6 +464,29 @@ namespace tpp {
                         }
                         break;
                     }
+                    case tpp::Sequence::Kind::NewSession: {
+                        Sequence::NewSession req{event->payloadStart, event->payloadEnd};
+                        RemoteSessions::Session * pty = remoteSessions_.open(si->terminal->pty(), req);
+                        if (pty == nullptr) {
+                            si->terminal->pty()->send(Sequence::Nack{req, "Session already exists"});
+                            break;
+                        }
+                        // the session is registered now so that no output is lost, but its terminal must be created in the UI thread
+                        si->terminal->pty()->send(Sequence::Ack{req, req.id()});
+                        Config::sessions_entry const * config = si->config;
+                        schedule([this, config, pty](){
+                            newSession(*config, pty, pty->name());
+                        });
+                        break;
+                    }
+                    case tpp::Sequence::Kind::SessionData: {
+                        remoteSessions_.data(si->terminal->pty(), Sequence::SessionData{event->payloadStart, event->payloadEnd});
+                        break;
+                    }
+                    case tpp::Sequence::Kind::SessionClosed: {
+                        remoteSessions_.closed(si->terminal->pty(), Sequence::SessionClosed{event->payloadStart, event->payloadEnd});
+                        break;
+                    }
                     default:
                         LOG() << "Unknown sequence";
                         break;
@@ -398,8 +509,17 @@ namespace tpp {
 
         RemoteFiles * remoteFiles_;
 
+        RemoteSessions remoteSessions_;
+
         std::thread versionChecker_;
 
+        /** Sessions being saved, guarded by mSnapshots_. */
+        std::vector<SessionInfo *> snapshots_;
+        std::mutex mSnapshots_;
+        std::condition_variable snapshotsStopped_;
+        bool stopSnapshots_ = false;
+        std::thread snapshotSaver_;
+
     };
 
 } // namespace tpp
@@ -1,13 +1,17 @@
 ﻿#include <iostream>
 #include <thread>
+#include <memory>
 
 #include "helpers/char.h"
 #include "helpers/time.h"
 #include "helpers/filesystem.h"
 #include "helpers/curl.h"
 #include "helpers/telemetry.h"
+#include "helpers/trace.h"
+#include "helpers/metrics.h"
 
 #include "config.h"
+#include "startup_profile.h"
 
 #if (defined ARCH_WINDOWS && defined RENDERER_NATIVE)
 
@@ -96,25 +100,41 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
 	int argc = __argc;
 	char** argv = __argv;
     CheckVersion(argc, argv, PrintVersion);
+    tpp::StartupProfile::Initialize(argc, argv);
 	tpp::APPLICATION_CLASS::Initialize(argc, argv, hInstance);
 #elif (defined ARCH_WINDOWS && defined RENDERER_QT)
 int main(int argc, char* argv[]) {
     CheckVersion(argc, argv, PrintVersion);
+    tpp::StartupProfile::Initialize(argc, argv);
 	tpp::APPLICATION_CLASS::Initialize(argc, argv);
 #else
 int main(int argc, char* argv[]) {
     CheckVersion(argc, argv, PrintVersion);
+    tpp::StartupProfile::Initialize(argc, argv);
 	tpp::APPLICATION_CLASS::Initialize(argc, argv);
 #endif
+    tpp::StartupProfile::Phase("application");
     // create the telemetry manager and its handler. 
     Telemetry telemetry(SendTelemetry);
     try {
         //tpp::Config const & config = tpp::Config::Setup(argc, argv);
         tpp::Config const & config = tpp::Config::Setup(argc, argv);
+        tpp::StartupProfile::Phase("config load");
         // open the telemetry and add the registered logs
         telemetry.open(config.telemetry.dir() + "/" + TimeInDashed());
         for (auto & i : config.telemetry.events())
             telemetry.addLog(i);
+        // start the binary trace of the terminal input if enabled, the unsupported sequences are traced as well
+        if (config.telemetry.trace()) {
+            Trace::Start(config.telemetry.dir() + "/" + TimeInDashed() + ".trace");
+            Log::Enable(Trace::LogWriter(), { ui::AnsiTerminal::SEQ_WONT_SUPPORT });
+        }
+#if (defined ARCH_UNIX)
+        // serve the performance counters if enabled
+        std::unique_ptr<Metrics::Server> metrics;
+        if (! config.telemetry.metricsSocket().empty())
+            metrics.reset(new Metrics::Server{config.telemetry.metricsSocket()});
+#endif
 
 		Log::Enable(Log::StdOutWriter(), { 
 			Log::Default(),
@@ -126,12 +146,15 @@ int main(int argc, char* argv[]) {
         tpp::Window * w = tpp::Application::Instance()->createWindow("Foobar", config.renderer.window.cols(), config.renderer.window.rows());
         if (config.renderer.window.fullscreen())
             w->setFullscreen(true);
+        tpp::StartupProfile::Phase("window");
         // currently owned by the window, when multiple sessions are available this might change
         tpp::TerminalWindow * tw = new tpp::TerminalWindow{w};
         tw->newSession(config.sessionByName(config.defaultSession()));
+        tpp::StartupProfile::Phase("session");
         //tw->newSession(config.sessions[0]);
         //new tpp::Session{w, config.sessionByName(config.defaultSession())};
         w->show();
+        tpp::StartupProfile::Phase("show");
 #if (defined ARCH_WINDOWS && defined RENDERER_NATIVE)
         // TODO se how fast this is and perhaps execute in separate thread?
         w->schedule([](){
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "helpers/metrics.h"
+
+namespace tpp {
+
+    /** Performance counters of the renderer, shared by all windows.
+
+        The counters are only updated from the UI thread.
+     */
+    class RendererMetrics : public Metrics::Group {
+    public:
+
+        static RendererMetrics & Instance() {
+            static RendererMetrics singleton;
+            return singleton;
+        }
+
+        Metrics::Counter frames{*this, "tpp_renderer_frames_total", "Number of frames rendered"};
+        Metrics::Histogram frameTime{*this, "tpp_renderer_frame_seconds", "Time to render a frame", 1e-6};
+
+        Metrics::Counter fontHits{*this, "tpp_renderer_font_lookups_total", "Font lookups by the glyph runs and their result", "result=\"hit\""};
+        Metrics::Counter fontMisses{*this, "tpp_renderer_font_lookups_total", "Font lookups by the glyph runs and their result", "result=\"miss\""};
+        Metrics::Counter fallbackHits{*this, "tpp_renderer_fallback_lookups_total", "Fallback font lookups for codepoints missing in the font and their result", "result=\"hit\""};
+        Metrics::Counter fallbackMisses{*this, "tpp_renderer_fallback_lookups_total", "Fallback font lookups for codepoints missing in the font and their result", "result=\"miss\""};
+
+    private:
+
+        RendererMetrics() = default;
+
+    }; // tpp::RendererMetrics
+
+} // namespace tpp
@@ -0,0 +1,71 @@
+#include <cstring>
+#include <iomanip>
+
+#include "helpers/helpers.h"
+
+#include "startup_profile.h"
+
+namespace tpp {
+
+    bool StartupProfile::Enabled_ = false;
+    std::chrono::steady_clock::time_point StartupProfile::Start_;
+    std::chrono::steady_clock::time_point StartupProfile::PhaseStart_;
+    std::vector<StartupProfile::Entry> StartupProfile::Entries_;
+
+    void StartupProfile::Initialize(int & argc, char ** argv) {
+        for (int i = 1; i < argc; ++i) {
+            if (strcmp(argv[i], "--startup-profile") == 0) {
+                for (int j = i + 1; j < argc; ++j)
+                    argv[j - 1] = argv[j];
+                --argc;
+                Enabled_ = true;
+                Start_ = std::chrono::steady_clock::now();
+                PhaseStart_ = Start_;
+                return;
+            }
+        }
+    }
+
+    void StartupProfile::Phase(char const * name) {
+        if (! Enabled_)
+            return;
+        auto now = std::chrono::steady_clock::now();
+        Entries_.push_back(Entry{name, now - PhaseStart_, true});
+        PhaseStart_ = now;
+    }
+
+    void StartupProfile::Add(char const * name, std::chrono::steady_clock::duration duration) {
+        // repeated operations within the same phase are summed
+        for (auto i = Entries_.rbegin(), e = Entries_.rend(); i != e && ! i->phase; ++i) {
+            if (i->name == name) {
+                i->duration += duration;
+                return;
+            }
+        }
+        Entries_.push_back(Entry{name, duration, false});
+    }
+
+    void StartupProfile::Report() {
+        Phase("first render");
+        Enabled_ = false;
+        auto ms = [](std::chrono::steady_clock::duration d) {
+            return STR(std::fixed << std::setprecision(2) << std::chrono::duration<double, std::milli>(d).count() << " ms");
+        };
+        // operations measured by scopes are reported under the phase they belong to, which is the phase that follows them
+        LOG() << "Startup profile:";
+        std::vector<Entry const *> operations;
+        for (Entry const & e : Entries_) {
+            if (! e.phase) {
+                operations.push_back(& e);
+                continue;
+            }
+            LOG() << "    " << std::left << std::setw(20) << e.name << ms(e.duration);
+            for (Entry const * op : operations)
+                LOG() << "        " << std::left << std::setw(16) << op->name << ms(op->duration);
+            operations.clear();
+        }
+        LOG() << "    " << std::left << std::setw(20) << "total" << ms(std::chrono::steady_clock::now() - Start_);
+        Entries_.clear();
+    }
+
+} // namespace tpp
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace tpp {
+
+    /** Time spent in the startup phases of the terminal. 
+
+        Enabled by the `--startup-profile` command line argument. The main function marks the end of each startup phase, while the costly operations within the phases, such as the font load, or the PTY spawn are measured by scopes so that they can be reported separately. The report is written to the log when the first frame has been rendered. 
+
+        The profile is only updated from the UI thread. 
+     */
+    class StartupProfile {
+    public:
+
+        /** Measures the time spent in the scope and adds it to the given operation. 
+         */
+        class Scope {
+        public:
+            explicit Scope(char const * name):
+                name_{Enabled_ ? name : nullptr},
+                start_{Enabled_ ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{}} {
+            }
+
+            ~Scope() {
+                if (name_ != nullptr)
+                    Add(name_, std::chrono::steady_clock::now() - start_);
+            }
+
+        private:
+            char const * name_;
+            std::chrono::steady_clock::time_point start_;
+        }; // tpp::StartupProfile::Scope
+
+        /** Enables the profile if the `--startup-profile` argument is present and removes the argument from the arguments list so that it does not interfere with the configuration arguments. 
+         */
+        static void Initialize(int & argc, char ** argv);
+
+        static bool Enabled() {
+            return Enabled_;
+        }
+
+        /** Marks the end of the given startup phase, which started at the end of the previous phase. 
+         */
+        static void Phase(char const * name);
+
+        /** Called after every frame rendered, the first frame ends the profile and writes the report. 
+         */
+        static void FrameRendered() {
+            if (Enabled_)
+                Report();
+        }
+
+    private:
+
+        class Entry {
+        public:
+            std::string name;
+            std::chrono::steady_clock::duration duration;
+            bool phase;
+        };
+
+        static void Add(char const * name, std::chrono::steady_clock::duration duration);
+
+        static void Report();
+
+        static bool Enabled_;
+        static std::chrono::steady_clock::time_point Start_;
+        static std::chrono::steady_clock::time_point PhaseStart_;
+        static std::vector<Entry> Entries_;
+
+    }; // tpp::StartupProfile
+
+} // namespace tpp
@@ -15,6 +15,8 @@
 
 #include "application.h"
 #include "font.h"
+#include "renderer_metrics.h"
+#include "startup_profile.h"
 
 namespace tpp {
 
@@ -289,6 +291,12 @@ namespace tpp {
          */
         static void StartBlinkerThread() {
             GlobalState_ = new GlobalState{};
+            // repaint the windows when a fallback font is resolved so that the placeholders are replaced
+            IMPLEMENTATION::Font::SetFallbackResolvedHandler([](){
+                std::lock_guard<std::mutex> g(GlobalState_->mWindows);
+                for (auto i : GlobalState_->windows)
+                    i.second->repaint();
+            });
             std::thread t([](){
                 GlobalState_->blinkVisible = true;
                 while (true) {
@@ -337,8 +345,7 @@ namespace tpp {
         void render(Rect const & rect) override {
             MARK_AS_UNUSED(rect);
             // then actually render the entire window
-            Stopwatch t;
-            t.start();
+            uint64_t start = Metrics::Now();
             // shorthand to the buffer
             Buffer const & buffer = this->buffer();
             // initialize the drawing and set the state for the first cell
@@ -435,6 +442,9 @@ namespace tpp {
                 }
             }
             finalizeDraw();
+            RendererMetrics::Instance().frames.add();
+            RendererMetrics::Instance().frameTime.recordSince(start);
+            StartupProfile::FrameRendered();
         }
 
         #undef initializeDraw
@@ -17,27 +17,28 @@ namespace tpp {
         FcPatternAddInteger(pattern_, FC_WEIGHT, font.bold() ? FC_WEIGHT_BOLD : FC_WEIGHT_NORMAL);
         FcPatternAddInteger(pattern_, FC_SLANT, font.italic() ? FC_SLANT_ITALIC : FC_SLANT_ROMAN);
         FcPatternAddDouble(pattern_, FC_PIXEL_SIZE, fontSize_.height());
+        xftFont_ = MatchFont(pattern_);
         initializeFromPattern();
     } 
 
-    X11Font::X11Font(X11Font const & base, char32_t codepoint):
+    X11Font::X11Font(X11Font const & base, char32_t codepoint, FcPattern * matched):
         Font<X11Font>{base.font_, base.fontSize_} {
         // get the font pattern 
-        pattern_ = FcPatternDuplicate(base.pattern_);
-        FcPatternRemove(pattern_, FC_FAMILY, 0);
-        FcPatternRemove(pattern_, FC_PIXEL_SIZE, 0);
-        FcPatternAddDouble(pattern_, FC_PIXEL_SIZE, fontSize_.height());
-        FcCharSet * charSet = FcCharSetCreate();
-        FcCharSetAddChar(charSet, codepoint);
-        FcPatternAddCharSet(pattern_, FC_CHARSET, charSet);
+        pattern_ = FallbackPattern(base.pattern_, codepoint, fontSize_.height());
+        // the font matched by the resolver is opened directly, the family makes sure that matching the pattern in other sizes finds the same font
+        FcChar8 * family;
+        if (FcPatternGetString(matched, FC_FAMILY, 0, & family) == FcResultMatch)
+            FcPatternAddString(pattern_, FC_FAMILY, family);
+        FcPatternDel(matched, FC_PIXEL_SIZE);
+        FcPatternAddDouble(matched, FC_PIXEL_SIZE, fontSize_.height());
+        XftDefaultSubstitute(X11Application::Instance()->xDisplay_, X11Application::Instance()->xScreen_, matched);
+        xftFont_ = OpenFont(matched);
         initializeFromPattern();
-
     }
 
     void X11Font::initializeFromPattern() {
         X11Application * app = X11Application::Instance();
         double fontHeight = fontSize_.height();
-        xftFont_ = MatchFont(pattern_);
         if (xftFont_ == nullptr) {
             FcValue fontName;
             FcPatternGet(pattern_, FC_FAMILY, 0, &fontName);
@@ -88,6 +89,61 @@ namespace tpp {
         strikethroughThickness_ = font_.size();
     }
 
+    std::function<X11Font*()> X11Font::MatchFallback(X11Font const & base, char32_t codepoint, FallbackCache::Ranges & coverage) {
+        FcPattern * pattern = FallbackPattern(base.pattern_, codepoint, base.fontSize_.height());
+        FcConfigSubstitute(nullptr, pattern, FcMatchPattern);
+        FcDefaultSubstitute(pattern);
+        FcResult fcr;
+        FcPattern * matched = FcFontMatch(nullptr, pattern, & fcr);
+        FcPatternDestroy(pattern);
+        if (matched == nullptr)
+            return nullptr;
+        FcCharSet * charSet = nullptr;
+        if (FcPatternGetCharSet(matched, FC_CHARSET, 0, & charSet) != FcResultMatch || ! FcCharSetHasChar(charSet, codepoint)) {
+            FcPatternDestroy(matched);
+            return nullptr;
+        }
+        coverage = CharSetRanges(charSet);
+        X11Font const * b = & base;
+        return [b, codepoint, matched]() {
+            return new X11Font{*b, codepoint, matched};
+        };
+    }
+
+    FcPattern * X11Font::FallbackPattern(FcPattern * base, char32_t codepoint, double pixelSize) {
+        FcPattern * result = FcPatternDuplicate(base);
+        FcPatternRemove(result, FC_FAMILY, 0);
+        FcPatternRemove(result, FC_PIXEL_SIZE, 0);
+        FcPatternAddDouble(result, FC_PIXEL_SIZE, pixelSize);
+        FcCharSet * charSet = FcCharSetCreate();
+        FcCharSetAddChar(charSet, codepoint);
+        FcPatternAddCharSet(result, FC_CHARSET, charSet);
+        FcCharSetDestroy(charSet);
+        return result;
+    }
+
+    FallbackCache::Ranges X11Font::CharSetRanges(FcCharSet * charSet) {
+        FallbackCache::Ranges result;
+        FcChar32 map[FC_CHARSET_MAP_SIZE];
+        FcChar32 next;
+        for (FcChar32 page = FcCharSetFirstPage(charSet, map, &next); page != FC_CHARSET_DONE; page = FcCharSetNextPage(charSet, map, &next)) {
+            for (unsigned i = 0; i < FC_CHARSET_MAP_SIZE; ++i) {
+                if (map[i] == 0)
+                    continue;
+                for (unsigned bit = 0; bit < 32; ++bit) {
+                    if ((map[i] & (1u << bit)) == 0)
+                        continue;
+                    char32_t c = page + i * 32 + bit;
+                    if (! result.empty() && result.back().second + 1 == c)
+                        result.back().second = c;
+                    else
+                        result.push_back(std::make_pair(c, c));
+                }
+            }
+        }
+        return result;
+    }
+
     XftFont * X11Font::MatchFont(FcPattern * pattern) {
         X11Application * app = X11Application::Instance();
         FcPattern * configured = FcPatternDuplicate(pattern);
@@ -97,17 +153,23 @@ namespace tpp {
         XftDefaultSubstitute(app->xDisplay_, app->xScreen_, configured);
         FcResult fcr;
         FcPattern * matched = FcFontMatch(nullptr, configured, & fcr);
-        if (matched == nullptr) {
-            FcPatternDestroy(configured);
+        FcPatternDestroy(configured);
+        if (matched == nullptr)
+            return nullptr;
+        return OpenFont(matched);
+    }
+
+    XftFont * X11Font::OpenFont(FcPattern * matched) {
+        XftFont * font = XftFontOpenPattern(X11Application::Instance()->xDisplay_, matched);
+        if (font == nullptr) {
+            FcPatternDestroy(matched);
             return nullptr;
         }
-        XftFont * font = XftFontOpenPattern(app->xDisplay_, matched);
         auto i = ActiveFontsMap_.find(font);
         if (i == ActiveFontsMap_.end())
             ActiveFontsMap_.insert(std::make_pair(font, 1));
         else 
             ++(i->second);
-        FcPatternDestroy(configured);
         return font;
     }
 
@@ -1,6 +1,7 @@
 #pragma once
 #if (defined ARCH_UNIX && defined RENDERER_NATIVE)
 
+#include <functional>
 #include <unordered_map>
 
 #include "helpers/helpers.h"
@@ -35,15 +36,35 @@ namespace tpp {
 
         X11Font(ui::Font font, int cellHeight, int cellWidth = 0);
 
-        X11Font(X11Font const & base, char32_t codepoint);
+        /** Creates the fallback font for given codepoint from the pattern matched by the resolver thread. 
+         */
+        X11Font(X11Font const & base, char32_t codepoint, FcPattern * matched);
 
         void initializeFromPattern();
 
+        /** Finds the fallback font for the codepoint using only fontconfig, since Xft is not thread safe. 
+         
+            The matched font is opened on the UI thread. 
+         */
+        static std::function<X11Font*()> MatchFallback(X11Font const & base, char32_t codepoint, FallbackCache::Ranges & coverage);
+
         XftFont * xftFont_;
         FcPattern * pattern_;
 
+        /** Returns the pattern for the fallback of given base font pattern that supports the codepoint. 
+         */
+        static FcPattern * FallbackPattern(FcPattern * base, char32_t codepoint, double pixelSize);
+
+        /** Returns the ranges of the character set. 
+         */
+        static FallbackCache::Ranges CharSetRanges(FcCharSet * charSet);
+
         static XftFont * MatchFont(FcPattern * pattern);
 
+        /** Opens the matched pattern, which is then owned by the font. 
+         */
+        static XftFont * OpenFont(FcPattern * matched);
+
         static void CloseFont(XftFont * font);
 
         static std::unordered_map<XftFont*, unsigned> ActiveFontsMap_;
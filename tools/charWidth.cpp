@@ -0,0 +1,135 @@
+#include <cstdlib>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "helpers/helpers.h"
+
+/** Generates the column width table used by Char::ColumnWidth() from the Unicode character database.
+
+    Reads the UnicodeData.txt and EastAsianWidth.txt files of the database and assigns each codepoint one of the widths:
+
+    - 0 for combining marks (general categories Mn and Me), format characters (Cf, which includes the zero width joiner) with the exception of the soft hyphen and for the Hangul medial vowels and final consonants, which all combine with the preceding character
+    - 2 for wide and fullwidth characters (East Asian width W or F), including the emoji presented as emoji by default
+    - 1 for everything else, including ambiguous width characters and control characters
+
+    The table has two levels. The first level is indexed by the codepoint without its lowest 8 bits and gives the index of the block of 256 codepoints in the second level, where each codepoint's width takes 2 bits. Identical blocks are stored only once, so the whole table takes a few kilobytes.
+ */
+
+constexpr char32_t MAX_CODEPOINT = 0x10ffff;
+constexpr size_t BLOCK_BITS = 8;
+constexpr size_t BLOCK_SIZE = 1 << BLOCK_BITS;
+constexpr size_t BLOCK_BYTES = BLOCK_SIZE / 4;
+
+/** Calls the given function with the first and last codepoint and the given field of each line of an UCD file.
+
+    Handles both the codepoint ranges (`XXXX..YYYY`) and the `<..., First>` and `<..., Last>` range lines of UnicodeData.txt.
+ */
+template<typename T>
+void ParseUCD(std::string const & filename, size_t field, T handler) {
+    std::ifstream input(filename);
+    if (! input.good())
+        THROW(IOError()) << "Unable to open " << filename;
+    std::string line;
+    char32_t rangeFirst = 0;
+    while (std::getline(input, line)) {
+        line = line.substr(0, line.find('#'));
+        std::vector<std::string> fields;
+        size_t start = 0;
+        for (size_t i = line.find(';'); i != std::string::npos; i = line.find(';', start)) {
+            fields.push_back(line.substr(start, i - start));
+            start = i + 1;
+        }
+        fields.push_back(line.substr(start));
+        if (fields.size() <= field)
+            continue;
+        std::string value = fields[field];
+        while (! value.empty() && value.back() == ' ')
+            value.pop_back();
+        size_t range = fields[0].find("..");
+        char32_t first = static_cast<char32_t>(std::stoul(fields[0].substr(0, range), nullptr, 16));
+        char32_t last = range == std::string::npos ? first : static_cast<char32_t>(std::stoul(fields[0].substr(range + 2), nullptr, 16));
+        if (fields.size() > 1 && fields[1].find(", First>") != std::string::npos) {
+            rangeFirst = first;
+            continue;
+        }
+        if (fields.size() > 1 && fields[1].find(", Last>") != std::string::npos)
+            first = rangeFirst;
+        handler(first, last, value);
+    }
+}
+
+int main(int argc, char * argv[]) {
+    if (argc != 4) {
+        std::cerr << "Invalid arguments, usage:" << std::endl << std::endl;
+        std::cerr << "char-width UnicodeData.txt EastAsianWidth.txt output.inc.h" << std::endl;
+        return EXIT_FAILURE;
+    }
+    try {
+        std::vector<unsigned char> widths(MAX_CODEPOINT + 1, 1);
+        // unassigned codepoints in the CJK blocks are wide by default
+        for (auto range : { std::make_pair(0x3400, 0x4dbf), std::make_pair(0x4e00, 0x9fff), std::make_pair(0xf900, 0xfaff), std::make_pair(0x20000, 0x2fffd), std::make_pair(0x30000, 0x3fffd) })
+            for (int cp = range.first; cp <= range.second; ++cp)
+                widths[cp] = 2;
+        ParseUCD(argv[2], 1, [&](char32_t first, char32_t last, std::string const & width) {
+            for (char32_t cp = first; cp <= last; ++cp)
+                widths[cp] = (width == "W" || width == "F") ? 2 : 1;
+        });
+        ParseUCD(argv[1], 2, [&](char32_t first, char32_t last, std::string const & category) {
+            if (category == "Mn" || category == "Me" || category == "Cf")
+                for (char32_t cp = first; cp <= last; ++cp)
+                    widths[cp] = 0;
+        });
+        // the soft hyphen is displayed where the line breaks, which is always in a terminal
+        widths[0xad] = 1;
+        for (char32_t cp = 0x1160; cp <= 0x11ff; ++cp)
+            widths[cp] = 0;
+        // build the deduplicated blocks
+        std::vector<size_t> index;
+        std::vector<std::vector<unsigned char>> blocks;
+        std::map<std::vector<unsigned char>, size_t> known;
+        for (size_t start = 0; start <= MAX_CODEPOINT; start += BLOCK_SIZE) {
+            std::vector<unsigned char> block(BLOCK_BYTES, 0);
+            for (size_t i = 0; i < BLOCK_SIZE; ++i)
+                block[i / 4] |= widths[start + i] << ((i % 4) * 2);
+            auto k = known.find(block);
+            if (k == known.end()) {
+                k = known.insert(std::make_pair(block, blocks.size())).first;
+                blocks.push_back(block);
+            }
+            index.push_back(k->second);
+        }
+        if (blocks.size() > 256)
+            THROW(Exception()) << "Too many different blocks: " << blocks.size();
+        // the first line of the database files names the file including the Unicode version
+        std::string version;
+        std::getline(std::ifstream{argv[2]}, version);
+        std::ofstream o(argv[3]);
+        if (! o.good())
+            THROW(IOError()) << "Unable to open " << argv[3];
+        o << "/* AUTOGENERATED FILE, DO NOT EDIT!" << std::endl;
+        o << "   This file was produced by tools/charWidth.cpp from the UnicodeData.txt and EastAsianWidth.txt files of the Unicode character database." << std::endl;
+        o << "   " << version << std::endl;
+        o << " */" << std::endl;
+        o << "static constexpr unsigned ColumnWidthBlockBits_ = " << BLOCK_BITS << ";" << std::endl;
+        o << "static constexpr unsigned char ColumnWidthIndex_[" << index.size() << "] = {";
+        for (size_t i = 0; i < index.size(); ++i)
+            o << (i % 32 == 0 ? "\n    " : "") << index[i] << ",";
+        o << "\n};" << std::endl;
+        o << "static constexpr unsigned char ColumnWidthBlocks_[" << blocks.size() * BLOCK_BYTES << "] = {";
+        for (size_t b = 0; b < blocks.size(); ++b) {
+            o << "\n    // block " << b;
+            for (size_t i = 0; i < BLOCK_BYTES; ++i)
+                o << (i % 16 == 0 ? "\n    " : "") << "0x" << std::hex << std::setw(2) << std::setfill('0') << static_cast<unsigned>(blocks[b][i]) << std::dec << ",";
+        }
+        o << "\n};" << std::endl;
+        std::cerr << "Done. " << index.size() << " index entries, " << blocks.size() << " blocks, " << index.size() + blocks.size() * BLOCK_BYTES << " bytes" << std::endl;
+        return EXIT_SUCCESS;
+    } catch (std::exception const & e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,45 @@
+#include <cstdlib>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+
+#include "helpers/helpers.h"
+#include "helpers/trace.h"
+
+/** Decodes the binary trace produced by terminal++ (see helpers/trace.h) into a human readable text.
+
+    Prints the records of all threads ordered by time, one record per line, consisting of the time since the beginning of the trace in microseconds, the thread, the event name and its arguments, or the text of the record.
+ */
+int main(int argc, char * argv[]) {
+    if (argc != 2) {
+        std::cerr << "Invalid arguments, usage:" << std::endl << std::endl;
+        std::cerr << "trace-decode input.trace" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::ifstream input(argv[1], std::ios::binary);
+    if (! input.good()) {
+        std::cerr << "Unable to open trace file " << argv[1] << std::endl;
+        return EXIT_FAILURE;
+    }
+    try {
+        Trace::Reader trace{input};
+        std::cout << std::fixed << std::setprecision(3);
+        for (Trace::Reader::Record const & r : trace.records()) {
+            std::cout << std::setw(14) << trace.nanoseconds(r.timestamp) / 1000 << " [" << r.thread << "] " << r.event->name;
+            if (r.event->text) {
+                std::cout << ": " << r.text;
+            } else {
+                for (size_t i = 0, e = r.args.size(); i != e; ++i)
+                    std::cout << " " << (i < r.event->args.size() ? r.event->args[i] : "?") << "=" << r.args[i];
+            }
+            std::cout << std::endl;
+        }
+        for (auto const & i : trace.dropped())
+            std::cerr << "Thread " << i.first << ": " << i.second << " records dropped" << std::endl;
+        std::cerr << "Done. " << trace.records().size() << " records decoded" << std::endl;
+        return EXIT_SUCCESS;
+    } catch (std::exception const & e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
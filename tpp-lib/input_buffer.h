@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstring>
+#include <algorithm>
+
+#include "helpers/helpers.h"
+
+#include "sequence.h"
+
+namespace tpp {
+
+    /** Input buffer of the terminal client.
+
+        New data is received directly after the data already in the buffer and the t++ sequences are extracted from it in place by a separate cursor, so that neither the sequences, nor the plain input between them is copied. Plain input is handed out as spans pointing into the buffer that are only valid for the duration of the callback.
+
+        The buffer is reused as a ring. When all received data has been processed the cursors simply rewind to the beginning of the buffer. When the end of the buffer is reached while some data is still pending, i.e. an incomplete t++ sequence, or plain input the client could not process yet such as a partial UTF-8 character, only the pending data is moved to the beginning of the buffer. The sequences are thus always contiguous and the amount of data copied does not depend on how the input was split by the reads. The buffer only grows when a single t++ sequence does not fit in it.
+     */
+    class InputBuffer {
+    public:
+
+        static constexpr size_t DEFAULT_CAPACITY = 65536;
+
+        explicit InputBuffer(size_t capacity = DEFAULT_CAPACITY):
+            buffer_{new char[capacity]},
+            capacity_{capacity} {
+        }
+
+        InputBuffer(InputBuffer const &) = delete;
+        InputBuffer & operator = (InputBuffer const &) = delete;
+
+        ~InputBuffer() {
+            delete [] buffer_;
+        }
+
+        size_t capacity() const {
+            return capacity_;
+        }
+
+        /** Returns the number of pending bytes, i.e. unprocessed plain input and incomplete t++ sequence.
+         */
+        size_t pending() const {
+            return write_ - input_;
+        }
+
+        /** Returns the number of bytes that had to be moved within the buffer so far.
+         */
+        size_t copied() const {
+            return copied_;
+        }
+
+        /** Returns the free space where new data should be received.
+
+            The free space is never empty, if necessary the pending data is moved to the beginning of the buffer, or the buffer grows.
+         */
+        char * writeStart() {
+            if (write_ == capacity_)
+                makeRoom();
+            return buffer_ + write_;
+        }
+
+        size_t writeSize() const {
+            return capacity_ - write_;
+        }
+
+        /** Processes the given number of bytes received at writeStart().
+
+            Calls `received(start, end)` for the plain input, which returns the number of bytes it has processed. The unprocessed bytes are handed out again, followed by the plain input received next. Calls `receivedSequence(kind, payload, payloadEnd)` for every complete t++ sequence.
+         */
+        template<typename RECEIVED, typename RECEIVED_SEQUENCE>
+        void process(size_t size, RECEIVED received, RECEIVED_SEQUENCE receivedSequence) {
+            ASSERT(write_ + size <= capacity_);
+            write_ += size;
+            char const * end = buffer_ + write_;
+            while (parse_ < write_) {
+                char * start = buffer_ + parse_;
+                char const * tppStart = Sequence::FindSequenceStart(start, end);
+                // hand out the plain input before the sequence, prepended with any unprocessed input
+                if (tppStart != start) {
+                    input_ += received(buffer_ + input_, tppStart);
+                    parse_ = tppStart - buffer_;
+                }
+                if (tppStart == end)
+                    break;
+                // do not rescan the part of an incomplete sequence that has already been searched for its end
+                char const * tppEnd = Sequence::FindSequenceEnd(std::max(tppStart, static_cast<char const *>(buffer_ + scan_)), end);
+                if (tppEnd == end) {
+                    scan_ = write_;
+                    break;
+                }
+                char const * payloadStart = tppStart + 3;
+                Sequence::Kind kind = Sequence::ParseKind(payloadStart, end);
+                receivedSequence(kind, payloadStart, tppEnd);
+                size_t next = tppEnd + 1 - buffer_;
+                // the unprocessed input, if any, is moved over the sequence so that it stays contiguous with the input that follows
+                size_t unprocessed = parse_ - input_;
+                if (unprocessed != 0) {
+                    memmove(buffer_ + next - unprocessed, buffer_ + input_, unprocessed);
+                    copied_ += unprocessed;
+                }
+                input_ = next - unprocessed;
+                parse_ = next;
+                scan_ = next;
+            }
+            // rewind if there is nothing pending
+            if (input_ == write_) {
+                input_ = 0;
+                parse_ = 0;
+                scan_ = 0;
+                write_ = 0;
+            }
+        }
+
+    private:
+
+        /** Moves the pending data to the beginning of the buffer, growing the buffer if the pending data fills it completely.
+         */
+        void makeRoom() {
+            size_t pending = write_ - input_;
+            if (input_ == 0) {
+                LOG(Log::Verbose) << "Input buffer full, growing to " << (capacity_ * 2);
+                char * buffer = new char[capacity_ * 2];
+                memcpy(buffer, buffer_, pending);
+                delete [] buffer_;
+                buffer_ = buffer;
+                capacity_ *= 2;
+            } else {
+                memmove(buffer_, buffer_ + input_, pending);
+                parse_ -= input_;
+                scan_ -= input_;
+                input_ = 0;
+                write_ = pending;
+            }
+            copied_ += pending;
+        }
+
+        char * buffer_;
+        size_t capacity_;
+        /** Start of the plain input not processed by the client yet. */
+        size_t input_ = 0;
+        /** The sequence extraction cursor, everything before it has been handed out. */
+        size_t parse_ = 0;
+        /** Position up to which an incomplete sequence has been searched for its end. */
+        size_t scan_ = 0;
+        /** End of the received data. */
+        size_t write_ = 0;
+        size_t copied_ = 0;
+
+    }; // tpp::InputBuffer
+
+} // namespace tpp
@@ -3,15 +3,22 @@
     #include <signal.h>
     #include <sys/wait.h>
     #include <sys/ioctl.h>
+    #include <sys/uio.h>
+    #include <poll.h>
     #include <errno.h>
     #if (defined ARCH_LINUX)
         #include <pty.h>
+        #include <fcntl.h>
+        #include <spawn.h>
+        #include <sys/stat.h>
+        #include <sys/syscall.h>
     #elif (defined ARCH_MACOS)
         #include <util.h>
     #endif
 #endif
 
 #include "local_pty.h"
+#include "pty_reactor.h"
 
 #include <iostream>
 
@@ -177,7 +184,21 @@ namespace tpp {
 
     LocalPTYMaster::~LocalPTYMaster() {
         terminate();
-        waiter_.join();
+#if (defined ARCH_LINUX)
+        if (writeFd_ != -1) {
+            PTYReactor::Instance().remove(writeWatch_);
+            close(writeFd_);
+        }
+        if (pidfd_ != -1) {
+            PTYReactor::Instance().remove(exitWatch_);
+            // the process has been killed, but the reactor may not have noticed yet
+            if (! terminated_)
+                reap(true);
+            close(pidfd_);
+        }
+#endif
+        if (waiter_.joinable())
+            waiter_.join();
     }
 
     void LocalPTYMaster::terminate() {
@@ -185,6 +206,14 @@ namespace tpp {
     }
 
     void LocalPTYMaster::start() {
+        environment_.unsetIfUnspecified("COLUMNS");
+        environment_.unsetIfUnspecified("LINES");
+        environment_.unsetIfUnspecified("TERMCAP");
+        environment_.setIfUnspecified("TERM", "xterm-256color");
+        environment_.setIfUnspecified("COLORTERM", "truecolor");
+#if (defined ARCH_LINUX) && (defined POSIX_SPAWN_SETSID)
+        spawn();
+#else
 		// fork & open the pty
 		switch (pid_ = forkpty(&pipe_, nullptr, nullptr, nullptr)) {
 			// forkpty failed
@@ -195,11 +224,6 @@ namespace tpp {
 				setsid();
 				if (ioctl(1, TIOCSCTTY, nullptr) < 0)
 					UNREACHABLE;
-				environment_.unsetIfUnspecified("COLUMNS");
-				environment_.unsetIfUnspecified("LINES");
-				environment_.unsetIfUnspecified("TERMCAP");
-				environment_.setIfUnspecified("TERM", "xterm-256color");
-				environment_.setIfUnspecified("COLORTERM", "truecolor");
 				environment_.apply();
 
 				signal(SIGCHLD, SIG_DFL);
@@ -218,18 +242,120 @@ namespace tpp {
 			default:
 				break;
 		}
+#endif
 
+#if (defined ARCH_LINUX)
+        // the master is read by the reactor, the blocking receive() polls when there are no data
+        OSCHECK(fcntl(pipe_, F_SETFL, fcntl(pipe_, F_GETFL) | O_NONBLOCK) != -1);
+#if (defined SYS_pidfd_open)
+        // watch for the process exit from the reactor if the kernel supports pidfd (5.3+), otherwise fallback to the waiter thread
+        pidfd_ = static_cast<int>(syscall(SYS_pidfd_open, pid_, 0));
+        if (pidfd_ != -1) {
+            exitWatch_ = PTYReactor::Instance().add(pidfd_, [this](){
+                return ! reap(false);
+            });
+            return;
+        }
+#endif
+#endif
         waiter_ = std::thread{[this](){
-            pid_t x = waitpid(pid_, &exitCode_, 0);
-            exitCode_ = WEXITSTATUS(exitCode_);
-            // it is ok to see errno ECHILD, happens when process has already been terminated
-            if (x < 0 && errno != ECHILD) 
-                NOT_IMPLEMENTED; // error
-            // mark as terminated
-            terminated_.store(true);
+            reap(true);
         }};
     }
 
+    bool LocalPTYMaster::reap(bool wait) {
+        int status = 0;
+        pid_t x = waitpid(pid_, &status, wait ? 0 : WNOHANG);
+        if (x == 0)
+            return false;
+        // it is ok to see errno ECHILD, happens when process has already been terminated
+        if (x < 0 && errno != ECHILD) 
+            NOT_IMPLEMENTED; // error
+        setTerminated(WEXITSTATUS(status));
+        return true;
+    }
+
+#if (defined ARCH_LINUX) && (defined POSIX_SPAWN_SETSID)
+    namespace {
+
+        /** Finds the executable of given command in the PATH of the environment given as `name=value` strings, the way execvp does. Commands containing a slash are returned as they are. Returns an empty string if the executable cannot be found. 
+         */
+        std::string FindExecutable(std::string const & command, std::vector<std::string> const & env) {
+            if (command.empty() || command.find('/') != std::string::npos)
+                return command;
+            std::string path;
+            auto i = std::find_if(env.begin(), env.end(), [](std::string const & x) { return x.compare(0, 5, "PATH=") == 0; });
+            if (i != env.end()) {
+                path = i->substr(5);
+            } else {
+                path.resize(confstr(_CS_PATH, nullptr, 0));
+                confstr(_CS_PATH, & path[0], path.size());
+                path.pop_back();
+            }
+            for (size_t start = 0; start <= path.size(); ) {
+                size_t end = std::min(path.find(':', start), path.size());
+                // empty entries denote the current directory
+                std::string dir = end == start ? std::string{"."} : path.substr(start, end - start);
+                std::string candidate = dir + "/" + command;
+                struct stat st;
+                if (stat(candidate.c_str(), & st) == 0 && S_ISREG(st.st_mode) && access(candidate.c_str(), X_OK) == 0)
+                    return candidate;
+                start = end + 1;
+            }
+            return std::string{};
+        }
+
+    }
+
+    void LocalPTYMaster::spawn() {
+        // open the pseudoterminal pair manually, the slave is opened only by the child
+        pipe_ = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+        OSCHECK(pipe_ != -1) << "Unable to open pseudoterminal";
+        char slave[64];
+        if (grantpt(pipe_) != 0 || unlockpt(pipe_) != 0 || ptsname_r(pipe_, slave, sizeof(slave)) != 0) {
+            int err = errno;
+            close(pipe_);
+            errno = err;
+            OSCHECK(false) << "Unable to open pseudoterminal";
+        }
+        // the child starts a new session and opening the slave then makes it its controlling terminal
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, slave, O_RDWR, 0);
+        posix_spawn_file_actions_adddup2(&actions, STDIN_FILENO, STDOUT_FILENO);
+        posix_spawn_file_actions_adddup2(&actions, STDIN_FILENO, STDERR_FILENO);
+        posix_spawnattr_t attr;
+        posix_spawnattr_init(&attr);
+        sigset_t signals;
+        sigemptyset(&signals);
+        posix_spawnattr_setsigmask(&attr, &signals);
+        for (int sig : { SIGCHLD, SIGHUP, SIGINT, SIGQUIT, SIGTERM, SIGALRM, SIGPIPE })
+            sigaddset(&signals, sig);
+        posix_spawnattr_setsigdefault(&attr, &signals);
+        posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSID | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+        std::vector<std::string> env{environment_.toEnvp()};
+        std::vector<char *> envp;
+        for (std::string & i : env)
+            envp.push_back(&i[0]);
+        envp.push_back(nullptr);
+        // posix_spawnp would search the PATH of the terminal, not the one the session gets
+        std::string executable = FindExecutable(command_.command(), env);
+        int err = ENOENT;
+        if (! executable.empty()) {
+            char ** argv = command_.toArgv();
+            err = posix_spawn(&pid_, executable.c_str(), &actions, &attr, argv, envp.data());
+            delete [] argv;
+        }
+        posix_spawnattr_destroy(&attr);
+        posix_spawn_file_actions_destroy(&actions);
+        if (err != 0) {
+            close(pipe_);
+            errno = err;
+            OSCHECK(false) << "Unable to execute command " << command_;
+        }
+    }
+#endif
+
     void LocalPTYMaster::resize(int cols, int rows) {
         struct winsize s;
         s.ws_row = rows;
@@ -240,17 +366,108 @@ namespace tpp {
             NOT_IMPLEMENTED;
     }
 
+#if (defined ARCH_LINUX)
+
+    /** Writes what it can right away, the rest is queued and written by the reactor when the slave reads, so that the caller, typically the UI thread, never blocks. 
+     */
+    void LocalPTYMaster::send(char const * buffer, size_t bufferSize) {
+        std::lock_guard<std::mutex> g{mSend_};
+        // only write directly if there is nothing queued, otherwise the order would not be preserved
+        if (outgoing_.empty()) {
+            while (bufferSize > 0) {
+                ssize_t nw = ::write(pipe_, buffer, bufferSize);
+                if (nw < 0) {
+                    if (errno == EINTR)
+                        continue;
+                    // EIO means the slave has been closed and there is nobody to send the data to
+                    if (errno == EIO)
+                        return;
+                    OSCHECK(errno == EAGAIN) << "Unable to write to pseudoterminal";
+                    break;
+                }
+                buffer += nw;
+                bufferSize -= static_cast<size_t>(nw);
+            }
+            if (bufferSize == 0)
+                return;
+            outgoing_.emplace_back(buffer, bufferSize);
+            if (writeFd_ == -1) {
+                writeFd_ = dup(pipe_);
+                OSCHECK(writeFd_ != -1) << "Unable to duplicate pseudoterminal descriptor";
+                writeWatch_ = PTYReactor::Instance().add(writeFd_, [this](){
+                    size_t pending;
+                    bool again;
+                    {
+                        std::lock_guard<std::mutex> g{mSend_};
+                        again = writeQueued() && ! outgoing_.empty();
+                        pending = pendingBytes_;
+                    }
+                    sendProgress(pending);
+                    return again;
+                }, /* writable */ true);
+            } else {
+                PTYReactor::Instance().rearm(writeWatch_);
+            }
+        } else if (outgoing_.back().size() < MIN_QUEUED_BUFFER) {
+            outgoing_.back().append(buffer, bufferSize);
+        } else {
+            outgoing_.emplace_back(buffer, bufferSize);
+        }
+        pendingBytes_ += bufferSize;
+    }
+
+    bool LocalPTYMaster::writeQueued() {
+        while (! outgoing_.empty()) {
+            iovec iov[MAX_WRITE_BUFFERS];
+            int n = 0;
+            for (auto i = outgoing_.begin(), e = outgoing_.end(); i != e && n < static_cast<int>(MAX_WRITE_BUFFERS); ++i, ++n) {
+                size_t offset = (n == 0) ? outgoingWritten_ : 0;
+                iov[n].iov_base = const_cast<char *>(i->c_str() + offset);
+                iov[n].iov_len = i->size() - offset;
+            }
+            ssize_t nw = ::writev(writeFd_, iov, n);
+            if (nw < 0) {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN)
+                    return true;
+                // the slave has been closed, the queued data will never be read
+                outgoing_.clear();
+                outgoingWritten_ = 0;
+                pendingBytes_ = 0;
+                return false;
+            }
+            pendingBytes_ -= static_cast<size_t>(nw);
+            size_t written = static_cast<size_t>(nw) + outgoingWritten_;
+            while (! outgoing_.empty() && written >= outgoing_.front().size()) {
+                written -= outgoing_.front().size();
+                outgoing_.pop_front();
+            }
+            outgoingWritten_ = written;
+        }
+        return true;
+    }
+
+#else
+
     void LocalPTYMaster::send(char const * buffer, size_t bufferSize) {
 		int nw = ::write(pipe_, (void*)buffer, bufferSize);
         OSCHECK(nw >= 0 && static_cast<unsigned>(nw) == bufferSize);
     }
 
+#endif
+
     size_t LocalPTYMaster::receive(char * buffer, size_t bufferSize) {
         while (true) {
             int cnt = 0;
             cnt = ::read(pipe_, (void*)buffer, bufferSize);
             if (cnt == -1) {
-                if (errno == EINTR || errno == EAGAIN)
+                if (errno == EAGAIN) {
+                    pollfd p{pipe_, POLLIN, 0};
+                    ::poll(&p, 1, -1);
+                    continue;
+                }
+                if (errno == EINTR)
                     continue;
                 return 0;
             } else {
@@ -259,6 +476,21 @@ namespace tpp {
         }
     }
 
+#if (defined ARCH_LINUX)
+    size_t LocalPTYMaster::tryReceive(char * buffer, size_t bufferSize, bool & closed) {
+        while (true) {
+            int cnt = ::read(pipe_, (void*)buffer, bufferSize);
+            if (cnt > 0)
+                return static_cast<size_t>(cnt);
+            if (cnt == -1 && errno == EINTR)
+                continue;
+            // reading the master fails with EIO once all descriptors of the slave are closed
+            closed = cnt == 0 || errno != EAGAIN;
+            return 0;
+        }
+    }
+#endif
+
 #endif
 
     // LocalPTYSlave
@@ -8,6 +8,8 @@
 #endif
 
 #include <thread>
+#include <deque>
+#include <string>
 
 #include "pty.h"
 
@@ -25,10 +27,54 @@ namespace tpp {
         size_t receive(char * buffer, size_t bufferSize) override;
         void resize(int cols, int rows) override;
 
+#if (defined ARCH_LINUX)
+        int pollHandle() const override {
+            return pipe_;
+        }
+
+        size_t tryReceive(char * buffer, size_t bufferSize, bool & closed) override;
+
+        size_t pendingBytes() const override {
+            return pendingBytes_;
+        }
+#endif
+
     private:
 
+#if (defined ARCH_LINUX)
+        /** Maximum number of buffers written by a single writev call. 
+         */
+        static constexpr size_t MAX_WRITE_BUFFERS = 64;
+
+        /** Queued sends smaller than this are appended to the last queued buffer instead of creating a new one. 
+         */
+        static constexpr size_t MIN_QUEUED_BUFFER = 4096;
+
+        /** Writes as much of the queued data as possible without blocking. 
+         
+            Expects the send lock to be held. Returns false if the queue could not be written because the slave has been closed, in which case the queue is discarded. 
+         */
+        bool writeQueued();
+#endif
+
         void start();
 
+#if (defined ARCH_UNIX)
+        /** Collects the exit code of the terminated process and marks the pseudoterminal as terminated. 
+
+            Returns false if the process is still running and the wait was not requested. 
+         */
+        bool reap(bool wait);
+#endif
+
+#if (defined ARCH_LINUX)
+        /** Opens the pseudoterminal and starts the command in it with posix_spawn. 
+
+            Unlike forkpty, which duplicates the page tables of the whole terminal process including its possibly huge history, posix_spawn uses vfork semantics so the cost of starting a session does not grow with the memory used by the terminal. The command is looked up in the PATH of the session's environment. 
+         */
+        void spawn();
+#endif
+
         Command command_;
         Environment environment_;
 
@@ -59,6 +105,31 @@ namespace tpp {
 
         /* Pid of the process. */
 		pid_t pid_;
+
+#if (defined ARCH_LINUX)
+        /* Descriptor of the process that becomes readable when it exits, watched by the PTY reactor instead of the waiter thread. -1 if pidfd is not supported by the kernel. */
+        int pidfd_ = -1;
+
+        /* Registration of the pidfd with the reactor. */
+        size_t exitWatch_ = 0;
+
+        /* Guards the outgoing queue. */
+        std::mutex mSend_;
+
+        /* Data sent while the slave was not reading, written by the reactor when the pipe becomes writable. The first buffer may have been partially written already. */
+        std::deque<std::string> outgoing_;
+
+        /* Number of bytes of the first outgoing buffer that have already been written. */
+        size_t outgoingWritten_ = 0;
+
+        std::atomic<size_t> pendingBytes_{0};
+
+        /* Duplicate of the pipe registered with the reactor for writing, since the pipe itself is registered for reading. -1 until the first time the queue is used. */
+        int writeFd_ = -1;
+
+        /* Registration of the write descriptor with the reactor. */
+        size_t writeWatch_ = 0;
+#endif
 #endif
 
     }; // tpp::LocalPTYMaster
@@ -1,6 +1,8 @@
 #pragma once 
 
 #include <atomic>
+#include <mutex>
+#include <functional>
 
 #include "helpers/process.h"
 #include "helpers/events.h"
@@ -72,6 +74,55 @@ namespace tpp {
             THROW(IOError()) << "Cannot obtain exit code of unterminated pseudoterminal's process";
         }
 
+        /** Returns a file descriptor that becomes readable when there are data to be received, or -1 if the pseudoterminal can only be read by blocking receive() calls. 
+
+            Pseudoterminals with a descriptor are read by the tryReceive() method from the shared PTY reactor instead of having a reader thread each. Such pseudoterminals must report their termination via setTerminated().
+         */
+        virtual int pollHandle() const {
+            return -1;
+        }
+
+        /** Receives the data that are available without blocking and returns their size. 
+
+            If there are no data, returns 0 and sets closed to true if there will never be any more data. Only supported by pseudoterminals with poll handle.
+         */
+        virtual size_t tryReceive(char * buffer, size_t bufferSize, bool & closed) {
+            MARK_AS_UNUSED(buffer);
+            MARK_AS_UNUSED(bufferSize);
+            MARK_AS_UNUSED(closed);
+            NOT_IMPLEMENTED;
+        }
+
+        /** Returns the number of bytes sent, but not yet written to the pseudoterminal. 
+
+            Pseudoterminals that write synchronously always return 0. Those that queue the data when the slave does not read them fast enough, so that send() never blocks, return the size of the queue. This can be used to throttle the sender and to report the progress of large pastes.
+         */
+        virtual size_t pendingBytes() const {
+            return 0;
+        }
+
+        /** Sets the handler called with the number of pending bytes whenever queued data are written to the pseudoterminal, including the final 0 when the queue empties. 
+
+            The handler is called from the thread that writes the data and must be set before anything is sent.
+         */
+        void setSendProgressHandler(std::function<void(size_t)> handler) {
+            sendProgressHandler_ = std::move(handler);
+        }
+
+        /** Registers a handler to be called once the slave terminates. 
+
+            If the slave has already terminated, the handler is called immediately. Otherwise it is called from whichever thread detects the termination. Only supported by pseudoterminals with poll handle.
+         */
+        void whenTerminated(std::function<void()> handler) {
+            std::unique_lock<std::mutex> g{mTerminated_};
+            if (! terminated_) {
+                terminatedHandler_ = std::move(handler);
+                return;
+            }
+            g.unlock();
+            handler();
+        }
+
     protected:
 
         PTYMaster():
@@ -79,9 +130,37 @@ namespace tpp {
             exitCode_{0} {
         }
 
+        /** Records the exit code of the slave, marks the pseudoterminal as terminated and calls the termination handler, if any. 
+         */
+        void setTerminated(ExitCode exitCode) {
+            std::function<void()> handler;
+            {
+                std::lock_guard<std::mutex> g{mTerminated_};
+                exitCode_ = exitCode;
+                terminated_.store(true);
+                std::swap(handler, terminatedHandler_);
+            }
+            if (handler)
+                handler();
+        }
+
+        /** Reports the number of still pending bytes to the send progress handler, if any. 
+         */
+        void sendProgress(size_t pending) {
+            if (sendProgressHandler_)
+                sendProgressHandler_(pending);
+        }
+
         std::atomic<bool> terminated_;
         ExitCode exitCode_;
 
+    private:
+
+        std::function<void(size_t)> sendProgressHandler_;
+
+        std::mutex mTerminated_;
+        std::function<void()> terminatedHandler_;
+
     }; // tpp::PTYMaster
 
 
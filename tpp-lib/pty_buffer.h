@@ -1,8 +1,11 @@
 #pragma once
 
 #include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #include "pty.h"
+#include "pty_reactor.h"
 
 namespace tpp {
 
@@ -40,33 +43,31 @@ namespace tpp {
             MARK_AS_UNUSED(exitCode);
         }
 
+        /** Starts reading the pseudoterminal. 
+
+            Pseudoterminals with a poll handle are read by the shared PTY reactor, all other get a reader thread of their own. 
+         */
         void startPTYReader() {
+            bufferSize_ = DEFAULT_BUFFER_SIZE;
+            buffer_ = new char[bufferSize_];
+#if (defined ARCH_LINUX)
+            if (pty_->pollHandle() != -1) {
+                readerWatch_ = PTYReactor::Instance().add(pty_->pollHandle(), [this](){
+                    return readAvailable();
+                });
+                pty_->whenTerminated([this](){
+                    readerFinished();
+                });
+                return;
+            }
+#endif
             reader_ = std::thread{[this](){
-                size_t unprocessed = 0;
-                size_t bufferSize = DEFAULT_BUFFER_SIZE;
-                char * buffer = new char[DEFAULT_BUFFER_SIZE];
                 while (true) {
-                    size_t available = pty_->receive(buffer + unprocessed, bufferSize - unprocessed);
+                    size_t available = pty_->receive(buffer_ + unprocessed_, bufferSize_ - unprocessed_);
                     // if no more bytes were read, then the PTY has been terminated, exit the loop
                     if (available == 0 && pty_->terminated())
                         break;
-                    available += unprocessed;
-                    unprocessed = available - received(buffer, buffer + available);
-                    // copy the unprocessed bytes at the beginning of the buffer
-                    memcpy(buffer, buffer + available - unprocessed, unprocessed);
-                    // grow the buffer if unprocessed == bufferSize
-                    if (unprocessed == bufferSize) {
-                        if (bufferSize < MAX_BUFFER_SIZE) {
-                            bufferSize *= 2;
-                            char * b = new char[bufferSize];
-                            memcpy(b, buffer, unprocessed);
-                            delete [] buffer;
-                            buffer = b;
-                        } else {
-                            unprocessed = 0;
-                            LOG() << "Buffer overflow, discarding " << bufferSize << " bytes";
-                        }
-                    }
+                    process(available);
                 }
                 ptyTerminated(pty_->exitCode());
             }};
@@ -75,9 +76,23 @@ namespace tpp {
         void terminatePty() {
             ASSERT(pty_ != nullptr);
             pty_->terminate();
-            reader_.join();
+#if (defined ARCH_LINUX)
+            if (readerWatch_ != 0) {
+                {
+                    std::unique_lock<std::mutex> g{mReader_};
+                    while (readerPending_ != 0)
+                        cvReader_.wait(g);
+                }
+                PTYReactor::Instance().remove(readerWatch_);
+                readerWatch_ = 0;
+            }
+#endif
+            if (reader_.joinable())
+                reader_.join();
             delete pty_;
             pty_ = nullptr;
+            delete [] buffer_;
+            buffer_ = nullptr;
         }
 
         void send(char const * what, size_t size) {
@@ -89,9 +104,81 @@ namespace tpp {
 
     private:
 
+        /** Processes the bytes read after the unprocessed bytes from previous reads, growing the buffer if none of them can be processed. 
+         */
+        void process(size_t available) {
+            available += unprocessed_;
+            unprocessed_ = available - received(buffer_, buffer_ + available);
+            // copy the unprocessed bytes at the beginning of the buffer
+            memcpy(buffer_, buffer_ + available - unprocessed_, unprocessed_);
+            // grow the buffer if unprocessed == bufferSize
+            if (unprocessed_ == bufferSize_) {
+                if (bufferSize_ < MAX_BUFFER_SIZE) {
+                    bufferSize_ *= 2;
+                    char * b = new char[bufferSize_];
+                    memcpy(b, buffer_, unprocessed_);
+                    delete [] buffer_;
+                    buffer_ = b;
+                } else {
+                    unprocessed_ = 0;
+                    LOG() << "Buffer overflow, discarding " << bufferSize_ << " bytes";
+                }
+            }
+        }
+
+#if (defined ARCH_LINUX)
+
+        /** Number of reads a reactor worker does before it lets the other pseudoterminals have their turn. 
+         */
+        static constexpr size_t MAX_READS_PER_DISPATCH = 16;
+
+        /** Processes the data available in the pseudoterminal, called by the reactor when the poll handle becomes readable. 
+         
+            Returns true if the pseudoterminal should be watched again. 
+         */
+        bool readAvailable() {
+            for (size_t i = 0; i < MAX_READS_PER_DISPATCH; ++i) {
+                bool closed = false;
+                size_t available = pty_->tryReceive(buffer_ + unprocessed_, bufferSize_ - unprocessed_, closed);
+                if (available == 0) {
+                    if (! closed)
+                        return true;
+                    readerFinished();
+                    return false;
+                }
+                process(available);
+            }
+            return true;
+        }
+
+        /** Called when the input of the pseudoterminal is closed and when its process terminates, whichever comes later notifies the buffer that the pseudoterminal has been terminated. 
+         
+            Both must happen so that all output has been processed and the exit code is known, just like when a reader thread is used. 
+         */
+        void readerFinished() {
+            std::lock_guard<std::mutex> g{mReader_};
+            if (--readerPending_ == 0) {
+                ptyTerminated(pty_->exitCode());
+                cvReader_.notify_all();
+            }
+        }
+
+        /** Registration of the poll handle with the reactor, 0 if a reader thread is used. */
+        size_t readerWatch_ = 0;
+        /** Number of events (input closed, process terminated) to happen before the pseudoterminal is finished. */
+        unsigned readerPending_ = 2;
+        std::mutex mReader_;
+        std::condition_variable cvReader_;
+
+#endif
 
         std::thread reader_;
 
+        char * buffer_ = nullptr;
+        size_t bufferSize_ = 0;
+        /** Number of bytes at the beginning of the buffer left unprocessed by the last read. */
+        size_t unprocessed_ = 0;
+
     }; // tpp::PTYBuffer
 
 } // namespace tpp
\ No newline at end of file
@@ -0,0 +1,139 @@
+#if (defined ARCH_LINUX)
+
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "pty_reactor.h"
+
+namespace tpp {
+
+    PTYReactor & PTYReactor::Instance() {
+        // the reactor threads run until the process exits, so the reactor is never destroyed
+        static PTYReactor * reactor = new PTYReactor{};
+        return *reactor;
+    }
+
+    PTYReactor::PTYReactor():
+        epoll_{epoll_create1(EPOLL_CLOEXEC)} {
+        OSCHECK(epoll_ != -1) << "Unable to create epoll instance";
+    }
+
+    size_t PTYReactor::add(int fd, Handler handler, bool writable) {
+        std::lock_guard<std::mutex> g{m_};
+        start();
+        size_t id = nextId_++;
+        Registration & r = registrations_[id];
+        r.fd = fd;
+        r.writable = writable;
+        r.handler = std::move(handler);
+        if (! arm(id, r, true)) {
+            registrations_.erase(id);
+            THROW(OSError()) << "Unable to watch descriptor " << fd;
+        }
+        return id;
+    }
+
+    void PTYReactor::rearm(size_t id) {
+        std::lock_guard<std::mutex> g{m_};
+        auto i = registrations_.find(id);
+        if (i == registrations_.end())
+            return;
+        if (i->second.runner != std::thread::id{})
+            i->second.rearm = true;
+        else if (! arm(id, i->second, false))
+            THROW(OSError()) << "Unable to rearm descriptor " << i->second.fd;
+    }
+
+    void PTYReactor::remove(size_t id) {
+        std::unique_lock<std::mutex> g{m_};
+        auto i = registrations_.find(id);
+        if (i == registrations_.end())
+            return;
+        // the descriptor may already be closed, in which case the kernel has forgotten it already
+        epoll_ctl(epoll_, EPOLL_CTL_DEL, i->second.fd, nullptr);
+        if (i->second.runner == std::this_thread::get_id()) {
+            i->second.removed = true;
+            return;
+        }
+        while (i->second.runner != std::thread::id{}) {
+            cvDone_.wait(g);
+            i = registrations_.find(id);
+        }
+        // any events already queued for the registration are ignored by the workers
+        registrations_.erase(i);
+    }
+
+    void PTYReactor::start() {
+        if (poller_.joinable())
+            return;
+        size_t n = std::max(MIN_WORKERS, static_cast<size_t>(std::thread::hardware_concurrency()));
+        for (size_t i = 0; i < n; ++i)
+            workers_.push_back(std::thread{[this](){ work(); }});
+        poller_ = std::thread{[this](){ poll(); }};
+    }
+
+    void PTYReactor::poll() {
+        epoll_event events[64];
+        while (true) {
+            int n = epoll_wait(epoll_, events, 64, -1);
+            if (n < 0) {
+                // any other error would fail again immediately and the descriptors would never be serviced, so it is fatal
+                OSCHECK(errno == EINTR) << "epoll_wait failed";
+                continue;
+            }
+            {
+                std::lock_guard<std::mutex> g{m_};
+                for (int i = 0; i < n; ++i)
+                    queue_.push_back(events[i].data.u64);
+            }
+            if (n == 1)
+                cvWork_.notify_one();
+            else
+                cvWork_.notify_all();
+        }
+    }
+
+    void PTYReactor::work() {
+        std::unique_lock<std::mutex> g{m_};
+        while (true) {
+            while (queue_.empty())
+                cvWork_.wait(g);
+            size_t id = queue_.front();
+            queue_.pop_front();
+            auto i = registrations_.find(id);
+            if (i == registrations_.end() || i->second.runner != std::thread::id{})
+                continue;
+            // references to the map elements are stable and the registration is not erased while its handler runs
+            Registration & r = i->second;
+            r.runner = std::this_thread::get_id();
+            g.unlock();
+            bool again = false;
+            try {
+                again = r.handler();
+            } catch (std::exception const & e) {
+                LOG() << "Unhandled exception in PTY handler: " << e.what();
+            }
+            g.lock();
+            r.runner = std::thread::id{};
+            again = again || r.rearm;
+            r.rearm = false;
+            if (r.removed)
+                registrations_.erase(id);
+            // rearming happens on the worker threads where there is nobody to throw to
+            else if (again && ! arm(id, r, false))
+                LOG() << "Unable to rearm descriptor " << r.fd << ", errno " << errno;
+            cvDone_.notify_all();
+        }
+    }
+
+    bool PTYReactor::arm(size_t id, Registration const & r, bool add) {
+        epoll_event e{};
+        e.events = (r.writable ? EPOLLOUT : EPOLLIN) | EPOLLONESHOT;
+        e.data.u64 = id;
+        return epoll_ctl(epoll_, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, r.fd, &e) == 0;
+    }
+
+} // namespace tpp
+
+#endif
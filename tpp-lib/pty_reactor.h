@@ -0,0 +1,115 @@
+#pragma once
+#if (defined ARCH_LINUX)
+
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <unordered_map>
+#include <condition_variable>
+
+#include "helpers/helpers.h"
+
+namespace tpp {
+
+    /** Services the file descriptors of all pseudoterminals in the process with a single epoll thread and a small pool of workers.
+
+        Instead of a blocking reader thread per pseudoterminal, the descriptors are registered with the reactor together with a handler. When a descriptor becomes readable, or writable for descriptors with data waiting to be sent, the reactor thread hands its handler to the worker pool. The descriptors are watched in one shot mode, so a handler never runs concurrently with itself and the descriptor is only watched again after the handler returns and asks for it. The number of threads therefore does not grow with the number of sessions and idle descriptors cost no wakeups at all.
+
+        The handlers must not block on I/O, but they may wait for short-lived locks, such as the terminal's buffer lock held by the UI thread while it paints. The pool therefore has at least MIN_WORKERS workers regardless of the number of cores so that handlers waiting for a lock do not stall the other descriptors. A handler that has more work than it wishes to do at once simply returns and asks to be watched again, so that the other descriptors get their turn. The threads are started with the first registration.
+     */
+    class PTYReactor {
+    public:
+
+        /** Handler of a readable descriptor, which returns true if the descriptor should be watched again.
+
+            Handlers may occasionally be called even if the descriptor is not readable and must cope with that.
+         */
+        using Handler = std::function<bool()>;
+
+        /** Minimal number of worker threads.
+         */
+        static constexpr size_t MIN_WORKERS = 4;
+
+        /** Returns the reactor shared by all pseudoterminals.
+         */
+        static PTYReactor & Instance();
+
+        PTYReactor(PTYReactor const &) = delete;
+        PTYReactor & operator = (PTYReactor const &) = delete;
+
+        /** Starts watching the given descriptor and returns the id of the registration.
+
+            By default the descriptor is watched for being readable, if writable is true, the handler is called when the descriptor becomes writable instead. A descriptor may only be registered once for each direction, but its duplicate can be registered separately.
+         */
+        size_t add(int fd, Handler handler, bool writable = false);
+
+        /** Watches again a descriptor whose handler previously asked not to be watched.
+
+            If the handler is running, the descriptor will be watched after it returns regardless of its result. 
+         */
+        void rearm(size_t id);
+
+        /** Stops watching the descriptor registered under given id.
+
+            When called from a thread other than the one running the handler, waits for the handler to finish so that it is guaranteed it will never run after the call returns. The descriptor must be closed only after it has been removed.
+         */
+        void remove(size_t id);
+
+        /** Returns the number of worker threads.
+         */
+        size_t workers() const {
+            return workers_.size();
+        }
+
+    private:
+
+        struct Registration {
+            int fd;
+            Handler handler;
+            /** Thread running the handler, if any. */
+            std::thread::id runner;
+            bool writable;
+            /** The registration was removed by its own handler and should be deleted when the handler returns. */
+            bool removed = false;
+            /** Rearm was requested while the handler was running. */
+            bool rearm = false;
+        };
+
+        PTYReactor();
+
+        /** Starts the epoll and worker threads unless already running.
+         */
+        void start();
+
+        /** Waits for the readable descriptors and queues their handlers for the workers.
+         */
+        void poll();
+
+        /** Executes the queued handlers and rearms their descriptors.
+         */
+        void work();
+
+        /** Watches the descriptor for a single readable event, returning false on failure.
+         */
+        bool arm(size_t id, Registration const & r, bool add);
+
+        int epoll_;
+        std::thread poller_;
+        std::vector<std::thread> workers_;
+
+        std::mutex m_;
+        /** Signals new work to the workers. */
+        std::condition_variable cvWork_;
+        /** Signals finished handlers to threads removing registrations. */
+        std::condition_variable cvDone_;
+        std::deque<size_t> queue_;
+        std::unordered_map<size_t, Registration> registrations_;
+        size_t nextId_ = 1;
+
+    }; // tpp::PTYReactor
+
+} // namespace tpp
+
+#endif
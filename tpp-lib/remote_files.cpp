@@ -1,4 +1,7 @@
+#include <memory>
+
 #include "helpers/filesystem.h"
+#include "helpers/hash.h"
 
 #include "remote_files.h"
 
@@ -14,20 +17,32 @@ namespace tpp {
         std::filesystem::path localPath = localRoot_ / remoteHost / remoteFilename;
         // if the local path exists, look if there is existing connection id
         File * file = getOrCreateFile(remoteHost, req.remotePath(), localPath, req.size());
-        // create the file and open its stream
-        if (file->f_.good())
+        if (file->f_.is_open())
             file->f_.close();
-        file->f_.open(file->localPath_, std::ios::binary);
+        // if there is a local copy already, open it without truncating so that its unchanged parts can be skipped by the transfer
+        file->localSize_ = 0;
+        if (std::filesystem::exists(file->localPath_)) {
+            file->f_.open(file->localPath_, std::ios::binary | std::ios::in | std::ios::out);
+            if (file->f_.good())
+                file->localSize_ = std::filesystem::file_size(file->localPath_);
+        } else {
+            file->f_.open(file->localPath_, std::ios::binary | std::ios::out);
+        }
         // if the file can't be opened, maybe it is locked by existing viewer, rename and try again
         if (!file->f_.good()) {
             std::pair<std::string, std::string> fext = SplitFilenameExt(remotePath);
             std::string filename = UniqueNameIn(localRoot_ / remoteHost, fext.first, fext.second);
             localPath = localRoot_ / remoteHost / filename;
             file->localPath_ = localPath.string();
-            file->f_.open(file->localPath_, std::ios::binary);
+            file->localSize_ = 0;
+            file->f_.clear();
+            file->f_.open(file->localPath_, std::ios::binary | std::ios::out);
             if (!file->f_.good())
                 THROW(IOError()) << "Unable to open local file for writing: " << file->localPath();
         }
+        // empty files are transferred immediately
+        if (file->size_ == 0)
+            transferCompleted(file);
         // return the acknowledgement
         return Sequence::Ack::Response{Sequence::Ack{req, file->id_}};
     }
@@ -37,21 +52,104 @@ namespace tpp {
         // only accept the transfer if the data is from valid offset
         if (f->received_ != data.packet())
             return false;
-        // store the file
+        // store the file, seek first as skipped data does not move the write position
+        f->f_.seekp(data.packet());
         f->f_.write(data.payload(), data.size());
         f->received_ += data.size();
         // if all has been received, close the file
         if (f->received_ == f->size_)
-            f->f_.close();
+            transferCompleted(f);
+        return true;
+    }
+
+    bool RemoteFiles::skip(Sequence::SkipData const & skip) {
+        File * f = get(skip.id());
+        if (f == nullptr || f->received_ != skip.offset() || skip.offset() + skip.size() > f->localSize_ || skip.offset() + skip.size() > f->size_)
+            return false;
+        f->received_ += skip.size();
+        if (f->received_ == f->size_)
+            transferCompleted(f);
         return true;
     }
 
     Sequence::TransferStatus::Response RemoteFiles::getTransferStatus(Sequence::GetTransferStatus const & req) {
         File * f = get(req.id());
-        if (f == nullptr)
+        if (f == nullptr) {
             return Sequence::TransferStatus::Response::Deny(req, "Not found");
-        else
-            return Sequence::TransferStatus::Response{Sequence::TransferStatus{req.id(), f->size_, f->received_}};
+        } else {
+            Sequence::TransferStatus result{req.id(), f->size_, f->received_};
+            result.setRequestId(req.requestId());
+            return Sequence::TransferStatus::Response{result};
+        }
+    }
+
+    RemoteFiles::~RemoteFiles() {
+        {
+            std::lock_guard<std::mutex> g{mHasher_};
+            stopHasher_ = true;
+            hasherReady_.notify_one();
+        }
+        if (hasher_.joinable())
+            hasher_.join();
+        for (auto & i : files_)
+            delete i.second;
+    }
+
+    void RemoteFiles::getBlockHashes(Sequence::GetBlockHashes const & req, std::function<void(Sequence::BlockHashes::Response const &)> handler) {
+        File * f = get(req.id());
+        if (f == nullptr) {
+            handler(Sequence::BlockHashes::Response::Deny(req, "Not found"));
+            return;
+        }
+        if (req.blockSize() == 0 || req.blockSize() > Sequence::GetBlockHashes::MAX_BLOCK_SIZE) {
+            handler(Sequence::BlockHashes::Response::Deny(req, "Invalid block size"));
+            return;
+        }
+        // a stale local copy may be much larger than the transferred file, but only its part within the file can be skipped
+        Sequence::BlockHashes result{req.id(), req.blockSize(), std::min(f->localSize_, f->size_)};
+        result.setRequestId(req.requestId());
+        if (result.size() == 0) {
+            handler(Sequence::BlockHashes::Response{result});
+            return;
+        }
+        f->f_.flush();
+        std::lock_guard<std::mutex> g{mHasher_};
+        hashRequests_.push_back(HashRequest{f->localPath_, result, handler});
+        if (! hasher_.joinable())
+            hasher_ = std::thread{[this](){ hashBlocks(); }};
+        hasherReady_.notify_one();
+    }
+
+    void RemoteFiles::hashBlocks() {
+        while (true) {
+            std::unique_lock<std::mutex> g{mHasher_};
+            while (hashRequests_.empty() && ! stopHasher_)
+                hasherReady_.wait(g);
+            if (stopHasher_)
+                return;
+            HashRequest req{std::move(hashRequests_.front())};
+            hashRequests_.pop_front();
+            g.unlock();
+            size_t blockSize = req.result.blockSize();
+            std::unique_ptr<char[]> buffer{new char[blockSize]};
+            std::ifstream local{req.localPath, std::ios::binary};
+            for (size_t offset = 0; offset < req.result.size(); offset += blockSize) {
+                if (stopHasher_)
+                    return;
+                size_t size = std::min(blockSize, req.result.size() - offset);
+                local.read(buffer.get(), size);
+                if (static_cast<size_t>(local.gcount()) != size)
+                    break;
+                req.result.addHash(FNV1a64(buffer.get(), size));
+            }
+            req.handler(Sequence::BlockHashes::Response{req.result});
+        }
+    }
+
+    void RemoteFiles::transferCompleted(File * f) {
+        f->f_.close();
+        if (f->localSize_ > f->size_)
+            std::filesystem::resize_file(f->localPath_, f->size_);
     }
 
     RemoteFiles::File * RemoteFiles::getOrCreateFile(std::string const & remoteHost, std::string const & remotePath, std::filesystem::path const & localPath, size_t size) {
@@ -1,8 +1,14 @@
 #pragma once
+#include <atomic>
 #include <mutex>
 #include <map>
+#include <deque>
+#include <thread>
+#include <fstream>
 #include <string>
+#include <functional>
 #include <filesystem>
+#include <condition_variable>
 
 #include "sequence.h"
 
@@ -39,6 +45,14 @@ namespace tpp {
                 return size_ == received_;
             }
 
+            /** Size of the local copy of the file when the transfer was opened. 
+             
+                Parts of the local copy that are identical to the transferred file may be skipped by the transfer.
+             */
+            size_t localSize() const {
+                return localSize_;
+            }
+
         private:
             friend class RemoteFiles;
 
@@ -48,6 +62,7 @@ namespace tpp {
                 localPath_{localPath},
                 size_{size},
                 received_{0},
+                localSize_{0},
                 id_{id} {
             }
 
@@ -56,7 +71,8 @@ namespace tpp {
             std::string localPath_;
             size_t size_;
             size_t received_;
-            std::ofstream f_;
+            size_t localSize_;
+            std::fstream f_;
             /* Stream id. */
             size_t id_;
         }; // RemoteFiles::File
@@ -65,6 +81,10 @@ namespace tpp {
             localRoot_{localRoot} {
         }
 
+        /** Stops the hashing of the local copies, the handlers of the unfinished requests are not called, and closes the files. 
+         */
+        ~RemoteFiles();
+
         File * get(size_t id) {
             std::lock_guard<std::mutex> g(mFiles_);
             auto i = files_.find(id);
@@ -75,10 +95,39 @@ namespace tpp {
 
         bool transfer(Sequence::Data const & data);
 
+        /** Advances the transfer past data that is already present in the local copy. 
+         
+            Only accepted if the skipped range starts at the received offset and lies within the local copy, returns false otherwise. 
+         */
+        bool skip(Sequence::SkipData const & skip);
+
         Sequence::TransferStatus::Response getTransferStatus(Sequence::GetTransferStatus const & req);
 
+        /** Calculates the hashes of the local copy's blocks so that the sender can skip the unchanged ones. 
+         
+            Only the part of the local copy that can be skipped, i.e. up to the size of the transferred file, is hashed. Since reading the local copy may take long, the blocks are hashed by a worker thread and the response is passed to the handler, which is called from the worker thread, or immediately if the request is denied. 
+         */
+        void getBlockHashes(Sequence::GetBlockHashes const & req, std::function<void(Sequence::BlockHashes::Response const &)> handler);
+
     private:
 
+        class HashRequest {
+        public:
+            std::string localPath;
+            Sequence::BlockHashes result;
+            std::function<void(Sequence::BlockHashes::Response const &)> handler;
+        };
+
+        /** The worker thread that hashes the blocks of the local copies. 
+         */
+        void hashBlocks();
+
+        /** Called when all data of the file has been received. 
+         
+            Closes the local copy and truncates it to the transferred size in case the previous local copy was larger. 
+         */
+        void transferCompleted(File * f);
+
         File * getOrCreateFile(std::string const & remoteHost, std::string const & remotePath, std::filesystem::path const & localPath, size_t size);
 
         /** Path to where the remote files are stored. 
@@ -91,6 +140,13 @@ namespace tpp {
         /** Mutex to guard the files map. */
         std::mutex mFiles_;
 
+        std::thread hasher_;
+        /** Pending hash requests, guarded by mHasher_. */
+        std::deque<HashRequest> hashRequests_;
+        std::mutex mHasher_;
+        std::condition_variable hasherReady_;
+        std::atomic<bool> stopHasher_{false};
+
     }; 
 
 
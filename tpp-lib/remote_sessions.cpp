@@ -0,0 +1,138 @@
+#include "remote_sessions.h"
+
+namespace tpp {
+
+    // RemoteSessions
+
+    RemoteSessions::Session * RemoteSessions::open(PTYMaster * connection, Sequence::NewSession const & req) {
+        std::lock_guard<std::mutex> g{m_};
+        auto & sessions = sessions_[connection];
+        if (sessions.find(req.id()) != sessions.end())
+            return nullptr;
+        Session * result = new Session{this, connection, req};
+        sessions.insert(std::make_pair(req.id(), result));
+        return result;
+    }
+
+    void RemoteSessions::data(PTYMaster * connection, Sequence::SessionData const & data) {
+        std::lock_guard<std::mutex> g{m_};
+        Session * s = get(connection, data.id());
+        if (s == nullptr) {
+            LOG(Log::Verbose) << "Data for unknown session " << data.id();
+            return;
+        }
+        s->output_.append(data.payload());
+        s->outputReady_.notify_one();
+    }
+
+    void RemoteSessions::closed(PTYMaster * connection, Sequence::SessionClosed const & closed) {
+        std::lock_guard<std::mutex> g{m_};
+        Session * s = get(connection, closed.id());
+        if (s == nullptr)
+            return;
+        sessions_[connection].erase(closed.id());
+        s->connection_ = nullptr;
+        s->terminated(closed.exitCode());
+    }
+
+    void RemoteSessions::detach(PTYMaster * connection) {
+        std::lock_guard<std::mutex> gs{mSend_};
+        std::lock_guard<std::mutex> g{m_};
+        auto i = sessions_.find(connection);
+        if (i == sessions_.end())
+            return;
+        for (auto & j : i->second) {
+            j.second->connection_ = nullptr;
+            j.second->terminated(EXIT_FAILURE);
+        }
+        sessions_.erase(i);
+    }
+
+    void RemoteSessions::send(Session const & session, Sequence const & seq) {
+        std::lock_guard<std::mutex> gs{mSend_};
+        PTYMaster * connection = nullptr;
+        {
+            std::lock_guard<std::mutex> g{m_};
+            connection = session.connection_;
+        }
+        if (connection == nullptr)
+            return;
+        try {
+            connection->send(seq);
+        } catch (std::exception const & e) {
+            LOG(Log::Verbose) << "Unable to send to session " << session.id_ << ": " << e.what();
+        }
+    }
+
+    void RemoteSessions::remove(Session * session) {
+        std::lock_guard<std::mutex> g{m_};
+        if (session->connection_ != nullptr)
+            sessions_[session->connection_].erase(session->id_);
+    }
+
+    RemoteSessions::Session * RemoteSessions::get(PTYMaster * connection, size_t id) {
+        auto i = sessions_.find(connection);
+        if (i == sessions_.end())
+            return nullptr;
+        auto j = i->second.find(id);
+        return j == i->second.end() ? nullptr : j->second;
+    }
+
+    // RemoteSessions::Session
+
+    RemoteSessions::Session::~Session() {
+        owner_->remove(this);
+    }
+
+    void RemoteSessions::Session::focus() {
+        owner_->send(*this, Sequence::FocusSession{id_});
+    }
+
+    void RemoteSessions::Session::terminate() {
+        if (terminated_)
+            return;
+        owner_->send(*this, Sequence::SessionClosed{id_, 0});
+        std::lock_guard<std::mutex> g{owner_->m_};
+        terminated(0);
+    }
+
+    void RemoteSessions::Session::send(char const * buffer, size_t numBytes) {
+        for (size_t i = 0; i < numBytes; i += MAX_PACKET_SIZE)
+            owner_->send(*this, Sequence::SessionData{id_, buffer + i, buffer + std::min(numBytes, i + MAX_PACKET_SIZE)});
+    }
+
+    size_t RemoteSessions::Session::receive(char * buffer, size_t bufferSize) {
+        std::unique_lock<std::mutex> g{owner_->m_};
+        while (outputRead_ == output_.size() && ! terminated_)
+            outputReady_.wait(g);
+        size_t result = std::min(bufferSize, output_.size() - outputRead_);
+        memcpy(buffer, output_.c_str() + outputRead_, result);
+        outputRead_ += result;
+        if (outputRead_ == output_.size()) {
+            output_.clear();
+            outputRead_ = 0;
+        }
+        // credit the server with the read output once it is large enough not to flood the connection with credits
+        consumed_ += result;
+        if (consumed_ < Sequence::SessionCredit::DEFAULT_WINDOW / 4 || terminated_)
+            return result;
+        size_t credit = consumed_;
+        consumed_ = 0;
+        g.unlock();
+        owner_->send(*this, Sequence::SessionCredit{id_, credit});
+        return result;
+    }
+
+    void RemoteSessions::Session::resize(int cols, int rows) {
+        owner_->send(*this, Sequence::ResizeSession{id_, cols, rows});
+    }
+
+    void RemoteSessions::Session::terminated(ExitCode exitCode) {
+        if (terminated_)
+            return;
+        exitCode_ = exitCode;
+        terminated_.store(true);
+        outputReady_.notify_all();
+    }
+
+} // namespace tpp
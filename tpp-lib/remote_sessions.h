@@ -0,0 +1,120 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <condition_variable>
+
+#include "pty.h"
+#include "sequence.h"
+
+namespace tpp {
+
+    /** Remote sessions manager.
+
+        Manages the multiplexed sessions hosted by servers, such as tpp-server, that run in other sessions of the terminal. The session the server runs in is the connection, all traffic of the multiplexed sessions goes through it, tagged with the session id. Each multiplexed session is a pseudoterminal master of its own so that it can be displayed by a terminal like any other session. The manager must outlive its sessions. 
+     */
+    class RemoteSessions {
+    public:
+
+        class Session;
+
+        /** Creates new session announced by the server running in the given connection.
+
+            The session is owned by the caller, typically the terminal that displays it. Returns nullptr if a session with the same id already exists.
+         */
+        Session * open(PTYMaster * connection, Sequence::NewSession const & req);
+
+        /** Delivers the output of a session.
+         */
+        void data(PTYMaster * connection, Sequence::SessionData const & data);
+
+        /** Terminates the session closed by the server.
+         */
+        void closed(PTYMaster * connection, Sequence::SessionClosed const & closed);
+
+        /** Terminates all sessions of the given connection.
+
+            Must be called before the connection is deleted.
+         */
+        void detach(PTYMaster * connection);
+
+    private:
+
+        friend class Session;
+
+        /** Sends sequence over the connection of given session, if still attached.
+         */
+        void send(Session const & session, Sequence const & seq);
+
+        void remove(Session * session);
+
+        Session * get(PTYMaster * connection, size_t id);
+
+        std::mutex m_;
+        /** Serializes the writes to the connections and their detaching. */
+        std::mutex mSend_;
+        std::unordered_map<PTYMaster *, std::unordered_map<size_t, Session *>> sessions_;
+
+    }; // tpp::RemoteSessions
+
+    /** A multiplexed session.
+
+        The output of the session is kept until the terminal reads it. The server may only send as much output as the terminal allows, which is replenished by credits sent as the output is read so that a slow terminal, or a busy UI, throttles the server.
+     */
+    class RemoteSessions::Session : public PTYMaster {
+    public:
+
+        /** Maximum size of a single session data sequence payload sent to the server. 
+         */
+        static constexpr size_t MAX_PACKET_SIZE = 4096;
+
+        ~Session() override;
+
+        size_t id() const {
+            return id_;
+        }
+
+        std::string const & name() const {
+            return name_;
+        }
+
+        /** Tells the server that the session is visible.
+         */
+        void focus();
+
+        void terminate() override;
+        void send(char const * buffer, size_t numBytes) override;
+        size_t receive(char * buffer, size_t bufferSize) override;
+        void resize(int cols, int rows) override;
+
+    private:
+
+        friend class RemoteSessions;
+
+        Session(RemoteSessions * owner, PTYMaster * connection, Sequence::NewSession const & req):
+            owner_{owner},
+            connection_{connection},
+            id_{req.id()},
+            name_{req.name()} {
+        }
+
+        /** Marks the session as terminated and wakes up the reader. Expects the owner's lock to be held.
+         */
+        void terminated(ExitCode exitCode);
+
+        RemoteSessions * owner_;
+        /** The connection, nullptr if detached. Guarded by the owner's lock. */
+        PTYMaster * connection_;
+        size_t id_;
+        std::string name_;
+        /** Output not yet read, guarded by the owner's lock. */
+        std::string output_;
+        size_t outputRead_ = 0;
+        /** Number of bytes read since the last credit was sent. */
+        size_t consumed_ = 0;
+        std::condition_variable outputReady_;
+
+    }; // tpp::RemoteSessions::Session
+
+} // namespace tpp
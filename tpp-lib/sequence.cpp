@@ -178,6 +178,7 @@ namespace tpp {
         s << ';';
         WriteString(s, request_);
         s << ';' << id_;
+        writeRequestId(s);
     }
 
     // Sequence::Nack
@@ -188,6 +189,14 @@ namespace tpp {
         WriteString(s, request_);
         s << ';';
         WriteString(s, reason_);
+        writeRequestId(s);
+    }
+
+    // Sequence::GetCapabilities
+
+    void Sequence::GetCapabilities::writeTo(std::ostream & s) const {
+        Sequence::writeTo(s);
+        writeRequestId(s);
     }
 
     // Sequence::Capabilities
@@ -195,6 +204,7 @@ namespace tpp {
     void Sequence::Capabilities::writeTo(std::ostream & s) const {
         Sequence::writeTo(s);
         s << ';' << version_;
+        writeRequestId(s);
     }
 
     // Sequence::Data
@@ -214,6 +224,7 @@ namespace tpp {
         s << ';';
         WriteString(s, remotePath_);
         s << ';' << size_;
+        writeRequestId(s);
     }
 
     // Sequence::GetTransferStatus
@@ -221,6 +232,7 @@ namespace tpp {
     void Sequence::GetTransferStatus::writeTo(std::ostream & s) const {
         Sequence::writeTo(s);
         s << ';' << id_;
+        writeRequestId(s);
     }
 
     // Sequence::TransferStatus;
@@ -228,6 +240,7 @@ namespace tpp {
     void Sequence::TransferStatus::writeTo(std::ostream & s) const {
         Sequence::writeTo(s);
         s << ';' << id_ << ';' << size_ << ';' << received_;
+        writeRequestId(s);
     }
 
     // Sequence::ViewRemoteFile
@@ -235,6 +248,78 @@ namespace tpp {
     void Sequence::ViewRemoteFile::writeTo(std::ostream & s) const {
         Sequence::writeTo(s);
         s << ';' << id_;
+        writeRequestId(s);
+    }
+
+    // Sequence::GetBlockHashes
+
+    void Sequence::GetBlockHashes::writeTo(std::ostream & s) const {
+        Sequence::writeTo(s);
+        s << ';' << id_ << ';' << blockSize_;
+        writeRequestId(s);
+    }
+
+    // Sequence::BlockHashes
+
+    void Sequence::BlockHashes::writeTo(std::ostream & s) const {
+        Sequence::writeTo(s);
+        s << ';' << id_ << ';' << blockSize_ << ';' << size_ << ';' << hashes_.size();
+        for (uint64_t h : hashes_)
+            s << ';' << h;
+        writeRequestId(s);
+    }
+
+    // Sequence::SkipData
+
+    void Sequence::SkipData::writeTo(std::ostream & s) const {
+        Sequence::writeTo(s);
+        s << ';' << id_ << ';' << offset_ << ';' << size_;
+    }
+
+    // Sequence::NewSession
+
+    void Sequence::NewSession::writeTo(std::ostream & s) const {
+        Sequence::writeTo(s);
+        s << ';' << id_ << ';';
+        WriteString(s, name_);
+        s << ';' << cols_ << ';' << rows_;
+        writeRequestId(s);
+    }
+
+    // Sequence::SessionData
+
+    void Sequence::SessionData::writeTo(std::ostream & s) const {
+        Sequence::writeTo(s);
+        s << ';' << id_ << ';' << payload_.size() << ';';
+        Encode(s, payload_.data(), payload_.data() + payload_.size());
+    }
+
+    // Sequence::SessionCredit
+
+    void Sequence::SessionCredit::writeTo(std::ostream & s) const {
+        Sequence::writeTo(s);
+        s << ';' << id_ << ';' << bytes_;
+    }
+
+    // Sequence::FocusSession
+
+    void Sequence::FocusSession::writeTo(std::ostream & s) const {
+        Sequence::writeTo(s);
+        s << ';' << id_;
+    }
+
+    // Sequence::ResizeSession
+
+    void Sequence::ResizeSession::writeTo(std::ostream & s) const {
+        Sequence::writeTo(s);
+        s << ';' << id_ << ';' << cols_ << ';' << rows_;
+    }
+
+    // Sequence::SessionClosed
+
+    void Sequence::SessionClosed::writeTo(std::ostream & s) const {
+        Sequence::writeTo(s);
+        s << ';' << id_ << ';' << exitCode_;
     }
 
 } // namespace tpp
@@ -1,11 +1,13 @@
 #pragma once
 
 #include <variant>
+#include <vector>
 #include <iostream>
 
 #include "helpers/helpers.h"
 #include "helpers/buffer.h"
 #include "helpers/char.h"
+#include "helpers/process.h"
 
 namespace tpp {
 
@@ -31,6 +33,29 @@ namespace tpp {
             GetTransferStatus,
             TransferStatus,
             ViewRemoteFile,
+            /** Requests hashes of the blocks of the terminal's local copy of a transferred file. 
+             */
+            GetBlockHashes,
+            BlockHashes,
+            /** Marks a range of a transferred file as already present in the terminal's local copy. 
+             */
+            SkipData,
+            /** Announces a new multiplexed session. 
+             */
+            NewSession,
+            /** Output of a multiplexed session, or input to it. 
+             */
+            SessionData,
+            /** Allows the server to send more output of a multiplexed session. 
+             */
+            SessionCredit,
+            /** Tells the server which multiplexed session is visible. 
+             */
+            FocusSession,
+            ResizeSession,
+            /** Multiplexed session has terminated, or the terminal requests its termination. 
+             */
+            SessionClosed,
 
             Invalid,
         };
@@ -41,6 +66,18 @@ namespace tpp {
             return kind_;
         }
 
+        /** Returns the request id. 
+
+            Requests expecting a response may carry a numeric id, which the terminal echoes in its response so that clients can match responses to requests without comparing their contents. Zero means no id. The id is always the last field of the payload so that older terminals, which ignore any extra payload, remain compatible. 
+         */
+        size_t requestId() const {
+            return requestId_;
+        }
+
+        void setRequestId(size_t id) {
+            requestId_ = id;
+        }
+
         static std::string PrettyPrint(char const * start, size_t size);
 
         static char const * FindSequenceStart(char const * buffer, char const * bufferEnd);
@@ -65,6 +102,16 @@ namespace tpp {
         class GetTransferStatus;
         class TransferStatus;
         class ViewRemoteFile;
+        class GetBlockHashes;
+        class BlockHashes;
+        class SkipData;
+
+        class NewSession;
+        class SessionData;
+        class SessionCredit;
+        class FocusSession;
+        class ResizeSession;
+        class SessionClosed;
 
         template<typename T>
         class Response;
@@ -88,8 +135,17 @@ namespace tpp {
 
         virtual void writeTo(std::ostream & s) const;
 
+        /** Writes the request id as the last payload field, if any. 
+         */
+        void writeRequestId(std::ostream & s) const {
+            if (requestId_ != 0)
+                s << ';' << requestId_;
+        }
+
         Kind kind_;
 
+        size_t requestId_ = 0;
+
         /** Reads unsigned value from the payload and moves the payload start past its end. 
          */
         static size_t ReadUnsigned(char const * & start, char const * end);
@@ -146,12 +202,14 @@ namespace tpp {
             Sequence{Kind::Ack},
             request_{STR(req)}, 
             id_{id} {
+            requestId_ = req.requestId();
         }
 
         Ack(char const * & start, char const * end):
             Sequence(Kind::Ack) {
             request_ = ReadString(start, end);
             id_ = ReadUnsigned(start, end);
+            requestId_ = ReadUnsigned(start, end);
         }
 
         std::string const & request() const {
@@ -179,12 +237,14 @@ namespace tpp {
             Sequence{Kind::Nack},
             request_{STR(req)}, 
             reason_{reason} {
+            requestId_ = req.requestId();
         }
 
         Nack(char const * & start, char const * end):
             Sequence(Kind::Nack) {
             request_ = ReadString(start, end);
             reason_ = ReadString(start, end);
+            requestId_ = ReadUnsigned(start, end);
         }
 
         std::string const & request() const {
@@ -213,10 +273,13 @@ namespace tpp {
         }
 
         GetCapabilities(char const * start, char const * end):
-            Sequence{Kind::Capabilities} {
-            MARK_AS_UNUSED(start);
-            MARK_AS_UNUSED(end);
+            Sequence{Kind::GetCapabilities} {
+            requestId_ = ReadUnsigned(start, end);
         }
+
+    protected:
+
+        void writeTo(std::ostream & s) const override;
     };
 
     /** Terminal capabilities information.
@@ -231,6 +294,7 @@ namespace tpp {
         Capabilities(char const * start, char const * end):
             Sequence(Kind::Capabilities) {
             version_ = ReadUnsigned(start, end);
+            requestId_ = ReadUnsigned(start, end);
         }
 
         size_t version() const {
@@ -341,6 +405,7 @@ namespace tpp {
             remoteHost_ = ReadString(start, end);
             remotePath_ = ReadString(start, end);
             size_ = ReadUnsigned(start, end);
+            requestId_ = ReadUnsigned(start, end);
         }
 
         std::string const & remoteHost() const {
@@ -379,6 +444,7 @@ namespace tpp {
         GetTransferStatus(char const * & start, char const * end):
             Sequence(Kind::GetTransferStatus) {
             id_ = ReadUnsigned(start, end);
+            requestId_ = ReadUnsigned(start, end);
         }
 
         size_t id() const {
@@ -411,6 +477,7 @@ namespace tpp {
             id_ = ReadUnsigned(start, end);
             size_ = ReadUnsigned(start, end);
             received_ = ReadUnsigned(start, end);
+            requestId_ = ReadUnsigned(start, end);
         }
 
         size_t id() const {
@@ -449,6 +516,7 @@ namespace tpp {
         ViewRemoteFile(char const * & start, char const * end):
             Sequence(Kind::ViewRemoteFile) {
             id_ = ReadUnsigned(start, end);
+            requestId_ = ReadUnsigned(start, end);
         }
 
         size_t id() const {
@@ -464,6 +532,390 @@ namespace tpp {
 
     }; // Sequence::ViewRemoteFile
 
+    /** Requests hashes of the terminal's local copy of a transferred file. 
+     
+        The local copy, up to the size of the transferred file, is split into blocks of the given size (the last block may be smaller) and a hash of each block is returned in the BlockHashes response. Requests with block sizes over MAX_BLOCK_SIZE are denied, since the terminal reads whole blocks into memory. 
+     */
+    class Sequence::GetBlockHashes : public Sequence {
+    public:
+
+        static constexpr size_t MAX_BLOCK_SIZE = 16 * 1024 * 1024;
+
+        GetBlockHashes(size_t id, size_t blockSize):
+            Sequence{Kind::GetBlockHashes},
+            id_{id},
+            blockSize_{blockSize} {
+        }
+
+        GetBlockHashes(char const * & start, char const * end):
+            Sequence(Kind::GetBlockHashes) {
+            id_ = ReadUnsigned(start, end);
+            blockSize_ = ReadUnsigned(start, end);
+            requestId_ = ReadUnsigned(start, end);
+        }
+
+        size_t id() const {
+            return id_;
+        }
+
+        size_t blockSize() const {
+            return blockSize_;
+        }
+
+    protected:
+
+        void writeTo(std::ostream & s) const override;
+
+    private:
+        size_t id_;
+        size_t blockSize_;
+
+    }; // Sequence::GetBlockHashes
+
+    /** Hashes of the blocks of the terminal's local copy of a transferred file. 
+     */
+    class Sequence::BlockHashes : public Sequence {
+    public:
+
+        using Response = Response<BlockHashes>;
+
+        BlockHashes(size_t id, size_t blockSize, size_t size):
+            Sequence{Kind::BlockHashes},
+            id_{id},
+            blockSize_{blockSize},
+            size_{size} {
+        }
+
+        BlockHashes(char const * & start, char const * end):
+            Sequence(Kind::BlockHashes) {
+            id_ = ReadUnsigned(start, end);
+            blockSize_ = ReadUnsigned(start, end);
+            size_ = ReadUnsigned(start, end);
+            size_t n = ReadUnsigned(start, end);
+            hashes_.reserve(n);
+            for (size_t i = 0; i < n; ++i)
+                hashes_.push_back(ReadUnsigned(start, end));
+            requestId_ = ReadUnsigned(start, end);
+        }
+
+        size_t id() const {
+            return id_;
+        }
+
+        size_t blockSize() const {
+            return blockSize_;
+        }
+
+        /** Size of the part of the local copy the hashes were calculated from. 
+         
+            This is never larger than the size of the transferred file. 
+         */
+        size_t size() const {
+            return size_;
+        }
+
+        std::vector<uint64_t> const & hashes() const {
+            return hashes_;
+        }
+
+        void addHash(uint64_t hash) {
+            hashes_.push_back(hash);
+        }
+
+    protected:
+
+        void writeTo(std::ostream & s) const override;
+
+    private:
+        size_t id_;
+        size_t blockSize_;
+        size_t size_;
+        std::vector<uint64_t> hashes_;
+
+    }; // Sequence::BlockHashes
+
+    /** Skips part of a transferred file. 
+     
+        Tells the terminal that the given range of the file, which must start at the currently received offset, is identical in the terminal's local copy and so does not have to be transferred. 
+     */
+    class Sequence::SkipData : public Sequence {
+    public:
+
+        SkipData(size_t id, size_t offset, size_t size):
+            Sequence{Kind::SkipData},
+            id_{id},
+            offset_{offset},
+            size_{size} {
+        }
+
+        SkipData(char const * & start, char const * end):
+            Sequence(Kind::SkipData) {
+            id_ = ReadUnsigned(start, end);
+            offset_ = ReadUnsigned(start, end);
+            size_ = ReadUnsigned(start, end);
+        }
+
+        size_t id() const {
+            return id_;
+        }
+
+        size_t offset() const {
+            return offset_;
+        }
+
+        size_t size() const {
+            return size_;
+        }
+
+    protected:
+
+        void writeTo(std::ostream & s) const override;
+
+    private:
+        size_t id_;
+        size_t offset_;
+        size_t size_;
+
+    }; // Sequence::SkipData
+
+    /** Announces a new multiplexed session. 
+
+        Multiplexed sessions allow a single terminal connection to host multiple sessions of a server, such as tpp-server. Each session is identified by its id, unique within the connection, and all of its traffic is tagged with the id. The terminal acknowledges the new session, or denies it. 
+     */
+    class Sequence::NewSession : public Sequence {
+    public:
+
+        NewSession(size_t id, std::string const & name, int cols, int rows):
+            Sequence{Kind::NewSession},
+            id_{id},
+            name_{name},
+            cols_{cols},
+            rows_{rows} {
+        }
+
+        NewSession(char const * & start, char const * end):
+            Sequence(Kind::NewSession) {
+            id_ = ReadUnsigned(start, end);
+            name_ = ReadString(start, end);
+            cols_ = static_cast<int>(ReadUnsigned(start, end));
+            rows_ = static_cast<int>(ReadUnsigned(start, end));
+            requestId_ = ReadUnsigned(start, end);
+        }
+
+        size_t id() const {
+            return id_;
+        }
+
+        std::string const & name() const {
+            return name_;
+        }
+
+        int cols() const {
+            return cols_;
+        }
+
+        int rows() const {
+            return rows_;
+        }
+
+    protected:
+
+        void writeTo(std::ostream & s) const override;
+
+    private:
+        size_t id_;
+        std::string name_;
+        int cols_;
+        int rows_;
+
+    }; // Sequence::NewSession
+
+    /** Data of a multiplexed session. 
+     
+        When sent by the server, the payload is the output of the session, when sent by the terminal, the payload is the input for the session. 
+     */
+    class Sequence::SessionData : public Sequence {
+    public:
+
+        SessionData(size_t id, char const * payload, char const * payloadEnd):
+            Sequence{Kind::SessionData},
+            id_{id},
+            payload_{payload, payloadEnd} {
+        }
+
+        SessionData(char const * & start, char const * end):
+            Sequence{Kind::SessionData} {
+            id_ = ReadUnsigned(start, end);
+            size_t size = ReadUnsigned(start, end);
+            Buffer b;
+            Decode(b, start, end);
+            if (size != b.size())
+                THROW(IOError()) << "SessionData Sequence size reported " << size << ", actual " << b.size();
+            payload_.assign(b.begin(), b.end());
+        }
+
+        size_t id() const {
+            return id_;
+        }
+
+        std::string const & payload() const {
+            return payload_;
+        }
+
+    protected:
+
+        void writeTo(std::ostream & s) const override;
+
+    private:
+        size_t id_;
+        std::string payload_;
+
+    }; // Sequence::SessionData
+
+    /** Flow control of a multiplexed session. 
+
+        The server may only send as much output of a session as the terminal allows. Each session starts with the default window and every credit sent by the terminal, once it has processed the session output, allows the server to send the given number of bytes more. 
+     */
+    class Sequence::SessionCredit : public Sequence {
+    public:
+
+        static constexpr size_t DEFAULT_WINDOW = 256 * 1024;
+
+        SessionCredit(size_t id, size_t bytes):
+            Sequence{Kind::SessionCredit},
+            id_{id},
+            bytes_{bytes} {
+        }
+
+        SessionCredit(char const * & start, char const * end):
+            Sequence(Kind::SessionCredit) {
+            id_ = ReadUnsigned(start, end);
+            bytes_ = ReadUnsigned(start, end);
+        }
+
+        size_t id() const {
+            return id_;
+        }
+
+        size_t bytes() const {
+            return bytes_;
+        }
+
+    protected:
+
+        void writeTo(std::ostream & s) const override;
+
+    private:
+        size_t id_;
+        size_t bytes_;
+
+    }; // Sequence::SessionCredit
+
+    /** Informs the server that the given multiplexed session is visible, the output of the other sessions can be throttled. 
+     */
+    class Sequence::FocusSession : public Sequence {
+    public:
+
+        explicit FocusSession(size_t id):
+            Sequence{Kind::FocusSession},
+            id_{id} {
+        }
+
+        FocusSession(char const * & start, char const * end):
+            Sequence(Kind::FocusSession) {
+            id_ = ReadUnsigned(start, end);
+        }
+
+        size_t id() const {
+            return id_;
+        }
+
+    protected:
+
+        void writeTo(std::ostream & s) const override;
+
+    private:
+        size_t id_;
+
+    }; // Sequence::FocusSession
+
+    class Sequence::ResizeSession : public Sequence {
+    public:
+
+        ResizeSession(size_t id, int cols, int rows):
+            Sequence{Kind::ResizeSession},
+            id_{id},
+            cols_{cols},
+            rows_{rows} {
+        }
+
+        ResizeSession(char const * & start, char const * end):
+            Sequence(Kind::ResizeSession) {
+            id_ = ReadUnsigned(start, end);
+            cols_ = static_cast<int>(ReadUnsigned(start, end));
+            rows_ = static_cast<int>(ReadUnsigned(start, end));
+        }
+
+        size_t id() const {
+            return id_;
+        }
+
+        int cols() const {
+            return cols_;
+        }
+
+        int rows() const {
+            return rows_;
+        }
+
+    protected:
+
+        void writeTo(std::ostream & s) const override;
+
+    private:
+        size_t id_;
+        int cols_;
+        int rows_;
+
+    }; // Sequence::ResizeSession
+
+    /** Multiplexed session termination. 
+     
+        Sent by the server when the session has terminated, or by the terminal to terminate the session. 
+     */
+    class Sequence::SessionClosed : public Sequence {
+    public:
+
+        SessionClosed(size_t id, ExitCode exitCode):
+            Sequence{Kind::SessionClosed},
+            id_{id},
+            exitCode_{exitCode} {
+        }
+
+        SessionClosed(char const * & start, char const * end):
+            Sequence(Kind::SessionClosed) {
+            id_ = ReadUnsigned(start, end);
+            exitCode_ = static_cast<ExitCode>(ReadUnsigned(start, end));
+        }
+
+        size_t id() const {
+            return id_;
+        }
+
+        ExitCode exitCode() const {
+            return exitCode_;
+        }
+
+    protected:
+
+        void writeTo(std::ostream & s) const override;
+
+    private:
+        size_t id_;
+        ExitCode exitCode_;
+
+    }; // Sequence::SessionClosed
+
     template<typename T>
     class Sequence::Response {
     public:
@@ -6,171 +6,184 @@
 
 namespace tpp {
 
-    // TerminalClient::Async
+    // TerminalClient
 
     TerminalClient::TerminalClient(PTYSlave * pty):
-        pty_{pty},
-        buffer_{new char[DEFAULT_BUFFER_SIZE]},
-        bufferSize_{DEFAULT_BUFFER_SIZE},
-        bufferUnprocessed_{0} {
+        pty_{pty} {
         pty_->onResized.setHandler(& TerminalClient::resized, this);
         reader_ = std::thread{[this](){
             while (true) {
-                size_t read = pty_->receive(buffer_ + bufferUnprocessed_, bufferSize_ - bufferUnprocessed_);
+                char * start = buffer_.writeStart();
+                size_t read = pty_->receive(start, buffer_.writeSize());
                 if (read == 0)
                     break;
-                // process the input
-                processInput(buffer_, buffer_ + read + bufferUnprocessed_);
-                // TODO grow the buffer if needs be
+                buffer_.process(read, 
+                    [this](char const * start, char const * end) {
+                        return received(start, end);
+                    },
+                    [this](Sequence::Kind kind, char const * payload, char const * payloadEnd) {
+                        receivedSequence(kind, payload, payloadEnd);
+                    }
+                );
             }
         }};
     }
 
-    void TerminalClient::processInput(char * start, char const * end) {
-        char * i = start;
-        size_t unprocessed = 0;
-        while (i < end) {
-            char const * tppStart = Sequence::FindSequenceStart(i, end);
-            // process the data received before tpp sequence found
-            if (tppStart != i)
-                unprocessed = (tppStart - i) - received(i, tppStart);
-            // determine the end of the sequence
-            char const * tppEnd = Sequence::FindSequenceEnd(tppStart, end);
-            // if there is entire sequence, parse it
-            if (tppEnd < end) {
-                char const * payloadStart = tppStart + 3;
-                tpp::Sequence::Kind kind = tpp::Sequence::ParseKind(payloadStart, end);
-                receivedSequence(kind, payloadStart, tppEnd);
-                ++tppEnd; // move past the bell character
-                // if we are at the end of the input, copy the unprocessed characters to the beginning and return
-                if (tppEnd == end) {
-                    memmove(buffer_, tppStart - unprocessed, unprocessed);
-                    break;
-                // otherwise copy the unprocessed characters before the end of the sequence and start analysis from this new beginning. 
-                // this will reanalyze the unprocessed characters so is not exactly super effective
-                } else {
-                    i = const_cast<char*>(tppEnd - unprocessed);
-                    memmove(i, tppStart - unprocessed, unprocessed);
-                    continue;
-                }
-            // if there is not entire sequence available, then copy unprocessed data to the beginning of the buffer, then copy the beginning of the tpp sequence, if any and exit
-            } else {
-                memmove(buffer_, tppStart - unprocessed, unprocessed);
-                memmove(buffer_ + unprocessed, tppStart, end - tppStart);
-                unprocessed += end - tppStart;
-                break;
-            }
-        }
-        bufferUnprocessed_ = unprocessed;
+    // TerminalClient::Async
+
+    TerminalClient::Async::Async(PTYSlave * pty):
+        TerminalClient{pty} {
+        timeouts_ = std::thread{[this](){
+            checkTimeouts();
+        }};
     }
 
-    // TerminalClient::Sync
+    TerminalClient::Async::~Async() {
+        {
+            std::lock_guard<std::mutex> g{mPending_};
+            terminating_ = true;
+        }
+        timeoutsChanged_.notify_one();
+        timeouts_.join();
+    }
 
-    Sequence::Capabilities TerminalClient::Sync::getCapabilities(size_t timeout, size_t attempts) {
-        Sequence::Capabilities result{0};
-        transmit(Sequence::GetCapabilities{}, result, timeout, attempts);
-        return result;
+    void TerminalClient::Async::receivedSequence(Sequence::Kind kind, char const * payload, char const * payloadEnd) {
+        switch (kind) {
+            case Sequence::Kind::Ack:
+                respond(Sequence::Ack{payload, payloadEnd});
+                break;
+            case Sequence::Kind::Nack:
+                reject(Sequence::Nack{payload, payloadEnd});
+                break;
+            case Sequence::Kind::Capabilities:
+                respond(Sequence::Capabilities{payload, payloadEnd});
+                break;
+            case Sequence::Kind::TransferStatus:
+                respond(Sequence::TransferStatus{payload, payloadEnd});
+                break;
+            case Sequence::Kind::BlockHashes:
+                respond(Sequence::BlockHashes{payload, payloadEnd});
+                break;
+            default:
+                LOG(Log::Verbose) << "Unexpected t++ sequence " << kind;
+                break;
+        }
     }
 
-    size_t TerminalClient::Sync::openFileTransfer(std::string const & host, std::string const & filename, size_t size, size_t timeout, size_t attempts) {
-        Sequence::OpenFileTransfer req{host, filename, size};
-        Sequence::Ack result{req, 0};
-        transmit(req, result, timeout, attempts);
-        return result.id();
+    TerminalClient::Async::PendingRequest & TerminalClient::Async::allocateSlot(std::unique_lock<std::mutex> & g) {
+        while (numPending_ == MAX_PENDING_REQUESTS)
+            slotReleased_.wait(g);
+        // the ids are assigned so that id modulo the table size is the index of a free slot
+        size_t i = nextRequestId_ % MAX_PENDING_REQUESTS;
+        while (pending_[i].id != 0)
+            i = (i + 1) % MAX_PENDING_REQUESTS;
+        nextRequestId_ = (nextRequestId_ / MAX_PENDING_REQUESTS + 1) * MAX_PENDING_REQUESTS + i;
+        pending_[i].id = nextRequestId_;
+        ++numPending_;
+        return pending_[i];
     }
 
-    Sequence::TransferStatus TerminalClient::Sync::getTransferStatus(size_t id, size_t timeout, size_t attempts) {
-        Sequence::TransferStatus result{id,0,0};
-        transmit(Sequence::GetTransferStatus{id}, result, timeout, attempts);
-        return result;
+    void TerminalClient::Async::releaseSlot(PendingRequest & slot) {
+        slot.id = 0;
+        slot.request.reset();
+        slot.contents.clear();
+        slot.promise = std::monostate{};
+        --numPending_;
+        slotReleased_.notify_one();
     }
 
-    void TerminalClient::Sync::viewRemoteFile(size_t id, size_t timeout, size_t attempts) {
-        Sequence::ViewRemoteFile req{id};
-        Sequence::Ack result{req, 0};
-        transmit(req, result, timeout, attempts);
+    TerminalClient::Async::PendingRequest * TerminalClient::Async::findPendingByContents(Sequence const & response) {
+        for (PendingRequest & slot : pending_) {
+            if (slot.id == 0 || (slot.responseKind != response.kind() && response.kind() != Sequence::Kind::Nack))
+                continue;
+            switch (response.kind()) {
+                case Sequence::Kind::Ack:
+                    if (dynamic_cast<Sequence::Ack const &>(response).request() == ContentsOf(slot))
+                        return & slot;
+                    break;
+                case Sequence::Kind::Nack:
+                    if (dynamic_cast<Sequence::Nack const &>(response).request() == ContentsOf(slot))
+                        return & slot;
+                    break;
+                case Sequence::Kind::Capabilities:
+                    return & slot;
+                case Sequence::Kind::TransferStatus:
+                    if (dynamic_cast<Sequence::TransferStatus const &>(response).id() == dynamic_cast<Sequence::GetTransferStatus const &>(*slot.request).id())
+                        return & slot;
+                    break;
+                case Sequence::Kind::BlockHashes:
+                    if (dynamic_cast<Sequence::BlockHashes const &>(response).id() == dynamic_cast<Sequence::GetBlockHashes const &>(*slot.request).id())
+                        return & slot;
+                    break;
+                default:
+                    break;
+            }
+        }
+        return nullptr;
     }
 
-    void TerminalClient::Sync::receivedSequence(Sequence::Kind kind, char const * payload, char const * payloadEnd) {
-        std::lock_guard<std::mutex> g{mSequences_};
-        if (responseCheck(kind, payload, payloadEnd)) {
-            if (result_->kind() != Sequence::Kind::Nack)
-                result_ = nullptr;
-            sequenceReady_.notify_one();
-        } else {
-            // raise the event
-            NOT_IMPLEMENTED;
+    std::string const & TerminalClient::Async::ContentsOf(PendingRequest & slot) {
+        if (slot.contents.empty()) {
+            // the request id is always the last payload field, so the request without it is a prefix of the serialized request
+            slot.contents = STR(*slot.request);
+            slot.contents.resize(slot.contents.size() - STR(';' << slot.request->requestId()).size());
         }
+        return slot.contents;
     }
 
-    void TerminalClient::Sync::transmit(Sequence const & send, Sequence & receive, size_t timeout, size_t attempts) {
-        std::unique_lock<std::mutex> g{mSequences_};
-        ASSERT(result_ == nullptr) << "Only one thread is allowed to transmit t++ sequences";
-        result_ = & receive;
-        request_ = & send;
-        while (attempts_ > 0) {
-            this->send(send);
-            auto timeoutTime = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
-            while (true) {
-                if (timeout > 0) {
-                    if (sequenceReady_.wait_until(g, timeoutTime) == std::cv_status::timeout) {
-                        if (--attempts == 0)
-                            THROW(TimeoutError());
-                        LOG(Log::Verbose) << "Request timeout, remaining attempts: " << attempts;
-                        break;
-                    }
-                } else {
-                    sequenceReady_.wait(g);
-                }
-                if (result_ == nullptr) {
-                    return;
-                } else if (result_->kind() == Sequence::Kind::Nack) {
-                    std::string reason = dynamic_cast<Sequence::Nack*>(result_)->reason();
-                    delete result_;
-                    result_ = nullptr;
-                    THROW(NackError()) << reason;
-                }
-            }
+    void TerminalClient::Async::reject(Sequence::Nack const & nack) {
+        std::lock_guard<std::mutex> g{mPending_};
+        PendingRequest * slot = nack.requestId() != 0 ? findPending(nack.requestId(), Sequence::Kind::Nack) : findPendingByContents(nack);
+        if (slot == nullptr) {
+            LOG(Log::Verbose) << "Unmatched t++ sequence " << nack.kind();
+            return;
         }
+        std::exception_ptr e = std::make_exception_ptr(CREATE_EXCEPTION(NackError()) << nack.reason());
+        std::visit([e](auto & p) {
+            if constexpr (! std::is_same_v<std::decay_t<decltype(p)>, std::monostate>)
+                p.set_exception(e);
+        }, slot->promise);
+        releaseSlot(*slot);
     }
 
-    bool TerminalClient::Sync::responseCheck(Sequence::Kind kind, char const * payload, char const * payloadEnd) {
-        if (result_ != nullptr && (result_->kind() == kind || kind == Sequence::Kind::Nack)) {
-            switch (kind) {
-                case Sequence::Kind::Ack: {
-                    Sequence::Ack * result = dynamic_cast<Sequence::Ack*>(result_);
-                    Sequence::Ack x{payload, payloadEnd};
-                    if (result->request() != x.request())
-                        return false;
-                    (*result) = x;
-                    return true;
-                }
-                case Sequence::Kind::Nack: {
-                    Sequence::Nack * x = new Sequence::Nack{payload, payloadEnd};
-                    std::string request = STR(*request_);
-                    if (request != x->request())
-                        return false;
-                    result_ = x;
-                    return true;
-                }
-                case Sequence::Kind::Capabilities: {
-                    Sequence::Capabilities * result = dynamic_cast<Sequence::Capabilities*>(result_);
-                    (*result) = Sequence::Capabilities{payload, payloadEnd};
-                    return true;
-                }
-                case Sequence::Kind::TransferStatus: {
-                    Sequence::TransferStatus * result = dynamic_cast<Sequence::TransferStatus*>(result_);
-                    Sequence::TransferStatus x{payload, payloadEnd};
-                    if (result->id() != x.id())
-                        return false;
-                    (*result) = x;
-                    return true;
+    void TerminalClient::Async::checkTimeouts() {
+        std::vector<std::shared_ptr<Sequence>> resend;
+        std::unique_lock<std::mutex> g{mPending_};
+        while (! terminating_) {
+            auto now = std::chrono::steady_clock::now();
+            auto next = std::chrono::steady_clock::time_point::max();
+            for (PendingRequest & slot : pending_) {
+                if (slot.id == 0)
+                    continue;
+                if (slot.deadline <= now) {
+                    if (--slot.attempts == 0) {
+                        std::exception_ptr e = std::make_exception_ptr(CREATE_EXCEPTION(TimeoutError()));
+                        std::visit([e](auto & p) {
+                            if constexpr (! std::is_same_v<std::decay_t<decltype(p)>, std::monostate>)
+                                p.set_exception(e);
+                        }, slot.promise);
+                        releaseSlot(slot);
+                        continue;
+                    }
+                    LOG(Log::Verbose) << "Request timeout, remaining attempts: " << slot.attempts;
+                    slot.deadline = now + std::chrono::milliseconds(slot.timeout);
+                    resend.push_back(slot.request);
                 }
-                default:
-                    return false;
+                next = std::min(next, slot.deadline);
+            }
+            // resend the timed out requests without holding the lock so that the responses can be matched meanwhile
+            if (! resend.empty()) {
+                g.unlock();
+                for (auto & r : resend)
+                    send(*r);
+                resend.clear();
+                g.lock();
+                continue;
             }
-        } else {
-            return false;
+            if (next == std::chrono::steady_clock::time_point::max())
+                timeoutsChanged_.wait(g);
+            else
+                timeoutsChanged_.wait_until(g, next);
         }
     }
 
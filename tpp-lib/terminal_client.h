@@ -1,6 +1,11 @@
 #pragma once
 
+#include <array>
 #include <thread>
+#include <mutex>
+#include <memory>
+#include <future>
+#include <variant>
 #include <algorithm>
 #include <condition_variable>
 
@@ -9,6 +14,7 @@
 #include "helpers/char.h"
 #include "pty.h"
 #include "sequence.h"
+#include "input_buffer.h"
 
 namespace tpp {
 
@@ -17,29 +23,36 @@ namespace tpp {
 
     class TerminalClient {
     public:
-        static constexpr size_t DEFAULT_BUFFER_SIZE = 1024;
 
+        class Async;
         class Sync;
 
         virtual ~TerminalClient() {
             delete pty_;
             reader_.join();
-            delete [] buffer_;
         }
 
         using ResizeEvent = PTYSlave::ResizeEvent;
 
+        /** Returns the size of the attached terminal (cols, rows). 
+         */
+        std::pair<int, int> size() const {
+            return pty_->size();
+        }
+
     protected:
 
         explicit TerminalClient(PTYSlave * pty);
 
         /** Called when normal input is received from the terminal. 
          
-            The implementation should process the received input and return the number of bytes processed. These will be removed from the buffer, while any unprocessed data will be prepended to data received next. 
+            The input points directly to the input buffer and is only valid for the duration of the call. The implementation should process the received input and return the number of bytes processed. These will be removed from the buffer, while any unprocessed data will be prepended to data received next. 
          */
         virtual size_t received(char const * buffer, char const * bufferEnd) = 0;
 
         /** Called when a t++ sequence has been received. 
+
+            The sequence is parsed in place, the payload is only valid for the duration of the call. 
          */
         virtual void receivedSequence(Sequence::Kind kind, char const * buffer, char const * bufferEnd) = 0;
 
@@ -53,65 +66,254 @@ namespace tpp {
         }
 
         /** Sends given buffer using the attached terminal. 
+         
+            Sending is guarded so that multiple threads may send at the same time without their data being interleaved. 
          */
         void send(char const * buffer, size_t numBytes) {
+            std::lock_guard<std::mutex> g{mSend_};
             pty_->send(buffer, numBytes);
         }
 
         /** Sends given t++ sequence. 
          */
         void send(Sequence const & seq) {
+            std::lock_guard<std::mutex> g{mSend_};
             pty_->send(seq);
         }
 
-        virtual void processInput(char * start, char const * end);
-
     private:
 
         PTYSlave * pty_;
         std::thread reader_;
-        char * buffer_;
-        size_t bufferSize_;
-        size_t bufferUnprocessed_;
+        std::mutex mSend_;
+        /** Accessed only by the reader thread. */
+        InputBuffer buffer_;
 
     }; // tpp::TerminalClient
 
 
+    /** Asynchronous terminal client. 
+
+        Requests are sent immediately and return a future to their response so that a client can have multiple requests in flight and keep sending data meanwhile. Each request is tagged with a numeric request id, which the terminal echoes in its response. The pending requests live in a fixed size table indexed by the request id so that matching a response to its request is O(1). If the table is full, new requests block until a slot is freed. 
+
+        Requests not answered within their timeout are resent until the number of attempts is exhausted, after which the future fails with TimeoutError. Negative acknowledgements fail the future with NackError. A timeout of 0 waits for the response indefinitely. 
+
+        Terminals that do not echo the request ids are supported too, their responses are matched by their contents (the stream id for transfer status and block hashes, the echoed request for acknowledgements). 
+     */
+    class TerminalClient::Async : public TerminalClient {
+    public:
+
+        /** Maximum number of requests in flight. 
+         */
+        static constexpr size_t MAX_PENDING_REQUESTS = 64;
+
+        explicit Async(PTYSlave * pty);
+
+        ~Async() override;
+
+        std::future<Sequence::Capabilities> requestCapabilities(size_t timeout, size_t attempts) {
+            return request<Sequence::Capabilities>(Sequence::GetCapabilities{}, timeout, attempts);
+        }
+
+        std::future<Sequence::Ack> requestOpenFileTransfer(std::string const & host, std::string const & filename, size_t size, size_t timeout, size_t attempts) {
+            return request<Sequence::Ack>(Sequence::OpenFileTransfer{host, filename, size}, timeout, attempts);
+        }
+
+        std::future<Sequence::TransferStatus> requestTransferStatus(size_t id, size_t timeout, size_t attempts) {
+            return request<Sequence::TransferStatus>(Sequence::GetTransferStatus{id}, timeout, attempts);
+        }
+
+        std::future<Sequence::BlockHashes> requestBlockHashes(size_t id, size_t blockSize, size_t timeout, size_t attempts) {
+            return request<Sequence::BlockHashes>(Sequence::GetBlockHashes{id, blockSize}, timeout, attempts);
+        }
+
+        std::future<Sequence::Ack> requestViewRemoteFile(size_t id, size_t timeout, size_t attempts) {
+            return request<Sequence::Ack>(Sequence::ViewRemoteFile{id}, timeout, attempts);
+        }
+
+        std::future<Sequence::Ack> requestNewSession(size_t id, std::string const & name, int cols, int rows, size_t timeout, size_t attempts) {
+            return request<Sequence::Ack>(Sequence::NewSession{id, name, cols, rows}, timeout, attempts);
+        }
+
+    protected:
+
+        void receivedSequence(Sequence::Kind kind, char const * payload, char const * payloadEnd) override;
+
+    private:
+
+        using Promise = std::variant<
+            std::monostate,
+            std::promise<Sequence::Ack>,
+            std::promise<Sequence::Capabilities>,
+            std::promise<Sequence::TransferStatus>,
+            std::promise<Sequence::BlockHashes>
+        >;
+
+        /** A slot in the pending requests table. 
+         */
+        class PendingRequest {
+        public:
+            /** The request id, 0 if the slot is free. */
+            size_t id = 0;
+            /** The request, kept for resending. */
+            std::shared_ptr<Sequence> request;
+            /** The request as serialized without its id, which is how terminals that do not support request ids echo it in their acknowledgements. 
+             
+                Only built when such acknowledgement arrives, see contentsOf(). 
+             */
+            std::string contents;
+            /** Kind of the expected response. */
+            Sequence::Kind responseKind = Sequence::Kind::Invalid;
+            Promise promise;
+            std::chrono::steady_clock::time_point deadline;
+            size_t timeout = 0;
+            size_t attempts = 0;
+        }; 
+
+        template<typename RESPONSE>
+        static constexpr Sequence::Kind ResponseKind() {
+            if constexpr (std::is_same_v<RESPONSE, Sequence::Ack>)
+                return Sequence::Kind::Ack;
+            else if constexpr (std::is_same_v<RESPONSE, Sequence::Capabilities>)
+                return Sequence::Kind::Capabilities;
+            else if constexpr (std::is_same_v<RESPONSE, Sequence::TransferStatus>)
+                return Sequence::Kind::TransferStatus;
+            else 
+                return Sequence::Kind::BlockHashes;
+        }
+
+        template<typename RESPONSE, typename REQUEST>
+        std::future<RESPONSE> request(REQUEST && req, size_t timeout, size_t attempts) {
+            std::shared_ptr<Sequence> r{new std::decay_t<REQUEST>{std::forward<REQUEST>(req)}};
+            std::future<RESPONSE> result;
+            {
+                std::unique_lock<std::mutex> g{mPending_};
+                PendingRequest & slot = allocateSlot(g);
+                r->setRequestId(slot.id);
+                slot.request = r;
+                slot.responseKind = ResponseKind<RESPONSE>();
+                std::promise<RESPONSE> p;
+                result = p.get_future();
+                slot.promise = std::move(p);
+                slot.timeout = timeout;
+                slot.attempts = attempts == 0 ? 1 : attempts;
+                slot.deadline = timeout == 0 ? std::chrono::steady_clock::time_point::max() : std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+            }
+            timeoutsChanged_.notify_one();
+            send(*r);
+            return result;
+        }
+
+        /** Finds a free slot in the pending requests table, waiting for one if the table is full, and assigns it a new request id. 
+         */
+        PendingRequest & allocateSlot(std::unique_lock<std::mutex> & g);
+
+        void releaseSlot(PendingRequest & slot);
+
+        /** Returns the pending request with given id, or nullptr if there is none. 
+         */
+        PendingRequest * findPending(size_t requestId, Sequence::Kind responseKind) {
+            PendingRequest & slot = pending_[requestId % MAX_PENDING_REQUESTS];
+            return (slot.id == requestId && (slot.responseKind == responseKind || responseKind == Sequence::Kind::Nack)) ? & slot : nullptr;
+        }
+
+        /** Matches response without request id by its contents. 
+         */
+        PendingRequest * findPendingByContents(Sequence const & response);
+
+        /** Returns the request of given slot serialized without its id. 
+         
+            Only terminals that do not support request ids need the serialized request to match their acknowledgements, so it is built on the first such acknowledgement and kept with the slot. 
+         */
+        static std::string const & ContentsOf(PendingRequest & slot);
+
+        /** Fulfils the pending request the response belongs to. 
+         */
+        template<typename RESPONSE>
+        void respond(RESPONSE && response) {
+            std::lock_guard<std::mutex> g{mPending_};
+            PendingRequest * slot = response.requestId() != 0 ? findPending(response.requestId(), response.kind()) : findPendingByContents(response);
+            // responses to requests that have already timed out end up here too, so they are not an error
+            if (slot == nullptr) {
+                LOG(Log::Verbose) << "Unmatched t++ sequence " << response.kind();
+                return;
+            }
+            std::get<std::promise<std::decay_t<RESPONSE>>>(slot->promise).set_value(std::forward<RESPONSE>(response));
+            releaseSlot(*slot);
+        }
+
+        /** Fails the pending request the negative acknowledgement belongs to. 
+         */
+        void reject(Sequence::Nack const & nack);
+
+        /** Resends the timed out requests and fails those that have no attempts left. 
+         */
+        void checkTimeouts();
+
+        std::array<PendingRequest, MAX_PENDING_REQUESTS> pending_;
+        size_t numPending_ = 0;
+        size_t nextRequestId_ = 0;
+        std::mutex mPending_;
+        std::condition_variable slotReleased_;
+        std::condition_variable timeoutsChanged_;
+        bool terminating_ = false;
+        std::thread timeouts_;
+
+    }; // tpp::TerminalClient::Async
+
     /** Synchronous terminal client. 
      
-        A simplified single threaded client that allows asynchronous operation. 
+        Each request blocks the calling thread until its response arrives. Multiple threads may have their requests in flight at the same time. The asynchronous API of the client can be used as well. 
      */
-    class TerminalClient::Sync : public TerminalClient {
+    class TerminalClient::Sync : public TerminalClient::Async {
     public:
 
         explicit Sync(PTYSlave * pty):
-            TerminalClient{pty},
+            Async{pty},
             timeout_{1000},
             attempts_{10},
-            result_{nullptr},
-            processed_{0} {
+            inputRead_{0} {
         }
 
-        std::pair<int, int> size() const {
-            return pty_->size();
+        /** Returns the default timeout for t++ sequence responses in milliseconds. 
+         */
+        size_t timeout() const {
+            return timeout_;
+        }
+
+        /** Returns the default number of attempts for t++ sequence requests. 
+         */
+        size_t attempts() const {
+            return attempts_;
         }
 
         /** Returns the number of non-t++ bytes that can be read without blocking. 
          */
         size_t available() const {
-            std::lock_guard<std::mutex> g{mBuffer_};
-            return bufferUnprocessed_ - processed_;
+            std::lock_guard<std::mutex> g{mInput_};
+            return input_.size() - inputRead_;
+        }
+
+        /** Returns the number of non-t++ bytes discarded so far because they were not read before the input buffer filled up. 
+         */
+        size_t discarded() const {
+            std::lock_guard<std::mutex> g{mInput_};
+            return discarded_;
         }
 
         /** Blocking read. 
          */
         size_t read(char * buffer, size_t bufferSize) {
-            std::unique_lock<std::mutex> g{mBuffer_};
-            while (bufferUnprocessed_ - processed_ == 0)
+            std::unique_lock<std::mutex> g{mInput_};
+            while (input_.size() == inputRead_)
                 dataReady_.wait(g);
-            size_t result = std::min(bufferSize, bufferUnprocessed_ - processed_);
-            memcpy(buffer, buffer_ + processed_, result);
-            bufferUnprocessed_ += result;
+            size_t result = std::min(bufferSize, input_.size() - inputRead_);
+            memcpy(buffer, input_.data() + inputRead_, result);
+            inputRead_ += result;
+            if (inputRead_ == input_.size()) {
+                input_.clear();
+                inputRead_ = 0;
+            }
             return result;
         }
 
@@ -120,7 +322,9 @@ namespace tpp {
         /** Returns the terminal capabilities. 
          */
         //@{
-        Sequence::Capabilities getCapabilities(size_t timeout, size_t attempts);
+        Sequence::Capabilities getCapabilities(size_t timeout, size_t attempts) {
+            return requestCapabilities(timeout, attempts).get();
+        }
 
         Sequence::Capabilities getCapabilities(size_t timeout) {
             return getCapabilities(timeout, 1);
@@ -133,7 +337,9 @@ namespace tpp {
 
 
         //@{
-        size_t openFileTransfer(std::string const & host, std::string const & filename, size_t size, size_t timeout, size_t attempts);
+        size_t openFileTransfer(std::string const & host, std::string const & filename, size_t size, size_t timeout, size_t attempts) {
+            return requestOpenFileTransfer(host, filename, size, timeout, attempts).get().id();
+        }
 
         size_t openFileTransfer(std::string const & host, std::string const & filename, size_t size, size_t timeout) {
             return openFileTransfer(host, filename, size, timeout, attempts_);
@@ -145,7 +351,9 @@ namespace tpp {
         //@}
 
         //@{
-        Sequence::TransferStatus getTransferStatus(size_t id, size_t timeout, size_t attempts);
+        Sequence::TransferStatus getTransferStatus(size_t id, size_t timeout, size_t attempts) {
+            return requestTransferStatus(id, timeout, attempts).get();
+        }
 
         Sequence::TransferStatus getTransferStatus(size_t id, size_t timeout) {
             return getTransferStatus(id, timeout, attempts_);
@@ -156,8 +364,26 @@ namespace tpp {
         }
         //@}
 
+        /** Returns hashes of the blocks of the terminal's local copy of the transferred file. 
+         */
+        //@{
+        Sequence::BlockHashes getBlockHashes(size_t id, size_t blockSize, size_t timeout, size_t attempts) {
+            return requestBlockHashes(id, blockSize, timeout, attempts).get();
+        }
+
+        Sequence::BlockHashes getBlockHashes(size_t id, size_t blockSize, size_t timeout) {
+            return getBlockHashes(id, blockSize, timeout, attempts_);
+        }
+
+        Sequence::BlockHashes getBlockHashes(size_t id, size_t blockSize) {
+            return getBlockHashes(id, blockSize, timeout_, attempts_);
+        }
+        //@}
+
         //@{
-        void viewRemoteFile(size_t id, size_t timeout, size_t attempts);
+        void viewRemoteFile(size_t id, size_t timeout, size_t attempts) {
+            requestViewRemoteFile(id, timeout, attempts).get();
+        }
 
         void viewRemoteFile(size_t id, size_t timeout) {
             viewRemoteFile(id, timeout, attempts_);
@@ -168,8 +394,6 @@ namespace tpp {
         }
         //@}
 
-
-
     protected:
 
         size_t received(char const * buffer, char const * bufferEnd) override {
@@ -180,25 +404,31 @@ namespace tpp {
 #else
                     exit(EXIT_FAILURE);
 #endif
+            {
+                std::lock_guard<std::mutex> g{mInput_};
+                // the input is kept only until read, once consumed it is removed from the buffer
+                if (inputRead_ > 0 && inputRead_ >= input_.size() - inputRead_) {
+                    input_.erase(0, inputRead_);
+                    inputRead_ = 0;
+                }
+                // if the input is not read fast enough, only the input over the capacity is discarded so that the unread input, which may be a partial response the client is waiting for, stays intact. The reader can't wait for the client instead as it must keep matching responses to requests
+                size_t size = static_cast<size_t>(bufferEnd - buffer);
+                size_t unread = input_.size() - inputRead_;
+                size_t fits = unread < InputBuffer::DEFAULT_CAPACITY ? std::min(size, InputBuffer::DEFAULT_CAPACITY - unread) : 0;
+                if (fits < size) {
+                    if (! discarding_)
+                        LOG() << "Input buffer full (" << unread << " unread bytes), discarding input until read";
+                    discarding_ = true;
+                    discarded_ += size - fits;
+                } else {
+                    discarding_ = false;
+                }
+                input_.append(buffer, fits);
+            }
             dataReady_.notify_all();
-            return 0;
-        }
-
-        void receivedSequence(Sequence::Kind kind, char const * payload, char const * payloadEnd) override;
-
-        void processInput(char * start, char const * end) override {
-            std::lock_guard<std::mutex> g{mBuffer_};
-            TerminalClient::processInput(start + processed_, end);
-            processed_ = 0;
+            return bufferEnd - buffer;
         }
 
-        /** Transmits the sequence and waits for the response to arrive within the client's timeout. 
-         */
-        
-        void transmit(Sequence const & send, Sequence & receive, size_t timeout, size_t attempts);
-
-        bool responseCheck(Sequence::Kind kind, char const * payload, char const * payloadEnd);
-
         /** timeout for t++ sequence responses in milliseconds. 
          */
         size_t timeout_;
@@ -207,15 +437,20 @@ namespace tpp {
          */
         size_t attempts_;
 
-        mutable std::mutex mBuffer_;
+        mutable std::mutex mInput_;
         mutable std::condition_variable dataReady_;
 
-        std::mutex mSequences_;
-        std::condition_variable sequenceReady_;
-        Sequence * volatile result_;
-        Sequence const * volatile request_;
-        /** Number of bytes processed by the read() method. */
-        size_t processed_;
+        /** Plain input received from the terminal and not yet read. */
+        std::string input_;
+
+        /** Number of bytes of the input consumed by the read() method. */
+        size_t inputRead_;
+
+        /** Total number of input bytes discarded because the input was not read. */
+        size_t discarded_ = 0;
+
+        /** True while the input is being discarded, so that the overflow is only logged once. */
+        bool discarding_ = false;
 
     }; // tpp::TerminalClient::Sync
 
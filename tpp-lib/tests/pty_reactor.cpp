@@ -0,0 +1,221 @@
+#if (defined ARCH_LINUX)
+
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+
+#include "helpers/filesystem.h"
+#include "helpers/tests.h"
+
+#include "../local_pty.h"
+#include "../pty_buffer.h"
+#include "../pty_reactor.h"
+
+using namespace tpp;
+
+namespace {
+
+    /** Collects the output of a local pseudoterminal read by the reactor.
+     */
+    class OutputCollector : public PTYBuffer<PTYMaster> {
+    public:
+        explicit OutputCollector(Command const & command):
+            PTYBuffer{new LocalPTYMaster{command}} {
+            startPTYReader();
+        }
+
+        OutputCollector(Command const & command, Environment const & env):
+            PTYBuffer{new LocalPTYMaster{command, env}} {
+            startPTYReader();
+        }
+
+        ~OutputCollector() override {
+            terminatePty();
+        }
+
+        /** Waits for the process to terminate and returns its exit code.
+         */
+        ExitCode wait() {
+            std::unique_lock<std::mutex> g{m_};
+            while (! terminated_)
+                cv_.wait(g);
+            return exitCode_;
+        }
+
+        std::string output() {
+            std::lock_guard<std::mutex> g{m_};
+            return output_;
+        }
+
+    protected:
+        size_t received(char * buffer, char const * end) override {
+            std::lock_guard<std::mutex> g{m_};
+            output_.append(buffer, end - buffer);
+            return end - buffer;
+        }
+
+        void ptyTerminated(ExitCode exitCode) override {
+            std::lock_guard<std::mutex> g{m_};
+            exitCode_ = exitCode;
+            terminated_ = true;
+            cv_.notify_all();
+        }
+
+    private:
+        std::mutex m_;
+        std::condition_variable cv_;
+        std::string output_;
+        bool terminated_ = false;
+        ExitCode exitCode_ = 0;
+    };
+
+}
+
+TEST(tpp_pty_reactor, handlerCalledWhenReadable) {
+    int fds[2];
+    EXPECT(pipe(fds) == 0);
+    std::mutex m;
+    std::condition_variable cv;
+    std::string received;
+    size_t id = PTYReactor::Instance().add(fds[0], [&]() {
+        char buffer[16];
+        ssize_t n = read(fds[0], buffer, sizeof(buffer));
+        std::lock_guard<std::mutex> g{m};
+        received.append(buffer, n);
+        cv.notify_all();
+        return true;
+    });
+    for (std::string what : { "foo", "bar" }) {
+        EXPECT(write(fds[1], what.c_str(), what.size()) == static_cast<ssize_t>(what.size()));
+        std::unique_lock<std::mutex> g{m};
+        while (received.size() % 3 != 0 || received.empty() || received.substr(received.size() - 3) != what)
+            cv.wait(g);
+    }
+    PTYReactor::Instance().remove(id);
+    // after the removal the handler must not be called
+    EXPECT(write(fds[1], "baz", 3) == 3);
+    std::this_thread::sleep_for(std::chrono::milliseconds{20});
+    EXPECT_EQ(received, "foobar");
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST(tpp_pty_reactor, removeWaitsForHandler) {
+    int fds[2];
+    EXPECT(pipe(fds) == 0);
+    std::atomic<bool> running{false};
+    std::atomic<bool> finished{false};
+    size_t id = PTYReactor::Instance().add(fds[0], [&]() {
+        running = true;
+        std::this_thread::sleep_for(std::chrono::milliseconds{50});
+        finished = true;
+        return false;
+    });
+    EXPECT(write(fds[1], "x", 1) == 1);
+    while (! running)
+        std::this_thread::yield();
+    PTYReactor::Instance().remove(id);
+    EXPECT(finished);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST(tpp_pty_reactor, handlerWaitingForLockDoesNotStallOthers) {
+    int blocked[2];
+    int other[2];
+    EXPECT(pipe(blocked) == 0);
+    EXPECT(pipe(other) == 0);
+    std::mutex lock;
+    std::unique_lock<std::mutex> held{lock};
+    std::atomic<bool> waiting{false};
+    std::atomic<bool> otherCalled{false};
+    size_t blockedId = PTYReactor::Instance().add(blocked[0], [&]() {
+        waiting = true;
+        std::lock_guard<std::mutex> g{lock};
+        return false;
+    });
+    size_t otherId = PTYReactor::Instance().add(other[0], [&]() {
+        otherCalled = true;
+        return false;
+    });
+    EXPECT(PTYReactor::Instance().workers() >= PTYReactor::MIN_WORKERS);
+    EXPECT(write(blocked[1], "x", 1) == 1);
+    while (! waiting)
+        std::this_thread::yield();
+    EXPECT(write(other[1], "x", 1) == 1);
+    while (! otherCalled)
+        std::this_thread::yield();
+    held.unlock();
+    PTYReactor::Instance().remove(blockedId);
+    PTYReactor::Instance().remove(otherId);
+    for (int fd : { blocked[0], blocked[1], other[0], other[1] })
+        close(fd);
+}
+
+TEST(tpp_pty_reactor, localPTYOutputAndExitCode) {
+    OutputCollector c{Command{"sh", { "-c", "printf 'hello world'; exit 3" }}};
+    EXPECT_EQ(c.wait(), 3);
+    EXPECT_EQ(c.output(), "hello world");
+}
+
+TEST(tpp_pty_reactor, localPTYSessionAndEnvironment) {
+    // the 7th field of the stat is the controlling terminal of the process
+    OutputCollector c{Command{"sh", { "-c", "read pid comm state ppid pgrp session tty rest < /proc/self/stat; echo \"$TERM $COLORTERM $((pid == session)) $((tty != 0))\"" }}};
+    EXPECT_EQ(c.wait(), 0);
+    EXPECT_EQ(c.output(), "xterm-256color truecolor 1 1\r\n");
+}
+
+TEST(tpp_pty_reactor, localPTYCommandFoundInSessionPath) {
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / UniqueNameIn(std::filesystem::temp_directory_path(), "tpp-test-path-");
+    std::filesystem::create_directory(dir);
+    std::string script = (dir / "tpp-test-command").string();
+    {
+        std::ofstream f{script};
+        f << "#!/bin/sh\nprintf found\n";
+    }
+    EXPECT(chmod(script.c_str(), 0700) == 0);
+    Environment env;
+    env.set("PATH", dir.string());
+    {
+        OutputCollector c{Command{"tpp-test-command", {}}, env};
+        EXPECT_EQ(c.wait(), 0);
+        EXPECT_EQ(c.output(), "found");
+    }
+    // the PATH of the terminal is not searched
+    EXPECT_THROWS(OSError, OutputCollector(Command{"sh", { "-c", "true" }}, env));
+    std::filesystem::remove_all(dir);
+}
+
+TEST(tpp_pty_reactor, localPTYQueuedSend) {
+    // the line discipline discards long lines in canonical mode, so the data must be sent only after the slave switches to raw mode
+    OutputCollector c{Command{"sh", { "-c", "stty raw -echo; echo ready; sleep 0.5; head -c 1000000 | wc -c" }}};
+    while (c.output().find("ready") == std::string::npos)
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    std::atomic<size_t> lastProgress{1};
+    c.pty()->setSendProgressHandler([&](size_t pending) {
+        lastProgress = pending;
+    });
+    std::string data(1000000, 'x');
+    // the slave does not read yet, so the send must not block, but queue the data
+    auto start = std::chrono::steady_clock::now();
+    c.pty()->send(data.c_str(), data.size());
+    EXPECT(std::chrono::steady_clock::now() - start < std::chrono::milliseconds{250});
+    EXPECT(c.pty()->pendingBytes() > 0);
+    EXPECT_EQ(c.wait(), 0);
+    EXPECT(c.output().find("1000000") != std::string::npos);
+    EXPECT_EQ(c.pty()->pendingBytes(), 0u);
+    EXPECT_EQ(lastProgress, 0u);
+}
+
+TEST(tpp_pty_reactor, localPTYTerminated) {
+    OutputCollector c{Command{"sleep", { "100" }}};
+    // the destructor kills the process and waits for the reactor to report it
+}
+
+#endif
@@ -0,0 +1,103 @@
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <string>
+
+#include "helpers/tests.h"
+#include "helpers/filesystem.h"
+#include "helpers/hash.h"
+
+#include "../remote_files.h"
+
+using namespace tpp;
+
+namespace {
+
+    /** Remote files stored in a fresh temporary folder, which is deleted afterwards.
+     */
+    class LocalRoot {
+    public:
+        LocalRoot():
+            path{std::filesystem::path{TempDir()} / UniqueNameIn(TempDir(), "tpp-remote-files-")},
+            files{path.string()} {
+        }
+
+        ~LocalRoot() {
+            std::filesystem::remove_all(path);
+        }
+
+        /** Creates the local copy of given remote file from an earlier transfer.
+         */
+        void createLocalCopy(std::string const & filename, std::string const & contents) {
+            std::filesystem::create_directories(path / "host");
+            std::ofstream f{path / "host" / filename, std::ios::binary};
+            f << contents;
+        }
+
+        std::string localCopy(std::string const & filename) {
+            std::ifstream f{path / "host" / filename, std::ios::binary};
+            return std::string{std::istreambuf_iterator<char>{f}, std::istreambuf_iterator<char>{}};
+        }
+
+        Sequence::BlockHashes::Response getBlockHashes(size_t id, size_t blockSize) {
+            std::promise<Sequence::BlockHashes::Response> response;
+            files.getBlockHashes(Sequence::GetBlockHashes{id, blockSize}, [&](Sequence::BlockHashes::Response const & r) {
+                response.set_value(r);
+            });
+            return response.get_future().get();
+        }
+
+        std::filesystem::path path;
+        RemoteFiles files;
+    };
+
+}
+
+TEST(tpp_remote_files, blockHashesOfStaleCopy) {
+    LocalRoot root;
+    // the local copy is much larger than the remote file, which has been truncated since the last transfer
+    std::string local = std::string(100, 'a') + std::string(100, 'b') + std::string(800, 'c');
+    root.createLocalCopy("foo.log", local);
+    size_t id = root.files.openFileTransfer(Sequence::OpenFileTransfer{"host", "/var/log/foo.log", 250}).result().id();
+    EXPECT_EQ(root.files.get(id)->localSize(), 1000u);
+    Sequence::BlockHashes::Response r = root.getBlockHashes(id, 100);
+    EXPECT(r.valid());
+    // only the part of the local copy within the remote file is hashed
+    EXPECT_EQ(r.result().size(), 250u);
+    EXPECT_EQ(r.result().hashes().size(), 3u);
+    EXPECT_EQ(r.result().hashes()[0], FNV1a64(local.c_str(), 100));
+    EXPECT_EQ(r.result().hashes()[1], FNV1a64(local.c_str() + 100, 100));
+    EXPECT_EQ(r.result().hashes()[2], FNV1a64(local.c_str() + 200, 50));
+    // invalid requests are denied
+    EXPECT(! root.getBlockHashes(id, 0).valid());
+    EXPECT(! root.getBlockHashes(id, Sequence::GetBlockHashes::MAX_BLOCK_SIZE + 1).valid());
+    EXPECT(! root.getBlockHashes(id + 1, 100).valid());
+}
+
+TEST(tpp_remote_files, blockHashesWithoutLocalCopy) {
+    LocalRoot root;
+    size_t id = root.files.openFileTransfer(Sequence::OpenFileTransfer{"host", "/var/log/foo.log", 250}).result().id();
+    Sequence::BlockHashes::Response r = root.getBlockHashes(id, 100);
+    EXPECT(r.valid());
+    EXPECT_EQ(r.result().size(), 0u);
+    EXPECT(r.result().hashes().empty());
+}
+
+TEST(tpp_remote_files, skipAndTruncate) {
+    LocalRoot root;
+    std::string local = std::string(100, 'a') + std::string(100, 'b') + std::string(800, 'c');
+    root.createLocalCopy("foo.log", local);
+    size_t id = root.files.openFileTransfer(Sequence::OpenFileTransfer{"host", "/var/log/foo.log", 250}).result().id();
+    // skips must start at the received offset and lie within both the local copy and the file
+    EXPECT(! root.files.skip(Sequence::SkipData{id, 100, 100}));
+    EXPECT(! root.files.skip(Sequence::SkipData{id, 0, 300}));
+    EXPECT(root.files.skip(Sequence::SkipData{id, 0, 100}));
+    // the changed block is transferred
+    std::string changed(100, 'x');
+    EXPECT(root.files.transfer(Sequence::Data{id, 100, changed.c_str(), changed.c_str() + changed.size()}));
+    EXPECT(! root.files.get(id)->ready());
+    EXPECT(root.files.skip(Sequence::SkipData{id, 200, 50}));
+    // once completed, the local copy is truncated to the size of the file
+    EXPECT(root.files.get(id)->ready());
+    EXPECT_EQ(root.localCopy("foo.log"), std::string(100, 'a') + changed + std::string(50, 'c'));
+}
@@ -0,0 +1,211 @@
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "helpers/tests.h"
+
+#include "../remote_sessions.h"
+
+using namespace tpp;
+
+namespace {
+
+    /** The connection to the server, collecting the t++ sequences sent to it.
+     */
+    class FakeConnection : public PTYMaster {
+    public:
+
+        void terminate() override {
+        }
+
+        void resize(int cols, int rows) override {
+            MARK_AS_UNUSED(cols);
+            MARK_AS_UNUSED(rows);
+        }
+
+        void send(char const * buffer, size_t numBytes) override {
+            std::lock_guard<std::mutex> g{m_};
+            sent_.append(buffer, numBytes);
+        }
+
+        size_t receive(char * buffer, size_t bufferSize) override {
+            MARK_AS_UNUSED(buffer);
+            MARK_AS_UNUSED(bufferSize);
+            return 0;
+        }
+
+        /** Returns the sequences sent so far as pairs of their kind and payload, and forgets them.
+         */
+        std::vector<std::pair<Sequence::Kind, std::string>> sequences() {
+            std::lock_guard<std::mutex> g{m_};
+            std::vector<std::pair<Sequence::Kind, std::string>> result;
+            size_t start = 0;
+            while ((start = sent_.find("\033P+", start)) != std::string::npos) {
+                size_t end = sent_.find('\007', start);
+                char const * x = sent_.c_str() + start + 3;
+                Sequence::Kind kind = Sequence::ParseKind(x, sent_.c_str() + end);
+                result.push_back(std::make_pair(kind, std::string{x, sent_.c_str() + end}));
+                start = end;
+            }
+            sent_.clear();
+            return result;
+        }
+
+    private:
+        std::mutex m_;
+        std::string sent_;
+    };
+
+    template<typename T>
+    T Parse(std::string const & payload) {
+        char const * x = payload.c_str();
+        return T{x, x + payload.size()};
+    }
+
+    /** The session's own terminated() hides the one of the pseudoterminal.
+     */
+    bool Terminated(PTYMaster const * session) {
+        return session->terminated();
+    }
+
+    std::string Receive(PTYMaster * session, size_t bytes) {
+        std::string result(bytes, '\0');
+        size_t received = 0;
+        while (received < bytes) {
+            size_t n = session->receive(& result[received], bytes - received);
+            if (n == 0)
+                break;
+            received += n;
+        }
+        result.resize(received);
+        return result;
+    }
+
+}
+
+TEST(tpp_remote_sessions, openAndReceive) {
+    RemoteSessions sessions;
+    FakeConnection connection;
+    std::unique_ptr<RemoteSessions::Session> s{sessions.open(& connection, Sequence::NewSession{1, "foo", 80, 25})};
+    EXPECT(s != nullptr);
+    EXPECT_EQ(s->id(), 1u);
+    EXPECT_EQ(s->name(), "foo");
+    // the session ids are unique per connection
+    EXPECT_NULL(sessions.open(& connection, Sequence::NewSession{1, "bar", 80, 25}));
+    FakeConnection other;
+    std::unique_ptr<RemoteSessions::Session> s2{sessions.open(& other, Sequence::NewSession{1, "bar", 80, 25})};
+    EXPECT(s2 != nullptr);
+    // the output is delivered to the session of the connection
+    std::string data{"hello"};
+    sessions.data(& connection, Sequence::SessionData{1, data.c_str(), data.c_str() + data.size()});
+    EXPECT_EQ(Receive(s.get(), 5), "hello");
+    // data for unknown sessions are ignored
+    sessions.data(& connection, Sequence::SessionData{2, data.c_str(), data.c_str() + data.size()});
+}
+
+TEST(tpp_remote_sessions, inputSentInPackets) {
+    RemoteSessions sessions;
+    FakeConnection connection;
+    std::unique_ptr<RemoteSessions::Session> s{sessions.open(& connection, Sequence::NewSession{3, "foo", 80, 25})};
+    std::string input(RemoteSessions::Session::MAX_PACKET_SIZE + 10, 'x');
+    s->send(input.c_str(), input.size());
+    auto sent = connection.sequences();
+    EXPECT_EQ(sent.size(), 2u);
+    std::string received;
+    for (auto const & i : sent) {
+        EXPECT(i.first == Sequence::Kind::SessionData);
+        Sequence::SessionData data{Parse<Sequence::SessionData>(i.second)};
+        EXPECT_EQ(data.id(), 3u);
+        received += data.payload();
+    }
+    EXPECT_EQ(received, input);
+}
+
+TEST(tpp_remote_sessions, focusAndResize) {
+    RemoteSessions sessions;
+    FakeConnection connection;
+    std::unique_ptr<RemoteSessions::Session> s{sessions.open(& connection, Sequence::NewSession{2, "foo", 80, 25})};
+    s->focus();
+    s->resize(100, 40);
+    auto sent = connection.sequences();
+    EXPECT_EQ(sent.size(), 2u);
+    EXPECT(sent[0].first == Sequence::Kind::FocusSession);
+    EXPECT_EQ(Parse<Sequence::FocusSession>(sent[0].second).id(), 2u);
+    EXPECT(sent[1].first == Sequence::Kind::ResizeSession);
+    Sequence::ResizeSession resize{Parse<Sequence::ResizeSession>(sent[1].second)};
+    EXPECT_EQ(resize.id(), 2u);
+    EXPECT_EQ(resize.cols(), 100);
+    EXPECT_EQ(resize.rows(), 40);
+}
+
+TEST(tpp_remote_sessions, readOutputCredited) {
+    RemoteSessions sessions;
+    FakeConnection connection;
+    std::unique_ptr<RemoteSessions::Session> s{sessions.open(& connection, Sequence::NewSession{1, "foo", 80, 25})};
+    size_t quarter = Sequence::SessionCredit::DEFAULT_WINDOW / 4;
+    std::string data(quarter - 1, 'x');
+    sessions.data(& connection, Sequence::SessionData{1, data.c_str(), data.c_str() + data.size()});
+    EXPECT_EQ(Receive(s.get(), data.size()).size(), data.size());
+    // small reads are not credited so that the connection is not flooded with credits
+    EXPECT(connection.sequences().empty());
+    sessions.data(& connection, Sequence::SessionData{1, data.c_str(), data.c_str() + 1});
+    EXPECT_EQ(Receive(s.get(), 1).size(), 1u);
+    auto sent = connection.sequences();
+    EXPECT_EQ(sent.size(), 1u);
+    EXPECT(sent[0].first == Sequence::Kind::SessionCredit);
+    Sequence::SessionCredit credit{Parse<Sequence::SessionCredit>(sent[0].second)};
+    EXPECT_EQ(credit.id(), 1u);
+    EXPECT_EQ(credit.bytes(), quarter);
+}
+
+TEST(tpp_remote_sessions, closedByServer) {
+    RemoteSessions sessions;
+    FakeConnection connection;
+    std::unique_ptr<RemoteSessions::Session> s{sessions.open(& connection, Sequence::NewSession{1, "foo", 80, 25})};
+    std::string data{"bye"};
+    sessions.data(& connection, Sequence::SessionData{1, data.c_str(), data.c_str() + data.size()});
+    // a reader blocked in receive is woken up, the output received before the termination can still be read
+    std::thread reader{[&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+        sessions.closed(& connection, Sequence::SessionClosed{1, 7});
+    }};
+    EXPECT_EQ(Receive(s.get(), 100), "bye");
+    reader.join();
+    EXPECT(Terminated(s.get()));
+    EXPECT_EQ(s->exitCode(), 7);
+    // the session is no longer attached, so nothing is sent for it
+    s->send("x", 1);
+    EXPECT(connection.sequences().empty());
+    // and a new session may reuse the id
+    std::unique_ptr<RemoteSessions::Session> s2{sessions.open(& connection, Sequence::NewSession{1, "foo", 80, 25})};
+    EXPECT(s2 != nullptr);
+}
+
+TEST(tpp_remote_sessions, terminatedByTerminal) {
+    RemoteSessions sessions;
+    FakeConnection connection;
+    std::unique_ptr<RemoteSessions::Session> s{sessions.open(& connection, Sequence::NewSession{4, "foo", 80, 25})};
+    s->terminate();
+    EXPECT(Terminated(s.get()));
+    auto sent = connection.sequences();
+    EXPECT_EQ(sent.size(), 1u);
+    EXPECT(sent[0].first == Sequence::Kind::SessionClosed);
+    EXPECT_EQ(Parse<Sequence::SessionClosed>(sent[0].second).id(), 4u);
+    EXPECT_EQ(Receive(s.get(), 1), "");
+}
+
+TEST(tpp_remote_sessions, detach) {
+    RemoteSessions sessions;
+    FakeConnection connection;
+    std::unique_ptr<RemoteSessions::Session> s1{sessions.open(& connection, Sequence::NewSession{1, "foo", 80, 25})};
+    std::unique_ptr<RemoteSessions::Session> s2{sessions.open(& connection, Sequence::NewSession{2, "bar", 80, 25})};
+    sessions.detach(& connection);
+    EXPECT(Terminated(s1.get()));
+    EXPECT(Terminated(s2.get()));
+    EXPECT_EQ(s1->exitCode(), EXIT_FAILURE);
+    // once detached, the sessions must not touch the connection
+    s1->send("x", 1);
+    s2->resize(10, 10);
+    EXPECT(connection.sequences().empty());
+}
@@ -0,0 +1,168 @@
+#include <condition_variable>
+#include <mutex>
+#include <string>
+
+#include "helpers/tests.h"
+
+#include "../terminal_client.h"
+
+using namespace tpp;
+
+namespace {
+
+    /** Terminal side of a connection whose input is provided by the test and whose output is collected.
+     */
+    class FakeTerminal : public PTYSlave {
+    public:
+
+        std::pair<int, int> size() const override {
+            return std::make_pair(80, 25);
+        }
+
+        void send(char const * buffer, size_t numBytes) override {
+            std::lock_guard<std::mutex> g{m_};
+            sent_.append(buffer, numBytes);
+            cv_.notify_all();
+        }
+
+        /** The client deletes the terminal before joining its reader, so the terminal waits for the reader to see the end of input first.
+         */
+        ~FakeTerminal() override {
+            std::unique_lock<std::mutex> g{m_};
+            closed_ = true;
+            cv_.notify_all();
+            while (! eof_)
+                cv_.wait(g);
+        }
+
+        size_t receive(char * buffer, size_t bufferSize) override {
+            std::unique_lock<std::mutex> g{m_};
+            while (input_.empty() && ! closed_)
+                cv_.wait(g);
+            if (input_.empty()) {
+                eof_ = true;
+                cv_.notify_all();
+                return 0;
+            }
+            size_t result = std::min(bufferSize, input_.size());
+            memcpy(buffer, input_.c_str(), result);
+            input_.erase(0, result);
+            return result;
+        }
+
+        /** Sends the sequence to the client as the terminal would.
+         */
+        void respond(Sequence const & seq) {
+            input(STR("\033P+" << seq << "\007"));
+        }
+
+        void input(std::string const & data) {
+            std::lock_guard<std::mutex> g{m_};
+            input_ += data;
+            cv_.notify_all();
+        }
+
+        /** Waits until the client sends at least given number of t++ sequences and returns everything it sent.
+         */
+        std::string waitForSequences(size_t count) {
+            std::unique_lock<std::mutex> g{m_};
+            while (static_cast<size_t>(std::count(sent_.begin(), sent_.end(), '\007')) < count)
+                cv_.wait(g);
+            return sent_;
+        }
+
+    private:
+        std::mutex m_;
+        std::condition_variable cv_;
+        std::string input_;
+        std::string sent_;
+        bool closed_ = false;
+        bool eof_ = false;
+    };
+
+    /** A client connected to the fake terminal.
+     */
+    class Connection {
+    public:
+        Connection():
+            terminal{new FakeTerminal{}},
+            client{new TerminalClient::Sync{terminal}} {
+        }
+
+        FakeTerminal * terminal;
+        std::unique_ptr<TerminalClient::Sync> client;
+    };
+
+    /** Returns the request id of the last sequence in the data sent by the client.
+     */
+    size_t LastRequestId(std::string const & sent) {
+        size_t end = sent.rfind('\007');
+        size_t start = sent.rfind(';', end);
+        return std::stoul(sent.substr(start + 1, end - start - 1));
+    }
+
+}
+
+TEST(tpp_terminal_client, ackMatchedByRequestId) {
+    Connection c;
+    auto ack = c.client->requestOpenFileTransfer("host", "file", 10, 1000, 1);
+    Sequence::OpenFileTransfer req{"host", "file", 10};
+    req.setRequestId(LastRequestId(c.terminal->waitForSequences(1)));
+    c.terminal->respond(Sequence::Ack{req, 7});
+    EXPECT_EQ(ack.get().id(), 7u);
+}
+
+TEST(tpp_terminal_client, ackWithoutRequestIdMatchedByContents) {
+    Connection c;
+    auto ack = c.client->requestOpenFileTransfer("host", "file", 10, 1000, 1);
+    c.terminal->waitForSequences(1);
+    // terminals that do not know request ids ignore them and echo the request without
+    c.terminal->respond(Sequence::Ack{Sequence::OpenFileTransfer{"host", "file", 10}, 7});
+    EXPECT_EQ(ack.get().id(), 7u);
+}
+
+TEST(tpp_terminal_client, acksWithoutRequestIdMatchedToTheirRequests) {
+    Connection c;
+    auto foo = c.client->requestOpenFileTransfer("host", "foo", 10, 1000, 1);
+    auto bar = c.client->requestOpenFileTransfer("host", "bar", 20, 1000, 1);
+    c.terminal->waitForSequences(2);
+    c.terminal->respond(Sequence::Ack{Sequence::OpenFileTransfer{"host", "bar", 20}, 8});
+    c.terminal->respond(Sequence::Ack{Sequence::OpenFileTransfer{"host", "foo", 10}, 7});
+    EXPECT_EQ(foo.get().id(), 7u);
+    EXPECT_EQ(bar.get().id(), 8u);
+}
+
+TEST(tpp_terminal_client, nackWithoutRequestIdMatchedByContents) {
+    Connection c;
+    auto ack = c.client->requestOpenFileTransfer("host", "file", 10, 1000, 1);
+    c.terminal->waitForSequences(1);
+    c.terminal->respond(Sequence::Nack{Sequence::OpenFileTransfer{"host", "file", 10}, "denied"});
+    EXPECT_THROWS(NackError, ack.get());
+}
+
+TEST(tpp_terminal_client, requestTimesOut) {
+    Connection c;
+    auto ack = c.client->requestOpenFileTransfer("host", "file", 10, 10, 2);
+    // the request is sent again after the first timeout
+    c.terminal->waitForSequences(2);
+    EXPECT_THROWS(TimeoutError, ack.get());
+}
+
+TEST(tpp_terminal_client, inputOverCapacityDiscarded) {
+    Connection c;
+    std::string input{"start" + std::string(100000, 'x')};
+    c.terminal->input(input);
+    while (c.client->available() + c.client->discarded() < input.size())
+        std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    // the unread input is kept, only the input that does not fit is discarded
+    EXPECT_EQ(c.client->available(), InputBuffer::DEFAULT_CAPACITY);
+    EXPECT_EQ(c.client->discarded(), input.size() - InputBuffer::DEFAULT_CAPACITY);
+    char buffer[5];
+    EXPECT_EQ(c.client->read(buffer, sizeof(buffer)), 5u);
+    EXPECT_EQ(std::string(buffer, 5), "start");
+    // once read, new input fits again
+    c.terminal->input("yz");
+    while (c.client->available() < InputBuffer::DEFAULT_CAPACITY - 3)
+        std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    EXPECT_EQ(c.client->discarded(), input.size() - InputBuffer::DEFAULT_CAPACITY);
+}
@@ -1,21 +1,87 @@
 #include <cstdlib>
 #include <iostream>
-#include <fstream>
 #include <memory>
-#include <filesystem>
 
 #include "helpers/helpers.h"
 #include "helpers/version.h"
+#include "helpers/json_config.h"
 
 #include "stamp.h"
 
 #include "tpp-lib/local_pty.h"
 
-#include "ui-terminal/ansi_renderer.h"
-#include "ui/event_queue.h"
+#include "multiplexer.h"
 
-#include "ui/widgets/panel.h"
-#include "ui/widgets/label.h"
+namespace tpp {
+
+    class Config : public JSONConfig::CmdArgsRoot {
+    public:
+        CONFIG_PROPERTY(
+            sessions,
+            "Number of sessions to start",
+            JSON{1},
+            unsigned
+        );
+        CONFIG_PROPERTY(
+            backgroundRate,
+            "Maximum output rate of the sessions not visible in the terminal (in bytes per second)",
+            JSON{65536},
+            unsigned
+        );
+        CONFIG_PROPERTY(
+            timeout,
+            "Timeout of the connection to terminal++ (in ms)",
+            JSON{1000},
+            unsigned
+        );
+        CONFIG_PROPERTY(
+            command,
+            "Command executed in the sessions, defaults to the user's shell. All arguments that follow are the command's arguments",
+            JSON::Array(),
+            std::vector<std::string>
+        );
+        CONFIG_PROPERTY(
+            verbose,
+            "Verbose output",
+            JSON{false},
+            bool
+        );
+
+        static Config & Instance() {
+            static Config singleton{};
+            return singleton;
+        }
+
+        static Config & Setup(int argc, char * argv[]) {
+            Config & config = Instance();
+            config.fillMissingValues();
+            config.parseCommandLine(argc, argv);
+            if (config.sessions() == 0)
+                THROW(ArgumentError()) << "At least one session must be started";
+            return config;
+        }
+
+        Command sessionCommand() const {
+            if (! command().empty())
+                return Command{command()};
+            char const * shell = Environment::Get("SHELL");
+            return Command{shell != nullptr ? shell : "/bin/sh", {}};
+        }
+
+    private:
+
+        Config() {
+            addArgument(sessions, {"--sessions", "-n"});
+            addArgument(backgroundRate, {"--background-rate"});
+            addArgument(timeout, {"--timeout", "-t"});
+            addArgument(verbose, {"--verbose", "-v"}, "true");
+            addArgument(command, {"--command", "-e"});
+            setLastArgument(command);
+        }
+
+    }; // tpp::Config
+
+} // namespace tpp
 
 void PrintVersion() {
     std::cout << "Terminal++ Server, version " << stamp::version << std::endl;
@@ -27,55 +93,27 @@ void PrintVersion() {
 
 int main(int argc, char * argv[]) {
     CheckVersion(argc, argv, PrintVersion);
-    using namespace ui;
     using namespace tpp;
-//    try {
-        ui::EventQueue eq{};
-        AnsiRenderer renderer{new LocalPTYSlave(), eq};
-        Panel * p = new Panel();
-        p->setBackground(Color::Blue);
-        Label * p2 = new Label();
-        p2->setText("Hello world! P2");
-        p2->setBackground(Color::Red);
-        Label * p3 = new Label();
-        p3->setText("Hello world! P3");
-        p3->setBackground(Color::Green);
-        //p2->resize(Size{10, 10});
-        //p2->move(Point{2,2});
-        p->attach(p2);
-        p->attach(p3);
-        renderer.setRoot(p);
-        p->setLayout(new Layout::Row{HorizontalAlign::Center, VerticalAlign::Middle});
-        p2->setWidthHint(SizeHint::AutoSize());
-        p2->setHeightHint(SizeHint::AutoSize());
-        p2->setText("Hello all folks and other people\nwho have come here!");
-        p3->setHeightHint(SizeHint::AutoSize());
-        p3->setHAlign(HorizontalAlign::Center);
-        p3->setText("Lorem ipsum and some stuff and some here and here and also here and one two three four five six seven eight nine ten eleven twelve thirteen fourteen fifteen sixteen seventeen twenty\n1 2 3 4 5 6 7 8 9 0");
-        p3->setWordWrap(true);
-        /*
-        p2->setWidthHint(SizeHint::Percentage(50));
-        p2->setHeightHint(SizeHint::Percentage(50)); */
-
-        renderer.onKeyDown.setHandler([&](Renderer::KeyEvent::Payload & e) {
-            p3->setText(STR(*e));
-        });
-        renderer.onMouseMove.setHandler([&](Renderer::MouseMoveEvent::Payload &e) {
-            p2->setText(STR("move: " << e->coords.x() << "; " << e->coords.y()));
-        });
-
-        renderer.mainLoop();
-
+    try {
+        Log::StdOutWriter().setDisplayLocation(false).setDisplayName(false).setDisplayTime(false).setEoL("\033[0K\r\n");
+        Log::Enable(Log::StdOutWriter(), { Log::Default()});
+        Config & config = Config::Setup(argc, argv);
+        if (config.verbose())
+            Log::Enable(Log::StdOutWriter(), { Log::Verbose()});
+        Command cmd = config.sessionCommand();
+        Multiplexer m{new LocalPTYSlave{}, config.backgroundRate()};
+        for (unsigned i = 0; i < config.sessions(); ++i)
+            m.open(cmd, STR(cmd.command() << " [" << (i + 1) << "]"), config.timeout());
+        m.run();
         return EXIT_SUCCESS;
-/*    } catch (NackError const & e) {
+    } catch (NackError const & e) {
         std::cerr << "t++ terminal error: " << e.what() << "\033[0K\r\n";
     } catch (TimeoutError const & e) {
-        std::cerr << "t++ terminal timeout.\033[0K\r\n"; 
+        std::cerr << "t++ terminal timeout, multiplexed sessions not supported.\033[0K\r\n";
     } catch (std::exception const & e) {
         std::cout << "\r\n Error: " << e.what() << "\033[0K\r\n";
     } catch (...) {
         std::cout << "\r\n Unspecified errror.\033[0K\r\n";
     }
-    */
     return EXIT_FAILURE;
 }
@@ -0,0 +1,271 @@
+#include <chrono>
+
+#include "multiplexer.h"
+
+namespace tpp {
+
+    Multiplexer::Multiplexer(PTYSlave * pty, size_t backgroundRate):
+        TerminalClient::Async{pty},
+        backgroundRate_{backgroundRate} {
+    }
+
+    /** The sessions are destroyed here, while the termination handlers of their pseudoterminals can still see that the multiplexer is terminating.
+     */
+    Multiplexer::~Multiplexer() {
+        std::unordered_map<size_t, std::shared_ptr<Session>> sessions;
+        {
+            std::lock_guard<std::mutex> g{m_};
+            terminating_ = true;
+            for (auto & i : sessions_)
+                i.second->pty->terminate();
+            std::swap(sessions, sessions_);
+        }
+#if (! defined ARCH_LINUX)
+        forwarded_.notify_all();
+#endif
+        for (auto & i : sessions)
+            stopReading(i.second.get());
+        sessions.clear();
+    }
+
+    void Multiplexer::open(Command const & command, std::string const & name, size_t timeout) {
+        std::shared_ptr<Session> s{new Session{nextId_++, command}};
+        std::pair<int, int> cols_rows = size();
+        s->pty->resize(cols_rows.first, cols_rows.second);
+        {
+            std::lock_guard<std::mutex> g{m_};
+            sessions_.insert(std::make_pair(s->id, s));
+            if (focused_ == 0)
+                focused_ = s->id;
+        }
+        try {
+            requestNewSession(s->id, name, cols_rows.first, cols_rows.second, timeout, 1).get();
+        } catch (...) {
+            s->pty->terminate();
+            std::lock_guard<std::mutex> g{m_};
+            sessions_.erase(s->id);
+            if (focused_ == s->id)
+                focused_ = 0;
+            throw;
+        }
+        Session * session = s.get();
+        s->pty->whenTerminated([this, session](){
+            std::lock_guard<std::mutex> g{m_};
+            if (! terminating_)
+                finished(session);
+        });
+#if (defined ARCH_LINUX)
+        s->readerWatch = PTYReactor::Instance().add(s->pty->pollHandle(), [this, session](){
+            return readAvailable(session);
+        });
+#else
+        s->reader = std::thread{[this, session](){
+            read(session);
+        }};
+#endif
+    }
+
+    void Multiplexer::run() {
+        std::unique_lock<std::mutex> g{m_};
+        auto nextInterval = std::chrono::steady_clock::now();
+        std::vector<std::shared_ptr<Session>> sessions;
+        while (! sessions_.empty()) {
+            auto now = std::chrono::steady_clock::now();
+            if (now >= nextInterval) {
+                for (auto & i : sessions_)
+                    i.second->budget = backgroundRate_ * BACKGROUND_INTERVAL / 1000;
+                nextInterval = now + std::chrono::milliseconds{BACKGROUND_INTERVAL};
+            }
+            // the sessions are copied as forwarding releases the lock
+            sessions.clear();
+            for (auto & i : sessions_)
+                sessions.push_back(i.second);
+            bool sent = false;
+            bool throttled = false;
+            for (auto & s : sessions) {
+                if (s->id == focused_) {
+                    sent = forward(s.get(), MAX_PACKET_SIZE, g) || sent;
+                } else {
+                    sent = forward(s.get(), s->budget, g) || sent;
+                    throttled = throttled || (! s->pending.empty() && s->budget == 0);
+                }
+                // terminated sessions are closed once all their output has been forwarded
+                if (s->terminated && s->pending.empty() && sessions_.find(s->id) != sessions_.end()) {
+                    sessions_.erase(s->id);
+                    if (focused_ == s->id)
+                        focused_ = 0;
+                    g.unlock();
+                    stopReading(s.get());
+                    send(Sequence::SessionClosed{s->id, s->pty->exitCode()});
+                    g.lock();
+                    sent = true;
+                }
+            }
+            if (sent)
+                continue;
+            if (throttled)
+                changed_.wait_until(g, nextInterval);
+            else
+                changed_.wait(g);
+        }
+    }
+
+    size_t Multiplexer::received(char const * buffer, char const * bufferEnd) {
+        std::shared_ptr<Session> s;
+        {
+            std::lock_guard<std::mutex> g{m_};
+            auto i = sessions_.find(focused_);
+            if (i != sessions_.end())
+                s = i->second;
+        }
+        if (s != nullptr)
+            sendInput(s.get(), buffer, bufferEnd - buffer);
+        return bufferEnd - buffer;
+    }
+
+    void Multiplexer::receivedSequence(Sequence::Kind kind, char const * payload, char const * payloadEnd) {
+        switch (kind) {
+            case Sequence::Kind::SessionData: {
+                Sequence::SessionData data{payload, payloadEnd};
+                std::shared_ptr<Session> s = session(data.id());
+                if (s != nullptr)
+                    sendInput(s.get(), data.payload().c_str(), data.payload().size());
+                break;
+            }
+            case Sequence::Kind::SessionCredit: {
+                Sequence::SessionCredit credit{payload, payloadEnd};
+                std::lock_guard<std::mutex> g{m_};
+                auto i = sessions_.find(credit.id());
+                if (i != sessions_.end()) {
+                    i->second->credit += credit.bytes();
+                    changed_.notify_one();
+                }
+                break;
+            }
+            case Sequence::Kind::FocusSession: {
+                Sequence::FocusSession focus{payload, payloadEnd};
+                std::lock_guard<std::mutex> g{m_};
+                focused_ = focus.id();
+                changed_.notify_one();
+                break;
+            }
+            case Sequence::Kind::ResizeSession: {
+                Sequence::ResizeSession resize{payload, payloadEnd};
+                std::shared_ptr<Session> s = session(resize.id());
+                if (s != nullptr)
+                    s->pty->resize(resize.cols(), resize.rows());
+                break;
+            }
+            case Sequence::Kind::SessionClosed: {
+                Sequence::SessionClosed closed{payload, payloadEnd};
+                std::shared_ptr<Session> s = session(closed.id());
+                if (s != nullptr)
+                    s->pty->terminate();
+                break;
+            }
+            default:
+                Async::receivedSequence(kind, payload, payloadEnd);
+                break;
+        }
+    }
+
+#if (defined ARCH_LINUX)
+
+    bool Multiplexer::readAvailable(Session * session) {
+        char buffer[MAX_PACKET_SIZE];
+        for (size_t i = 0; i < MAX_READS_PER_DISPATCH; ++i) {
+            bool closed = false;
+            size_t n = session->pty->tryReceive(buffer, sizeof(buffer), closed);
+            std::lock_guard<std::mutex> g{m_};
+            if (terminating_)
+                return false;
+            if (n == 0) {
+                if (! closed)
+                    return true;
+                finished(session);
+                return false;
+            }
+            session->pending.append(buffer, n);
+            changed_.notify_one();
+            // the reading is resumed by the event loop once enough output has been forwarded
+            if (session->pending.size() >= MAX_PENDING) {
+                session->paused = true;
+                return false;
+            }
+        }
+        return true;
+    }
+
+#else
+
+    void Multiplexer::read(Session * session) {
+        char buffer[MAX_PACKET_SIZE];
+        while (true) {
+            size_t n = session->pty->receive(buffer, sizeof(buffer));
+            std::unique_lock<std::mutex> g{m_};
+            if (n == 0) {
+                if (! terminating_)
+                    finished(session);
+                break;
+            }
+            while (session->pending.size() >= MAX_PENDING && ! terminating_)
+                forwarded_.wait(g);
+            session->pending.append(buffer, n);
+            changed_.notify_one();
+        }
+    }
+
+#endif
+
+    void Multiplexer::finished(Session * session) {
+        if (--session->finishing == 0) {
+            session->terminated = true;
+            changed_.notify_one();
+        }
+    }
+
+    void Multiplexer::stopReading(Session * session) {
+#if (defined ARCH_LINUX)
+        if (session->readerWatch != 0)
+            PTYReactor::Instance().remove(session->readerWatch);
+        session->readerWatch = 0;
+#else
+        if (session->reader.joinable())
+            session->reader.join();
+#endif
+    }
+
+    bool Multiplexer::forward(Session * session, size_t limit, std::unique_lock<std::mutex> & g) {
+        size_t size = std::min(std::min(session->pending.size(), session->credit), std::min(limit, MAX_PACKET_SIZE));
+        if (size == 0)
+            return false;
+        Sequence::SessionData data{session->id, session->pending.c_str(), session->pending.c_str() + size};
+        session->pending.erase(0, size);
+        session->credit -= size;
+        if (session->id != focused_)
+            session->budget -= size;
+#if (defined ARCH_LINUX)
+        if (session->paused && session->pending.size() < MAX_PENDING) {
+            session->paused = false;
+            PTYReactor::Instance().rearm(session->readerWatch);
+        }
+#else
+        forwarded_.notify_all();
+#endif
+        // send without holding the lock so that the terminal input can be processed meanwhile
+        g.unlock();
+        send(data);
+        g.lock();
+        return true;
+    }
+
+    void Multiplexer::sendInput(Session * session, char const * buffer, size_t numBytes) {
+        try {
+            session->pty->send(buffer, numBytes);
+        } catch (std::exception const & e) {
+            // the session may have terminated already
+            LOG(Log::Verbose) << "Unable to send input to session " << session->id << ": " << e.what();
+        }
+    }
+
+} // namespace tpp
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <memory>
+#include <unordered_map>
+#include <condition_variable>
+
+#include "helpers/helpers.h"
+#include "helpers/process.h"
+
+#include "tpp-lib/local_pty.h"
+#include "tpp-lib/pty_reactor.h"
+#include "tpp-lib/terminal_client.h"
+
+namespace tpp {
+
+    /** Hosts multiple local sessions over a single terminal connection.
+
+        Each session is a local pseudoterminal whose output is read by the shared PTY reactor into a bounded pending buffer (platforms without the reactor use a reader thread per session instead). When the buffer is full, the session's pseudoterminal is not read until the output has been forwarded, which in turn blocks the session's process. A single event loop forwards the pending output to the terminal as t++ sequences tagged with the session id. A session is closed once its output has been closed and its process has terminated.
+
+        The focused session, i.e. the one the terminal displays, is forwarded as soon as its output is available, limited only by the credit the terminal has given to the session. The output of the background sessions is forwarded at a limited rate so that the latency of the focused session stays low regardless of what the background sessions are doing.
+     */
+    class Multiplexer : public TerminalClient::Async {
+    public:
+
+        /** Maximum size of a single session data sequence payload.
+         */
+        static constexpr size_t MAX_PACKET_SIZE = 4096;
+
+        /** Maximum amount of session output waiting to be forwarded before the session is blocked.
+         */
+        static constexpr size_t MAX_PENDING = 64 * 1024;
+
+        /** Interval in which the background sessions are allowed to forward more output (in ms).
+         */
+        static constexpr size_t BACKGROUND_INTERVAL = 100;
+
+        /** Creates the multiplexer where the background sessions are limited to given number of bytes per second.
+         */
+        Multiplexer(PTYSlave * pty, size_t backgroundRate);
+
+        ~Multiplexer() override;
+
+        /** Starts new session running the given command.
+
+            Throws NackError if the terminal denies the session and TimeoutError if the terminal does not support multiplexed sessions.
+         */
+        void open(Command const & command, std::string const & name, size_t timeout);
+
+        /** Forwards the sessions' output until all sessions are terminated.
+         */
+        void run();
+
+    protected:
+
+        /** Plain input is sent to the focused session.
+         */
+        size_t received(char const * buffer, char const * bufferEnd) override;
+
+        void receivedSequence(Sequence::Kind kind, char const * payload, char const * payloadEnd) override;
+
+    private:
+
+        class Session {
+        public:
+            size_t id;
+            std::unique_ptr<LocalPTYMaster> pty;
+#if (defined ARCH_LINUX)
+            /** Registration of the pseudoterminal with the reactor. */
+            size_t readerWatch = 0;
+            /** The pseudoterminal is not read until the pending output is forwarded. */
+            bool paused = false;
+#else
+            std::thread reader;
+#endif
+            /** Output not yet forwarded to the terminal. */
+            std::string pending;
+            /** Number of bytes the terminal allows to be sent. */
+            size_t credit = Sequence::SessionCredit::DEFAULT_WINDOW;
+            /** Number of bytes the session may send in the current interval if in background. */
+            size_t budget = 0;
+            /** Number of events (output closed, process terminated) to happen before the session is terminated. */
+            unsigned finishing = 2;
+            bool terminated = false;
+
+            Session(size_t id, Command const & command):
+                id{id},
+                pty{new LocalPTYMaster{command}} {
+            }
+        };
+
+#if (defined ARCH_LINUX)
+        /** Number of reads done by a reactor worker before the other pseudoterminals get their turn.
+         */
+        static constexpr size_t MAX_READS_PER_DISPATCH = 16;
+
+        /** Reads the output of the session available without blocking, called by the reactor.
+
+            Returns true if the pseudoterminal should be watched again, i.e. unless its output has been closed, or the pending output is full.
+         */
+        bool readAvailable(Session * session);
+#else
+        /** Reads the output of the session until it is closed.
+         */
+        void read(Session * session);
+#endif
+
+        /** Called when the output of the session is closed and when its process terminates, the session is terminated when both happened, so that all its output has been read and the exit code is known.
+
+            Expects the lock to be held.
+         */
+        void finished(Session * session);
+
+        /** Stops reading the session's output.
+         */
+        void stopReading(Session * session);
+
+        /** Forwards single packet of the session's pending output, at most of given size. Returns true if any data were sent.
+         */
+        bool forward(Session * session, size_t limit, std::unique_lock<std::mutex> & g);
+
+        /** Returns the session of given id, or nullptr if there is no such session.
+         */
+        std::shared_ptr<Session> session(size_t id) {
+            std::lock_guard<std::mutex> g{m_};
+            auto i = sessions_.find(id);
+            return i == sessions_.end() ? nullptr : i->second;
+        }
+
+        /** Sends the input to given session.
+         */
+        void sendInput(Session * session, char const * buffer, size_t numBytes);
+
+        size_t backgroundRate_;
+
+        std::mutex m_;
+        /** Signalled when there is output to be forwarded, or the credit or focus changed. */
+        std::condition_variable changed_;
+#if (! defined ARCH_LINUX)
+        /** Signalled when pending output has been forwarded. */
+        std::condition_variable forwarded_;
+#endif
+        std::unordered_map<size_t, std::shared_ptr<Session>> sessions_;
+        size_t nextId_ = 1;
+        size_t focused_ = 0;
+        bool terminating_ = false;
+
+    }; // tpp::Multiplexer
+
+} // namespace tpp
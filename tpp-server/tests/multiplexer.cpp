@@ -0,0 +1,190 @@
+#if (defined ARCH_LINUX)
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "helpers/tests.h"
+
+#include "../multiplexer.h"
+
+using namespace tpp;
+
+namespace {
+
+    /** Terminal connected to the multiplexer that acknowledges new sessions and collects the sequences it receives.
+     */
+    class FakeTerminal : public PTYSlave {
+    public:
+
+        std::pair<int, int> size() const override {
+            return std::make_pair(80, 25);
+        }
+
+        void send(char const * buffer, size_t numBytes) override {
+            std::lock_guard<std::mutex> g{m_};
+            sent_.append(buffer, numBytes);
+            cv_.notify_all();
+        }
+
+        /** The multiplexer deletes the terminal before joining its reader, so the terminal waits for the reader to see the end of input first.
+         */
+        ~FakeTerminal() override {
+            std::unique_lock<std::mutex> g{m_};
+            closed_ = true;
+            cv_.notify_all();
+            while (! eof_)
+                cv_.wait(g);
+        }
+
+        size_t receive(char * buffer, size_t bufferSize) override {
+            std::unique_lock<std::mutex> g{m_};
+            while (input_.empty() && ! closed_)
+                cv_.wait(g);
+            if (input_.empty()) {
+                eof_ = true;
+                cv_.notify_all();
+                return 0;
+            }
+            size_t result = std::min(bufferSize, input_.size());
+            memcpy(buffer, input_.c_str(), result);
+            input_.erase(0, result);
+            return result;
+        }
+
+        void respond(Sequence const & seq) {
+            input(STR("\033P+" << seq << "\007"));
+        }
+
+        void input(std::string const & data) {
+            std::lock_guard<std::mutex> g{m_};
+            input_ += data;
+            cv_.notify_all();
+        }
+
+        /** Waits until the multiplexer sends given sequence and returns its payload.
+         */
+        std::string waitFor(Sequence::Kind kind) {
+            std::unique_lock<std::mutex> g{m_};
+            while (true) {
+                size_t start = 0;
+                while ((start = sent_.find("\033P+", start)) != std::string::npos) {
+                    size_t end = sent_.find('\007', start);
+                    char const * x = sent_.c_str() + start + 3;
+                    if (Sequence::ParseKind(x, sent_.c_str() + end) == kind)
+                        return std::string{x, sent_.c_str() + end};
+                    start = end;
+                }
+                cv_.wait(g);
+            }
+        }
+
+        /** Returns the output of given session sent so far.
+         */
+        std::string output(size_t id) {
+            std::lock_guard<std::mutex> g{m_};
+            std::string result;
+            size_t start = 0;
+            while ((start = sent_.find("\033P+", start)) != std::string::npos) {
+                size_t end = sent_.find('\007', start);
+                char const * x = sent_.c_str() + start + 3;
+                if (Sequence::ParseKind(x, sent_.c_str() + end) == Sequence::Kind::SessionData) {
+                    Sequence::SessionData data{x, sent_.c_str() + end};
+                    if (data.id() == id)
+                        result += data.payload();
+                }
+                start = end;
+            }
+            return result;
+        }
+
+    private:
+        std::mutex m_;
+        std::condition_variable cv_;
+        std::string input_;
+        std::string sent_;
+        bool closed_ = false;
+        bool eof_ = false;
+    };
+
+    /** A multiplexer connected to the fake terminal.
+     */
+    class Connection {
+    public:
+        Connection():
+            terminal{new FakeTerminal{}},
+            multiplexer{new Multiplexer{terminal, 1000000}} {
+        }
+
+        ~Connection() {
+            if (runner.joinable())
+                runner.join();
+            multiplexer.reset();
+        }
+
+        /** Opens the session running given command, acknowledged by the terminal.
+         */
+        void open(Command const & command) {
+            std::thread opener{[&]() {
+                multiplexer->open(command, "test", 1000);
+            }};
+            std::string req = terminal->waitFor(Sequence::Kind::NewSession);
+            char const * x = req.c_str();
+            terminal->respond(Sequence::Ack{Sequence::NewSession{x, x + req.size()}, 0});
+            opener.join();
+        }
+
+        void run() {
+            runner = std::thread{[this]() {
+                multiplexer->run();
+            }};
+        }
+
+        FakeTerminal * terminal;
+        std::unique_ptr<Multiplexer> multiplexer;
+        std::thread runner;
+    };
+
+}
+
+TEST(tpp_server_multiplexer, outputForwardedAndSessionClosed) {
+    Connection c;
+    c.open(Command{"sh", { "-c", "printf 'hello world'; exit 3" }});
+    c.run();
+    std::string closedPayload = c.terminal->waitFor(Sequence::Kind::SessionClosed);
+    char const * x = closedPayload.c_str();
+    Sequence::SessionClosed closed{x, x + closedPayload.size()};
+    EXPECT_EQ(closed.id(), 1u);
+    EXPECT_EQ(closed.exitCode(), 3);
+    // all output is forwarded before the session is closed
+    EXPECT_EQ(c.terminal->output(1), "hello world");
+}
+
+TEST(tpp_server_multiplexer, inputSentToFocusedSession) {
+    Connection c;
+    c.open(Command{"sh", { "-c", "stty -echo; echo ready; read line; echo \"got $line\"" }});
+    c.run();
+    while (c.terminal->output(1).find("ready") == std::string::npos)
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    c.terminal->input("foo\n");
+    c.terminal->waitFor(Sequence::Kind::SessionClosed);
+    EXPECT_EQ(c.terminal->output(1), "ready\r\ngot foo\r\n");
+}
+
+TEST(tpp_server_multiplexer, outputLimitedByCredit) {
+    Connection c;
+    c.open(Command{"sh", { "-c", "stty raw; head -c 300000 /dev/zero" }});
+    c.run();
+    size_t window = Sequence::SessionCredit::DEFAULT_WINDOW;
+    while (c.terminal->output(1).size() < window)
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    // no more output is sent until the terminal gives the session more credit
+    std::this_thread::sleep_for(std::chrono::milliseconds{50});
+    EXPECT_EQ(c.terminal->output(1).size(), window);
+    c.terminal->respond(Sequence::SessionCredit{1, window});
+    c.terminal->waitFor(Sequence::Kind::SessionClosed);
+    EXPECT_EQ(c.terminal->output(1).size(), 300000u);
+}
+
+#endif
@@ -1,6 +1,7 @@
 #include <functional>
 
 #include "helpers/memory.h"
+#include "helpers/trace.h"
 
 #include "ansi_terminal.h"
 
@@ -28,6 +29,15 @@ namespace ui {
                 printableKeys.insert(Key::FromCode(k));
             }
         }
+
+        /** Binary trace events of the processed input. Unlike the SEQ log, these are cheap enough to be recorded in release builds.
+         */
+        Trace::Event TRACE_CODEPOINT{"codepoint", {"codepoint"}};
+        Trace::Event TRACE_CONTROL{"control", {"char"}};
+        Trace::Event TRACE_ESC{"ESC", {"char", "size"}};
+        Trace::Event TRACE_CSI{"CSI", {"first", "final", "numArgs", "arg0", "arg1", "arg2"}};
+        Trace::Event TRACE_OSC{"OSC", {"num", "numArgs"}};
+        Trace::Event TRACE_TPP{"tpp", {"kind", "size"}};
     }
 
     std::unordered_map<Key, std::string> AnsiTerminal::KeyMap_;
@@ -54,6 +64,9 @@ namespace ui {
         state_->reset(palette_.defaultForeground(), palette_.defaultBackground());
         stateBackup_->reset(palette_.defaultForeground(), palette_.defaultBackground());
         setFocusable(true);
+        pty_->setSendProgressHandler([this](size_t) {
+            sendProgress();
+        });
         
         startPTYReader();
 
@@ -67,54 +80,128 @@ namespace ui {
 
     // Widget
 
+    /** The terminal buffer is painted from the last published snapshot so that the UI thread does not have to wait for the input thread to finish its batch. The buffer lock is only taken when history rows are visible as these are not part of the snapshot. 
+
+        Only the snapshot rows that changed since the last paint are copied to the renderer's buffer. The selection, scrollbar and cursor are painted as overlays, which are restored from the snapshot on the next paint. 
+     */
     void AnsiTerminal::paint(Canvas & canvas) {
         Canvas ccanvas{contentsCanvas(canvas)};
 #ifdef SHOW_LINE_ENDINGS
         Border endOfLine{Border::All(Color::Red, Border::Kind::Thin)};
 #endif
         Rect visibleRect{ccanvas.visibleRect()};
-        std::lock_guard<PriorityLock> g(bufferLock_.priorityLock(), std::adopt_lock);
-        int top = terminalBufferTop();
+        metrics_.repaints.add();
+        // if the input thread is not processing, make sure that any changes done by the UI thread are in the snapshot 
+        if (bufferLock_.tryLock()) {
+            publishSnapshot(true);
+            bufferLock_.unlock();
+        }
+        Snapshot const * snapshot = & acquireSnapshot();
+        // if history rows are visible, lock the buffer and publish a snapshot consistent with the history
+        std::unique_lock<PriorityLock> g;
+        uint64_t locked = 0;
+        if (visibleRect.top() < snapshot->top) {
+            uint64_t start = Metrics::Now();
+            g = std::unique_lock<PriorityLock>{bufferLock_.priorityLock(), std::adopt_lock};
+            locked = Metrics::Now();
+            metrics_.paintLockWait.record(locked - start);
+            publishSnapshot(true);
+            snapshot = & acquireSnapshot();
+        }
+        Canvas::Buffer const & buffer = snapshot->buffer;
+        // when new history rows were added after the snapshot has been published and the terminal scrolled with them, the snapshot is drawn at the top of the visible area
+        int top = std::max(snapshot->top, g.owns_lock() ? 0 : visibleRect.top());
         ccanvas.setBg(palette_.defaultBackground());
+        // restore the cells covered by overlays in the previous paint
+        for (Rect const & overlay : overlays_)
+            ccanvas.drawFallbackBuffer(buffer, Point{0, top}, overlay + scrollOffset());
+        overlays_.clear();
         // see if there are any history lines that need to be drawn
-        for (int row = std::max(0, visibleRect.top()), re = std::min(top, visibleRect.bottom()); row < re ; ++row) {
-            for (int col = 0, ce = historyRows_[row].first; col < ce; ++col) {
-                ccanvas.at(Point{col, row}).stripSpecialObjectAndAssign(historyRows_[row].second[col]);
+        if (g.owns_lock()) {
+            for (int row = std::max(0, visibleRect.top()), re = std::min(top, visibleRect.bottom()); row < re ; ++row) {
+                HistoryRow stored = historyRow(row);
+                for (int col = 0; col < stored.cols; ++col) {
+                    ccanvas.at(Point{col, row}).stripSpecialObjectAndAssign(stored.attributes->cell(stored.cells[col]));
 #ifdef SHOW_LINE_ENDINGS
-                if (Buffer::IsLineEnd(historyRows_[row].second[col]))
-                    ccanvas.setBorder(Point{col, row}, endOfLine);
+                    if (Buffer::IsLineEnd(stored.cells[col]))
+                        ccanvas.setBorder(Point{col, row}, endOfLine);
 #endif
+                }
+                ccanvas.fill(Rect{Point{stored.cols, row}, Point{width(), row + 1}},
+                Cell{}.setBg(ccanvas.bg()));
             }
-            ccanvas.fill(Rect{Point{historyRows_[row].first, row}, Point{width(), row + 1}},
-            Cell{}.setBg(ccanvas.bg()));
         }
         // TODO once we support sixels or other shared objects that might survive to the drawing stage, this function will likely change. 
-        ccanvas.drawFallbackBuffer(state_->buffer, Point{0, top});
+        ccanvas.drawFallbackBuffer(buffer, Point{0, top});
+        // everything below is an overlay
+        ccanvas.beginOverlay();
 #ifdef  SHOW_LINE_ENDINGS
         // now add borders to the cells that are marked as end of line
-        for (int row = std::max(top, visibleRect.top()), rs = row, re = visibleRect.bottom(); ; ++row) {
-            if (row >= re)
-                break;
-            for (int col = 0; col < width(); ++col) {
-                if (Buffer::IsLineEnd(const_cast<Buffer const &>(state_->buffer).at(Point{col, row - rs})))
+        for (int row = std::max(top, visibleRect.top()), re = std::min(visibleRect.bottom(), top + buffer.height()); row < re; ++row) {
+            for (int col = 0; col < buffer.width(); ++col) {
+                if (Buffer::IsLineEnd(buffer.at(Point{col, row - top})))
                     ccanvas.setBorder(Point{col, row}, endOfLine);
             }
         }
+        overlays_.push_back(canvas.rect());
 #endif
         // draw the selection, if any 
         SelectionOwner::paint(ccanvas);
+        Selection sel = selection();
+        if (! sel.empty())
+            overlays_.push_back(Rect{Point{0, sel.start().y()}, Point{width(), sel.end().y()}} - scrollOffset());
         // display scrollbars
         canvas.verticalScrollbar(top + height(), scrollOffset().y());
+        overlays_.push_back(Rect{Point{canvas.width() - 1, 0}, Size{1, canvas.height()}});
         // draw the cursor 
+        Point cursorPosition = buffer.cursorPosition() + Point{0, top};
         if (focused()) {
             // set the cursor via the canvas
-            ccanvas.setCursor(cursor(), cursorPosition() + Point{0, top});
-        } else if (cursor().visible()) {
+            ccanvas.setCursor(buffer.cursor(), cursorPosition);
+        } else if (buffer.cursor().visible()) {
             // TODO the color of this should be configurable
-            ccanvas.setBorder(cursorPosition() + Point{0, top}, Border::All(inactiveCursorColor_, Border::Kind::Thin));
+            ccanvas.setBorder(cursorPosition, Border::All(inactiveCursorColor_, Border::Kind::Thin));
+        }
+        overlays_.push_back(Rect{cursorPosition - scrollOffset(), Size{1, 1}});
+        ccanvas.endOverlay();
+        if (g.owns_lock())
+            metrics_.paintLockHold.recordSince(locked);
+    }
+
+    void AnsiTerminal::setVisible(bool value) {
+        Widget::setVisible(value);
+        if (hidden_ != value)
+            return;
+        hidden_ = ! value;
+        metrics_.hidden.set(value ? 0 : 1);
+        if (value) {
+            // the input processed while hidden has not been published
+            {
+                std::lock_guard<PriorityLock> g{bufferLock_.priorityLock(), std::adopt_lock};
+                publishSnapshot(true);
+            }
+            repaint();
         }
     }
 
+    void AnsiTerminal::publishSnapshot(bool force) {
+        ASSERT(bufferLock_.locked());
+        if (! force && (readySnapshot_.load(std::memory_order_relaxed) & FRESH_SNAPSHOT))
+            return;
+        if (detectHyperlinks_)
+            detectHyperlinks();
+        Snapshot & snapshot = snapshots_[backSnapshot_];
+        snapshot.buffer.copyFrom(state_->buffer);
+        snapshot.top = terminalBufferTop();
+        backSnapshot_ = readySnapshot_.exchange(backSnapshot_ | FRESH_SNAPSHOT, std::memory_order_acq_rel) & ~ FRESH_SNAPSHOT;
+    }
+
+    AnsiTerminal::Snapshot const & AnsiTerminal::acquireSnapshot() {
+        if (readySnapshot_.load(std::memory_order_relaxed) & FRESH_SNAPSHOT)
+            frontSnapshot_ = readySnapshot_.exchange(frontSnapshot_, std::memory_order_acq_rel) & ~ FRESH_SNAPSHOT;
+        return snapshots_[frontSnapshot_];
+    }
+
     // User Input
     
     void AnsiTerminal::pasteContents(std::string const & contents) {
@@ -127,6 +214,17 @@ namespace ui {
         }        
     }
 
+    void AnsiTerminal::sendProgress() {
+        if (sendProgressScheduled_.exchange(true))
+            return;
+        schedule([this](){
+            // clear the flag first so that a later report is never lost
+            sendProgressScheduled_ = false;
+            SendProgressEvent::Payload p{pty_->pendingBytes()};
+            onSendProgress(p, this);
+        });
+    }
+
     void AnsiTerminal::keyDown(KeyEvent::Payload & e) {
         onKeyDown(e, this);
         if (e.active()) {
@@ -258,7 +356,7 @@ namespace ui {
     void AnsiTerminal::mouseWheel(MouseWheelEvent::Payload & e) {
         onMouseWheel(e, this);
         if (e.active()) {
-            if (! alternateMode_ && historyRows_.size() > 0) {
+            if (! alternateMode_ && historyRows() > 0) {
                 if (e->by > 0)
                     scrollBy(Point{0, -1});
                 else 
@@ -342,16 +440,21 @@ namespace ui {
         int endRow = sel.end().y();
         int col = sel.start().x();
         std::lock_guard<PriorityLock> g(bufferLock_);
-        int terminalTop =  alternateMode_ ? 0 : static_cast<int>(historyRows_.size());
+        int terminalTop = terminalBufferTop();
+        std::vector<Cell> historyCells;
         while (row < endRow) {
             int endCol = (row < endRow - 1) ? width() : sel.end().x();
-            Cell * rowCells;
+            Cell const * rowCells;
             // if the current row comes from the history, get the appropriate cells
             if (row < terminalTop) {
-                rowCells = historyRows_[row].second;
+                HistoryRow stored = historyRow(row);
+                historyCells.clear();
+                for (int i = 0; i < stored.cols; ++i)
+                    historyCells.push_back(stored.attributes->cell(stored.cells[i]));
+                rowCells = historyCells.data();
                 // if the stored row is shorter than the start of the selection, adjust the endCol so that no processing will be involved
-                if (endCol > historyRows_[row].first)
-                    endCol = historyRows_[row].first;
+                if (endCol > stored.cols)
+                    endCol = stored.cols;
             } else {
                 rowCells = state_->buffer.row(row - terminalTop);
             }
@@ -391,22 +494,20 @@ namespace ui {
         Point end = pos;
         {
             std::lock_guard<PriorityLock> g(bufferLock_);
-            Cell const * c = cellAt(pos);
+            Cell c;
             // if there is nothing at the coordinates, or we are not inside a word, do nothing
-            if (c == nullptr || IsWordSeparator(c->codepoint()))
+            if (! cellAt(pos, c) || IsWordSeparator(c.codepoint()))
                 return;
             // find beginning and end of the word
             while (true) {
                 Point prev = prevCell(start);
-                c = cellAt(prev);
-                if (c == nullptr || IsWordSeparator(c->codepoint()))
+                if (! cellAt(prev, c) || IsWordSeparator(c.codepoint()))
                     break;
                 start = prev;
             }
             while(true) {
                 Point next = nextCell(end);
-                c = cellAt(next);
-                if (c == nullptr || IsWordSeparator(c->codepoint()))
+                if (! cellAt(next, c) || IsWordSeparator(c.codepoint()))
                     break;
                 end = next;
             }
@@ -421,10 +522,10 @@ namespace ui {
         {
             std::lock_guard<PriorityLock> g(bufferLock_);
             // see if the above line ends with a line end character
+            Cell c;
             while (start != Point{0,0}) {
                 start = prevCell(start);
-                Cell const * c = cellAt(start);
-                if (c != nullptr && Buffer::IsLineEnd(*c)) {
+                if (cellAt(start, c) && Buffer::IsLineEnd(c)) {
                     start = Point{0, start.y() + 1};
                     break;
                 }
@@ -432,8 +533,7 @@ namespace ui {
             // now find end of the line at cursor
             Point bottomRight = Point{state_->buffer.width() - 1, state_->buffer.height() - 1 + terminalBufferTop()};
             while (end != bottomRight) {
-                Cell const * c = cellAt(end);
-                if (c != nullptr && Buffer::IsLineEnd(*c))
+                if (cellAt(end, c) && Buffer::IsLineEnd(c))
                     break;
                 end = nextCell(end);
             }
@@ -443,53 +543,79 @@ namespace ui {
     }
 
 
-    void AnsiTerminal::detectHyperlink(char32_t next) {
+    void AnsiTerminal::detectHyperlinks() {
         ASSERT(bufferLock_.locked());
-        // don't do any mathing if we are inside hyperlink command
-        if (inProgressHyperlink_ != nullptr)
-            return;
-        size_t matchSize = urlMatcher_.next(next);
-        if (matchSize == 0)
-            return;
-        // we have found a hyperlink, construct its address and determine which cells to use, which we do by retracting
-        Hyperlink::Ptr link{new Hyperlink{"", normalHyperlinkStyle_, activeHyperlinkStyle_}};
-        std::string url{};
-        Point pos = cursorPosition();
-        do {
-            // the url is too long and disappeared, do not match
-            if (pos == Point{0,0}) {
-                link->detachFromAllCells();
-                return;
+        Buffer & buffer = state_->buffer;
+        std::unordered_set<uint64_t> detected;
+        for (int row = 0, height = buffer.height(); row < height; ) {
+            // find the rows of the line and whether any of them changed
+            int end = row;
+            bool changed = false;
+            do {
+                changed = changed || hyperlinkRows_.find(buffer.rowTag(end)) == hyperlinkRows_.end();
+            } while (! buffer.hasLineEnd(end++) && end < height);
+            if (changed)
+                detectHyperlinks(row, end);
+            // attaching the hyperlinks changes the row tags
+            for (; row < end; ++row)
+                detected.insert(buffer.rowTag(row));
+        }
+        hyperlinkRows_.swap(detected);
+    }
+
+    void AnsiTerminal::detectHyperlinks(int top, int bottom) {
+        Buffer const & buffer = state_->buffer;
+        UrlMatcher matcher;
+        for (int row = top; row < bottom; ++row) {
+            for (int col = 0, width = buffer.width(); col < width; ++col) {
+                size_t size = matcher.next(buffer.at(col, row).codepoint());
+                if (size != 0)
+                    attachHyperlink(Point{col, row}, size);
             }
-            if (pos.x() == 0)
-                pos = Point{state_->buffer.width() - 1, pos.y() - 1};
-            else 
-                pos -= Point{1, 0};
-            Cell & cell = state_->buffer.at(pos);
-            url = Char{cell.codepoint()} + url;
-            cell.attachSpecialObject(link);
-        } while (--matchSize != 0);
-        // set the url we calculated
-        link->setUrl(url);
+        }
+        size_t size = matcher.reset();
+        if (size != 0)
+            attachHyperlink(Point{0, bottom}, size);
+    }
+
+    void AnsiTerminal::attachHyperlink(Point end, size_t size) {
+        Buffer & buffer = state_->buffer;
+        int width = buffer.width();
+        // determine the first cell of the url
+        int offset = end.y() * width + end.x() - static_cast<int>(size);
+        ASSERT(offset >= 0);
+        Point start{offset % width, offset / width};
+        Canvas::SpecialObject * existing = const_cast<Buffer const &>(buffer).at(start).specialObject();
+        std::stringstream url;
+        bool attached = existing != nullptr;
+        for (Point p = start; p != end; p = (p.x() == width - 1) ? Point{0, p.y() + 1} : p + Point{1, 0}) {
+            Cell const & cell = const_cast<Buffer const &>(buffer).at(p);
+            url << Char{cell.codepoint()};
+            attached = attached && cell.specialObject() == existing;
+        }
+        if (attached)
+            return;
+        Hyperlink::Ptr link{new Hyperlink{url.str(), normalHyperlinkStyle_, activeHyperlinkStyle_}};
+        for (Point p = start; p != end; p = (p.x() == width - 1) ? Point{0, p.y() + 1} : p + Point{1, 0})
+            buffer.attachSpecialObject(p, link);
     }
 
     // Terminal State 
 
     void AnsiTerminal::deleteCharacters(unsigned num) {
-		int r = cursorPosition().y();
-		for (unsigned c = cursorPosition().x(), e = state_->buffer.width() - num; c < e; ++c) 
-			state_->buffer.at(c, r) = state_->buffer.at(c + num, r);
-		for (unsigned c = state_->buffer.width() - num, e = state_->buffer.width(); c < e; ++c)
-			state_->buffer.at(c, r) = state_->cell;
+        int r = cursorPosition().y();
+        int c = cursorPosition().x();
+        int n = std::min(static_cast<int>(num), state_->buffer.width() - c);
+        state_->buffer.moveInRow(r, c + n, c, state_->buffer.width() - c - n);
+        state_->buffer.fillRow(r, state_->cell, state_->buffer.width() - n, n);
     }
 
     void AnsiTerminal::insertCharacters(unsigned num) {
-		unsigned r = cursorPosition().y();
-		// first copy the characters
-		for (unsigned c = state_->buffer.width() - 1, e = cursorPosition().x() + num; c >= e; --c)
-			state_->buffer.at(c, r) = state_->buffer.at(c - num, r);
-		for (unsigned c = cursorPosition().x(), e = cursorPosition().x() + num; c < e; ++c)
-			state_->buffer.at(c, r) = state_->cell;
+        int r = cursorPosition().y();
+        int c = cursorPosition().x();
+        int n = std::min(static_cast<int>(num), state_->buffer.width() - c);
+        state_->buffer.moveInRow(r, c, c + n, state_->buffer.width() - c - n);
+        state_->buffer.fillRow(r, state_->cell, c, n);
     }
     
     void AnsiTerminal::updateCursorPosition() {
@@ -534,45 +660,108 @@ namespace ui {
         }
     }
 
-    /** If the terminal is scrolled into view, scrolls the terminal into view after the history line has been added as well. 
+    /** Once enough new attributes were added to the history, the attributes table is compacted so that attributes of the rows that are no longer in the history do not accumulate. 
      */
     void AnsiTerminal::addHistoryRow(Cell * row, int cols) {
+        CompactCell * compact = new CompactCell[cols];
+        for (int i = 0; i < cols; ++i)
+            compact[i] = historyAttributes_.compact(row[i]);
+        delete [] row;
+        appendHistoryRow(compact, cols);
+        if (historyAttributes_.shouldCompact()) {
+            historyAttributes_.compact(historyRows_.begin(), historyRows_.end());
+            trimHistory();
+        }
+    }
+
+    /** If the terminal is scrolled into view, scrolls the terminal into view after the history line has been added as well. 
+     */
+    void AnsiTerminal::appendHistoryRow(CompactCell * row, int cols) {
+        historyCells_ += cols;
         if (cols <= width()) {
             historyRows_.push_back(std::make_pair(cols, row));
+            ++historyRowsAdded_;
         // if the line is too long, simply chop it in pieces of maximal length
         } else {
-            Cell * i = row;
+            CompactCell * i = row;
             while (cols != 0) {
                 int xSize = std::min(width(), cols);
-                Cell * x = new Cell[xSize];
-                // copy the cells one by one as they are PODs
+                CompactCell * x = new CompactCell[xSize];
                 MemCopy(x, i, xSize);
                 i += xSize;
                 cols -= xSize;
                 historyRows_.push_back(std::make_pair(xSize, x));
+                ++historyRowsAdded_;
             }
             delete [] row;
         }
-        while (historyRows_.size() > static_cast<size_t>(maxHistoryRows_)) {
-            delete [] historyRows_.front().second;
-            historyRows_.pop_front();
+        trimHistory();
+        if (scrollToTerminal_)
+            schedule([this](){
+                setScrollOffset(Point{0, historyRows()});
+            });
+    }
+
+    void AnsiTerminal::setHistorySpill(std::string const & filename, int memoryRows) {
+        std::lock_guard<PriorityLock> g{bufferLock_};
+        if (filename.empty() || memoryRows <= 0) {
+            historySpill_.reset();
+        } else {
+            if (historySpill_ == nullptr || historySpill_->filename() != filename)
+                historySpill_.reset(new HistorySpill{filename, metrics_.historyPageLoads});
+            maxMemoryHistoryRows_ = memoryRows;
         }
+        trimHistory();
         if (scrollToTerminal_)
             schedule([this](){
-                setScrollOffset(Point{0, static_cast<int>(historyRows_.size())});
+                setScrollOffset(Point{0, historyRows()});
             });
     }
 
+    /** The oldest rows are in the spill, if any, so those are removed first when the history is over its maximum size. 
+     */
+    void AnsiTerminal::trimHistory() {
+        size_t maxRows = static_cast<size_t>(maxHistoryRows_);
+        size_t spilled = spilledHistoryRows();
+        if (spilled + historyRows_.size() > maxRows && spilled > 0) {
+            historySpill_->removeFirst(std::min(spilled + historyRows_.size() - maxRows, spilled));
+            spilled = historySpill_->rows();
+        }
+        while (spilled + historyRows_.size() > maxRows) {
+            historyCells_ -= historyRows_.front().first;
+            delete [] historyRows_.front().second;
+            historyRows_.pop_front();
+        }
+        if (historySpill_ != nullptr && historyRows_.size() > static_cast<size_t>(maxMemoryHistoryRows_)) {
+            auto end = historyRows_.begin() + static_cast<ptrdiff_t>(historyRows_.size() - static_cast<size_t>(maxMemoryHistoryRows_));
+            historySpill_->append(historyRows_.begin(), end, historyAttributes_);
+            for (auto i = historyRows_.begin(); i != end; ++i) {
+                historyCells_ -= i->first;
+                delete [] i->second;
+            }
+            historyRows_.erase(historyRows_.begin(), end);
+            spilled = historySpill_->rows();
+        }
+        historySize_ = static_cast<int>(spilled + historyRows_.size());
+        metrics_.historyRows.set(static_cast<int64_t>(spilled + historyRows_.size()));
+        metrics_.historyBytes.set(static_cast<int64_t>(historyCells_ * sizeof(CompactCell) + historyRows_.size() * sizeof(std::pair<int, CompactCell*>) + historyAttributes_.bytes()));
+        metrics_.historySpilledRows.set(static_cast<int64_t>(spilled));
+        metrics_.historySpillBytes.set(static_cast<int64_t>(historySpill_ == nullptr ? 0 : historySpill_->bytes()));
+    }
+
     void AnsiTerminal::resizeHistory() {
-        std::deque<std::pair<int, Cell*>> oldRows{std::move(historyRows_)};
-        Cell * row = nullptr;
+        ++historyVersion_;
+        std::deque<std::pair<int, CompactCell*>> oldRows{std::move(historyRows_)};
+        historyRows_.clear();
+        historyCells_ = 0;
+        CompactCell * row = nullptr;
         int rowSize = 0;
         for (auto & i : oldRows) {
             if (row == nullptr) {
                 row = i.second;
                 rowSize = i.first;
             } else {
-                Cell * newRow = new Cell[rowSize + i.first];
+                CompactCell * newRow = new CompactCell[rowSize + i.first];
                 MemCopy(newRow, row, rowSize);
                 MemCopy(newRow + rowSize, i.second, i.first);
                 rowSize += i.first;
@@ -582,16 +771,18 @@ namespace ui {
             }
             ASSERT(row != nullptr);
             if (Buffer::IsLineEnd(row[rowSize - 1])) {
-                addHistoryRow(row, rowSize);
+                appendHistoryRow(row, rowSize);
                 row = nullptr;
                 rowSize = 0;
             }
         }
         if (row != nullptr)
-            addHistoryRow(row, rowSize);
+            appendHistoryRow(row, rowSize);
+        trimHistory();
     }
 
     void AnsiTerminal::resizeBuffers(Size size) {
+        joinerPosition_ = Point{-1, -1};
         if (alternateMode_) {
             state_->resize(size, nullptr);
             stateBackup_->resize(size, std::bind(&AnsiTerminal::addHistoryRow, this, std::placeholders::_1, std::placeholders::_2));
@@ -601,22 +792,23 @@ namespace ui {
         }
     }
 
-    AnsiTerminal::Cell const * AnsiTerminal::cellAt(Point coords) {
+    bool AnsiTerminal::cellAt(Point coords, Cell & cell) {
         ASSERT(bufferLock_.locked());
         int bufferTop = terminalBufferTop();
         if (bufferTop <= coords.y()) {
             coords -= Point{0, bufferTop};
             if (! state_->buffer.contains(coords))
-                return nullptr;
-            return & const_cast<Buffer const &>(state_->buffer).at(coords);
+                return false;
+            cell = const_cast<Buffer const &>(state_->buffer).at(coords);
         } else {
             if (coords.y() < 0)
-                return nullptr;
-            auto const & row = historyRows_[coords.y()];
-            if (coords.x() >= row.first)
-                return nullptr;
-            return row.second + coords.x();
+                return false;
+            HistoryRow row = historyRow(coords.y());
+            if (coords.x() >= row.cols)
+                return false;
+            cell = row.attributes->cell(row.cells[coords.x()]);
         }
+        return true;
     }
 
     Point AnsiTerminal::prevCell(Point coords) const {
@@ -637,103 +829,143 @@ namespace ui {
 
     // Input Processing
 
+    /** The time spent waiting for the buffer lock and holding it are recorded in the terminal metrics together with the time it took to process the input and the CPU time of the whole batch.
+     */
     size_t AnsiTerminal::received(char * buffer, char const * bufferEnd) {
+        uint64_t cpuStart = Metrics::ThreadCpuTime();
+        size_t processed;
+        bool hidden;
         {
+            uint64_t start = Metrics::Now();
             std::lock_guard<PriorityLock> g(bufferLock_);
-            // then process the input
-            char const * x = buffer;
-            while (x != bufferEnd) {
-                switch (*x) {
-                    /* Parse the escape sequence */
-                    case Char::ESC: {
-                        size_t processed = parseEscapeSequence(x, bufferEnd);
-                        // if no characters were processed, the sequence was incomplete and we should end processing
-                        if (processed == 0)
+            uint64_t locked = Metrics::Now();
+            metrics_.inputLockWait.record(locked - start);
+            processed = processInput(buffer, bufferEnd);
+            metrics_.parseTime.recordSince(locked);
+            metrics_.bytes.add(processed);
+            // a hidden terminal publishes the buffer only when shown, which happens under the lock as well
+            hidden = hidden_;
+            if (! hidden)
+                publishSnapshot(false);
+            metrics_.inputLockHold.recordSince(locked);
+        }
+        // if the input ends with an incomplete sequence, the terminal is repainted once the rest of the sequence arrives
+        if (buffer + processed == bufferEnd && ! hidden)
+            scheduleRepaint();
+        metrics_.inputCpu.record(Metrics::ThreadCpuTime() - cpuStart);
+        return processed;
+    }
+
+    size_t AnsiTerminal::processInput(char const * buffer, char const * bufferEnd) {
+        ASSERT(bufferLock_.locked());
+        char const * x = buffer;
+        while (x != bufferEnd) {
+            // control characters and escape sequences, which may move the cursor, end the grapheme cluster of the last joiner
+            if (static_cast<unsigned char>(*x) < 0x20)
+                joinerPosition_ = Point{-1, -1};
+            switch (*x) {
+                /* Parse the escape sequence */
+                case Char::ESC: {
+                    size_t processed = parseEscapeSequence(x, bufferEnd);
+                    // if no characters were processed, the sequence was incomplete and we should end processing
+                    if (processed == 0)
+                        return x - buffer;
+                    // move past the sequence
+                    x += processed;
+                    break;
+                }
+                /* BEL triggers the notification */
+                case Char::BEL:
+                    metrics_.controls.add();
+                    parseNotification();
+                    ++x;
+                    break;
+                case Char::TAB:
+                    metrics_.controls.add();
+                    parseTab();
+                    ++x;
+                    break;
+                case Char::LF:
+                    metrics_.controls.add();
+                    parseLF();
+                    ++x;
+                    break;
+                case Char::CR:
+                    metrics_.controls.add();
+                    parseCR();
+                    ++x;
+                    break;
+                case Char::BACKSPACE:
+                    metrics_.controls.add();
+                    parseBackspace();
+                    ++x;
+                    break;
+                default: {
+                    // the text up to the next control character is decoded in blocks
+                    char32_t codepoints[DECODE_BLOCK_SIZE];
+                    size_t n = Char::DecodeUTF8(x, bufferEnd, codepoints, DECODE_BLOCK_SIZE);
+                    if (n == 0) {
+                        // if nothing was decoded, the input either ends with an incomplete UTF8 sequence and we must wait for the rest, or there is a control character without special meaning, which is displayed as a codepoint
+                        if (static_cast<unsigned char>(*x) >= 0x20)
                             return x - buffer;
-                        // move past the sequence
-                        x += processed;
-                        break;
-                    }
-                    /* BEL triggers the notification */
-                    case Char::BEL:
-                        parseNotification();
-                        ++x;
-                        break;
-                    case Char::TAB:
-                        parseTab();
-                        ++x;
-                        break;
-                    case Char::LF:
-                        parseLF();
-                        ++x;
-                        break;
-                    case Char::CR:
-                        parseCR();
-                        ++x;
-                        break;
-                    case Char::BACKSPACE:
-                        parseBackspace();
-                        ++x;
-                        break;
-                    default: {
-                        // while this is a code duplication from the Char class, since this code is a bottleneck for processing large ammounts of text, the code is copied for performance
-                        char32_t cp = 0;
-                        unsigned char const * ux = pointer_cast<unsigned char const *>(x);
-                        if (*ux < 0x80) {
-                            cp = *ux;
-                            ++x;
-                        } else if (*ux < 0xe0) {
-                            if (x + 2 > bufferEnd)
-                                return x - buffer;
-                            cp = ((ux[0] & 0x1f) << 6) + (ux[1] & 0x3f);
-                            x += 2;
-                        } else if (*ux < 0xf0) {
-                            if (x + 3 > bufferEnd)
-                                return x - buffer;
-                            cp = ((ux[0] & 0x0f) << 12) + ((ux[1] & 0x3f) << 6) + (ux[2] & 0x3f);
-                            x += 3;
-                        } else {
-                            if (x + 4 > bufferEnd)
-                                return x - buffer;
-                            cp = ((ux[0] & 0x07) << 18) + ((ux[1] & 0x3f) << 12) + ((ux[2] & 0x3f) << 6) + (ux[3] & 0x3f);
-                            x += 4;
-                        }
-                        parseCodepoint(cp);
-                        break;
+                        codepoints[n++] = static_cast<unsigned char>(*x++);
                     }
+                    metrics_.codepoints.add(n);
+                    for (size_t i = 0; i < n; ++i)
+                        parseCodepoint(codepoints[i]);
+                    break;
                 }
             }
         }
-        scheduleRepaint();
         return bufferEnd - buffer;
     }
 
-
     void AnsiTerminal::parseCodepoint(char32_t codepoint) {
         if (lineDrawingSet_ && codepoint >= 0x6a && codepoint < 0x79)
             codepoint = LineDrawingChars_[codepoint-0x6a];
         LOG(SEQ) << "codepoint " << Char{codepoint} << " " << static_cast<char>(codepoint & 0xff);
-        // detect the hyperlinks if enabled, before updating the cursor position
-        if (detectHyperlinks_)
-            detectHyperlink(codepoint);
+        TRACE(TRACE_CODEPOINT, codepoint);
+        int columnWidth = Char::ColumnWidth(codepoint);
+        // zero width characters and the characters joined to the previous one are part of its grapheme cluster
+        if (columnWidth == 0 || cursorPosition() == joinerPosition_) {
+            joinerPosition_ = (codepoint == Char::ZWJ) ? cursorPosition() : Point{-1, -1};
+            return;
+        }
         updateCursorPosition();
+        // wide characters that do not fit on the line wrap to the next one
+        if (columnWidth == 2 && cursorPosition().x() == state_->buffer.width() - 1 && state_->buffer.width() > 1) {
+            setCursorPosition(cursorPosition() + Point{1, 0});
+            updateCursorPosition();
+        }
+        // if the right half of a wide character is overwritten, the wide character is erased
+        if (cursorPosition().x() > 0) {
+            Point leftPos = cursorPosition() - Point{1, 0};
+            // the mutable access marks the row as changed and clears the cell's unused bits, so it is only used when the cell really changes
+            if (static_cast<Buffer const &>(state_->buffer).at(leftPos).font().doubleWidth()) {
+                Cell & left = state_->buffer.at(leftPos);
+                left.setCodepoint(' ');
+                left.font().setDoubleWidth(false);
+            }
+        }
         // set the cell according to the codepoint and current settings. If there is an active hyperlink, the hyperlink is first attached to the cell and then new cell is added to the hyperlink fallback 
         Cell & cell = state_->buffer.at(cursorPosition());
         cell = state_->cell;
         // attach hyperlink special object, of one is active
         if (inProgressHyperlink_ != nullptr)
-            cell.attachSpecialObject(inProgressHyperlink_);
+            state_->buffer.attachSpecialObject(cursorPosition(), inProgressHyperlink_);
         cell.setCodepoint(codepoint);
-        // what's left is to deal with corner cases, such as larger fonts & double width characters
-        int columnWidth = Char::ColumnWidth(codepoint);
-        // if the character's column width is 2 and current font is not double width, update to double width font
-        if (columnWidth == 2 && ! cell.font().doubleWidth()) {
-            //columnWidth = 1;
-            cell.font().setDoubleWidth(true);
-        }
-
         // advance cursor's column
         setCursorPosition(cursorPosition() + Point{1, 0});
+        // wide characters are displayed in double width font and take the next cell as well, which is never displayed
+        if (columnWidth == 2) {
+            cell.font().setDoubleWidth(true);
+            if (cursorPosition().x() < state_->buffer.width()) {
+                Cell & right = state_->buffer.at(cursorPosition());
+                right = state_->cell;
+                right.setCodepoint(' ');
+                setCursorPosition(cursorPosition() + Point{1, 0});
+            }
+        }
 
 
         // TODO do double width & height characters properly for the per-line 
@@ -764,6 +996,7 @@ namespace ui {
     }
 
     void AnsiTerminal::parseNotification() {
+        TRACE(TRACE_CONTROL, Char::BEL);
         schedule([this](){
             VoidEvent::Payload p;
             onNotification(p, this);
@@ -771,18 +1004,18 @@ namespace ui {
     }
 
     void AnsiTerminal::parseTab() {
-        resetHyperlinkDetection();
         updateCursorPosition();
         if (cursorPosition().x() % 8 == 0)
             setCursorPosition(cursorPosition() + Point{8, 0});
         else
             setCursorPosition(cursorPosition() + Point{8 - cursorPosition().x() % 8, 0});
         LOG(SEQ) << "Tab: cursor col is " << cursorPosition().x();
+        TRACE(TRACE_CONTROL, Char::TAB);
     }
 
     void AnsiTerminal::parseLF() {
         LOG(SEQ) << "LF";
-        resetHyperlinkDetection();
+        TRACE(TRACE_CONTROL, Char::LF);
         state_->markLineEnd();
         // disable double width and height chars
         state_->cell.font().setSize(1).setDoubleWidth(false);
@@ -798,7 +1031,7 @@ namespace ui {
 
     void AnsiTerminal::parseCR() {
         LOG(SEQ) << "CR";
-        resetHyperlinkDetection();
+        TRACE(TRACE_CONTROL, Char::CR);
         // mark the last character as line end? 
         // TODO
         setCursorPosition(Point{0, cursorPosition().y()});
@@ -806,7 +1039,7 @@ namespace ui {
 
     void AnsiTerminal::parseBackspace() {
         LOG(SEQ) << "BACKSPACE";
-        resetHyperlinkDetection();
+        TRACE(TRACE_CONTROL, Char::BACKSPACE);
         if (cursorPosition().x() == 0) {
             if (cursorPosition().y() > 0)
                 setCursorPosition(cursorPosition() - Point{0, 1});
@@ -826,6 +1059,11 @@ namespace ui {
             /* CSI Sequence. */
             case '[': {
                 x -= 2;
+                // SGR sequences are the most common CSI sequences by far, so they have their own fast path
+                if (size_t processed = parseSGRFast(x, bufferEnd)) {
+                    x += processed;
+                    break;
+                }
                 CSISequence seq{CSISequence::Parse(x, bufferEnd)};
                 // if the sequence is not valid, it has been reported already and we should just exit
                 if (!seq.valid())
@@ -853,20 +1091,17 @@ namespace ui {
 			/* Save Cursor. */
 			case '7':
 				LOG(SEQ) << "DECSC: Cursor position saved";
-                resetHyperlinkDetection();
                 state_->saveCursor();
 				break;
 			/* Restore Cursor. */
 			case '8':
                 LOG(SEQ) << "DECRC: Cursor position restored";
-                resetHyperlinkDetection();
                 state_->restoreCursor();
 				break;
 			/* Reverse line feed - move up 1 row, same column.
 			 */
 			case 'M':
 				LOG(SEQ) << "RI: move cursor 1 line up";
-                resetHyperlinkDetection();
 				if (cursorPosition().y() == state_->scrollStart) 
 					insertLines(1, state_->scrollStart, state_->scrollEnd, state_->cell);
 				else
@@ -875,11 +1110,9 @@ namespace ui {
             /* Device Control String (DCS). 
              */
             case 'P':
-                resetHyperlinkDetection();
                 if (x == bufferEnd)
                     return false;
                 if (*x == '+') {
-                    resetHyperlinkDetection();
                     // frees the UI thread to draw the buffer while we are dealing with the tpp sequence
                     bufferLock_.unlock();
                     size_t p = parseTppSequence(buffer, bufferEnd);
@@ -892,7 +1125,6 @@ namespace ui {
     		/* Character set specification - most cases are ignored, with the exception of the box drawing and reset to english (0 and B) respectively. 
              */
 			case '(':
-                resetHyperlinkDetection();
                 if (x != bufferEnd) {
                     if (*x == '0') {
                         ++x;
@@ -911,7 +1143,6 @@ namespace ui {
 			case '*':
 			case '+':
 				// missing character set specification
-                resetHyperlinkDetection();
 				if (x == bufferEnd)
 					return false;
 				if (*x == 'B') { // US
@@ -924,13 +1155,11 @@ namespace ui {
 			/* ESC = -- Application keypad */
 			case '=':
 				LOG(SEQ) << "Application keypad mode enabled";
-                resetHyperlinkDetection();
                 keypadMode_ = KeypadMode::Application;
 				break;
 			/* ESC > -- Normal keypad */
 			case '>':
 				LOG(SEQ) << "Normal keypad mode enabled";
-                resetHyperlinkDetection();
                 keypadMode_ = KeypadMode::Normal;
 				break;
             /* ESC # number -- font size changes */
@@ -943,10 +1172,13 @@ namespace ui {
                 break;
                 */
             default:
-                resetHyperlinkDetection();
 				LOG(SEQ_UNKNOWN) << "Unknown escape sequence \x1b" << *(x-1);
 				break;
         }
+        TRACE(TRACE_ESC, buffer[1], x - buffer);
+        // CSI and OSC sequences are counted on their own
+        if (buffer[1] != '[' && buffer[1] != ']')
+            metrics_.escapes.add();
         return x - buffer;
     }
 
@@ -960,6 +1192,8 @@ namespace ui {
         tpp::Sequence::Kind kind = tpp::Sequence::ParseKind(i, bufferEnd);
         // now we have kind and beginning and end of the payload so we can process the sequence
         LOG(SEQ) << "t++ sequence " << kind << ", payload size " << (tppEnd - i);
+        TRACE(TRACE_TPP, kind, tppEnd - i);
+        metrics_.tpp.add();
         // processes the tpp sequence, the default implementation simply raises the tpp sequence event
         tppSequence(TppSequenceEvent::Payload{kind, i, tppEnd});
         // and return
@@ -967,9 +1201,8 @@ namespace ui {
     }
 
     void AnsiTerminal::parseCSISequence(CSISequence & seq) {
-        // reset hyperlink detection for all but SGR commands
-        if (seq.firstByte() != 0 || seq.finalByte() != 'm')
-            resetHyperlinkDetection();
+        TRACE(TRACE_CSI, seq.firstByte(), seq.finalByte(), seq.numArgs(), seq[0], seq[1], seq[2]);
+        metrics_.csi.add();
         // process the sequence
         switch (seq.firstByte()) {
             // the "normal" CSI sequences
@@ -1188,7 +1421,7 @@ namespace ui {
                             LOG(SEQ) << "Repeat previous character " << seq[0] << " times";
                             Cell const & prev = state_->buffer.at(cursorPosition() - Point{1, 0});
                             for (size_t i = 0, e = seq[0]; i < e; ++i) {
-                                state_->buffer.at(cursorPosition()) = prev;
+                                state_->buffer.set(cursorPosition(), prev);
                                 setCursorPosition(cursorPosition() + Point{1,0});
                             }
                         }
@@ -1425,7 +1658,7 @@ namespace ui {
                             if (alternateMode_)
                                 setScrollOffset(Point{0, 0});
                             else
-                                setScrollOffset(Point{0, static_cast<int>(historyRows_.size())});
+                                setScrollOffset(Point{0, historyRows()});
                         });
                         // if we are entering the alternate mode, reset the state to default values
                         if (value) {
@@ -1456,8 +1689,47 @@ namespace ui {
 
     void AnsiTerminal::parseSGR(CSISequence & seq) {
         seq.setDefault(0, 0);
-		for (size_t i = 0; i < seq.numArgs(); ++i) {
-			switch (seq[i]) {
+        std::vector<int> args;
+        args.reserve(seq.numArgs());
+        for (size_t i = 0; i < seq.numArgs(); ++i)
+            args.push_back(seq[i]);
+        applySGR(args.data(), args.size());
+    }
+
+    size_t AnsiTerminal::parseSGRFast(char const * buffer, char const * bufferEnd) {
+        ASSERT(buffer[0] == Char::ESC && buffer[1] == '[');
+        int args[MAX_FAST_SGR_ARGS];
+        size_t numArgs = 0;
+        int arg = 0;
+        char const * x = buffer + 2;
+        while (true) {
+            // incomplete sequences are left to the general parser which knows how to deal with them
+            if (x == bufferEnd)
+                return 0;
+            char c = *x++;
+            if (c >= '0' && c <= '9') {
+                // no SGR argument is larger than 255, clamping prevents the overflow
+                arg = std::min(arg * 10 + (c - '0'), 0xffff);
+            } else if (c == ';' || c == 'm') {
+                if (numArgs == MAX_FAST_SGR_ARGS)
+                    return 0;
+                args[numArgs++] = arg;
+                arg = 0;
+                if (c == 'm')
+                    break;
+            } else {
+                return 0;
+            }
+        }
+        TRACE(TRACE_CSI, '\0', 'm', numArgs, args[0], numArgs > 1 ? args[1] : 0, numArgs > 2 ? args[2] : 0);
+        metrics_.csi.add();
+        applySGR(args, numArgs);
+        return x - buffer;
+    }
+
+    void AnsiTerminal::applySGR(int const * args, size_t numArgs) {
+		for (size_t i = 0; i < numArgs; ++i) {
+			switch (args[i]) {
 				/* Resets all attributes. */
 				case 0:
                     state_->cell.setFg(palette_.defaultForeground()) 
@@ -1554,7 +1826,7 @@ namespace ui {
 				/* 30 - 37 are dark foreground colors, handled in the default case. */
 				/* 38 - extended foreground color */
 				case 38: {
-                    Color fg = parseSGRExtendedColor(seq, i);
+                    Color fg = parseSGRExtendedColor(args, numArgs, i);
                     state_->cell.setFg(fg).setDecor(fg);    
 					LOG(SEQ) << "fg set to " << fg;
 					break;
@@ -1568,7 +1840,7 @@ namespace ui {
 				/* 40 - 47 are dark background color, handled in the default case. */
 				/* 48 - extended background color */
 				case 48: {
-                    Color bg = parseSGRExtendedColor(seq, i);
+                    Color bg = parseSGRExtendedColor(args, numArgs, i);
                     state_->cell.setBg(bg);    
 					LOG(SEQ) << "bg set to " << bg;
 					break;
@@ -1581,60 +1853,62 @@ namespace ui {
 				/* 90 - 97 are bright foreground colors, handled in the default case. */
 				/* 100 - 107 are bright background colors, handled in the default case. */
 				default:
-					if (seq[i] >= 30 && seq[i] <= 37) {
-                        int colorIndex = seq[i] - 30;
+					if (args[i] >= 30 && args[i] <= 37) {
+                        int colorIndex = args[i] - 30;
                         if (boldIsBright_ && state_->bold)
                             colorIndex += 8;
 						state_->cell.setFg(palette_.at(colorIndex))
                                    .setDecor(palette_.at(colorIndex));
-						LOG(SEQ) << "fg set to " << palette_.at(seq[i] - 30);
-					} else if (seq[i] >= 40 && seq[i] <= 47) {
-						state_->cell.setBg(palette_.at(seq[i] - 40));
-						LOG(SEQ) << "bg set to " << palette_.at(seq[i] - 40);
-					} else if (seq[i] >= 90 && seq[i] <= 97) {
-						state_->cell.setFg(palette_.at(seq[i] - 82))
-                                   .setDecor(palette_.at(seq[i] - 82));
-						LOG(SEQ) << "fg set to " << palette_.at(seq[i] - 82);
-					} else if (seq[i] >= 100 && seq[i] <= 107) {
-						state_->cell.setBg(palette_.at(seq[i] - 92));
-						LOG(SEQ) << "bg set to " << palette_.at(seq[i] - 92);
+						LOG(SEQ) << "fg set to " << palette_.at(args[i] - 30);
+					} else if (args[i] >= 40 && args[i] <= 47) {
+						state_->cell.setBg(palette_.at(args[i] - 40));
+						LOG(SEQ) << "bg set to " << palette_.at(args[i] - 40);
+					} else if (args[i] >= 90 && args[i] <= 97) {
+						state_->cell.setFg(palette_.at(args[i] - 82))
+                                   .setDecor(palette_.at(args[i] - 82));
+						LOG(SEQ) << "fg set to " << palette_.at(args[i] - 82);
+					} else if (args[i] >= 100 && args[i] <= 107) {
+						state_->cell.setBg(palette_.at(args[i] - 92));
+						LOG(SEQ) << "bg set to " << palette_.at(args[i] - 92);
 					} else {
-						LOG(SEQ_UNKNOWN) << "Invalid SGR code: " << seq;
+						LOG(SEQ_UNKNOWN) << "Invalid SGR code: " << args[i];
 					}
 					break;
 			}
 		}
     }
 
-    Color AnsiTerminal::parseSGRExtendedColor(CSISequence & seq, size_t & i) {
+    Color AnsiTerminal::parseSGRExtendedColor(int const * args, size_t numArgs, size_t & i) {
 		++i;
-		if (i < seq.numArgs()) {
-			switch (seq[i++]) {
+		if (i < numArgs) {
+			switch (args[i++]) {
 				/* index from 256 colors */
 				case 5:
-					if (i >= seq.numArgs()) // not enough args 
+					if (i >= numArgs) // not enough args 
 						break;
-					if (seq[i] > 255) // invalid color spec
+					if (args[i] > 255) // invalid color spec
 						break;
-                    return palette_.at(seq[i]);
+                    return palette_.at(args[i]);
 				/* true color rgb */
 				case 2:
 					i += 2;
-					if (i >= seq.numArgs()) // not enough args
+					if (i >= numArgs) // not enough args
 						break;
-					if (seq[i - 2] > 255 || seq[i - 1] > 255 || seq[i] > 255) // invalid color spec
+					if (args[i - 2] > 255 || args[i - 1] > 255 || args[i] > 255) // invalid color spec
 						break;
-					return Color(seq[i - 2] & 0xff, seq[i - 1] & 0xff, seq[i] & 0xff);
+					return Color(args[i - 2] & 0xff, args[i - 1] & 0xff, args[i] & 0xff);
 				/* everything else is an error */
 				default:
 					break;
 			}
 		}
-		LOG(SEQ_UNKNOWN) << "Invalid extended color: " << seq;
+		LOG(SEQ_UNKNOWN) << "Invalid extended color specification";
 		return Color::White;
     }
 
     void AnsiTerminal::parseOSCSequence(OSCSequence & seq) {
+        TRACE(TRACE_OSC, seq.num(), seq.numArgs());
+        metrics_.osc.add();
         switch (seq.num()) {
             /* OSC 0 - change window title and icon name
                OSC 2 - change window title
@@ -1721,6 +1995,10 @@ namespace ui {
         Cell * x = rows_[bottom - 1];
         memmove(rows_ + top + 1, rows_ + top, sizeof(Cell*) * (bottom - top - 1));
         rows_[top] = x;
+        // the moved rows keep their tags as their contents did not change, the reused row keeps its tag so that its special objects are released by the fill
+        RowTag xTag = rowTags_[bottom - 1];
+        memmove(rowTags_ + top + 1, rowTags_ + top, sizeof(RowTag) * (bottom - top - 1));
+        rowTags_[top] = xTag;
         fillRow(top, fill, 0, width());
     }
 
@@ -1744,8 +2022,7 @@ namespace ui {
             lastCol = width();
         // make the copy and return it
         Cell * result = new Cell[lastCol];
-        // we cannot use memcopy here because the cells can be special
-        MemCopy(result, x, lastCol);
+        CopyCells(result, x, lastCol, rowTags_[row].special);
         return std::make_pair(result, lastCol);
     }
 
@@ -1753,6 +2030,9 @@ namespace ui {
         Cell * x = rows_[top];
         memmove(rows_ + top, rows_ + top + 1, sizeof(Cell*) * (bottom - top - 1));
         rows_[bottom - 1] = x;
+        RowTag xTag = rowTags_[top];
+        memmove(rowTags_ + top, rowTags_ + top + 1, sizeof(RowTag) * (bottom - top - 1));
+        rowTags_[bottom - 1] = xTag;
         fillRow(bottom - 1, fill, 0, width());
     }
 
@@ -1777,7 +2057,7 @@ namespace ui {
             for (int col = 0; col < oldWidth; ++col) {
                 adjustCursorPosition(fill, addToHistory);
                 // append the character from the old buffer
-                rows_[cursorPosition_.y()][cursorPosition_.x()] = old[col];
+                set(cursorPosition_, old[col]);
                 // if the cell is marked as end of line and the rest of the line are just whitespace characters then set position to new line and ignore the whitespace
                 if (IsLineEnd(old[col]) && hasOnlyWhitespace(old, col + 1, oldWidth)) {
                     cursorPosition_ = Point{0, cursorPosition_.y() + 1};
@@ -1819,7 +2099,7 @@ namespace ui {
         if (cursorPosition_.y() >= height()) {
             if (addToHistory) {
                 Cell * rowCopy = new Cell[width()];
-                MemCopy(rowCopy, rows_[0], width());
+                CopyCells(rowCopy, rows_[0], width(), rowTags_[0].special);
                 addToHistory(rowCopy, width());
             }
             deleteLine(0, height(), fill);
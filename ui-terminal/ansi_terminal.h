@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -11,8 +12,11 @@
 #include "tpp-lib/pty.h"
 #include "tpp-lib/pty_buffer.h"
 
+#include "compact_cell.h"
 #include "csi_sequence.h"
+#include "history_spill.h"
 #include "osc_sequence.h"
+#include "terminal_metrics.h"
 #include "url_matcher.h"
 
 namespace ui {
@@ -28,11 +32,14 @@ namespace ui {
 
     using ExitCodeEvent = Event<ExitCode>;
 
+    using SendProgressEvent = Event<size_t>;
+
     /** The terminal alone. 
      
         The simplest interface to the rerminal, no history, selection, etc?
      */
     class AnsiTerminal : public virtual Widget, public tpp::PTYBuffer<tpp::PTYMaster>, SelectionOwner {
+        friend class TerminalSnapshot;
     public:
         using Cell = Canvas::Cell;
         using Cursor = Canvas::Cursor;
@@ -196,24 +203,87 @@ namespace ui {
         TppSequenceEvent onTppSequence;
         ExitCodeEvent onPTYTerminated;
 
+        /** Triggered when the input sent to the pseudoterminal, such as a large paste, could not be written at once, with the number of bytes still pending. 
+         
+            Triggered repeatedly as the input is written, the last time with 0 when all of it has been written. 
+         */
+        SendProgressEvent onSendProgress;
+
 
     /** \name Widget 
      */
     //@{
 
+    public:
+
+        /** Hidden terminal, such as an inactive page of a pager, only parses its input into the buffer. 
+         
+            It does not publish snapshots for painting, does not detect hyperlinks and does not schedule repaints so that a noisy background session costs little more than parsing its output. When shown again, the current buffer is published and the terminal repainted.
+         */
+        void setVisible(bool value = true) override;
+
     protected:
 
         Size contentsSize() const override {
             if (alternateMode_) {
                 return Widget::contentsSize();
             } else {
-                std::lock_guard<PriorityLock> g(bufferLock_.priorityLock(), std::adopt_lock);
-                return Size{width(), height() + static_cast<int>(historyRows_.size())};
+                return Size{width(), height() + historySize_};
             }
         }
 
         void paint(Canvas & canvas) override;
 
+        /** The terminal draws all of its cells, either from the history, or from the buffer. 
+         */
+        bool opaqueContents() const override {
+            return true;
+        }
+
+    protected:
+
+        /** Copy of the terminal buffer published for painting. 
+
+            The top is the number of history rows above the buffer at the time the snapshot was taken. 
+         */
+        class Snapshot {
+        public:
+            Canvas::Buffer buffer{Size{0, 0}};
+            int top = 0;
+        };
+
+        /** Copies the current terminal buffer into a snapshot and publishes it for painting.
+
+            Called by the input thread at the end of each batch of input and by the UI thread when it finds the buffer lock free, so that its own changes to the buffer are painted as well. Unless forced, nothing is published while the previously published snapshot has not been painted yet as the UI thread publishes itself once the input is processed. 
+         */
+        void publishSnapshot(bool force);
+
+        /** Returns the most recently published snapshot. 
+
+            The snapshot is owned by the UI thread until the next call, so that it can be painted without the buffer lock. 
+         */
+        Snapshot const & acquireSnapshot();
+
+    private:
+
+        /** Areas painted over the terminal buffer by the last paint (selection, scrollbar, cursor) in widget coordinates. 
+
+            The areas are restored before the terminal buffer is drawn again so that the unchanged rows of the buffer do not have to be copied. 
+         */
+        std::vector<Rect> overlays_;
+
+        /** Mirror of the widget's visibility readable by the input processing. */
+        std::atomic<bool> hidden_{false};
+
+        /** The snapshots are triple buffered so that neither the publisher, nor the painter ever wait for each other. The back snapshot is written by the publisher under the buffer lock, the front snapshot is painted by the UI thread and the ready snapshot is the latest published one, with the FRESH_SNAPSHOT bit set until the UI thread acquires it. 
+         */
+        Snapshot snapshots_[3];
+        unsigned backSnapshot_ = 0;
+        unsigned frontSnapshot_ = 1;
+        std::atomic<unsigned> readySnapshot_{2};
+
+        static constexpr unsigned FRESH_SNAPSHOT = 4;
+
     //@}
 
     /** \name User Input
@@ -319,13 +389,23 @@ namespace ui {
          */
         void selectLine(Point pos);
 
+        /** Reports the progress of input queued by the pseudoterminal to the UI thread. 
+
+            Called from the thread writing the queued input. The reports are coalesced so that a large paste does not flood the UI thread with events, the event reports the number of pending bytes at the time it is processed. 
+         */
+        void sendProgress();
+
     private:
 
         /** Number of pressed mouse buttons to determine mouse capture. */
         unsigned mouseButtonsDown_ = 0;
+
         /** Last pressed mouse button for mouse move reporting. */
         unsigned mouseLastButton_ = 0;
 
+        /** True if a send progress event has been scheduled, but not yet processed. */
+        std::atomic<bool> sendProgressScheduled_{false};
+
         static std::unordered_map<Key, std::string> KeyMap_;
         static std::unordered_set<Key> PrintableKeys_;
 
@@ -369,8 +449,9 @@ namespace ui {
             Note that disabling automatic hyperlink detection has no effect on OSC explicit hyperlinks.
          */
         virtual void setDetectHyperlinks(bool value = true) {
+            std::lock_guard<PriorityLock> g{bufferLock_};
             detectHyperlinks_ = value;
-            urlMatcher_.reset();
+            hyperlinkRows_.clear();
         }
 
         /** Returns the style used for new hyperlinks. 
@@ -406,25 +487,30 @@ namespace ui {
          */
         Hyperlink * hyperlinkAt(Point widgetCoords) {
             ASSERT(bufferLock_.locked());
-            Cell const * cell = cellAt(toContentsCoords(widgetCoords));
-            return cell == nullptr ? nullptr : dynamic_cast<Hyperlink*>(cell->specialObject());
+            // the hovered rows may not have been painted yet
+            if (detectHyperlinks_)
+                detectHyperlinks();
+            Cell cell;
+            if (! cellAt(toContentsCoords(widgetCoords), cell))
+                return nullptr;
+            return dynamic_cast<Hyperlink*>(cell.specialObject());
         }
 
-        /** Resets the hyperlink detection matching. 
-         
-            If the matching is in valid state, creates the hyperlink. The reset is done by adding an url separator character, which terminates the url scheme.
+        /** Detects urls in the terminal buffer rows that changed since the last detection and attaches hyperlinks to them. 
 
-            Any sequence other than SGR ones should reset the hyperlink matching.
+            The detection is lazy, it only runs when the buffer is about to be painted, or hovered by the mouse, so that output which scrolls into the history before it is ever displayed is never matched. Rows are identified by their row tags so that rows that only moved are not matched again. A line wrapped over multiple rows is matched whole if any of its rows changed. 
          */
-        void resetHyperlinkDetection() {
-            detectHyperlink(' ');
-        }
+        void detectHyperlinks();
 
-        /** Adds given character to the url matcher. 
-         
-            If adding the character makes a previously valid match invalid, creates the hyperlink and attaches it to its respective cells.
+        /** Matches the urls in the given rows of the terminal buffer, which form a single line. 
          */
-        void detectHyperlink(char32_t next);
+        void detectHyperlinks(int top, int bottom);
+
+        /** Attaches new hyperlink to the given number of cells that precede the end position in the terminal buffer. 
+
+            Nothing is attached if the cells already share the same special object, such as the hyperlink from previous detection, or an explicit hyperlink. 
+         */
+        void attachHyperlink(Point end, size_t size);
 
     private:
 
@@ -436,9 +522,9 @@ namespace ui {
          */
         Hyperlink::Ptr activeHyperlink_;
 
-        /** Url matcher to detect hyperlinks in the terminal output automatically. 
+        /** Tags of the terminal buffer rows in which the urls have been detected. 
          */
-        UrlMatcher urlMatcher_;
+        std::unordered_set<uint64_t> hyperlinkRows_;
 
         /** If true, OSC hyperlinks are supported. 
          */
@@ -522,13 +608,12 @@ namespace ui {
          */
         void setCursor(Canvas::Cursor const & value);
 
-        /** Returns the number of current history rows. 
+        /** Returns the number of current history rows, including those spilled to the disk. 
          
-            Note that to do so, the buffer must be locked as history rows are protected by its mutex so this function is not as cheap as getting a size of a vector. 
+            The history rows themselves are protected by the buffer lock, but their number is mirrored so that it can be read without the lock. 
          */
-        int historyRows() {
-            std::lock_guard<PriorityLock> g{bufferLock_};
-            return static_cast<int>(historyRows_.size());
+        int historyRows() const {
+            return historySize_;
         }
 
         int maxHistoryRows() const {
@@ -539,13 +624,28 @@ namespace ui {
             if (value != maxHistoryRows_) {
                 maxHistoryRows_ = std::max(value, 0);
                 std::lock_guard<PriorityLock> g{bufferLock_};
-                while (historyRows_.size() > static_cast<size_t>(maxHistoryRows_)) {
-                    delete [] historyRows_.front().second;
-                    historyRows_.pop_front();
-                }
+                trimHistory();
             }
         }
 
+        /** Returns the maximum number of history rows kept in memory, or 0 if all history rows are kept in memory.
+         */
+        int maxMemoryHistoryRows() const {
+            return historySpill_ == nullptr ? 0 : maxMemoryHistoryRows_;
+        }
+
+        /** Spills the history rows over given number of rows kept in memory to the given file.
+
+            The oldest rows are spilled first and read back from the file when they are displayed or selected. If the number of rows is 0, or the filename is empty, the history is kept in memory and any rows already spilled are discarded, as they are if the filename changes. The file is deleted when no longer used.
+         */
+        void setHistorySpill(std::string const & filename, int memoryRows);
+
+        /** Returns the performance counters of the terminal.
+         */
+        TerminalMetrics & metrics() {
+            return metrics_;
+        }
+
     protected:
 
         void setScrollOffset(Point const & value) override {
@@ -575,8 +675,49 @@ namespace ui {
             */
         void deleteLines(int lines, int top, int bottom, Cell const & fill);
 
+        /** Adds given row to the history, converting its cells to their compact form. 
+         
+            Takes ownership of the row. 
+         */
         void addHistoryRow(Cell * row, int cols);
 
+        /** Appends the already compacted row to the history, splitting it if it is wider than the terminal and trimming the history to its maximum size. 
+         */
+        void appendHistoryRow(CompactCell * row, int cols);
+
+        /** Removes the oldest history rows over the maximum history size, spills the in-memory rows over the memory budget, if enabled, and updates the history metrics. 
+         */
+        void trimHistory();
+
+        /** A history row whose cells refer to the given attribute table.
+         */
+        struct HistoryRow {
+            int cols;
+            CompactCell const * cells;
+            CompactCell::Attributes const * attributes;
+        };
+
+        /** Returns the history row of given index, which may be spilled to the disk.
+
+            The cells of a spilled row are only valid until another row is requested, or the history changes.
+         */
+        HistoryRow historyRow(int index) {
+            ASSERT(bufferLock_.locked());
+            size_t spilled = spilledHistoryRows();
+            if (static_cast<size_t>(index) < spilled) {
+                auto row = historySpill_->row(static_cast<size_t>(index));
+                return HistoryRow{row.first, row.second, & historySpill_->attributes()};
+            }
+            auto const & row = historyRows_[static_cast<size_t>(index) - spilled];
+            return HistoryRow{row.first, row.second, & historyAttributes_};
+        }
+
+        /** Returns the number of history rows spilled to the disk.
+         */
+        size_t spilledHistoryRows() const {
+            return historySpill_ == nullptr ? 0 : historySpill_->rows();
+        }
+
         void ptyTerminated(ExitCode exitCode) override {
             schedule([this, exitCode](){
                 ExitCodeEvent::Payload p{exitCode};
@@ -584,6 +725,10 @@ namespace ui {
             });
         }
 
+        /** Rewraps the history rows to the terminal's width.
+
+            Only the rows kept in memory are rewrapped, rows spilled to the disk keep their width.
+         */
         void resizeHistory();
         void resizeBuffers(Size size);
 
@@ -596,7 +741,7 @@ namespace ui {
          */
         int terminalBufferTop() const {
             ASSERT(bufferLock_.locked());
-            return alternateMode_ ? 0 : static_cast<int>(historyRows_.size());            
+            return alternateMode_ ? 0 : static_cast<int>(spilledHistoryRows() + historyRows_.size());
         }
 
         /** Converts the given widget coordinates to terminal buffer coordinates. 
@@ -607,13 +752,13 @@ namespace ui {
             return widgetCoordinates + scrollOffset() - Point{0, terminalBufferTop()};
         }
 
-        /** Returns the cell at given coordinates. 
+        /** Gets the cell at given coordinates. 
          
-            The coordinates are adjusted for the scroll buffer and then either a terminal buffer, or history cell is returned. In case of history cells, it is possible that no cell exists at the coordinates if the particular line was terminated before, in which case nullptr is returned. 
+            The coordinates are adjusted for the scroll buffer and then either a terminal buffer, or history cell is returned. In case of history cells, it is possible that no cell exists at the coordinates if the particular line was terminated before, in which case false is returned. 
 
-            Furthermore, if the coordinates are outside of valid range, nullptr is returned as well. 
+            Furthermore, if the coordinates are outside of valid range, false is returned as well. 
          */
-        Cell const * cellAt(Point coords);
+        bool cellAt(Point coords, Cell & cell);
 
         /** Returns previous cell coordinates in contents coords. (that left of current one)
          */
@@ -664,6 +809,10 @@ namespace ui {
         /** Determines whether the line drawing character set is currently active. */
         bool lineDrawingSet_ = false;
 
+        /** Cursor position after the last zero width joiner. The character printed at this position belongs to the grapheme cluster of the joined character and does not get its own cell. 
+         */
+        Point joinerPosition_{-1, -1};
+
         /* Determines whether pasted text will be surrounded by ESC[200~ and ESC[201~ */
         bool bracketedPaste_ = false;
 
@@ -691,7 +840,24 @@ namespace ui {
         mutable PriorityLock bufferLock_;
 
         int maxHistoryRows_ = 0;
-        std::deque<std::pair<int, Cell*>> historyRows_;
+        /** The history rows, stored as compact cells. */
+        std::deque<std::pair<int, CompactCell*>> historyRows_;
+        /** Attributes of the history cells. */
+        CompactCell::Attributes historyAttributes_;
+        /** The oldest history rows spilled to the disk, if enabled. */
+        std::unique_ptr<HistorySpill> historySpill_;
+        /** Number of the most recent history rows kept in memory when the spill is enabled. */
+        int maxMemoryHistoryRows_ = 0;
+        /** Total number of cells in the history rows. */
+        size_t historyCells_ = 0;
+        /** Number of the history rows, updated under the buffer lock, but readable without it. */
+        std::atomic<int> historySize_{0};
+        /** Total number of rows ever appended to the history, so that snapshots can tell which rows are new. */
+        uint64_t historyRowsAdded_ = 0;
+        /** Incremented every time the existing history rows change, i.e. when they are rewrapped. */
+        uint64_t historyVersion_ = 0;
+
+        TerminalMetrics metrics_;
 
     //@}
 
@@ -701,6 +867,18 @@ namespace ui {
     protected:
         size_t received(char * buffer, char const * bufferEnd) override;
 
+        /** Processes the input, returning the number of bytes processed, which is less than the input size if the input ends with an incomplete sequence. 
+         */
+        size_t processInput(char const * buffer, char const * bufferEnd);
+
+        /** Maximum number of codepoints decoded from the input at once. 
+         */
+        static constexpr size_t DECODE_BLOCK_SIZE = 256;
+
+        /** Prints the given codepoint at the cursor position and advances the cursor.
+
+            Wide characters occupy two cells, the second of which is a space that is never displayed. Characters of zero width, such as combining marks, and characters joined by the zero width joiner to the previous character belong to its grapheme cluster. Since cells store only a single codepoint they are not displayed at all, but they do not take up a cell either so that the cursor stays in sync with the applications.
+         */
         void parseCodepoint(char32_t cp);
         void parseNotification();
         void parseTab();
@@ -745,9 +923,23 @@ namespace ui {
          */
         void parseSGR(CSISequence & seq);
 
+        /** Parses the SGR sequence at the beginning of the buffer without constructing the CSI sequence first. 
+
+            Colored output consists mostly of SGR sequences, so plain SGR sequences with up to MAX_FAST_SGR_ARGS numeric arguments are parsed directly from the input into a fixed array, without any allocations. Returns the number of bytes processed, or 0 if the sequence is not a plain SGR sequence, or is incomplete, in which case the general CSI sequence parser must be used. 
+         */
+        size_t parseSGRFast(char const * buffer, char const * bufferEnd);
+
+        /** Applies the SGR attributes given by their numeric arguments to the current cell. 
+         */
+        void applySGR(int const * args, size_t numArgs);
+
         /** Parses the SGR extended color specification, i.e. either TrueColor RGB values, or 256 palette specification.
          */
-        Color parseSGRExtendedColor(CSISequence & seq, size_t & i);
+        Color parseSGRExtendedColor(int const * args, size_t numArgs, size_t & i);
+
+        /** Maximum number of arguments of an SGR sequence parsed by the fast path. Longer sequences, which are rare, use the general CSI sequence parser. 
+         */
+        static constexpr size_t MAX_FAST_SGR_ARGS = 16;
 
         /** Parses the operating system sequence. 
          */
@@ -790,6 +982,21 @@ namespace ui {
             return GetUnusedBits(c) & END_OF_LINE;
         }
 
+        /** Returns true if the given row contains a line end, i.e. the row is not wrapped to the next one. 
+         */
+        bool hasLineEnd(int row) const {
+            ASSERT(row >= 0 && row < height());
+            Cell const * cells = rows_[row];
+            for (int col = width() - 1; col >= 0; --col)
+                if (IsLineEnd(cells[col]))
+                    return true;
+            return false;
+        }
+
+        static bool IsLineEnd(CompactCell const & c) {
+            return c.unusedBits() & END_OF_LINE;
+        }
+
         /** Overrides canvas cursor position to disable the check whether the cell has the cursor flag. 
          
             The cursor in terminal is only one and always valid at the coordinates specified in the buffer. 
@@ -819,7 +1026,7 @@ namespace ui {
 
     private:
 
-        Cell * row(int row) {
+        Cell const * row(int row) const {
             ASSERT(row >= 0 && row < height());
             return rows_[row];
         }
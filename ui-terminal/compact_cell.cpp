@@ -0,0 +1,66 @@
+#include "compact_cell.h"
+
+namespace ui {
+
+    CompactCell CompactCell::Attributes::compact(Canvas::Cell const & cell) {
+        Key key{cell.fg(), cell.bg(), cell.decor(), cell.font(), cell.border(), cell.specialObject()};
+        return CompactCell{cell.codepoint_ & ~ Canvas::Cell::SPECIAL_OBJECT, intern(key)};
+    }
+
+    CompactCell::Attributes::Record CompactCell::Attributes::record(uint32_t index) const {
+        ASSERT(index < entries_.size());
+        Entry const & entry = entries_[index];
+        return Record{entry.fg, entry.bg, entry.decor, entry.border, entry.font};
+    }
+
+    uint32_t CompactCell::Attributes::add(Record const & record) {
+        return intern(Key{record.fg, record.bg, record.decor, record.font, record.border, nullptr});
+    }
+
+    uint32_t CompactCell::Attributes::intern(Key const & key) {
+        auto i = index_.find(key);
+        if (i == index_.end()) {
+            i = index_.insert(std::make_pair(key, static_cast<uint32_t>(entries_.size()))).first;
+            entries_.push_back(Entry{key});
+        }
+        return i->second;
+    }
+
+    Canvas::Cell CompactCell::Attributes::cell(CompactCell const & cell) const {
+        ASSERT(cell.attributes_ < entries_.size());
+        Entry const & entry = entries_[cell.attributes_];
+        Canvas::Cell result;
+        result.setFg(entry.fg).setBg(entry.bg).setDecor(entry.decor).setFont(entry.font).setBorder(entry.border);
+        result.codepoint_ = cell.codepoint_;
+        if (entry.specialObject != nullptr)
+            result.attachSpecialObject(entry.specialObject);
+        return result;
+    }
+
+    size_t CompactCell::Attributes::bytes() const {
+        return entries_.capacity() * sizeof(Entry) + index_.size() * (sizeof(Key) + sizeof(uint32_t) + sizeof(void *)) + index_.bucket_count() * sizeof(void *);
+    }
+
+    size_t CompactCell::Attributes::KeyHash::operator () (Key const & key) const {
+        size_t font = key.font.size()
+            + (key.font.bold() << 3)
+            + (key.font.italic() << 4)
+            + (key.font.underline() << 5)
+            + (key.font.strikethrough() << 6)
+            + (key.font.dashed() << 7)
+            + (key.font.blink() << 8)
+            + (key.font.doubleWidth() << 9);
+        size_t border = static_cast<size_t>(key.border.left())
+            + (static_cast<size_t>(key.border.right()) << 2)
+            + (static_cast<size_t>(key.border.top()) << 4)
+            + (static_cast<size_t>(key.border.bottom()) << 6);
+        size_t result = std::hash<uint32_t>()(key.fg.toRGBA());
+        result = result * 31 + std::hash<uint32_t>()(key.bg.toRGBA());
+        result = result * 31 + std::hash<uint32_t>()(key.decor.toRGBA());
+        result = result * 31 + std::hash<uint32_t>()(key.border.color().toRGBA());
+        result = result * 31 + (font << 8) + border;
+        result = result * 31 + std::hash<void *>()(key.specialObject);
+        return result;
+    }
+
+} // namespace ui
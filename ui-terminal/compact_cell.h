@@ -0,0 +1,205 @@
+#pragma once
+
+#include <atomic>
+#include <type_traits>
+#include <vector>
+#include <unordered_map>
+
+#include "ui/canvas.h"
+
+namespace ui {
+
+    /** Compact representation of a canvas cell.
+
+        Only the codepoint is stored in the cell itself, all other attributes (colors, font, border and the attached special object) are interned in a per-buffer attribute table and the cell keeps only their index. Since only a handful of different attributes is typically used, this makes the compact cell 8 bytes instead of the 24 bytes of the full canvas cell.
+
+        Compact cells are only used for storage, conversion to and from the full cells happens via the attribute table when the cells are stored or accessed.
+     */
+    class CompactCell {
+        friend class HistoryFile;
+    public:
+
+        class Attributes;
+
+        CompactCell() = default;
+
+        char32_t codepoint() const {
+            return codepoint_ & 0x1fffff;
+        }
+
+        /** Returns the extra information stored by the buffer in the codepoint's unused bits. 
+         
+            See Canvas::Buffer::GetUnusedBits() for details. 
+         */
+        char32_t unusedBits() const {
+            return codepoint_ & 0x7fe00000;
+        }
+
+    private:
+
+        CompactCell(char32_t codepoint, uint32_t attributes):
+            codepoint_{codepoint},
+            attributes_{attributes} {
+        }
+
+        /** The codepoint including the buffer's extra bits (such as the end of line flag), but without the special object flag.
+         */
+        char32_t codepoint_;
+        uint32_t attributes_;
+
+    }; // ui::CompactCell
+
+    static_assert(sizeof(CompactCell) == 8, "Compact cell should be 8 bytes");
+
+    /** Interned cell attributes table.
+
+        Attributes are added to the table as cells are compacted and never removed, unless the table is compacted, which retains only the attributes used by given cells. The table keeps the special objects of its attributes alive.
+     */
+    class CompactCell::Attributes {
+    public:
+
+        class Record;
+
+        /** Returns the compact form of given cell, adding its attributes to the table if necessary.
+         */
+        CompactCell compact(Canvas::Cell const & cell);
+
+        /** Returns the attributes of given index without the special object, as they are stored in files.
+         */
+        Record record(uint32_t index) const;
+
+        /** Returns the index of given attributes, adding them to the table if necessary.
+         */
+        uint32_t add(Record const & record);
+
+        /** Returns the full cell, including any special object, from its compact form.
+         */
+        Canvas::Cell cell(CompactCell const & cell) const;
+
+        /** Returns true if the attributes of given compact cell are in the table, which cells read from files must be checked for.
+         */
+        bool contains(CompactCell const & cell) const {
+            return cell.attributes_ < entries_.size();
+        }
+
+        /** Number of different attributes in the table.
+         */
+        size_t size() const {
+            return entries_.size();
+        }
+
+        /** Size of the table in bytes, excluding the special objects.
+         */
+        size_t bytes() const;
+
+        /** Version of the table's indices.
+
+            Each table gets a new version when created and whenever its indices change because it is compacted, so that indices of the table remembered elsewhere are valid for as long as the version stays the same.
+         */
+        uint64_t version() const {
+            return version_;
+        }
+
+        /** Returns true if the table has grown enough since it was last compacted that it should be compacted again.
+         */
+        bool shouldCompact() const {
+            return entries_.size() >= MIN_COMPACT_SIZE && entries_.size() >= 2 * compactedSize_;
+        }
+
+        /** Compacts the table so that only the attributes used by the given rows remain.
+
+            The rows are given as an iterator range of pairs of row length and cells (as the terminal's history rows are stored). The cells are updated to point to the new attribute indices.
+         */
+        template<typename ITERATOR>
+        void compact(ITERATOR begin, ITERATOR end) {
+            std::vector<uint32_t> mapping(entries_.size(), NONE);
+            std::vector<Entry> entries;
+            for (; begin != end; ++begin) {
+                for (CompactCell * c = begin->second, * ce = c + begin->first; c != ce; ++c) {
+                    uint32_t & index = mapping[c->attributes_];
+                    if (index == NONE) {
+                        index = static_cast<uint32_t>(entries.size());
+                        entries.push_back(entries_[c->attributes_]);
+                    }
+                    c->attributes_ = index;
+                }
+            }
+            entries_ = std::move(entries);
+            index_.clear();
+            for (size_t i = 0, e = entries_.size(); i != e; ++i)
+                index_.insert(std::make_pair(static_cast<Key const &>(entries_[i]), static_cast<uint32_t>(i)));
+            compactedSize_ = entries_.size();
+            version_ = NextVersion();
+        }
+
+    private:
+
+        static constexpr uint32_t NONE = 0xffffffff;
+        /** Minimal size of the table before it is worth compacting.
+         */
+        static constexpr size_t MIN_COMPACT_SIZE = 1024;
+
+        class Key {
+        public:
+            Color fg;
+            Color bg;
+            Color decor;
+            Font font;
+            Border border;
+            Canvas::SpecialObject * specialObject;
+
+            bool operator == (Key const & other) const {
+                return fg == other.fg && bg == other.bg && decor == other.decor && font == other.font && border == other.border && specialObject == other.specialObject;
+            }
+        };
+
+        class KeyHash {
+        public:
+            size_t operator () (Key const & key) const;
+        };
+
+        /** Returns the index of given attributes, adding them to the table if necessary.
+         */
+        uint32_t intern(Key const & key);
+
+        /** The attributes together with the reference to their special object so that the object lives as long as the table references it.
+         */
+        class Entry : public Key {
+        public:
+            Entry(Key const & key):
+                Key{key},
+                object{key.specialObject} {
+            }
+
+            Canvas::SpecialObject::Ptr<Canvas::SpecialObject> object;
+        };
+
+        static uint64_t NextVersion() {
+            static std::atomic<uint64_t> version{0};
+            return ++version;
+        }
+
+        std::vector<Entry> entries_;
+        std::unordered_map<Key, uint32_t, KeyHash> index_;
+        size_t compactedSize_ = 0;
+        uint64_t version_ = NextVersion();
+
+    }; // ui::CompactCell::Attributes
+
+    /** Attributes of a compact cell without the special object.
+
+        The record is trivially copyable so that it can be written to and read from files as is. 
+     */
+    class CompactCell::Attributes::Record {
+    public:
+        Color fg;
+        Color bg;
+        Color decor;
+        Border border;
+        Font font;
+    }; // ui::CompactCell::Attributes::Record
+
+    static_assert(std::is_trivially_copyable<CompactCell::Attributes::Record>::value, "Attribute records are stored in files as they are");
+    static_assert(std::is_trivially_copyable<CompactCell>::value, "Compact cells are stored in files as they are");
+
+} // namespace ui
@@ -0,0 +1,251 @@
+#if (defined ARCH_UNIX)
+    #include <fcntl.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#include "history_file.h"
+
+namespace ui {
+
+    namespace {
+
+        /** Creates the file, or truncates an existing one, readable and writable only by the user, as the history contains whatever the terminal displayed.
+         */
+        void CreatePrivateFile(std::string const & filename) {
+#if (defined ARCH_UNIX)
+            int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+            OSCHECK(fd != -1) << "Unable to create history file " << filename;
+            // the mode of an existing file is not changed by open
+            int result = fchmod(fd, S_IRUSR | S_IWUSR);
+            ::close(fd);
+            OSCHECK(result == 0) << "Unable to set permissions of history file " << filename;
+#else
+            MARK_AS_UNUSED(filename);
+#endif
+        }
+
+    }
+
+    void HistoryFile::flush() {
+        if (pending_.empty())
+            return;
+        if (! file_.is_open())
+            open();
+        file_.write(pending_.c_str(), pending_.size());
+        file_.flush();
+        OSCHECK(file_.good()) << "Unable to write history file " << filename_;
+        pending_.clear();
+        pendingRows_ = 0;
+    }
+
+    void HistoryFile::clear() {
+        mapped_.reset();
+        file_.close();
+        file_.clear();
+        bytes_ = 0;
+        pending_.clear();
+        pendingRows_ = 0;
+        rows_ = 0;
+        attributes_ = CompactCell::Attributes{};
+        pages_.clear();
+        attributesMap_.clear();
+        attributesVersion_ = 0;
+    }
+
+    /** The file is mapped only up to the given size, so that a file which is being appended to by another writer, or whose last records were not completely written yet, is read only as far as it is known to be valid.
+     */
+    void HistoryFile::load(size_t bytes) {
+        clear();
+        if (! PathExists(filename_))
+            return;
+        mapped_.reset(new MappedFile{filename_, bytes});
+        char const * data = mapped_->data();
+        char const * end = data + mapped_->size();
+        if (mapped_->size() < HEADER_SIZE) {
+            mapped_.reset();
+            return;
+        }
+        if (memcmp(data, MAGIC, sizeof(MAGIC)) != 0 || ReadWord(data + sizeof(MAGIC)) != VERSION)
+            THROW(IOError()) << "Not a history file: " << filename_;
+        char const * x = data + HEADER_SIZE;
+        while (static_cast<size_t>(end - x) >= sizeof(uint32_t)) {
+            uint32_t word = ReadWord(x);
+            if (word == ATTRIBUTES) {
+                if (static_cast<size_t>(end - x) < ATTRIBUTES_RECORD_SIZE)
+                    break;
+                CompactCell::Attributes::Record record;
+                memcpy(static_cast<void *>(& record), x + sizeof(uint32_t), sizeof(CompactCell::Attributes::Record));
+                attributes_.add(record);
+                x += ATTRIBUTES_RECORD_SIZE;
+            } else {
+                if (static_cast<size_t>(end - x) < 2 * sizeof(uint32_t) || static_cast<size_t>(end - x) - 2 * sizeof(uint32_t) < ReadWord(x + sizeof(uint32_t)))
+                    break;
+                // every cell takes at least a byte of the record, so that the number of cells, which readers allocate, is bounded by the file size
+                if (word > ReadWord(x + sizeof(uint32_t))) {
+                    clear();
+                    THROW(IOError()) << "Invalid row in history file " << filename_;
+                }
+                if (rows_ % PAGE_ROWS == 0)
+                    pages_.push_back(static_cast<size_t>(x - data));
+                ++rows_;
+                x += 2 * sizeof(uint32_t) + ReadWord(x + sizeof(uint32_t));
+            }
+        }
+        bytes_ = static_cast<size_t>(x - data);
+    }
+
+    /** The new file starts with all attribute records so that the attribute indices of the remaining rows do not change and their records can be copied as they are. The new file is written next to the old one and then replaces it.
+     */
+    void HistoryFile::removeFirst(size_t rows) {
+        ASSERT(rows <= rows_);
+        if (rows == 0)
+            return;
+        map();
+        std::string tmp = filename_ + ".tmp";
+        std::vector<size_t> pages;
+        size_t bytes = HEADER_SIZE + attributes_.size() * ATTRIBUTES_RECORD_SIZE;
+        {
+            CreatePrivateFile(tmp);
+            std::ofstream f{tmp, std::ios::out | std::ios::binary | std::ios::trunc};
+            OSCHECK(f.good()) << "Unable to create history file " << tmp;
+            f.write(MAGIC, sizeof(MAGIC));
+            f.write(pointer_cast<char const *>(& VERSION), sizeof(uint32_t));
+            for (size_t i = 0, e = attributes_.size(); i < e; ++i) {
+                CompactCell::Attributes::Record record = attributes_.record(static_cast<uint32_t>(i));
+                f.write(pointer_cast<char const *>(& ATTRIBUTES), sizeof(uint32_t));
+                f.write(pointer_cast<char const *>(& record), sizeof(CompactCell::Attributes::Record));
+            }
+            if (rows < rows_) {
+                char const * x = mapped_->data() + pages_[rows / PAGE_ROWS];
+                for (size_t row = rows - rows % PAGE_ROWS; row < rows_; ) {
+                    if (ReadWord(x) == ATTRIBUTES) {
+                        x += ATTRIBUTES_RECORD_SIZE;
+                        continue;
+                    }
+                    size_t size = 2 * sizeof(uint32_t) + ReadWord(x + sizeof(uint32_t));
+                    if (row >= rows) {
+                        if ((row - rows) % PAGE_ROWS == 0)
+                            pages.push_back(bytes);
+                        f.write(x, size);
+                        bytes += size;
+                    }
+                    x += size;
+                    ++row;
+                }
+            }
+            f.close();
+            OSCHECK(f.good()) << "Unable to write history file " << tmp;
+        }
+        mapped_.reset();
+        file_.close();
+        file_.clear();
+        Rename(tmp, filename_);
+        bytes_ = bytes;
+        rows_ -= rows;
+        pages_ = std::move(pages);
+    }
+
+    uint32_t HistoryFile::addAttributes(CompactCell::Attributes::Record const & record) {
+        size_t entries = attributes_.size();
+        uint32_t result = attributes_.add(record);
+        if (attributes_.size() != entries) {
+            writeHeader();
+            write(& ATTRIBUTES, sizeof(uint32_t));
+            write(& record, sizeof(CompactCell::Attributes::Record));
+        }
+        return result;
+    }
+
+    void HistoryFile::appendRow(CompactCell const * cells, int cols) {
+        record_.clear();
+        uint32_t numRuns = static_cast<uint32_t>(runs_.size());
+        record_.append(pointer_cast<char const *>(& numRuns), sizeof(uint32_t));
+        for (auto const & run : runs_) {
+            record_.append(pointer_cast<char const *>(& run.first), sizeof(uint32_t));
+            record_.append(pointer_cast<char const *>(& run.second), sizeof(uint32_t));
+        }
+        for (int i = 0; i < cols; ++i) {
+            uint32_t cp = cells[i].codepoint_;
+            while (cp >= 0x80) {
+                record_ += static_cast<char>((cp & 0x7f) | 0x80);
+                cp >>= 7;
+            }
+            record_ += static_cast<char>(cp);
+        }
+        record_.resize((record_.size() + 3) & ~ static_cast<size_t>(3), 0);
+        writeHeader();
+        if (rows_ % PAGE_ROWS == 0)
+            pages_.push_back(bytes_);
+        ++rows_;
+        ++pendingRows_;
+        uint32_t header[] = { static_cast<uint32_t>(cols), static_cast<uint32_t>(record_.size()) };
+        write(header, sizeof(header));
+        write(record_.c_str(), record_.size());
+    }
+
+    void HistoryFile::decodeRow(char const * record, CompactCell * cells) const {
+        uint32_t cols = ReadWord(record);
+        char const * end = record + 2 * sizeof(uint32_t) + ReadWord(record + sizeof(uint32_t));
+        char const * x = record + 2 * sizeof(uint32_t);
+        if (static_cast<size_t>(end - x) < sizeof(uint32_t))
+            THROW(IOError()) << "Invalid row in history file " << filename_;
+        uint32_t numRuns = ReadWord(x);
+        x += sizeof(uint32_t);
+        if (static_cast<size_t>(end - x) / (2 * sizeof(uint32_t)) < numRuns)
+            THROW(IOError()) << "Invalid row in history file " << filename_;
+        unsigned char const * cp = pointer_cast<unsigned char const *>(x + numRuns * 2 * sizeof(uint32_t));
+        unsigned char const * cpEnd = pointer_cast<unsigned char const *>(end);
+        CompactCell * c = cells;
+        CompactCell * cellsEnd = cells + cols;
+        for (uint32_t run = 0; run < numRuns; ++run, x += 2 * sizeof(uint32_t)) {
+            uint32_t attributes = ReadWord(x);
+            uint32_t length = ReadWord(x + sizeof(uint32_t));
+            if (attributes >= attributes_.size() || static_cast<size_t>(cellsEnd - c) < length)
+                THROW(IOError()) << "Invalid row in history file " << filename_;
+            for (CompactCell * e = c + length; c != e; ++c) {
+                if (cp == cpEnd)
+                    THROW(IOError()) << "Invalid row in history file " << filename_;
+                uint32_t value = *cp++;
+                if (value >= 0x80) {
+                    value &= 0x7f;
+                    for (unsigned shift = 7; cp != cpEnd && shift < 32; shift += 7) {
+                        uint32_t b = *cp++;
+                        value |= (b & 0x7f) << shift;
+                        if (b < 0x80)
+                            break;
+                    }
+                }
+                *c = CompactCell{value, attributes};
+            }
+        }
+        if (c != cellsEnd)
+            THROW(IOError()) << "Invalid row in history file " << filename_;
+    }
+
+    /** Rows appended since the file was last mapped are not part of the existing mapping, in which case the file is flushed and mapped again.
+     */
+    void HistoryFile::map() {
+        if (mapped_ != nullptr && mapped_->size() >= bytes_)
+            return;
+        flush();
+        mapped_.reset();
+        mapped_.reset(new MappedFile{filename_, bytes_});
+    }
+
+    /** A new file, or one that has been cleared, is created empty as its header is pending with the records. Otherwise the file is truncated to the last valid record loaded so that the new records follow it immediately.
+     */
+    void HistoryFile::open() {
+        size_t written = bytes_ - pending_.size();
+        if (written == 0) {
+            CreatePrivateFile(filename_);
+            file_.open(filename_, std::ios::out | std::ios::binary | std::ios::trunc);
+            OSCHECK(file_.good()) << "Unable to create history file " << filename_;
+        } else {
+            std::filesystem::resize_file(filename_, written);
+            file_.open(filename_, std::ios::out | std::ios::binary | std::ios::app);
+            OSCHECK(file_.good()) << "Unable to open history file " << filename_;
+        }
+    }
+
+} // namespace ui
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "helpers/filesystem.h"
+
+#include "compact_cell.h"
+
+namespace ui {
+
+    /** Append-only file of compact history rows.
+
+        The file starts with a header, followed by records of two kinds. An attribute record is a marker followed by a single attribute table entry without its special object. The attribute indices of the cells in the file refer to the file's own attribute table, whose entries are added by the attribute records in order, each preceding the first row that uses it.
+
+        A row record starts with the number of its cells and the size of the rest of the record. The attributes of the cells follow as runs of the attribute index and the number of cells that use it, since consecutive cells mostly share their attributes. Then come the codepoints, including the bits the buffer uses to mark line ends, as variable length integers of 7 bits per byte, so that the text of most rows takes a byte per cell. The record is padded to a multiple of 4 bytes.
+
+        The file is only accessible by the user. Appended records are kept in memory until flushed, so that rows can be appended while holding a lock and written to the disk after it has been released. Since records are only ever appended, a file whose writing was interrupted is valid up to its last complete record. The rows are read from the file mapped into memory. Only the offset of every PAGE_ROWS-th row is kept in memory, rows in between are found by skipping the records that precede them.
+     */
+    class HistoryFile {
+    public:
+
+        /** Number of rows whose offset in the file is not remembered separately.
+         */
+        static constexpr size_t PAGE_ROWS = 256;
+
+        /** Creates the history file of given name.
+
+            The file is not accessed until it is either loaded, or rows are appended to it.
+         */
+        explicit HistoryFile(std::string const & filename):
+            filename_{filename} {
+        }
+
+        std::string const & filename() const {
+            return filename_;
+        }
+
+        /** Size of the file in bytes, including the records not yet flushed.
+         */
+        size_t bytes() const {
+            return bytes_;
+        }
+
+        /** Number of rows in the file.
+         */
+        size_t rows() const {
+            return rows_;
+        }
+
+        /** Number of rows appended since the file was last flushed.
+         */
+        size_t pendingRows() const {
+            return pendingRows_;
+        }
+
+        /** The attribute table of the cells stored in the file.
+         */
+        CompactCell::Attributes const & attributes() const {
+            return attributes_;
+        }
+
+        /** Appends the rows given as an iterator range of pairs of row length and cells (as the terminal's history rows are stored), compacted by the given attribute table.
+
+            The indices of the given table in the file's table are remembered for as long as the version of the given table does not change so that rows can be appended one by one cheaply.
+         */
+        template<typename ITERATOR>
+        void append(ITERATOR begin, ITERATOR end, CompactCell::Attributes const & attributes) {
+            if (attributesVersion_ != attributes.version()) {
+                attributesVersion_ = attributes.version();
+                attributesMap_.clear();
+            }
+            attributesMap_.resize(attributes.size(), NONE);
+            for (; begin != end; ++begin) {
+                CompactCell const * cells = begin->second;
+                int cols = begin->first;
+                runs_.clear();
+                for (int i = 0; i < cols; ++i) {
+                    uint32_t & index = attributesMap_[cells[i].attributes_];
+                    if (index == NONE)
+                        index = addAttributes(attributes.record(cells[i].attributes_));
+                    if (runs_.empty() || runs_.back().first != index)
+                        runs_.push_back(std::make_pair(index, 0));
+                    ++runs_.back().second;
+                }
+                appendRow(cells, cols);
+            }
+        }
+
+        /** Writes all appended records to the disk.
+
+            If the file has been loaded, anything after its last valid record is truncated first.
+         */
+        void flush();
+
+        /** Removes all rows and attributes, truncating the file.
+         */
+        void clear();
+
+        /** Loads the first given number of bytes of the file.
+
+            The file's attribute table is rebuilt and its rows are indexed. Anything after the last complete record is truncated when rows are appended next. If the file does not exist, it is treated as empty. Throws IOError if the file is not a history file, or if it has rows with more cells than their records can hold.
+         */
+        void load(size_t bytes);
+
+        /** Removes given number of the oldest rows by rewriting the file without them.
+
+            The attribute table stays the same.
+         */
+        void removeFirst(size_t rows);
+
+        /** Decodes the rows from first (inclusive) to last (exclusive).
+
+            For each row, the handler is called with the number of its cells and must return the array the cells are decoded into, or nullptr if the row should not be decoded. The attribute indices of the decoded cells refer to the file's attribute table. The file is mapped into memory first, if necessary, flushing any appended records.
+         */
+        template<typename T>
+        void read(size_t first, size_t last, T handler) {
+            ASSERT(first <= last && last <= rows_);
+            if (first == last)
+                return;
+            map();
+            char const * x = mapped_->data() + pages_[first / PAGE_ROWS];
+            for (size_t row = first - first % PAGE_ROWS; row < last; ) {
+                uint32_t cols = ReadWord(x);
+                if (cols == ATTRIBUTES) {
+                    x += ATTRIBUTES_RECORD_SIZE;
+                } else {
+                    if (row >= first) {
+                        CompactCell * cells = handler(static_cast<int>(cols));
+                        if (cells != nullptr)
+                            decodeRow(x, cells);
+                    }
+                    x += 2 * sizeof(uint32_t) + ReadWord(x + sizeof(uint32_t));
+                    ++row;
+                }
+            }
+        }
+
+        /** Releases the memory mapping of the file.
+         */
+        void release() {
+            mapped_.reset();
+        }
+
+    private:
+
+        static constexpr uint32_t NONE = 0xffffffff;
+
+        /** Marker of the attribute records, which can never be a valid row size.
+         */
+        static constexpr uint32_t ATTRIBUTES = 0xffffffff;
+        static constexpr size_t ATTRIBUTES_RECORD_SIZE = sizeof(uint32_t) + sizeof(CompactCell::Attributes::Record);
+
+        static constexpr char MAGIC[4] = { 'T', 'P', 'P', 'H' };
+        static constexpr uint32_t VERSION = 1;
+        static constexpr size_t HEADER_SIZE = sizeof(MAGIC) + sizeof(uint32_t);
+
+        static uint32_t ReadWord(char const * x) {
+            uint32_t result;
+            memcpy(& result, x, sizeof(uint32_t));
+            return result;
+        }
+
+        /** Adds the attributes to the file's table, writing the attribute record if they are new, and returns their index.
+         */
+        uint32_t addAttributes(CompactCell::Attributes::Record const & record);
+
+        /** Appends the row record of given cells, whose attribute runs have already been determined.
+         */
+        void appendRow(CompactCell const * cells, int cols);
+
+        /** Decodes the cells of the row record into the given array, throwing IOError if the record is not valid.
+         */
+        void decodeRow(char const * record, CompactCell * cells) const;
+
+        /** Makes sure that all records of the file are mapped into memory.
+         */
+        void map();
+
+        /** Opens the file for appending, truncating it to the size of the records already on the disk first.
+         */
+        void open();
+
+        /** Writes the header if the file is empty, i.e. it is new, or has been cleared.
+         */
+        void writeHeader() {
+            if (bytes_ == 0) {
+                write(MAGIC, sizeof(MAGIC));
+                write(& VERSION, sizeof(uint32_t));
+            }
+        }
+
+        void write(void const * data, size_t bytes) {
+            pending_.append(static_cast<char const *>(data), bytes);
+            bytes_ += bytes;
+        }
+
+        std::string filename_;
+        std::ofstream file_;
+        size_t bytes_ = 0;
+        size_t rows_ = 0;
+        CompactCell::Attributes attributes_;
+        /** Offsets of every PAGE_ROWS-th row record in the file. */
+        std::vector<size_t> pages_;
+        std::unique_ptr<MappedFile> mapped_;
+        /** Indices in the file's attribute table of the table the rows were last appended from. */
+        std::vector<uint32_t> attributesMap_;
+        uint64_t attributesVersion_ = 0;
+        /** Attribute runs of the row being appended, as pairs of the attribute index and the number of cells. */
+        std::vector<std::pair<uint32_t, uint32_t>> runs_;
+        /** Buffer for the row record being appended. */
+        std::string record_;
+        /** Records appended, but not yet written to the disk, which are the last bytes of the file. */
+        std::string pending_;
+        size_t pendingRows_ = 0;
+
+    }; // ui::HistoryFile
+
+} // namespace ui
@@ -0,0 +1,72 @@
+#include "history_spill.h"
+
+namespace ui {
+
+    HistorySpill::~HistorySpill() {
+        file_.clear();
+        std::error_code ec;
+        std::filesystem::remove(file_.filename(), ec);
+    }
+
+    void HistorySpill::removeFirst(size_t rows) {
+        ASSERT(rows <= this->rows());
+        first_ += rows;
+        if (first_ == file_.rows()) {
+            clear();
+        } else if (first_ >= HistoryFile::PAGE_ROWS && first_ >= this->rows()) {
+            clearCache();
+            file_.removeFirst(first_);
+            first_ = 0;
+        }
+    }
+
+    void HistorySpill::clear() {
+        clearCache();
+        file_.clear();
+        first_ = 0;
+    }
+
+    std::pair<int, CompactCell const *> HistorySpill::row(size_t index) {
+        ASSERT(index < rows());
+        index += first_;
+        Page & p = page(index / HistoryFile::PAGE_ROWS, index);
+        auto const & row = p.rows[index % HistoryFile::PAGE_ROWS];
+        return std::make_pair(row.first, p.cells.data() + row.second);
+    }
+
+    HistorySpill::Page & HistorySpill::page(size_t index, size_t row) {
+        auto i = cache_.find(index);
+        if (i != cache_.end()) {
+            pages_.splice(pages_.begin(), pages_, i->second);
+            if (row % HistoryFile::PAGE_ROWS < pages_.front().rows.size())
+                return pages_.front();
+        } else {
+            if (pages_.size() == MAX_PAGES) {
+                cache_.erase(pages_.back().index);
+                pages_.pop_back();
+            }
+            pages_.push_front(Page{index, {}, {}});
+            cache_.insert(std::make_pair(index, pages_.begin()));
+        }
+        Page & p = pages_.front();
+        p.rows.clear();
+        p.cells.clear();
+        size_t first = index * HistoryFile::PAGE_ROWS;
+        size_t last = std::min(first + HistoryFile::PAGE_ROWS, file_.rows());
+        // determine the sizes of the rows first so that the cells can be decoded in a single array without reallocating it
+        size_t cells = 0;
+        file_.read(first, last, [&](int cols) {
+            p.rows.push_back(std::make_pair(cols, cells));
+            cells += static_cast<size_t>(cols);
+            return nullptr;
+        });
+        p.cells.resize(cells);
+        size_t r = 0;
+        file_.read(first, last, [&](int) {
+            return p.cells.data() + p.rows[r++].second;
+        });
+        pageLoads_.add();
+        return p;
+    }
+
+} // namespace ui
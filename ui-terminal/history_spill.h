@@ -0,0 +1,110 @@
+#pragma once
+
+#include <list>
+#include <unordered_map>
+
+#include "helpers/metrics.h"
+
+#include "history_file.h"
+
+namespace ui {
+
+    /** The oldest history rows of a terminal, kept on the disk instead of in memory.
+
+        The rows are appended to a history file as they are spilled from the terminal's in-memory history and read back in pages of HistoryFile::PAGE_ROWS rows when they are displayed or selected. The last MAX_PAGES decoded pages are cached, the least recently used page is evicted first.
+
+        The spilled rows are written to the disk a page at a time, so that the terminal, which spills the rows while holding its lock, does not write to the file for every row that scrolls out. Pages are also written whenever rows are read.
+
+        Rows removed from the start of the spill are only skipped at first. Once at least as many rows were removed as remain, the file is rewritten without them, so that the file stays at most twice as large as the spilled rows and each row is copied only a constant number of times on average. The file is deleted when the spill is destroyed.
+     */
+    class HistorySpill {
+    public:
+
+        static constexpr size_t MAX_PAGES = 16;
+
+        /** Creates the spill in the given file, counting the pages read from it in given counter.
+         */
+        HistorySpill(std::string const & filename, Metrics::Counter & pageLoads):
+            file_{filename},
+            pageLoads_{pageLoads} {
+        }
+
+        ~HistorySpill();
+
+        std::string const & filename() const {
+            return file_.filename();
+        }
+
+        /** Number of the spilled rows.
+         */
+        size_t rows() const {
+            return file_.rows() - first_;
+        }
+
+        /** Size of the spill file in bytes.
+         */
+        size_t bytes() const {
+            return file_.bytes();
+        }
+
+        /** The attribute table the cells of the spilled rows refer to.
+         */
+        CompactCell::Attributes const & attributes() const {
+            return file_.attributes();
+        }
+
+        /** Appends the rows, given as an iterator range of pairs of row length and cells compacted by the given attribute table.
+         */
+        template<typename ITERATOR>
+        void append(ITERATOR begin, ITERATOR end, CompactCell::Attributes const & attributes) {
+            file_.append(begin, end, attributes);
+            if (file_.pendingRows() >= HistoryFile::PAGE_ROWS)
+                file_.flush();
+        }
+
+        /** Removes given number of the oldest spilled rows.
+
+            The file is rewritten by the caller, i.e. when the terminal trims its history the rewrite happens under the terminal's lock. While the rewrite is amortized over the removed rows, a single rewrite copies all remaining spilled rows, i.e. up to the terminal's maximum history size.
+         */
+        void removeFirst(size_t rows);
+
+        /** Removes all spilled rows.
+         */
+        void clear();
+
+        /** Returns the length and cells of the spilled row at given index.
+
+            The cells refer to the spill's attribute table and are valid until the spill is modified, or another row is requested.
+         */
+        std::pair<int, CompactCell const *> row(size_t index);
+
+    private:
+
+        /** Decoded rows of a page, as pairs of the row length and the offset of their first cell.
+         */
+        struct Page {
+            size_t index;
+            std::vector<std::pair<int, size_t>> rows;
+            std::vector<CompactCell> cells;
+        };
+
+        /** Returns the decoded page of given index, loading it from the file if it is not cached, or if it is missing the given row because the page was not full when decoded.
+         */
+        Page & page(size_t index, size_t row);
+
+        void clearCache() {
+            pages_.clear();
+            cache_.clear();
+        }
+
+        HistoryFile file_;
+        Metrics::Counter & pageLoads_;
+        /** Number of the rows at the start of the file that were already removed. */
+        size_t first_ = 0;
+        /** The cached pages, most recently used first. */
+        std::list<Page> pages_;
+        std::unordered_map<size_t, std::list<Page>::iterator> cache_;
+
+    }; // ui::HistorySpill
+
+} // namespace ui
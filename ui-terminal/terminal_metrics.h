@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+
+#include "helpers/metrics.h"
+
+namespace ui {
+
+    /** Performance counters of a single terminal.
+
+        The input counters are updated by the thread that processes the terminal input, the repaints by the UI thread. The buffer lock is measured from both threads, distinguished by the `thread` label. Each terminal is identified by a unique `terminal` label, the owner of the terminal may add more labels, such as the session name.
+     */
+    class TerminalMetrics : public Metrics::Group {
+    public:
+
+        TerminalMetrics() {
+            setLabel("terminal", std::to_string(NextId()));
+        }
+
+        Metrics::Counter bytes{*this, "tpp_terminal_input_bytes_total", "Bytes of the terminal input processed"};
+
+        Metrics::Counter codepoints{*this, "tpp_terminal_input_total", "Terminal input processed by kind", "kind=\"codepoint\""};
+        Metrics::Counter controls{*this, "tpp_terminal_input_total", "Terminal input processed by kind", "kind=\"control\""};
+        Metrics::Counter escapes{*this, "tpp_terminal_input_total", "Terminal input processed by kind", "kind=\"esc\""};
+        Metrics::Counter csi{*this, "tpp_terminal_input_total", "Terminal input processed by kind", "kind=\"csi\""};
+        Metrics::Counter osc{*this, "tpp_terminal_input_total", "Terminal input processed by kind", "kind=\"osc\""};
+        Metrics::Counter tpp{*this, "tpp_terminal_input_total", "Terminal input processed by kind", "kind=\"tpp\""};
+
+        Metrics::Histogram parseTime{*this, "tpp_terminal_parse_seconds", "Time to process a batch of terminal input", 1e-6};
+        /** The sum of the histogram is the CPU time the terminal's input processing has used so far. */
+        Metrics::Histogram inputCpu{*this, "tpp_terminal_input_cpu_seconds", "CPU time used to process a batch of terminal input, including publishing it for painting", 1e-6};
+
+        Metrics::Histogram inputLockWait{*this, "tpp_terminal_lock_wait_seconds", "Time spent waiting for the terminal buffer lock", 1e-6, "thread=\"input\""};
+        Metrics::Histogram paintLockWait{*this, "tpp_terminal_lock_wait_seconds", "Time spent waiting for the terminal buffer lock", 1e-6, "thread=\"ui\""};
+        Metrics::Histogram inputLockHold{*this, "tpp_terminal_lock_hold_seconds", "Time the terminal buffer lock was held", 1e-6, "thread=\"input\""};
+        Metrics::Histogram paintLockHold{*this, "tpp_terminal_lock_hold_seconds", "Time the terminal buffer lock was held", 1e-6, "thread=\"ui\""};
+
+        Metrics::Gauge historyRows{*this, "tpp_terminal_history_rows", "Rows in the terminal history"};
+        Metrics::Gauge historyBytes{*this, "tpp_terminal_history_bytes", "Memory used by the terminal history cells and their attributes"};
+        Metrics::Gauge historySpilledRows{*this, "tpp_terminal_history_spilled_rows", "Rows of the terminal history spilled to the disk"};
+        Metrics::Gauge historySpillBytes{*this, "tpp_terminal_history_spill_bytes", "Size of the file the terminal history rows are spilled to"};
+        Metrics::Counter historyPageLoads{*this, "tpp_terminal_history_page_loads_total", "Pages of spilled history rows read back from the disk"};
+
+        Metrics::Counter repaints{*this, "tpp_terminal_repaints_total", "Number of times the terminal was painted"};
+        Metrics::Gauge hidden{*this, "tpp_terminal_hidden", "1 if the terminal is hidden, such as an inactive tab, and only parses its input"};
+
+    private:
+
+        static unsigned NextId() {
+            static std::atomic<unsigned> id{0};
+            return ++id;
+        }
+
+    }; // ui::TerminalMetrics
+
+} // namespace ui
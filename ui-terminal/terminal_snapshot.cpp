@@ -0,0 +1,270 @@
+#include "terminal_snapshot.h"
+
+namespace ui {
+
+    namespace {
+
+        template<typename T>
+        void Write(std::string & into, T const & value) {
+            static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be written as they are");
+            into.append(pointer_cast<char const *>(& value), sizeof(T));
+        }
+
+        /** Reads values from the state file, throwing IOError if the file is shorter than expected.
+         */
+        class Reader {
+        public:
+            Reader(std::string const & data, std::string const & filename):
+                x_{data.c_str()},
+                end_{data.c_str() + data.size()},
+                filename_{filename} {
+            }
+
+            template<typename T>
+            T read() {
+                static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be read as they are");
+                if (static_cast<size_t>(end_ - x_) < sizeof(T))
+                    THROW(IOError()) << "Truncated terminal snapshot " << filename_;
+                T result;
+                memcpy(static_cast<void *>(& result), x_, sizeof(T));
+                x_ += sizeof(T);
+                return result;
+            }
+
+            /** Returns true if there are at least given number of values of given type left to read.
+             */
+            template<typename T>
+            bool hasValues(size_t count) const {
+                return static_cast<size_t>(end_ - x_) / sizeof(T) >= count;
+            }
+
+            /** Reads a compact cell, throwing IOError if its attributes are not in the given table.
+             */
+            CompactCell readCell(CompactCell::Attributes const & attributes) {
+                CompactCell result = read<CompactCell>();
+                if (! attributes.contains(result))
+                    THROW(IOError()) << "Invalid cell attributes in terminal snapshot " << filename_;
+                return result;
+            }
+
+        private:
+            char const * x_;
+            char const * end_;
+            std::string const & filename_;
+        };
+
+        void WriteState(std::string & into, AnsiTerminal::State const & state, CompactCell::Attributes & attributes) {
+            AnsiTerminal::Buffer const & buffer = state.buffer;
+            Write<int32_t>(into, buffer.width());
+            Write<int32_t>(into, buffer.height());
+            Write<int32_t>(into, buffer.cursorPosition().x());
+            Write<int32_t>(into, buffer.cursorPosition().y());
+            Write<int32_t>(into, state.scrollStart);
+            Write<int32_t>(into, state.scrollEnd);
+            Write<uint8_t>(into, state.inverseMode);
+            Write<uint8_t>(into, state.bold);
+            Canvas::Cursor const & cursor = buffer.cursor();
+            Write<char32_t>(into, cursor.codepoint());
+            Write<uint8_t>(into, cursor.visible());
+            Write<uint8_t>(into, cursor.blink());
+            Write<Color>(into, cursor.color());
+            Write<CompactCell>(into, attributes.compact(state.cell));
+            for (int row = 0, rows = buffer.height(); row < rows; ++row)
+                for (int col = 0, cols = buffer.width(); col < cols; ++col)
+                    Write<CompactCell>(into, attributes.compact(buffer.at(Point{col, row})));
+        }
+
+        AnsiTerminal::State * ReadState(Reader & reader, CompactCell::Attributes const & attributes, Color defaultBackground) {
+            int cols = reader.read<int32_t>();
+            int rows = reader.read<int32_t>();
+            if (cols <= 0 || rows <= 0)
+                THROW(IOError()) << "Invalid terminal snapshot buffer size " << cols << "x" << rows;
+            // the size is checked against the data before the buffer is allocated
+            if (! reader.hasValues<CompactCell>(static_cast<size_t>(cols) * static_cast<size_t>(rows)))
+                THROW(IOError()) << "Truncated terminal snapshot buffer of size " << cols << "x" << rows;
+            int cursorX = reader.read<int32_t>();
+            int cursorY = reader.read<int32_t>();
+            // the cursor is past the last column after a character has been written there
+            if (cursorX < 0 || cursorX > cols || cursorY < 0 || cursorY >= rows)
+                THROW(IOError()) << "Invalid terminal snapshot cursor position " << cursorX << ", " << cursorY;
+            int scrollStart = reader.read<int32_t>();
+            int scrollEnd = reader.read<int32_t>();
+            if (scrollStart < 0 || scrollStart >= scrollEnd || scrollEnd > rows)
+                THROW(IOError()) << "Invalid terminal snapshot scroll region " << scrollStart << " - " << scrollEnd;
+            std::unique_ptr<AnsiTerminal::State> state{new AnsiTerminal::State{Size{cols, rows}, defaultBackground}};
+            state->scrollStart = scrollStart;
+            state->scrollEnd = scrollEnd;
+            state->inverseMode = reader.read<uint8_t>();
+            state->bold = reader.read<uint8_t>();
+            Canvas::Cursor cursor;
+            cursor.setCodepoint(reader.read<char32_t>());
+            cursor.setVisible(reader.read<uint8_t>());
+            cursor.setBlink(reader.read<uint8_t>());
+            cursor.setColor(reader.read<Color>());
+            state->buffer.setCursor(cursor, Point{cursorX, cursorY});
+            state->cell = attributes.cell(reader.readCell(attributes));
+            for (int row = 0; row < rows; ++row)
+                for (int col = 0; col < cols; ++col)
+                    state->buffer.set(Point{col, row}, attributes.cell(reader.readCell(attributes)));
+            return state.release();
+        }
+
+    }
+
+    /** The new history rows and the state are encoded in memory while the terminal's buffer is locked and written to the disk only after the lock has been released, so that the terminal is not blocked by the disk. The history file is written first so that the state file never refers to history rows that are not on the disk yet. The state file is written to a temporary file and then renamed so that an interrupted save leaves the previous snapshot intact.
+     */
+    void TerminalSnapshot::save(AnsiTerminal & terminal) {
+        std::string result;
+        {
+            std::lock_guard<PriorityLock> g{terminal.bufferLock_};
+            saveHistory(terminal);
+            AnsiTerminal::Palette const & palette = terminal.palette_;
+            result.append(MAGIC, sizeof(MAGIC));
+            Write<uint32_t>(result, VERSION);
+            Write<uint64_t>(result, history_.bytes());
+            Write<uint32_t>(result, static_cast<uint32_t>(palette.size()));
+            for (size_t i = 0, e = palette.size(); i < e; ++i)
+                Write<Color>(result, palette[i]);
+            Write<Color>(result, palette.defaultForeground());
+            Write<Color>(result, palette.defaultBackground());
+            Write<uint8_t>(result, static_cast<uint8_t>(terminal.cursorMode_));
+            Write<uint8_t>(result, static_cast<uint8_t>(terminal.keypadMode_));
+            Write<uint8_t>(result, static_cast<uint8_t>(terminal.mouseMode_));
+            Write<uint8_t>(result, static_cast<uint8_t>(terminal.mouseEncoding_));
+            Write<uint8_t>(result, terminal.lineDrawingSet_);
+            Write<uint8_t>(result, terminal.bracketedPaste_);
+            Write<uint8_t>(result, terminal.alternateMode_);
+            // the buffers are compacted first so that the attribute table can precede them
+            CompactCell::Attributes attributes;
+            std::string states;
+            WriteState(states, *terminal.state_, attributes);
+            WriteState(states, *terminal.stateBackup_, attributes);
+            Write<uint32_t>(result, static_cast<uint32_t>(attributes.size()));
+            for (size_t i = 0, e = attributes.size(); i < e; ++i)
+                Write<CompactCell::Attributes::Record>(result, attributes.record(static_cast<uint32_t>(i)));
+            result += states;
+        }
+        history_.flush();
+        std::string tmp = filename_ + ".tmp";
+        {
+            std::ofstream f{tmp, std::ios::out | std::ios::binary | std::ios::trunc};
+            f.write(result.c_str(), result.size());
+            f.close();
+            OSCHECK(f.good()) << "Unable to write terminal snapshot " << tmp;
+        }
+        Rename(tmp, filename_);
+        stateBytes_ = result.size();
+    }
+
+    bool TerminalSnapshot::restore(AnsiTerminal & terminal) {
+        if (! PathExists(filename_))
+            return false;
+        std::string data = ReadEntireFile(filename_);
+        Reader reader{data, filename_};
+        char magic[4];
+        for (char & c : magic)
+            c = reader.read<char>();
+        if (memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || reader.read<uint32_t>() != VERSION)
+            THROW(IOError()) << "Not a terminal snapshot: " << filename_;
+        size_t historyBytes = static_cast<size_t>(reader.read<uint64_t>());
+        uint32_t paletteSize = reader.read<uint32_t>();
+        // the terminal indexes the palette with the color numbers of the sequences it receives, which the palette of the terminal is known to accept
+        if (paletteSize != terminal.palette_.size() || ! reader.hasValues<Color>(paletteSize))
+            THROW(IOError()) << "Invalid terminal snapshot palette size " << paletteSize;
+        AnsiTerminal::Palette palette(paletteSize);
+        for (uint32_t i = 0; i < paletteSize; ++i)
+            palette.setColor(i, reader.read<Color>());
+        palette.setDefaultForeground(reader.read<Color>());
+        palette.setDefaultBackground(reader.read<Color>());
+        AnsiTerminal::CursorMode cursorMode = static_cast<AnsiTerminal::CursorMode>(reader.read<uint8_t>());
+        AnsiTerminal::KeypadMode keypadMode = static_cast<AnsiTerminal::KeypadMode>(reader.read<uint8_t>());
+        AnsiTerminal::MouseMode mouseMode = static_cast<AnsiTerminal::MouseMode>(reader.read<uint8_t>());
+        AnsiTerminal::MouseEncoding mouseEncoding = static_cast<AnsiTerminal::MouseEncoding>(reader.read<uint8_t>());
+        bool lineDrawingSet = reader.read<uint8_t>();
+        bool bracketedPaste = reader.read<uint8_t>();
+        bool alternateMode = reader.read<uint8_t>();
+        CompactCell::Attributes attributes;
+        uint32_t numAttributes = reader.read<uint32_t>();
+        if (! reader.hasValues<CompactCell::Attributes::Record>(numAttributes))
+            THROW(IOError()) << "Truncated terminal snapshot attributes " << filename_;
+        for (uint32_t i = 0; i < numAttributes; ++i)
+            attributes.add(reader.read<CompactCell::Attributes::Record>());
+        std::unique_ptr<AnsiTerminal::State> state{ReadState(reader, attributes, palette.defaultBackground())};
+        std::unique_ptr<AnsiTerminal::State> stateBackup{ReadState(reader, attributes, palette.defaultBackground())};
+        history_.load(historyBytes);
+        {
+            std::lock_guard<PriorityLock> g{terminal.bufferLock_};
+            terminal.palette_ = palette;
+            terminal.cursorMode_ = cursorMode;
+            terminal.keypadMode_ = keypadMode;
+            terminal.mouseMode_ = mouseMode;
+            terminal.mouseEncoding_ = mouseEncoding;
+            terminal.lineDrawingSet_ = lineDrawingSet;
+            terminal.bracketedPaste_ = bracketedPaste;
+            terminal.alternateMode_ = alternateMode;
+            delete terminal.state_;
+            delete terminal.stateBackup_;
+            terminal.state_ = state.release();
+            terminal.stateBackup_ = stateBackup.release();
+            // replace the history, the attribute table of the history file becomes the history's attribute table so that the cells can be decoded as they are
+            for (auto & row : terminal.historyRows_)
+                delete [] row.second;
+            terminal.historyRows_.clear();
+            terminal.historyCells_ = 0;
+            if (terminal.historySpill_ != nullptr)
+                terminal.historySpill_->clear();
+            terminal.historyAttributes_ = CompactCell::Attributes{};
+            for (size_t i = 0, e = history_.attributes().size(); i < e; ++i)
+                terminal.historyAttributes_.add(history_.attributes().record(static_cast<uint32_t>(i)));
+            // the rows are read a page at a time so that rows over the terminal's memory budget can be spilled as they are restored
+            size_t maxRows = static_cast<size_t>(terminal.maxHistoryRows_);
+            for (size_t i = history_.rows() > maxRows ? history_.rows() - maxRows : 0, e = history_.rows(); i < e; i += HistoryFile::PAGE_ROWS) {
+                history_.read(i, std::min(i + HistoryFile::PAGE_ROWS, e), [&](int cols) {
+                    CompactCell * cells = new CompactCell[cols];
+                    terminal.historyRows_.push_back(std::make_pair(cols, cells));
+                    terminal.historyCells_ += cols;
+                    return cells;
+                });
+                terminal.trimHistory();
+            }
+            history_.release();
+            terminal.trimHistory();
+            savedRows_ = terminal.historyRowsAdded_;
+            savedVersion_ = terminal.historyVersion_;
+            // the buffers were restored in their original size, which may differ from the current size of the terminal
+            Size size = terminal.rect().size();
+            if (size.width() > 0 && size.height() > 0 && size != terminal.state_->buffer.size()) {
+                terminal.resizeHistory();
+                terminal.resizeBuffers(size);
+            }
+            terminal.publishSnapshot(true);
+        }
+        stateBytes_ = data.size();
+        if (terminal.scrollToTerminal_)
+            terminal.setScrollOffset(Point{0, terminal.historyRows()});
+        terminal.repaint();
+        return true;
+    }
+
+    /** Appends the rows added to the terminal's history since the last save, which are the last rows of the history. If some of the added rows were already trimmed from the history, if the history rows have been rewrapped, or if the file would be more than twice as large as the history, the history file is rewritten instead.
+
+        The rows are appended one by one as the rows spilled to the disk refer to a different attribute table than the rows in memory. The appended rows are only encoded, the caller flushes them to the disk.
+     */
+    void TerminalSnapshot::saveHistory(AnsiTerminal & terminal) {
+        size_t rows = terminal.spilledHistoryRows() + terminal.historyRows_.size();
+        uint64_t added = terminal.historyRowsAdded_ - savedRows_;
+        size_t first = 0;
+        if (terminal.historyVersion_ != savedVersion_ || added > rows || history_.rows() + added > 2 * rows)
+            history_.clear();
+        else
+            first = rows - static_cast<size_t>(added);
+        for (size_t i = first; i < rows; ++i) {
+            AnsiTerminal::HistoryRow row = terminal.historyRow(static_cast<int>(i));
+            std::pair<int, CompactCell const *> cells{row.cols, row.cells};
+            history_.append(& cells, & cells + 1, *row.attributes);
+        }
+        savedRows_ = terminal.historyRowsAdded_;
+        savedVersion_ = terminal.historyVersion_;
+    }
+
+} // namespace ui
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+
+#include "history_file.h"
+#include "ansi_terminal.h"
+
+namespace ui {
+
+    /** Snapshot of a terminal's state on disk, from which the terminal can be restored after its process has been terminated.
+
+        The snapshot consists of two files. The state file contains the palette, the terminal modes and both buffers together with their cursors and is rewritten on every save. The history rows are stored separately in a history file of the same name with the `.history` extension, to which only the rows added to the terminal's history since the last save are appended. The state file records how much of the history file was valid at the time of the save so that the two files are always restored consistently.
+
+        To keep the history file from growing indefinitely, it is rewritten from the terminal's history when it contains twice as many rows as the terminal's history can hold, or when the terminal's history rows were rewrapped since the last save.
+
+        The files are stored in the native byte order and cell layout and are therefore not portable across platforms. Special objects, such as hyperlinks, are not stored.
+     */
+    class TerminalSnapshot {
+    public:
+
+        explicit TerminalSnapshot(std::string const & filename):
+            filename_{filename},
+            history_{filename + ".history"} {
+        }
+
+        std::string const & filename() const {
+            return filename_;
+        }
+
+        /** Total size of the snapshot files on disk.
+         */
+        size_t bytes() const {
+            return stateBytes_ + history_.bytes();
+        }
+
+        /** Saves the state of the terminal.
+
+            Only the history rows added since the last save, or restore, are written unless the history file must be rewritten.
+         */
+        void save(AnsiTerminal & terminal);
+
+        /** Restores the terminal from the snapshot, returning false if there is no snapshot to restore from.
+
+            The buffers are restored in the size they were saved in and then resized to the terminal's current size, if it differs. Only as many of the most recent history rows as the terminal's history can hold are restored. Throws IOError if the snapshot files are not valid.
+         */
+        bool restore(AnsiTerminal & terminal);
+
+    private:
+
+        static constexpr char MAGIC[4] = { 'T', 'P', 'P', 'S' };
+        static constexpr uint32_t VERSION = 1;
+
+        void saveHistory(AnsiTerminal & terminal);
+
+        std::string filename_;
+        HistoryFile history_;
+        size_t stateBytes_ = 0;
+        /** Number of rows the terminal had added to its history at the time of the last save. */
+        uint64_t savedRows_ = 0;
+        /** Version of the terminal's history rows at the time of the last save. */
+        uint64_t savedVersion_ = 0;
+
+    }; // ui::TerminalSnapshot
+
+} // namespace ui
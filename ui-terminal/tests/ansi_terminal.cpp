@@ -0,0 +1,476 @@
+#include <condition_variable>
+#include <mutex>
+
+#include "helpers/tests.h"
+
+#include "helpers/filesystem.h"
+
+#include "../ansi_terminal.h"
+#include "../terminal_snapshot.h"
+
+using namespace ui;
+
+namespace {
+
+    /** Pseudoterminal that never receives anything so that the test can feed the terminal input directly.
+     */
+    class IdlePTY : public tpp::PTYMaster {
+    public:
+
+        void send(char const * buffer, size_t numBytes) override {
+            MARK_AS_UNUSED(buffer);
+            MARK_AS_UNUSED(numBytes);
+        }
+
+        size_t receive(char * buffer, size_t bufferSize) override {
+            MARK_AS_UNUSED(buffer);
+            MARK_AS_UNUSED(bufferSize);
+            std::unique_lock<std::mutex> g{m_};
+            while (! terminated_)
+                cv_.wait(g);
+            return 0;
+        }
+
+        void terminate() override {
+            std::lock_guard<std::mutex> g{m_};
+            terminated_ = true;
+            cv_.notify_all();
+        }
+
+        void resize(int cols, int rows) override {
+            MARK_AS_UNUSED(cols);
+            MARK_AS_UNUSED(rows);
+        }
+
+    private:
+        std::mutex m_;
+        std::condition_variable cv_;
+    };
+
+    class TestTerminal : public AnsiTerminal {
+    public:
+        TestTerminal(Size size):
+            AnsiTerminal{new IdlePTY{}, Palette::XTerm256()} {
+            setDetectHyperlinks();
+            resize(size);
+        }
+
+        void input(std::string const & text) {
+            received(const_cast<char *>(text.c_str()), text.c_str() + text.size());
+        }
+
+        /** Returns the url of the hyperlink at given terminal buffer coordinates, detecting the hyperlinks first.
+         */
+        std::string urlAt(Point p) {
+            std::lock_guard<PriorityLock> g{bufferLock_};
+            detectHyperlinks();
+            Hyperlink * link = dynamic_cast<Hyperlink *>(const_cast<Buffer const &>(state_->buffer).at(p).specialObject());
+            return link == nullptr ? "" : link->url();
+        }
+
+        /** Returns a copy of the terminal buffer cell at given coordinates.
+         */
+        Cell cellAt(Point p) {
+            std::lock_guard<PriorityLock> g{bufferLock_};
+            Cell result;
+            result.stripSpecialObjectAndAssign(const_cast<Buffer const &>(state_->buffer).at(p));
+            return result;
+        }
+
+        /** Returns the text of given terminal buffer row, without trailing spaces.
+         */
+        std::string row(int row) {
+            std::lock_guard<PriorityLock> g{bufferLock_};
+            Buffer const & buffer = state_->buffer;
+            std::string result;
+            for (int col = 0; col < buffer.width(); ++col)
+                result += static_cast<char>(buffer.at(Point{col, row}).codepoint());
+            return result.substr(0, result.find_last_not_of(' ') + 1);
+        }
+
+        /** Returns the text of given history row, which may be spilled to the disk.
+         */
+        std::string historyRow(int row) {
+            std::lock_guard<PriorityLock> g{bufferLock_};
+            HistoryRow stored = AnsiTerminal::historyRow(row);
+            std::string result;
+            for (int col = 0; col < stored.cols; ++col)
+                result += static_cast<char>(stored.attributes->cell(stored.cells[col]).codepoint());
+            return result;
+        }
+
+        bool bracketedPaste() const {
+            return bracketedPaste_;
+        }
+
+        /** Returns the text of given row of the snapshot that would be painted next.
+         */
+        std::string paintedRow(int row) {
+            Canvas::Buffer const & buffer = acquireSnapshot().buffer;
+            std::string result;
+            for (int col = 0; col < buffer.width(); ++col) {
+                char32_t c = buffer.at(Point{col, row}).codepoint();
+                if (c != ' ' && c != 0)
+                    result += static_cast<char>(c);
+            }
+            return result;
+        }
+    };
+
+}
+
+TEST(ansi_terminal, hyperlinkDetection) {
+    TestTerminal t{Size{40, 5}};
+    t.input("see https://terminalpp.com/docs here\r\n");
+    EXPECT_EQ(t.urlAt(Point{3, 0}), "");
+    EXPECT_EQ(t.urlAt(Point{4, 0}), "https://terminalpp.com/docs");
+    EXPECT_EQ(t.urlAt(Point{30, 0}), "https://terminalpp.com/docs");
+    EXPECT_EQ(t.urlAt(Point{31, 0}), "");
+}
+
+TEST(ansi_terminal, hyperlinkDetectionWrapped) {
+    TestTerminal t{Size{20, 5}};
+    t.input("go to https://terminalpp.com\r\n");
+    EXPECT_EQ(t.urlAt(Point{6, 0}), "https://terminalpp.com");
+    EXPECT_EQ(t.urlAt(Point{7, 1}), "https://terminalpp.com");
+}
+
+TEST(ansi_terminal, hyperlinkDetectionChangedRow) {
+    TestTerminal t{Size{40, 5}};
+    t.input("https://terminalpp.com\r\n");
+    EXPECT_EQ(t.urlAt(Point{0, 0}), "https://terminalpp.com");
+    // rewrite the row, moving the url
+    t.input("\033[1;1H\033[2Kfoo https://github.com\r\n");
+    EXPECT_EQ(t.urlAt(Point{0, 0}), "");
+    EXPECT_EQ(t.urlAt(Point{4, 0}), "https://github.com");
+}
+
+TEST(ansi_terminal, hiddenTerminalPublishesWhenShown) {
+    TestTerminal t{Size{40, 5}};
+    t.input("foo");
+    EXPECT_EQ(t.paintedRow(0), "foo");
+    t.setVisible(false);
+    t.input("bar");
+    EXPECT_EQ(t.paintedRow(0), "foo");
+    t.setVisible(true);
+    EXPECT_EQ(t.paintedRow(0), "foobar");
+}
+
+TEST(ansi_terminal, sgrColors) {
+    TestTerminal t{Size{40, 5}};
+    t.input("\033[38;2;1;2;3;48;5;4mA\033[mB\033[1;3;4mC\033[22;23;24;32mD");
+    Canvas::Cell a = t.cellAt(Point{0, 0});
+    EXPECT_EQ(a.fg(), Color(1, 2, 3));
+    EXPECT_EQ(a.bg(), t.palette().at(4));
+    Canvas::Cell b = t.cellAt(Point{1, 0});
+    EXPECT_EQ(b.fg(), t.palette().defaultForeground());
+    EXPECT_EQ(b.bg(), t.palette().defaultBackground());
+    Canvas::Cell c = t.cellAt(Point{2, 0});
+    EXPECT(c.font().bold());
+    EXPECT(c.font().italic());
+    EXPECT(c.font().underline());
+    Canvas::Cell d = t.cellAt(Point{3, 0});
+    EXPECT(! d.font().bold());
+    EXPECT(! d.font().italic());
+    EXPECT(! d.font().underline());
+    EXPECT_EQ(d.fg(), t.palette().at(2));
+}
+
+TEST(ansi_terminal, sgrLongSequence) {
+    // too many arguments for the SGR fast path
+    TestTerminal t{Size{40, 5}};
+    t.input("\033[3;3;3;3;3;3;3;3;3;3;3;3;3;3;3;3;3;38;2;4;5;6mX");
+    Canvas::Cell x = t.cellAt(Point{0, 0});
+    EXPECT(x.codepoint() == 'X');
+    EXPECT(x.font().italic());
+    EXPECT_EQ(x.fg(), Color(4, 5, 6));
+}
+
+TEST(ansi_terminal, invalidUTF8Replaced) {
+    TestTerminal t{Size{40, 5}};
+    t.input("a\xff\xe4\xbd" "b");
+    EXPECT(t.cellAt(Point{0, 0}).codepoint() == 'a');
+    EXPECT(t.cellAt(Point{1, 0}).codepoint() == Char::REPLACEMENT);
+    EXPECT(t.cellAt(Point{2, 0}).codepoint() == Char::REPLACEMENT);
+    EXPECT(t.cellAt(Point{3, 0}).codepoint() == 'b');
+}
+
+TEST(ansi_terminal, wideCharacters) {
+    TestTerminal t{Size{4, 5}};
+    t.input("\xe4\xbd\xa0" "a\xe4\xbd\xa0");
+    EXPECT(t.cellAt(Point{0, 0}).codepoint() == 0x4f60);
+    EXPECT(t.cellAt(Point{0, 0}).font().doubleWidth());
+    EXPECT(t.cellAt(Point{2, 0}).codepoint() == 'a');
+    // the second wide character does not fit on the line and wraps
+    EXPECT(t.cellAt(Point{0, 1}).codepoint() == 0x4f60);
+    // overwriting the right half of a wide character erases it
+    t.input("\033[1;2Hb");
+    EXPECT(t.cellAt(Point{0, 0}).codepoint() == ' ');
+    EXPECT(! t.cellAt(Point{0, 0}).font().doubleWidth());
+    EXPECT(t.cellAt(Point{1, 0}).codepoint() == 'b');
+}
+
+TEST(ansi_terminal, graphemeClusters) {
+    TestTerminal t{Size{40, 5}};
+    // combining acute accent, then family emoji joined by zero width joiners
+    t.input("e\xcc\x81x\xf0\x9f\x91\xa8\xe2\x80\x8d\xf0\x9f\x91\xa9\xe2\x80\x8d\xf0\x9f\x91\xa7y");
+    EXPECT(t.cellAt(Point{0, 0}).codepoint() == 'e');
+    EXPECT(t.cellAt(Point{1, 0}).codepoint() == 'x');
+    EXPECT(t.cellAt(Point{2, 0}).codepoint() == 0x1f468);
+    EXPECT(t.cellAt(Point{4, 0}).codepoint() == 'y');
+    // the joiner does not join characters across cursor movement
+    t.input("\r\n\xe2\x80\x8d\r\nz");
+    EXPECT(t.cellAt(Point{0, 2}).codepoint() == 'z');
+}
+
+TEST(ansi_terminal, graphemeClusterEndedByControls) {
+    TestTerminal t{Size{40, 5}};
+    // the joiner at the start of the line is followed by a character at the same position after the carriage return
+    t.input("\xe2\x80\x8d\rz");
+    EXPECT(t.cellAt(Point{0, 0}).codepoint() == 'z');
+    // the same for cursor movement by escape sequences
+    t.input("\033[2;5H\xe2\x80\x8d\033[2;5Hw");
+    EXPECT(t.cellAt(Point{4, 1}).codepoint() == 'w');
+}
+
+TEST(ansi_terminal, snapshotRestore) {
+    std::string filename = (std::filesystem::path{TempDir()} / UniqueNameIn(TempDir(), "tpp-snapshot-")).string();
+    {
+        TestTerminal t{Size{20, 4}};
+        t.setMaxHistoryRows(100);
+        for (int i = 0; i < 10; ++i)
+            t.input(STR("line " << i << "\r\n"));
+        t.input("\033[?2004h\033[38;2;1;2;3mfoo");
+        TerminalSnapshot s{filename};
+        s.save(t);
+    }
+    TestTerminal t{Size{20, 4}};
+    t.setMaxHistoryRows(100);
+    TerminalSnapshot s{filename};
+    EXPECT(s.restore(t));
+    EXPECT_EQ(t.historyRows(), 7);
+    EXPECT_EQ(t.historyRow(0), "line 0");
+    EXPECT_EQ(t.historyRow(6), "line 6");
+    EXPECT_EQ(t.row(2), "line 9");
+    EXPECT_EQ(t.row(3), "foo");
+    EXPECT_EQ(t.cellAt(Point{0, 3}).fg(), Color(1, 2, 3));
+    EXPECT(t.bracketedPaste());
+    // the cursor and current attributes are restored as well
+    t.input("bar");
+    EXPECT_EQ(t.row(3), "foobar");
+    EXPECT_EQ(t.cellAt(Point{3, 3}).fg(), Color(1, 2, 3));
+    std::filesystem::remove(filename);
+    std::filesystem::remove(filename + ".history");
+}
+
+TEST(ansi_terminal, snapshotAppendsHistory) {
+    std::string filename = (std::filesystem::path{TempDir()} / UniqueNameIn(TempDir(), "tpp-snapshot-")).string();
+    {
+        TestTerminal t{Size{20, 4}};
+        t.setMaxHistoryRows(100);
+        TerminalSnapshot s{filename};
+        for (int i = 0; i < 10; ++i)
+            t.input(STR("line " << i << "\r\n"));
+        s.save(t);
+        std::string history = ReadEntireFile(filename + ".history");
+        for (int i = 10; i < 20; ++i)
+            t.input(STR("line " << i << "\r\n"));
+        s.save(t);
+        // only the new rows are appended to the history file
+        std::string appended = ReadEntireFile(filename + ".history");
+        EXPECT(appended.size() > history.size());
+        EXPECT(appended.substr(0, history.size()) == history);
+    }
+    // restoring into a terminal with shorter history keeps only the latest rows
+    TestTerminal t{Size{20, 4}};
+    t.setMaxHistoryRows(5);
+    TerminalSnapshot s{filename};
+    EXPECT(s.restore(t));
+    EXPECT_EQ(t.historyRows(), 5);
+    EXPECT_EQ(t.historyRow(0), "line 12");
+    EXPECT_EQ(t.historyRow(4), "line 16");
+    std::filesystem::remove(filename);
+    std::filesystem::remove(filename + ".history");
+}
+
+TEST(ansi_terminal, snapshotMissing) {
+    TestTerminal t{Size{20, 4}};
+    TerminalSnapshot s{(std::filesystem::path{TempDir()} / UniqueNameIn(TempDir(), "tpp-snapshot-")).string()};
+    EXPECT(! s.restore(t));
+}
+
+TEST(ansi_terminal, snapshotInterruptedHistory) {
+    std::string filename = (std::filesystem::path{TempDir()} / UniqueNameIn(TempDir(), "tpp-snapshot-")).string();
+    {
+        TestTerminal t{Size{20, 4}};
+        t.setMaxHistoryRows(100);
+        for (int i = 0; i < 10; ++i)
+            t.input(STR("line " << i << "\r\n"));
+        TerminalSnapshot s{filename};
+        s.save(t);
+    }
+    // rows appended after the last save of the state file are ignored
+    {
+        std::ofstream f{filename + ".history", std::ios::out | std::ios::binary | std::ios::app};
+        f << "incomplete";
+    }
+    TestTerminal t{Size{20, 4}};
+    t.setMaxHistoryRows(100);
+    TerminalSnapshot s{filename};
+    EXPECT(s.restore(t));
+    EXPECT_EQ(t.historyRows(), 7);
+    EXPECT_EQ(t.historyRow(6), "line 6");
+    // and overwritten by the next save
+    t.input("line 10\r\n");
+    s.save(t);
+    TestTerminal t2{Size{20, 4}};
+    t2.setMaxHistoryRows(100);
+    EXPECT(TerminalSnapshot{filename}.restore(t2));
+    EXPECT_EQ(t2.historyRows(), 8);
+    EXPECT_EQ(t2.historyRow(7), "line 7");
+    std::filesystem::remove(filename);
+    std::filesystem::remove(filename + ".history");
+}
+
+TEST(ansi_terminal, snapshotInvalid) {
+    std::string filename = (std::filesystem::path{TempDir()} / UniqueNameIn(TempDir(), "tpp-snapshot-")).string();
+    {
+        TestTerminal t{Size{20, 4}};
+        t.setMaxHistoryRows(100);
+        for (int i = 0; i < 10; ++i)
+            t.input(STR("line " << i << "\r\n"));
+        TerminalSnapshot s{filename};
+        s.save(t);
+    }
+    std::string state = ReadEntireFile(filename);
+    std::string history = ReadEntireFile(filename + ".history");
+    // restores from the snapshot with a single word replaced, which must be refused as invalid
+    auto corrupted = [&](std::string const & file, size_t offset, uint32_t value) {
+        std::string data = file == filename ? state : history;
+        memcpy(& data[offset], & value, sizeof(uint32_t));
+        {
+            std::ofstream f{file, std::ios::out | std::ios::binary | std::ios::trunc};
+            f.write(data.c_str(), data.size());
+        }
+        TestTerminal t{Size{20, 4}};
+        t.setMaxHistoryRows(100);
+        TerminalSnapshot s{filename};
+        EXPECT_THROWS(IOError, s.restore(t));
+        std::ofstream f{file, std::ios::out | std::ios::binary | std::ios::trunc};
+        f << (file == filename ? state : history);
+    };
+    size_t palette = 4 + sizeof(uint32_t) + sizeof(uint64_t);
+    corrupted(filename, palette, 0xffffffff);
+    size_t attributes = palette + sizeof(uint32_t) + 258 * sizeof(Color) + 7;
+    uint32_t numAttributes;
+    memcpy(& numAttributes, state.c_str() + attributes, sizeof(uint32_t));
+    corrupted(filename, attributes, 0xffffffff);
+    size_t buffer = attributes + sizeof(uint32_t) + numAttributes * sizeof(CompactCell::Attributes::Record);
+    uint32_t size[2];
+    memcpy(size, state.c_str() + buffer, sizeof(size));
+    EXPECT(size[0] == 20 && size[1] == 4);
+    // buffer size, cursor position and scroll region
+    corrupted(filename, buffer + 4, 0x7fffffff);
+    corrupted(filename, buffer + 8, 21);
+    corrupted(filename, buffer + 12, 0xffffffff);
+    corrupted(filename, buffer + 20, 5);
+    // the attributes of the current cell, which follows the cursor
+    size_t cell = buffer + 24 + 2 + sizeof(char32_t) + 2 + sizeof(Color);
+    corrupted(filename, cell + 4, numAttributes);
+    // the number of cells and of the attribute runs of the first history row
+    size_t row = 8;
+    while (history.compare(row, 4, "\xff\xff\xff\xff") == 0)
+        row += 4 + sizeof(CompactCell::Attributes::Record);
+    corrupted(filename + ".history", row, 0x7fffffff);
+    corrupted(filename + ".history", row + 8, 0x7fffffff);
+    // and the unchanged snapshot is still valid
+    TestTerminal t{Size{20, 4}};
+    t.setMaxHistoryRows(100);
+    EXPECT(TerminalSnapshot{filename}.restore(t));
+    std::filesystem::remove(filename);
+    std::filesystem::remove(filename + ".history");
+}
+
+TEST(ansi_terminal, historySpill) {
+    std::string filename = (std::filesystem::path{TempDir()} / UniqueNameIn(TempDir(), "tpp-history-")).string();
+    {
+        TestTerminal t{Size{20, 4}};
+        t.setMaxHistoryRows(1000);
+        t.setHistorySpill(filename, 10);
+        for (int i = 0; i < 100; ++i)
+            t.input(STR("line " << i << "\r\n"));
+        EXPECT_EQ(t.historyRows(), 97);
+        EXPECT_EQ(t.metrics().historySpilledRows.value(), 87);
+        // the spilled rows are written a page at a time, or when read
+        EXPECT(! PathExists(filename));
+        // spilled rows are read back in pages, rows in memory are not affected
+        EXPECT_EQ(t.historyRow(0), "line 0");
+        EXPECT(PathExists(filename));
+#if (defined ARCH_UNIX)
+        // only the user can read the spilled rows
+        EXPECT((std::filesystem::status(filename).permissions() & std::filesystem::perms::all) == (std::filesystem::perms::owner_read | std::filesystem::perms::owner_write));
+#endif
+        EXPECT_EQ(t.historyRow(86), "line 86");
+        EXPECT_EQ(t.historyRow(87), "line 87");
+        EXPECT_EQ(t.historyRow(96), "line 96");
+        EXPECT_EQ(t.metrics().historyPageLoads.value(), 1);
+        EXPECT_EQ(t.historyRow(1), "line 1");
+        EXPECT_EQ(t.metrics().historyPageLoads.value(), 1);
+        // disabling the spill discards the spilled rows
+        t.setHistorySpill("", 0);
+        EXPECT_EQ(t.historyRows(), 10);
+        EXPECT_EQ(t.historyRow(0), "line 87");
+        EXPECT(! PathExists(filename));
+    }
+}
+
+TEST(ansi_terminal, historySpillTrimmed) {
+    std::string filename = (std::filesystem::path{TempDir()} / UniqueNameIn(TempDir(), "tpp-history-")).string();
+    {
+        TestTerminal t{Size{20, 4}};
+        t.setMaxHistoryRows(300);
+        t.setHistorySpill(filename, 10);
+        for (int i = 0; i < 2000; ++i) {
+            t.input(STR("line " << i << "\r\n"));
+            // the rows trimmed from the spill are eventually removed from the file as well
+            EXPECT(t.metrics().historySpillBytes.value() <= 2 * 290 * 40);
+        }
+        EXPECT_EQ(t.historyRows(), 300);
+        EXPECT_EQ(t.historyRow(0), "line 1697");
+        EXPECT_EQ(t.historyRow(289), "line 1986");
+        EXPECT_EQ(t.historyRow(299), "line 1996");
+        // which also works if the file is read in between
+        for (int i = 2000; i < 3000; ++i) {
+            t.input(STR("line " << i << "\r\n"));
+            EXPECT_EQ(t.historyRow(0), STR("line " << (i - 302)));
+        }
+    }
+    EXPECT(! PathExists(filename));
+}
+
+TEST(ansi_terminal, snapshotHistorySpill) {
+    std::string filename = (std::filesystem::path{TempDir()} / UniqueNameIn(TempDir(), "tpp-snapshot-")).string();
+    std::string spill = (std::filesystem::path{TempDir()} / UniqueNameIn(TempDir(), "tpp-history-")).string();
+    {
+        TestTerminal t{Size{20, 4}};
+        t.setMaxHistoryRows(100);
+        t.setHistorySpill(spill, 10);
+        for (int i = 0; i < 50; ++i)
+            t.input(STR("line " << i << "\r\n"));
+        TerminalSnapshot s{filename};
+        s.save(t);
+        for (int i = 50; i < 60; ++i)
+            t.input(STR("line " << i << "\r\n"));
+        s.save(t);
+    }
+    TestTerminal t{Size{20, 4}};
+    t.setMaxHistoryRows(100);
+    t.setHistorySpill(spill, 10);
+    EXPECT(TerminalSnapshot{filename}.restore(t));
+    EXPECT_EQ(t.historyRows(), 57);
+    EXPECT_EQ(t.metrics().historySpilledRows.value(), 47);
+    EXPECT_EQ(t.historyRow(0), "line 0");
+    EXPECT_EQ(t.historyRow(56), "line 56");
+    std::filesystem::remove(filename);
+    std::filesystem::remove(filename + ".history");
+}
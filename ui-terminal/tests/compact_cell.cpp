@@ -0,0 +1,49 @@
+#include "helpers/tests.h"
+
+#include "../compact_cell.h"
+
+using namespace ui;
+
+TEST(compact_cell, roundtrip) {
+    CompactCell::Attributes attributes;
+    Canvas::Cell cell;
+    cell.setCodepoint('x').setFg(Color::Red).setBg(Color::Blue).setDecor(Color::Green).setBorder(Border::All(Color::Yellow, Border::Kind::Thin));
+    cell.font().setBold().setUnderline();
+    CompactCell c = attributes.compact(cell);
+    EXPECT(c.codepoint() == U'x');
+    Canvas::Cell result = attributes.cell(c);
+    EXPECT(result.codepoint() == U'x');
+    EXPECT(result.fg() == Color::Red);
+    EXPECT(result.bg() == Color::Blue);
+    EXPECT(result.decor() == Color::Green);
+    EXPECT(result.font() == cell.font());
+    EXPECT(result.border() == cell.border());
+}
+
+TEST(compact_cell, attributesAreInterned) {
+    CompactCell::Attributes attributes;
+    Canvas::Cell cell;
+    cell.setFg(Color::Red);
+    attributes.compact(cell.setCodepoint('a'));
+    attributes.compact(cell.setCodepoint('b'));
+    EXPECT_EQ(attributes.size(), 1u);
+    attributes.compact(cell.setFg(Color::Green));
+    EXPECT_EQ(attributes.size(), 2u);
+}
+
+TEST(compact_cell, compaction) {
+    CompactCell::Attributes attributes;
+    Canvas::Cell cell;
+    cell.setCodepoint('a');
+    CompactCell * row = new CompactCell[2];
+    attributes.compact(cell.setFg(Color::Red));
+    row[0] = attributes.compact(cell.setFg(Color::Green));
+    row[1] = attributes.compact(cell.setFg(Color::Blue));
+    EXPECT_EQ(attributes.size(), 3u);
+    std::vector<std::pair<int, CompactCell *>> rows{std::make_pair(2, row)};
+    attributes.compact(rows.begin(), rows.end());
+    EXPECT_EQ(attributes.size(), 2u);
+    EXPECT(attributes.cell(row[0]).fg() == Color::Green);
+    EXPECT(attributes.cell(row[1]).fg() == Color::Blue);
+    delete [] row;
+}
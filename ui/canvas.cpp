@@ -60,21 +60,59 @@ namespace ui {
         // calculate the buffer offset for the input buffer
         Point bufferOffset = at + visibleArea_.offset();
         for (int row = r.top(), re = r.bottom(); row < re; ++row) {
-            for (int col = r.left(), ce = r.right(); col < ce; ++col) {
-                buffer_->at(col, row) = buffer.at(col - bufferOffset.x(), row - bufferOffset.y());
-            }
+            int sourceRow = row - bufferOffset.y();
+            bool special = buffer.rowTags_[sourceRow].special;
+            buffer_->touchRow(row);
+            Buffer::RowTag & tag = buffer_->rowTags_[row];
+            Buffer::CopyCells(buffer_->rows_[row] + r.left(), buffer.rows_[sourceRow] - bufferOffset.x() + r.left(), r.width(), special || tag.special);
+            tag.special = tag.special || special;
         }
         return *this;
     }
 
+    /** Rows whose tag says they are an unmodified copy of the same source row contents, columns and offset are skipped. Rows that contain special objects are never tagged as their fallback cells may change even if the row itself does not. Rows without special objects in either buffer are copied as plain memory.
+     */
     Canvas & Canvas::drawFallbackBuffer(Buffer const & buffer, Point at) {
         // calculate the target rectangle in the canvas and its intersection with the visible rectangle and offset it to the backing buffer coordinates
         Rect r = (Rect{at, buffer.size()} & visibleArea_.rect()) + visibleArea_.offset();
         // calculate the buffer offset for the input buffer
         Point bufferOffset = at + visibleArea_.offset();
+        bool wholeRow = r.left() == 0 && r.right() == buffer_->width();
         for (int row = r.top(), re = r.bottom(); row < re; ++row) {
-            for (int col = r.left(), ce = r.right(); col < ce; ++col) {
-                buffer_->at(col, row).stripSpecialObjectAndAssign(buffer.at(col - bufferOffset.x(), row - bufferOffset.y()));
+            int sourceRow = row - bufferOffset.y();
+            uint64_t source = buffer.rowTag(sourceRow);
+            Buffer::RowTag & tag = buffer_->rowTags_[row];
+            if (tag.source == source && tag.left == r.left() && tag.right == r.right() && tag.offset == bufferOffset.x())
+                continue;
+            Cell * to = buffer_->rows_[row];
+            Cell const * from = buffer.rows_[sourceRow] - bufferOffset.x();
+            bool special = buffer.rowTags_[sourceRow].special;
+            if (special || tag.special) {
+                for (int col = r.left(), ce = r.right(); col < ce; ++col)
+                    to[col].stripSpecialObjectAndAssign(from[col]);
+            } else {
+                Buffer::CopyCells(to + r.left(), from + r.left(), r.width(), false);
+            }
+            // the copied cells have their special objects stripped
+            bool targetSpecial = tag.special && ! wholeRow;
+            tag = special ? Buffer::RowTag{0, 0, 0, 0, 0, targetSpecial} : Buffer::RowTag{0, source, r.left(), r.right(), bufferOffset.x(), targetSpecial};
+        }
+        return *this;
+    }
+
+    Canvas & Canvas::drawFallbackBuffer(Buffer const & buffer, Point at, Rect const & rect) {
+        Rect r = (Rect{at, buffer.size()} & rect & visibleArea_.rect()) + visibleArea_.offset();
+        Point bufferOffset = at + visibleArea_.offset();
+        // the cells are copied directly so that the row tags are left intact
+        for (int row = r.top(), re = r.bottom(); row < re; ++row) {
+            int sourceRow = row - bufferOffset.y();
+            Cell * to = buffer_->rows_[row];
+            Cell const * from = buffer.rows_[sourceRow] - bufferOffset.x();
+            if (buffer.rowTags_[sourceRow].special || buffer_->rowTags_[row].special) {
+                for (int col = r.left(), ce = r.right(); col < ce; ++col)
+                    to[col].stripSpecialObjectAndAssign(from[col]);
+            } else {
+                Buffer::CopyCells(to + r.left(), from + r.left(), r.width(), false);
             }
         }
         return *this;
@@ -108,19 +146,19 @@ namespace ui {
 
     Canvas & Canvas::fill(Rect const & rect, Cell const & fill) {
         Rect r = (rect & visibleArea_.rect()) + visibleArea_.offset();
-        for (int y = r.top(), ye = r.bottom(); y < ye; ++y) {
-            for (int x = r.left(), xe = r.right(); x < xe; ++x) {
-                buffer_->at(x,y) = fill;
-            }
-        }
+        for (int y = r.top(), ye = r.bottom(); y < ye; ++y)
+            buffer_->fillRow(y, fill, r.left(), r.width());
         return *this;
-
     }
 
     Canvas & Canvas::textOut(Point x, Char::iterator_utf8 begin, Char::iterator_utf8 end) {
         Rect vr = visibleArea_.rect() + visibleArea_.offset();
         x = x + visibleArea_.offset();
         for (; begin != end; ++begin) {
+            int width = Char::ColumnWidth(*begin);
+            // zero width characters belong to the preceding character and since a cell holds a single codepoint, they are not displayed
+            if (width == 0)
+                continue;
             if (vr.contains(x)) {
                 Cell & c = buffer_->at(x);
                 c.detachSpecialObject();
@@ -130,7 +168,7 @@ namespace ui {
                 c.setFont(font_);
                 c.setCodepoint(begin->codepoint());
             }
-            x.setX(x.x() + Char::ColumnWidth(*begin) * font_.width());
+            x.setX(x.x() + width * font_.width());
         }
         return *this;
     }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <atomic>
+
 #include "font.h"
 #include "color.h"
 #include "border.h"
@@ -9,6 +11,7 @@ namespace ui {
 
     class Widget;
     class Renderer;
+    class CompactCell;
 
     class Canvas {
         friend class Widget;
@@ -127,6 +130,12 @@ namespace ui {
          */
         Canvas & drawFallbackBuffer(Buffer const & buffer, Point at);
 
+        /** Draws only the given rectangle (in canvas coordinates) of the fallback buffer placed at given top left corner. 
+
+            Used to restore the cells covered by overlays painted over a previously drawn buffer. Unlike the full drawFallbackBuffer(), always copies the cells.
+         */
+        Canvas & drawFallbackBuffer(Buffer const & buffer, Point at, Rect const & rect);
+
         Canvas & fill(Rect const & rect) {
             return fill(rect, bg_);
         }
@@ -154,6 +163,14 @@ namespace ui {
         Canvas & verticalScrollbar(int size, int offset);
         Canvas & horizontalScrollbar(int size, int offset);
 
+        /** Starts painting overlays. 
+
+            Overlays are painted over rows drawn by drawFallbackBuffer() and the widget promises to restore the cells they cover before the next drawFallbackBuffer() call so that the rows can still be considered identical to their source and their copy skipped. 
+         */
+        void beginOverlay();
+
+        void endOverlay();
+
         //@}
 
         /** \name Single cell access. 
@@ -463,6 +480,7 @@ namespace ui {
     class Canvas::Cell {
         friend class Canvas::Buffer;
         friend class Canvas::SpecialObject;
+        friend class ui::CompactCell;
     public:
 
         /** Default constructor.
@@ -551,6 +569,9 @@ namespace ui {
             bool hadSo = hasSpecialObject();
             // casting to void * so that compiler won't give warnings that non POD object is copied, since we deal with the special object later
             memcpy(static_cast<void*>(this), static_cast<void const *>(& from), sizeof(Cell));
+            // the most common case, neither cell is special so there is no need to lock the special objects
+            if (! hadSo && ! from.hasSpecialObject())
+                return *this;
             {
                 std::lock_guard<std::mutex> g{SpecialObject::MObjects_};
                 if (hadSo) {
@@ -735,7 +756,12 @@ namespace ui {
 
     }; // ui::Canvas::Cell
 
+    /** Canvas buffer. 
+
+        Apart from the cells, each row of the buffer is tagged so that rows can be copied between buffers only when they change. A row's id identifies the current contents of the row and is reset by any non-const access to the row. When a row is copied by Canvas::drawFallbackBuffer(), the target row remembers the id of its source so that the next copy of the same row can be skipped. 
+     */
     class Canvas::Buffer {
+        friend class Canvas;
     public:
 
         explicit Buffer(Size const & size):
@@ -745,17 +771,21 @@ namespace ui {
 
         Buffer(Buffer && from) noexcept:
             size_{from.size_},
-            rows_{from.rows_} {
+            rows_{from.rows_},
+            rowTags_{from.rowTags_} {
             from.size_ = Size{0,0};
             from.rows_ = nullptr;
+            from.rowTags_ = nullptr;
         }
 
         Buffer & operator = (Buffer && from) noexcept {
             clear();
             size_ = from.size_;
             rows_ = from.rows_;
+            rowTags_ = from.rowTags_;
             from.size_ = Size{0,0};
             from.rows_ = nullptr;
+            from.rowTags_ = nullptr;
             return *this;
         }          
 
@@ -804,9 +834,20 @@ namespace ui {
             Cell & result = cellAt(p);
             // clear the unused bits because of non-const access
             SetUnusedBits(result, 0);
+            touchRow(p.y());
             return result;
         }
 
+        /** Returns the tag identifying the current contents of given row. 
+         */
+        uint64_t rowTag(int row) const {
+            ASSERT(row >= 0 && row < size_.height());
+            RowTag & tag = rowTags_[row];
+            if (tag.id == 0)
+                tag.id = NextRowTag();
+            return tag.id;
+        }
+
         /** Returns the cursor properties. 
          */
         Cursor const & cursor() const {
@@ -833,25 +874,120 @@ namespace ui {
                 SetUnusedBits(at(cursorPosition_), CURSOR_POSITION);
         }
 
+        /** Assigns the cell at given coordinates, keeping track of the special objects in the row. 
+         */
+        Cell & set(Point p, Cell const & cell) {
+            Cell & result = at(p);
+            result = cell;
+            if (cell.hasSpecialObject())
+                rowTags_[p.y()].special = true;
+            return result;
+        }
+
+        /** Attaches the special object to the cell at given coordinates. 
+
+            Special objects must be attached to the buffer cells via this method, or set(), so that the buffer knows which rows contain special objects. 
+         */
+        Cell & attachSpecialObject(Point p, SpecialObject * so) {
+            Cell & result = at(p);
+            result.attachSpecialObject(so);
+            rowTags_[p.y()].special = true;
+            return result;
+        }
+
+        /** Returns true if the given row may contain cells with special objects. 
+         */
+        bool hasSpecialObjects(int row) const {
+            ASSERT(row >= 0 && row < size_.height());
+            return rowTags_[row].special;
+        }
+
         /** Fills portion of given row with the specified cell. 
          
-            Exponentially increases the size of copied cells for performance.
+            If neither the fill, nor the row have special objects, the cells are copied as plain memory, exponentially increasing the size of the copied block.
          */
         void fillRow(int row, Cell const & fill, int from, int cols) {
+            ASSERT(row >= 0 && row < size_.height() && from >= 0 && from + cols <= size_.width());
+            touchRow(row);
+            Cell * r = rows_[row] + from;
+            if (cols <= 0)
+                return;
+            RowTag & tag = rowTags_[row];
+            if (fill.hasSpecialObject() || tag.special) {
+                for (int i = 0; i < cols; ++i)
+                    r[i] = fill;
+                // filling the whole row either removes, or attaches the special objects everywhere
+                if (fill.hasSpecialObject())
+                    tag.special = true;
+                else if (from == 0 && cols == size_.width())
+                    tag.special = false;
+                return;
+            }
+            ASSERT(! HasSpecialObjects(r, cols));
+            memcpy(static_cast<void*>(r), static_cast<void const *>(& fill), sizeof(Cell));
+            for (int i = 1; i < cols; ) {
+                int n = std::min(i, cols - i);
+                memcpy(static_cast<void*>(r + i), static_cast<void const *>(r), sizeof(Cell) * n);
+                i += n;
+            }
+        }
+
+        /** Moves given number of cells within the row, from one column to another. 
+
+            The source and target spans may overlap. The cells left behind by the move keep their contents. If the row has no special objects, the cells are moved as plain memory. 
+         */
+        void moveInRow(int row, int from, int to, int cols) {
+            ASSERT(row >= 0 && row < size_.height() && from >= 0 && to >= 0 && from + cols <= size_.width() && to + cols <= size_.width());
+            if (cols <= 0 || from == to)
+                return;
+            touchRow(row);
             Cell * r = rows_[row];
-            for (int e = from + cols; from < e; ++from)
-                r[from] = fill;
-            /*
-            r[from] = fill;
-            int i = 1;
-            int next = 2;
-            while (next < cols) {
-                memcpy(r + from + i, r + from, sizeof(Cell) * i);
-                i = next;
-                next *= 2;
+            if (! rowTags_[row].special) {
+                ASSERT(! HasSpecialObjects(r, size_.width()));
+                memmove(static_cast<void*>(r + to), static_cast<void const *>(r + from), sizeof(Cell) * cols);
+            } else if (from > to) {
+                for (int i = 0; i < cols; ++i)
+                    r[to + i] = r[from + i];
+            } else {
+                for (int i = cols - 1; i >= 0; --i)
+                    r[to + i] = r[from + i];
             }
-            memcpy(r + from + i, r + from, sizeof(Cell) * (cols - i));
-            */
+        }
+
+        /** Copies the cells to an array of cells, such as a row of the buffer, or its copy. 
+
+            Unless the special flag says that either of the arrays may contain special objects, the cells are copied as plain memory. 
+         */
+        static void CopyCells(Cell * to, Cell const * from, int cols, bool special) {
+            if (cols <= 0)
+                return;
+            if (special) {
+                for (int i = 0; i < cols; ++i)
+                    to[i] = from[i];
+            } else {
+                ASSERT(! HasSpecialObjects(from, cols) && ! HasSpecialObjects(to, cols));
+                memcpy(static_cast<void*>(to), static_cast<void const *>(from), sizeof(Cell) * cols);
+            }
+        }
+
+        /** Copies the contents and the cursor of the other buffer, resizing itself if necessary.
+
+            Unlike Canvas::drawFallbackBuffer(), the special objects are preserved so that their fallback cells are determined only when the copy itself is drawn. Rows that are already an unmodified copy of the source row are skipped and the copied rows keep the id of their source so that canvases that have drawn the source buffer can skip them too.
+         */
+        void copyFrom(Buffer const & from) {
+            resize(from.size_);
+            int width = size_.width();
+            for (int row = 0, re = size_.height(); row < re; ++row) {
+                uint64_t source = from.rowTag(row);
+                RowTag & tag = rowTags_[row];
+                if (tag.source == source && tag.left == 0 && tag.right == width && tag.offset == 0)
+                    continue;
+                bool special = from.rowTags_[row].special;
+                CopyCells(rows_[row], from.rows_[row], width, special || tag.special);
+                tag = RowTag{source, source, 0, width, 0, special};
+            }
+            cursor_ = from.cursor_;
+            cursorPosition_ = from.cursorPosition_;
         }
 
     protected:
@@ -888,12 +1024,53 @@ namespace ui {
          */
         static char32_t constexpr CURSOR_POSITION = 0x200000;
 
+        /** Row tag. 
+
+            The id identifies the row contents, 0 meaning not yet assigned. The source is the id of the row the contents was copied from, together with the copied columns and the column offset of the copy, or 0 if the row is not an unmodified copy. The special flag is set when any cell of the row may have a special object attached and is only cleared when the whole row is overwritten. 
+         */
+        struct RowTag {
+            uint64_t id = 0;
+            uint64_t source = 0;
+            int left = 0;
+            int right = 0;
+            int offset = 0;
+            bool special = false;
+        };
+
+        /** Marks the row as changed. 
+
+            Unless we are painting an overlay, which will be restored, the row is no longer a copy of its source either. 
+         */
+        void touchRow(int row) {
+            RowTag & tag = rowTags_[row];
+            tag.id = 0;
+            if (! overlay_)
+                tag.source = 0;
+        }
+
+        /** Returns true if any of the given cells has a special object attached to it. 
+
+            Only used to verify the row flags in debug builds. 
+         */
+        static bool HasSpecialObjects(Cell const * cells, int cols) {
+            for (int i = 0; i < cols; ++i)
+                if (cells[i].hasSpecialObject())
+                    return true;
+            return false;
+        }
+
+        static uint64_t NextRowTag() {
+            static std::atomic<uint64_t> id{0};
+            return ++id;
+        }
+
     protected:
 
         void create(Size const & size) {
             rows_ = new Cell*[size.height()];
             for (int i = 0; i < size.height(); ++i)
                 rows_[i] = new Cell[size.width()];
+            rowTags_ = new RowTag[size.height()];
             size_ = size;
         }
 
@@ -904,11 +1081,17 @@ namespace ui {
                     delete [] rows_[i];
                 delete [] rows_;
             }
+            // the row tags are never backed up
+            delete [] rowTags_;
+            rowTags_ = nullptr;
             size_ = Size{0,0};
         }
 
         Size size_;
         Cell ** rows_;
+        RowTag * rowTags_ = nullptr;
+        /** True when overlays are being painted, see Canvas::beginOverlay(). */
+        bool overlay_ = false;
 
         Cursor cursor_;
         Point cursorPosition_;
@@ -939,4 +1122,12 @@ namespace ui {
         return buffer_->at(coords + visibleArea_.offset());
     }
 
+    inline void Canvas::beginOverlay() {
+        buffer_->overlay_ = true;
+    }
+
+    inline void Canvas::endOverlay() {
+        buffer_->overlay_ = false;
+    }
+
 } // namespace ui
\ No newline at end of file
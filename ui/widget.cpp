@@ -321,7 +321,7 @@ namespace ui {
     void Widget::requestRepaint() {
         UI_THREAD_ONLY;
 
-        if (parent_ == nullptr || background_.opaque()) {
+        if (parent_ == nullptr || background_.opaque() || opaqueContents()) {
             // propagate the paint event through parents so that they can decide to actually repaint themselves instead, if the repaint is allowed, instruct the renderer to repaint
             if (parent_ == nullptr || parent_->allowRepaintRequest(this)) {
                 if (renderer() != nullptr)
@@ -340,9 +340,10 @@ namespace ui {
             return;
         pendingRepaint_ = false;
         Canvas canvas{renderer_->buffer_, visibleArea_, size()};
-        // paint the background first
+        // paint the background first, unless the widget paints all of its cells itself
         canvas.setBg(background_);
-        canvas.fill(canvas.rect());
+        if (! opaqueContents())
+            canvas.fill(canvas.rect());
         // now paint whatever the widget contents is
         paint(canvas);
         // paint the border now that the widget has been painted
@@ -479,6 +479,14 @@ namespace ui {
          */
         virtual void requestRepaint();
 
+        /** Returns true if the paint(Canvas &) method overwrites all cells of the widget. 
+
+            Such widget does not need its background to be filled before it paints itself, nor does it need its parent to repaint first when its background is transparent. 
+         */
+        virtual bool opaqueContents() const {
+            return false;
+        }
+
         /** Paints given child. 
          
             This method is necessary because subclasses can't simply call paint() on the children because of C++ protection rules. 
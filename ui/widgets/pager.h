@@ -5,7 +5,9 @@
 
 namespace ui {
 
-    /**
+    /** Displays one of its children, the pages, at a time. 
+
+        All pages but the active one are hidden so that they can avoid the work needed only for painting. 
      */
     class Pager : public Widget {
     public: